@@ -0,0 +1,42 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "common/CodeBuffer.h"
+
+#include <assert.h>
+#include <malloc.h>
+#include <ogc/cache.h>
+#include <stdlib.h>
+
+CodeBuffer::CodeBuffer(size_t max_instructions) : m_capacity(max_instructions), m_size(0)
+{
+  // Cache line aligned, so that flushing the code never touches unrelated data
+  m_code = (u32*)memalign(32, (max_instructions * sizeof(u32) + 31) & ~31);
+}
+
+CodeBuffer::~CodeBuffer()
+{
+  free(m_code);
+}
+
+size_t CodeBuffer::Emit(u32 instruction)
+{
+  assert(m_size < m_capacity);
+  m_code[m_size] = instruction;
+  return m_size++;
+}
+
+void CodeBuffer::Patch(size_t index, u32 instruction)
+{
+  assert(index < m_size);
+  m_code[index] = instruction;
+  DCFlushRange(&m_code[index], sizeof(u32));
+  ICInvalidateRange(&m_code[index], sizeof(u32));
+}
+
+void CodeBuffer::Finalize()
+{
+  DCFlushRange(m_code, m_size * sizeof(u32));
+  ICInvalidateRange(m_code, m_size * sizeof(u32));
+}
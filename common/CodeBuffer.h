@@ -0,0 +1,44 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/CommonTypes.h"
+
+// Buffer for instructions generated at runtime (see common/PPCEncoder.h).
+// Code is emitted one instruction at a time and becomes callable after Finalize(), which
+// writes it back to memory and invalidates the instruction cache.
+// Generated functions follow the regular calling convention and must end in blr.
+class CodeBuffer
+{
+public:
+  explicit CodeBuffer(size_t max_instructions);
+  ~CodeBuffer();
+
+  CodeBuffer(const CodeBuffer&) = delete;
+  CodeBuffer& operator=(const CodeBuffer&) = delete;
+
+  void Clear() { m_size = 0; }
+
+  // Returns the index of the emitted instruction, which can be passed to Patch().
+  size_t Emit(u32 instruction);
+
+  // Replaces a single instruction of finalized code and makes the change visible to the CPU.
+  void Patch(size_t index, u32 instruction);
+
+  void Finalize();
+
+  size_t Size() const { return m_size; }
+
+  template <typename Function>
+  Function GetFunction() const
+  {
+    return reinterpret_cast<Function>(m_code);
+  }
+
+private:
+  u32* m_code;
+  size_t m_capacity;
+  size_t m_size;
+};
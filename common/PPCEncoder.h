@@ -0,0 +1,244 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+// Encoders for the PowerPC instructions used by runtime-generated test code.
+// Register and field arguments are plain numbers (e.g. 3 for r3, 1 for cr1).
+// This header has no hardware dependencies, so it can be used on any host.
+
+#pragma once
+
+#include "common/CommonTypes.h"
+
+namespace PPC
+{
+// Generic instruction forms
+
+constexpr u32 DForm(u32 opcode, u32 rd, u32 ra, s32 imm)
+{
+  return (opcode << 26) | (rd << 21) | (ra << 16) | (static_cast<u32>(imm) & 0xFFFF);
+}
+
+constexpr u32 XForm(u32 opcode, u32 rd, u32 ra, u32 rb, u32 xo, bool rc = false)
+{
+  return (opcode << 26) | (rd << 21) | (ra << 16) | (rb << 11) | (xo << 1) | (rc ? 1 : 0);
+}
+
+constexpr u32 XLForm(u32 opcode, u32 bt, u32 ba, u32 bb, u32 xo)
+{
+  return XForm(opcode, bt, ba, bb, xo);
+}
+
+constexpr u32 XOForm(u32 opcode, u32 rd, u32 ra, u32 rb, u32 xo, bool oe = false, bool rc = false)
+{
+  return (opcode << 26) | (rd << 21) | (ra << 16) | (rb << 11) | (oe ? 0x400 : 0) | (xo << 1) |
+         (rc ? 1 : 0);
+}
+
+constexpr u32 AForm(u32 opcode, u32 frd, u32 fra, u32 frb, u32 frc, u32 xo, bool rc = false)
+{
+  return (opcode << 26) | (frd << 21) | (fra << 16) | (frb << 11) | (frc << 6) | (xo << 1) |
+         (rc ? 1 : 0);
+}
+
+constexpr u32 MForm(u32 opcode, u32 rs, u32 ra, u32 sh, u32 mb, u32 me, bool rc = false)
+{
+  return (opcode << 26) | (rs << 21) | (ra << 16) | (sh << 11) | (mb << 6) | (me << 1) |
+         (rc ? 1 : 0);
+}
+
+// Integer arithmetic
+
+constexpr u32 ADDI(u32 rd, u32 ra, s32 imm)
+{
+  return DForm(14, rd, ra, imm);
+}
+
+constexpr u32 LI(u32 rd, s32 imm)
+{
+  return ADDI(rd, 0, imm);
+}
+
+constexpr u32 ADD(u32 rd, u32 ra, u32 rb)
+{
+  return XOForm(31, rd, ra, rb, 266);
+}
+
+constexpr u32 MULLW(u32 rd, u32 ra, u32 rb)
+{
+  return XOForm(31, rd, ra, rb, 235);
+}
+
+constexpr u32 DIVW(u32 rd, u32 ra, u32 rb)
+{
+  return XOForm(31, rd, ra, rb, 491);
+}
+
+constexpr u32 RLWINM(u32 ra, u32 rs, u32 sh, u32 mb, u32 me)
+{
+  return MForm(21, rs, ra, sh, mb, me);
+}
+
+// Floating point arithmetic. Note that the C operand comes after B in the encoding.
+
+constexpr u32 FADD(u32 frd, u32 fra, u32 frb)
+{
+  return AForm(63, frd, fra, frb, 0, 21);
+}
+
+constexpr u32 FMUL(u32 frd, u32 fra, u32 frc)
+{
+  return AForm(63, frd, fra, 0, frc, 25);
+}
+
+constexpr u32 FMADD(u32 frd, u32 fra, u32 frc, u32 frb)
+{
+  return AForm(63, frd, fra, frb, frc, 29);
+}
+
+constexpr u32 FDIV(u32 frd, u32 fra, u32 frb)
+{
+  return AForm(63, frd, fra, frb, 0, 18);
+}
+
+// Paired singles
+
+constexpr u32 PS_ADD(u32 frd, u32 fra, u32 frb)
+{
+  return AForm(4, frd, fra, frb, 0, 21);
+}
+
+constexpr u32 PS_MUL(u32 frd, u32 fra, u32 frc)
+{
+  return AForm(4, frd, fra, 0, frc, 25);
+}
+
+constexpr u32 PS_MADD(u32 frd, u32 fra, u32 frc, u32 frb)
+{
+  return AForm(4, frd, fra, frb, frc, 29);
+}
+
+// Condition register instructions
+
+constexpr u32 CRAND(u32 crbd, u32 crba, u32 crbb)
+{
+  return XLForm(19, crbd, crba, crbb, 257);
+}
+constexpr u32 CRANDC(u32 crbd, u32 crba, u32 crbb)
+{
+  return XLForm(19, crbd, crba, crbb, 129);
+}
+constexpr u32 CREQV(u32 crbd, u32 crba, u32 crbb)
+{
+  return XLForm(19, crbd, crba, crbb, 289);
+}
+constexpr u32 CRNAND(u32 crbd, u32 crba, u32 crbb)
+{
+  return XLForm(19, crbd, crba, crbb, 225);
+}
+constexpr u32 CRNOR(u32 crbd, u32 crba, u32 crbb)
+{
+  return XLForm(19, crbd, crba, crbb, 33);
+}
+constexpr u32 CROR(u32 crbd, u32 crba, u32 crbb)
+{
+  return XLForm(19, crbd, crba, crbb, 449);
+}
+constexpr u32 CRORC(u32 crbd, u32 crba, u32 crbb)
+{
+  return XLForm(19, crbd, crba, crbb, 417);
+}
+constexpr u32 CRXOR(u32 crbd, u32 crba, u32 crbb)
+{
+  return XLForm(19, crbd, crba, crbb, 193);
+}
+
+constexpr u32 MCRF(u32 crfd, u32 crfs)
+{
+  return XLForm(19, crfd << 2, crfs << 2, 0, 0);
+}
+
+constexpr u32 MCRXR(u32 crfd)
+{
+  return XForm(31, crfd << 2, 0, 0, 512);
+}
+
+constexpr u32 MFCR(u32 rd)
+{
+  return XForm(31, rd, 0, 0, 19);
+}
+
+constexpr u32 MTCRF(u32 crm, u32 rs)
+{
+  return (31 << 26) | (rs << 21) | ((crm & 0xFF) << 12) | (144 << 1);
+}
+
+// Special purpose registers. The two halves of the SPR number are swapped in the encoding.
+
+constexpr u32 MFSPR(u32 rd, u32 spr)
+{
+  return XForm(31, rd, spr & 0x1F, spr >> 5, 339);
+}
+
+constexpr u32 MTSPR(u32 spr, u32 rs)
+{
+  return XForm(31, rs, spr & 0x1F, spr >> 5, 467);
+}
+
+constexpr u32 MFXER(u32 rd)
+{
+  return MFSPR(rd, 1);
+}
+
+constexpr u32 MTXER(u32 rs)
+{
+  return MTSPR(1, rs);
+}
+
+constexpr u32 MTCTR(u32 rs)
+{
+  return MTSPR(9, rs);
+}
+
+// Loads and stores
+
+constexpr u32 LWZ(u32 rd, s32 offset, u32 ra)
+{
+  return DForm(32, rd, ra, offset);
+}
+
+constexpr u32 STW(u32 rs, s32 offset, u32 ra)
+{
+  return DForm(36, rs, ra, offset);
+}
+
+constexpr u32 LFS(u32 frd, s32 offset, u32 ra)
+{
+  return DForm(48, frd, ra, offset);
+}
+
+constexpr u32 LFD(u32 frd, s32 offset, u32 ra)
+{
+  return DForm(50, frd, ra, offset);
+}
+
+// The offset is 12 bits; gqr selects the quantization register
+constexpr u32 PSQ_L(u32 frd, s32 offset, u32 ra, bool w, u32 gqr)
+{
+  return (56 << 26) | (frd << 21) | (ra << 16) | (w ? 0x8000 : 0) | (gqr << 12) |
+         (static_cast<u32>(offset) & 0xFFF);
+}
+
+// Branches
+
+constexpr u32 BLR()
+{
+  return 0x4E800020;
+}
+
+// Decrement CTR and branch if it is nonzero; offset is in bytes relative to this instruction
+constexpr u32 BDNZ(s32 offset)
+{
+  return (16 << 26) | (16 << 21) | (static_cast<u32>(offset) & 0xFFFC);
+}
+}  // namespace PPC
@@ -3,3 +3,7 @@
 #include "common/CommonTypes.h"
 
 extern "C" u64 GetTimebase();
+
+// The timebase is incremented every 4 bus clocks, and the CPU runs at 3 times the bus clock
+// (on both GameCube and Wii), so one tick corresponds to 12 CPU cycles.
+constexpr u32 CPU_CYCLES_PER_TIMEBASE_TICK = 12;
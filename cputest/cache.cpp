@@ -0,0 +1,352 @@
+#include <gctypes.h>
+#include <malloc.h>
+#include <ogc/cache.h>
+#include <ogc/machine/processor.h>
+#include <ogc/system.h>
+#include <stdlib.h>
+#include <wiiuse/wpad.h>
+#include "common/PPCEncoder.h"
+#include "common/hwtests.h"
+#include "common/timebase.h"
+
+// Throughput and semantics of the cache management instructions and of the locked cache DMA
+// engine. Each measurement is printed as
+//   cache <operation> <initial state> size=<bytes> ticks=<timebase ticks> cycles/line=<cycles>
+// where the initial state describes the cache lines covering the buffer before the operation.
+
+static const u32 CACHE_LINE_SIZE = 32;
+static const u32 BUFFER_SIZES[] = {1024, 4096, 16384, 65536, 262144};
+static const u32 MAX_BUFFER_SIZE = 262144;
+
+// Size of the locked cache (half of the L1 data cache), mapped at 0xE0000000 by LCEnable
+static const u32 LOCKED_CACHE_SIZE = 16384;
+static u8* const LOCKED_CACHE = (u8*)0xE0000000;
+
+// Number of times each measurement is repeated. The fastest run is reported.
+static const int REPETITIONS = 4;
+
+enum class LineState
+{
+  Uncached,  // Not present in the data cache
+  Clean,     // Present in the data cache and identical to memory
+  Dirty,     // Present in the data cache and modified
+};
+
+static const char* GetLineStateName(LineState state)
+{
+  switch (state)
+  {
+  case LineState::Uncached:
+    return "uncached";
+  case LineState::Clean:
+    return "clean";
+  case LineState::Dirty:
+    return "dirty";
+  }
+  return "?";
+}
+
+static u32 GetPatternWord(u32 seed, u32 index)
+{
+  return seed ^ (index * 0x9E3779B9);
+}
+
+static void FillPattern(u8* buffer, u32 size, u32 seed)
+{
+  u32* words = (u32*)buffer;
+  for (u32 i = 0; i < size / 4; ++i)
+    words[i] = GetPatternWord(seed, i);
+}
+
+// Returns the index of the first word not matching the pattern, or size / 4 if all match
+static u32 FindPatternMismatch(const u8* buffer, u32 size, u32 seed)
+{
+  const u32* words = (const u32*)buffer;
+  for (u32 i = 0; i < size / 4; ++i)
+    if (words[i] != GetPatternWord(seed, i))
+      return i;
+  return size / 4;
+}
+
+// Uncached view of a buffer, which always reflects the contents of main memory
+static u8* Uncached(u8* buffer)
+{
+  return (u8*)MEM_K0_TO_K1(buffer);
+}
+
+// Writes the pattern to main memory and leaves the buffer in the requested state
+static void PrepareBuffer(u8* buffer, u32 size, u32 seed, LineState state)
+{
+  DCFlushRange(buffer, size);
+  DCInvalidateRange(buffer, size);
+
+  switch (state)
+  {
+  case LineState::Uncached:
+    FillPattern(Uncached(buffer), size, seed);
+    break;
+  case LineState::Clean:
+    FillPattern(buffer, size, seed);
+    DCStoreRange(buffer, size);
+    break;
+  case LineState::Dirty:
+    // Main memory holds the inverted pattern, which must not be observed after a write back
+    FillPattern(Uncached(buffer), size, ~seed);
+    FillPattern(buffer, size, seed);
+    break;
+  }
+}
+
+#define DEFINE_CACHE_OPERATION(name, insn, post)                                                   \
+  static void name(u8* buffer, u32 size)                                                           \
+  {                                                                                                \
+    for (u32 offset = 0; offset < size; offset += CACHE_LINE_SIZE)                                 \
+      asm volatile(insn " 0,%0" : : "b"(buffer + offset) : "memory");                              \
+    asm volatile(post : : : "memory");                                                             \
+  }
+
+DEFINE_CACHE_OPERATION(RunDcbz, "dcbz", "sync")
+DEFINE_CACHE_OPERATION(RunDcbst, "dcbst", "sync")
+DEFINE_CACHE_OPERATION(RunDcbf, "dcbf", "sync")
+DEFINE_CACHE_OPERATION(RunDcbi, "dcbi", "sync")
+DEFINE_CACHE_OPERATION(RunIcbi, "icbi", "sync ; isync")
+
+// Runs the operation on a freshly prepared buffer and returns the elapsed timebase ticks
+static u32 MeasureOperation(void (*operation)(u8*, u32), u8* buffer, u32 size, u32 seed,
+                            LineState state)
+{
+  PrepareBuffer(buffer, size, seed, state);
+
+  u32 level;
+  _CPU_ISR_Disable(level);
+  const u64 start = GetTimebase();
+  operation(buffer, size);
+  const u64 end = GetTimebase();
+  _CPU_ISR_Restore(level);
+
+  return (u32)(end - start);
+}
+
+static void ReportMeasurement(const char* name, LineState state, u32 size, u32 ticks)
+{
+  const u32 lines = size / CACHE_LINE_SIZE;
+  const u32 tenth_cycles_per_line = (u32)((u64)ticks * CPU_CYCLES_PER_TIMEBASE_TICK * 10 / lines);
+  network_printf("cache %-8s %-8s size=%6u ticks=%7u cycles/line=%u.%u\n", name,
+                 GetLineStateName(state), size, ticks, tenth_cycles_per_line / 10,
+                 tenth_cycles_per_line % 10);
+}
+
+static const struct
+{
+  const char* name;
+  void (*operation)(u8*, u32);
+  LineState state;
+} cache_operations[] = {
+    {"dcbz", RunDcbz, LineState::Uncached}, {"dcbz", RunDcbz, LineState::Dirty},
+    {"dcbst", RunDcbst, LineState::Clean},  {"dcbst", RunDcbst, LineState::Dirty},
+    {"dcbf", RunDcbf, LineState::Uncached}, {"dcbf", RunDcbf, LineState::Clean},
+    {"dcbf", RunDcbf, LineState::Dirty},    {"dcbi", RunDcbi, LineState::Clean},
+    {"dcbi", RunDcbi, LineState::Dirty},    {"icbi", RunIcbi, LineState::Clean},
+};
+
+static void DataCacheTest(u8* buffer)
+{
+  START_TEST();
+
+  for (const auto& op : cache_operations)
+  {
+    for (u32 size : BUFFER_SIZES)
+    {
+      const u32 seed = 0x12345678 ^ size;
+      u32 best = 0xFFFFFFFF;
+      for (int i = 0; i < REPETITIONS; ++i)
+      {
+        const u32 ticks = MeasureOperation(op.operation, buffer, size, seed, op.state);
+        if (ticks < best)
+          best = ticks;
+      }
+      ReportMeasurement(op.name, op.state, size, best);
+
+      // The last repetition left the buffer as the operation produced it
+      const u32 words = size / 4;
+      if (op.operation == RunDcbz)
+      {
+        const u32 cached = FindPatternMismatch(buffer, size, 0);
+        DCFlushRange(buffer, size);
+        const u32 memory = FindPatternMismatch(Uncached(buffer), size, 0);
+        DO_TEST(cached == words && memory == words,
+                "dcbz %s size=%u: zeroed data not visible (cached word %u, memory word %u)",
+                GetLineStateName(op.state), size, cached, memory);
+      }
+      else if (op.operation == RunDcbst || op.operation == RunDcbf)
+      {
+        // Written back lines must reach memory without a further flush
+        const u32 memory = FindPatternMismatch(Uncached(buffer), size, seed);
+        const u32 cached = FindPatternMismatch(buffer, size, seed);
+        DO_TEST(cached == words && memory == words,
+                "%s %s size=%u: mismatch (cached word %u, memory word %u)", op.name,
+                GetLineStateName(op.state), size, cached, memory);
+      }
+      else if (op.operation == RunDcbi && op.state == LineState::Dirty)
+      {
+        // Invalidated lines are discarded without a write back, so the previous memory
+        // contents reappear. Lines may be evicted before the dcbi if the buffer doesn't fit
+        // comfortably in the cache, so only small buffers are checked.
+        if (size <= LOCKED_CACHE_SIZE)
+        {
+          const u32 cached = FindPatternMismatch(buffer, size, ~seed);
+          DO_TEST(cached == words, "dcbi dirty size=%u: modified data survived at word %u", size,
+                  cached);
+        }
+      }
+      else
+      {
+        const u32 cached = FindPatternMismatch(buffer, size, seed);
+        DO_TEST(cached == words, "%s %s size=%u: mismatch at word %u", op.name,
+                GetLineStateName(op.state), size, cached);
+      }
+    }
+  }
+
+  END_TEST();
+}
+
+// Checks that dcbst followed by icbi makes modified code visible to instruction fetches
+static void CodeModificationTest()
+{
+  START_TEST();
+
+  u32* code = (u32*)memalign(CACHE_LINE_SIZE, CACHE_LINE_SIZE);
+  const auto function = (u32(*)())code;
+
+  for (s32 value = 0; value < 16; ++value)
+  {
+    code[0] = PPC::LI(3, value);
+    code[1] = PPC::BLR();
+    RunDcbst((u8*)code, CACHE_LINE_SIZE);
+    RunIcbi((u8*)code, CACHE_LINE_SIZE);
+
+    const u32 result = function();
+    DO_TEST(result == (u32)value, "Stale instruction executed: got %u, expected %d", result,
+            value);
+  }
+
+  free(code);
+
+  END_TEST();
+}
+
+static u32 GetDMAQueueLength()
+{
+  u32 hid2;
+  asm volatile("mfspr %0, 920" : "=r"(hid2));
+  return (hid2 >> 4) & 0xF;
+}
+
+static bool IsDMATriggered()
+{
+  u32 dmal;
+  asm volatile("mfspr %0, 923" : "=r"(dmal));
+  return (dmal & 2) != 0;
+}
+
+// Waits for all queued locked cache transfers, including the one in progress, to finish
+static void WaitForDMA()
+{
+  while (GetDMAQueueLength() != 0 || IsDMATriggered())
+  {
+  }
+}
+
+static u32 MeasureLockedCacheLoad(u8* buffer, u32 size)
+{
+  u32 level;
+  _CPU_ISR_Disable(level);
+  const u64 start = GetTimebase();
+  LCLoadData(LOCKED_CACHE, buffer, size);
+  WaitForDMA();
+  const u64 end = GetTimebase();
+  _CPU_ISR_Restore(level);
+
+  return (u32)(end - start);
+}
+
+static u32 MeasureLockedCacheStore(u8* buffer, u32 size)
+{
+  u32 level;
+  _CPU_ISR_Disable(level);
+  const u64 start = GetTimebase();
+  LCStoreData(buffer, LOCKED_CACHE, size);
+  WaitForDMA();
+  const u64 end = GetTimebase();
+  _CPU_ISR_Restore(level);
+
+  return (u32)(end - start);
+}
+
+// Transfers between main memory and the locked cache. The DMA engine accesses main memory
+// directly, so the buffer is written through the uncached mirror and has no lines in the data
+// cache before each transfer, and stored data is read back through the uncached mirror as well.
+static void LockedCacheTest(u8* buffer)
+{
+  START_TEST();
+
+  LCEnable();
+
+  for (u32 size : BUFFER_SIZES)
+  {
+    if (size > LOCKED_CACHE_SIZE)
+      break;
+
+    const u32 words = size / 4;
+    const u32 seed = 0x87654321 ^ size;
+    u32 best_load = 0xFFFFFFFF;
+    u32 best_store = 0xFFFFFFFF;
+
+    for (int i = 0; i < REPETITIONS; ++i)
+    {
+      PrepareBuffer(buffer, size, seed, LineState::Uncached);
+      const u32 load_ticks = MeasureLockedCacheLoad(buffer, size);
+      if (load_ticks < best_load)
+        best_load = load_ticks;
+
+      const u32 loaded = FindPatternMismatch(LOCKED_CACHE, size, seed);
+      DO_TEST(loaded == words, "Locked cache load size=%u: mismatch at word %u", size, loaded);
+
+      FillPattern(LOCKED_CACHE, size, ~seed);
+      PrepareBuffer(buffer, size, seed, LineState::Uncached);
+      const u32 store_ticks = MeasureLockedCacheStore(buffer, size);
+      if (store_ticks < best_store)
+        best_store = store_ticks;
+
+      const u32 stored = FindPatternMismatch(Uncached(buffer), size, ~seed);
+      DO_TEST(stored == words, "Locked cache store size=%u: mismatch at word %u", size, stored);
+    }
+
+    ReportMeasurement("lc_load", LineState::Uncached, size, best_load);
+    ReportMeasurement("lc_store", LineState::Uncached, size, best_store);
+  }
+
+  LCDisable();
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  u8* buffer = (u8*)memalign(CACHE_LINE_SIZE, MAX_BUFFER_SIZE);
+
+  DataCacheTest(buffer);
+  CodeModificationTest();
+  LockedCacheTest(buffer);
+
+  free(buffer);
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
@@ -1,5 +1,9 @@
 #include <gctypes.h>
+#include <initializer_list>
+#include <stdlib.h>
 #include <wiiuse/wpad.h>
+#include "common/CodeBuffer.h"
+#include "common/PPCEncoder.h"
 #include "common/hwtests.h"
 
 // The i parameter uses PowerPC bit ordering (MSB is bit 0)
@@ -124,12 +128,251 @@ static void CRTest()
   END_TEST();
 }
 
+// The i parameter uses PowerPC bit ordering (MSB is bit 0)
+static u32 GetBit(u32 n, size_t i)
+{
+  return (n >> (31 - i)) & 1;
+}
+
+// Hashes test results so that complete runs can be compared at a glance
+static u32 UpdateDigest(u32 digest, u32 value)
+{
+  return (digest ^ value) * 16777619u;
+}
+
+static const u32 DIGEST_INIT = 2166136261u;
+
+// Generated test functions save the caller's condition register in r5, as cr2-cr4 are
+// nonvolatile, load the input CR from r3 and return the resulting CR in r3.
+typedef u32 (*CRFunction)(u32 cr);
+
+static size_t EmitCRTestFunction(CodeBuffer* code, u32 instruction)
+{
+  code->Clear();
+  code->Emit(PPC::MFCR(5));
+  code->Emit(PPC::MTCRF(0xFF, 3));
+  const size_t index = code->Emit(instruction);
+  code->Emit(PPC::MFCR(3));
+  code->Emit(PPC::MTCRF(0xFF, 5));
+  code->Emit(PPC::BLR());
+  code->Finalize();
+  return index;
+}
+
+static const struct
+{
+  const char* name;
+  u32 (*encode)(u32 crbd, u32 crba, u32 crbb);
+  u32 (*evaluate)(u32 a, u32 b);
+} cr_logical_ops[] = {
+    {"crand", PPC::CRAND, [](u32 a, u32 b) -> u32 { return a & b; }},
+    {"crandc", PPC::CRANDC, [](u32 a, u32 b) -> u32 { return a & ~b & 1; }},
+    {"creqv", PPC::CREQV, [](u32 a, u32 b) -> u32 { return ~(a ^ b) & 1; }},
+    {"crnand", PPC::CRNAND, [](u32 a, u32 b) -> u32 { return ~(a & b) & 1; }},
+    {"crnor", PPC::CRNOR, [](u32 a, u32 b) -> u32 { return ~(a | b) & 1; }},
+    {"cror", PPC::CROR, [](u32 a, u32 b) -> u32 { return a | b; }},
+    {"crorc", PPC::CRORC, [](u32 a, u32 b) -> u32 { return (a | ~b) & 1; }},
+    {"crxor", PPC::CRXOR, [](u32 a, u32 b) -> u32 { return a ^ b; }},
+};
+
+// Runs every condition register logical instruction on every (crbD, crbA, crbB) triple.
+// For each triple, the input CR is chosen such that all four combinations of the two source
+// bits are covered, while the remaining bits hold a pattern which must stay untouched.
+static void CRLogicalTest()
+{
+  START_TEST();
+
+  CodeBuffer code(16);
+
+  for (const auto& op : cr_logical_ops)
+  {
+    const size_t patch_index = EmitCRTestFunction(&code, op.encode(0, 0, 0));
+    const CRFunction function = code.GetFunction<CRFunction>();
+    u32 digest = DIGEST_INIT;
+
+    for (u32 crbd = 0; crbd < 32; ++crbd)
+    {
+      for (u32 crba = 0; crba < 32; ++crba)
+      {
+        for (u32 crbb = 0; crbb < 32; ++crbb)
+        {
+          code.Patch(patch_index, op.encode(crbd, crba, crbb));
+
+          for (u32 combination = 0; combination < 4; ++combination)
+          {
+            u32 input = 0x5A3C96E1 ^ (crbd * 0x01010101);
+            ClearBit(&input, crba);
+            ClearBit(&input, crbb);
+            if (combination & 1)
+              SetBit(&input, crba);
+            if (combination & 2)
+              SetBit(&input, crbb);
+
+            u32 expected = input;
+            ClearBit(&expected, crbd);
+            if (op.evaluate(GetBit(input, crba), GetBit(input, crbb)))
+              SetBit(&expected, crbd);
+
+            const u32 result = function(input);
+            digest = UpdateDigest(digest, result);
+            DO_TEST(result == expected, "%s %d, %d, %d (cr=0x%08x):\n"
+                                        "     got 0x%08x\n"
+                                        "expected 0x%08x",
+                    op.name, crbd, crba, crbb, input, result, expected);
+          }
+        }
+      }
+    }
+
+    network_printf("digest %s %08x\n", op.name, digest);
+  }
+
+  END_TEST();
+}
+
+// Move to condition register fields, with every possible field mask
+static void MtcrfTest()
+{
+  START_TEST();
+
+  CodeBuffer code(16);
+
+  // The second register operand is loaded from r4
+  code.Emit(PPC::MFCR(5));
+  code.Emit(PPC::MTCRF(0xFF, 3));
+  const size_t patch_index = code.Emit(PPC::MTCRF(0, 4));
+  code.Emit(PPC::MFCR(3));
+  code.Emit(PPC::MTCRF(0xFF, 5));
+  code.Emit(PPC::BLR());
+  code.Finalize();
+  const auto function = code.GetFunction<u32 (*)(u32 cr, u32 value)>();
+
+  u32 digest = DIGEST_INIT;
+  for (u32 crm = 0; crm < 256; ++crm)
+  {
+    code.Patch(patch_index, PPC::MTCRF(crm, 4));
+
+    u32 field_mask = 0;
+    for (int field = 0; field < 8; ++field)
+      if (crm & (0x80 >> field))
+        field_mask |= 0xF0000000 >> (4 * field);
+
+    for (int i = 0; i < 16; ++i)
+    {
+      const u32 cr = (u32)rand() ^ ((u32)rand() << 16);
+      const u32 value = (u32)rand() ^ ((u32)rand() << 16);
+      const u32 expected = (cr & ~field_mask) | (value & field_mask);
+      const u32 result = function(cr, value);
+      digest = UpdateDigest(UpdateDigest(digest, crm), result);
+      DO_TEST(result == expected, "mtcrf 0x%02x (cr=0x%08x, value=0x%08x):\n"
+                                  "     got 0x%08x\n"
+                                  "expected 0x%08x",
+              crm, cr, value, result, expected);
+    }
+  }
+
+  network_printf("digest mtcrf %08x\n", digest);
+
+  END_TEST();
+}
+
+// Move condition register field, for every pair of fields
+static void McrfTest()
+{
+  START_TEST();
+
+  CodeBuffer code(16);
+  const size_t patch_index = EmitCRTestFunction(&code, PPC::MCRF(0, 0));
+  const CRFunction function = code.GetFunction<CRFunction>();
+
+  u32 digest = DIGEST_INIT;
+  for (u32 crfd = 0; crfd < 8; ++crfd)
+  {
+    for (u32 crfs = 0; crfs < 8; ++crfs)
+    {
+      code.Patch(patch_index, PPC::MCRF(crfd, crfs));
+
+      for (u32 input : {0x00000000u, 0xFFFFFFFFu, 0x0123CDEFu, 0xFEDC3210u, 0x5A3C96E1u})
+      {
+        const u32 field = (input >> (28 - 4 * crfs)) & 0xF;
+        const u32 expected = (input & ~(0xF0000000 >> (4 * crfd))) | (field << (28 - 4 * crfd));
+        const u32 result = function(input);
+        digest = UpdateDigest(digest, result);
+        DO_TEST(result == expected, "mcrf %d, %d (cr=0x%08x):\n"
+                                    "     got 0x%08x\n"
+                                    "expected 0x%08x",
+                crfd, crfs, input, result, expected);
+      }
+    }
+  }
+
+  network_printf("digest mcrf %08x\n", digest);
+
+  END_TEST();
+}
+
+// Move to condition register from XER
+static void McrxrTest()
+{
+  START_TEST();
+
+  // Writable bits of XER (see mtspr test)
+  const u32 xer_mask = 0xE000FF7F;
+
+  CodeBuffer code(16);
+  code.Emit(PPC::MFCR(6));
+  code.Emit(PPC::MTCRF(0xFF, 3));
+  code.Emit(PPC::MTXER(4));
+  const size_t patch_index = code.Emit(PPC::MCRXR(0));
+  code.Emit(PPC::MFCR(3));
+  code.Emit(PPC::MFXER(4));
+  code.Emit(PPC::STW(4, 0, 5));
+  code.Emit(PPC::MTCRF(0xFF, 6));
+  code.Emit(PPC::BLR());
+  code.Finalize();
+  const auto function = code.GetFunction<u32 (*)(u32 cr, u32 xer, u32* xer_out)>();
+
+  u32 digest = DIGEST_INIT;
+  for (u32 crfd = 0; crfd < 8; ++crfd)
+  {
+    code.Patch(patch_index, PPC::MCRXR(crfd));
+
+    for (u32 xer_top = 0; xer_top < 16; ++xer_top)
+    {
+      for (u32 cr : {0x00000000u, 0xFFFFFFFFu, 0x5A3C96E1u})
+      {
+        const u32 xer = (xer_top << 28) | 0x00001234;
+        const u32 field = (xer & xer_mask) >> 28;
+        const u32 expected_cr = (cr & ~(0xF0000000 >> (4 * crfd))) | (field << (28 - 4 * crfd));
+        const u32 expected_xer = xer & xer_mask & 0x0FFFFFFF;
+
+        u32 result_xer = 0;
+        const u32 result_cr = function(cr, xer, &result_xer);
+        digest = UpdateDigest(UpdateDigest(digest, result_cr), result_xer);
+        DO_TEST(result_cr == expected_cr && result_xer == expected_xer,
+                "mcrxr %d (cr=0x%08x, xer=0x%08x):\n"
+                "     got cr=0x%08x xer=0x%08x\n"
+                "expected cr=0x%08x xer=0x%08x",
+                crfd, cr, xer, result_cr, result_xer, expected_cr, expected_xer);
+      }
+    }
+  }
+
+  network_printf("digest mcrxr %08x\n", digest);
+
+  END_TEST();
+}
+
 int main()
 {
   network_init();
   WPAD_Init();
 
   CRTest();
+  CRLogicalTest();
+  MtcrfTest();
+  McrfTest();
+  McrxrTest();
 
   network_printf("Shutting down...\n");
   network_shutdown();
@@ -0,0 +1,274 @@
+#include <gctypes.h>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+
+// FPSCR bits (PowerPC bit ordering in the comments, MSB is bit 0)
+enum : u32
+{
+  FPSCR_FX = 0x80000000,        // 0
+  FPSCR_FEX = 0x40000000,       // 1
+  FPSCR_VX = 0x20000000,        // 2
+  FPSCR_OX = 0x10000000,        // 3
+  FPSCR_UX = 0x08000000,        // 4
+  FPSCR_ZX = 0x04000000,        // 5
+  FPSCR_XX = 0x02000000,        // 6
+  FPSCR_VXSNAN = 0x01000000,    // 7
+  FPSCR_VXISI = 0x00800000,     // 8
+  FPSCR_VXIDI = 0x00400000,     // 9
+  FPSCR_VXZDZ = 0x00200000,     // 10
+  FPSCR_VXIMZ = 0x00100000,     // 11
+  FPSCR_VXVC = 0x00080000,      // 12
+  FPSCR_RESERVED = 0x00000800,  // 20
+  FPSCR_VXSOFT = 0x00000400,    // 21
+  FPSCR_VXSQRT = 0x00000200,    // 22
+  FPSCR_VXCVI = 0x00000100,     // 23
+
+  FPSCR_ANY_VX = FPSCR_VXSNAN | FPSCR_VXISI | FPSCR_VXIDI | FPSCR_VXZDZ | FPSCR_VXIMZ |
+                 FPSCR_VXVC | FPSCR_VXSOFT | FPSCR_VXSQRT | FPSCR_VXCVI,
+  FPSCR_STICKY = FPSCR_FX | FPSCR_OX | FPSCR_UX | FPSCR_ZX | FPSCR_XX | FPSCR_ANY_VX,
+};
+
+// Input categories. Every instruction is run on every combination of these.
+static const u64 inputs[] = {
+    0x0000000000000000,  // +0
+    0x8000000000000000,  // -0
+    0x3ff0000000000000,  // +1
+    0xc008000000000000,  // -3 (makes divisions inexact)
+    0x3ff0000000000001,  // 1 + ulp (inexact when rounded to single)
+    0x0000000000000001,  // smallest positive denormal
+    0x0010000000000000,  // smallest positive normal (underflows when squared)
+    0x7fefffffffffffff,  // largest normal (overflows when squared)
+    0x7ff0000000000000,  // +infinity
+    0xfff0000000000000,  // -infinity
+    0x7ff8000000000000,  // a QNaN
+    0x7ff4000000000000,  // a SNaN
+};
+static const size_t num_inputs = sizeof(inputs) / sizeof(inputs[0]);
+
+// FPSCR states the instructions start from. The second one has every sticky bit set, which
+// must survive any arithmetic instruction.
+static const u32 initial_states[][2] = {
+    {0x00000000, 0},
+    {FPSCR_STICKY, 1},
+};
+
+typedef u32 (*FpOperation)(u32 fpscr, u64 a, u64 b, u64 c);
+
+// Runs a single instruction with the given FPSCR and returns the FPSCR afterwards.
+// Operands: %2 = frA, %3 = frB, %4 = frC
+#define DEFINE_FP_OPERATION(name, instruction)                                                     \
+  static u32 name(u32 fpscr, u64 a, u64 b, u64 c)                                                  \
+  {                                                                                                \
+    u64 state = fpscr;                                                                             \
+    u64 result;                                                                                    \
+    asm volatile("mtfsf 0xFF, %1\n"                                                                \
+                 instruction "\n"                                                                  \
+                 "mffs %1"                                                                         \
+                 : "=&f"(result), "+f"(state)                                                      \
+                 : "f"(a), "f"(b), "f"(c)                                                          \
+                 : "cr1");                                                                         \
+    return (u32)state;                                                                             \
+  }
+
+DEFINE_FP_OPERATION(Fadd, "fadd %0, %2, %3")
+DEFINE_FP_OPERATION(Fsub, "fsub %0, %2, %3")
+DEFINE_FP_OPERATION(Fmul, "fmul %0, %2, %4")
+DEFINE_FP_OPERATION(Fdiv, "fdiv %0, %2, %3")
+DEFINE_FP_OPERATION(Fadds, "fadds %0, %2, %3")
+DEFINE_FP_OPERATION(Fsubs, "fsubs %0, %2, %3")
+DEFINE_FP_OPERATION(Fmuls, "fmuls %0, %2, %4")
+DEFINE_FP_OPERATION(Fdivs, "fdivs %0, %2, %3")
+DEFINE_FP_OPERATION(Fmadd, "fmadd %0, %2, %4, %3")
+DEFINE_FP_OPERATION(Fmsub, "fmsub %0, %2, %4, %3")
+DEFINE_FP_OPERATION(Fnmadd, "fnmadd %0, %2, %4, %3")
+DEFINE_FP_OPERATION(Fnmsub, "fnmsub %0, %2, %4, %3")
+DEFINE_FP_OPERATION(Fmadds, "fmadds %0, %2, %4, %3")
+DEFINE_FP_OPERATION(Fmsubs, "fmsubs %0, %2, %4, %3")
+DEFINE_FP_OPERATION(Fnmadds, "fnmadds %0, %2, %4, %3")
+DEFINE_FP_OPERATION(Fnmsubs, "fnmsubs %0, %2, %4, %3")
+DEFINE_FP_OPERATION(Fres, "fres %0, %3")
+DEFINE_FP_OPERATION(Frsqrte, "frsqrte %0, %3")
+DEFINE_FP_OPERATION(Frsp, "frsp %0, %3")
+DEFINE_FP_OPERATION(Fctiw, "fctiw %0, %3")
+DEFINE_FP_OPERATION(Fctiwz, "fctiwz %0, %3")
+DEFINE_FP_OPERATION(Fcmpu, "fcmpu cr1, %2, %3\n fmr %0, %2")
+DEFINE_FP_OPERATION(Fcmpo, "fcmpo cr1, %2, %3\n fmr %0, %2")
+
+// Which of the operands an instruction actually reads
+enum OperandMask
+{
+  OPERAND_A = 1,
+  OPERAND_B = 2,
+  OPERAND_C = 4,
+};
+
+static const struct
+{
+  const char* name;
+  FpOperation operation;
+  int operands;
+} operations[] = {
+    {"fadd", Fadd, OPERAND_A | OPERAND_B},
+    {"fsub", Fsub, OPERAND_A | OPERAND_B},
+    {"fmul", Fmul, OPERAND_A | OPERAND_C},
+    {"fdiv", Fdiv, OPERAND_A | OPERAND_B},
+    {"fadds", Fadds, OPERAND_A | OPERAND_B},
+    {"fsubs", Fsubs, OPERAND_A | OPERAND_B},
+    {"fmuls", Fmuls, OPERAND_A | OPERAND_C},
+    {"fdivs", Fdivs, OPERAND_A | OPERAND_B},
+    {"fmadd", Fmadd, OPERAND_A | OPERAND_B | OPERAND_C},
+    {"fmsub", Fmsub, OPERAND_A | OPERAND_B | OPERAND_C},
+    {"fnmadd", Fnmadd, OPERAND_A | OPERAND_B | OPERAND_C},
+    {"fnmsub", Fnmsub, OPERAND_A | OPERAND_B | OPERAND_C},
+    {"fmadds", Fmadds, OPERAND_A | OPERAND_B | OPERAND_C},
+    {"fmsubs", Fmsubs, OPERAND_A | OPERAND_B | OPERAND_C},
+    {"fnmadds", Fnmadds, OPERAND_A | OPERAND_B | OPERAND_C},
+    {"fnmsubs", Fnmsubs, OPERAND_A | OPERAND_B | OPERAND_C},
+    {"fres", Fres, OPERAND_B},
+    {"frsqrte", Frsqrte, OPERAND_B},
+    {"frsp", Frsp, OPERAND_B},
+    {"fctiw", Fctiw, OPERAND_B},
+    {"fctiwz", Fctiwz, OPERAND_B},
+    {"fcmpu", Fcmpu, OPERAND_A | OPERAND_B},
+    {"fcmpo", Fcmpo, OPERAND_A | OPERAND_B},
+};
+
+// Compresses the outcomes of one instruction into a transition table.
+// Each distinct resulting FPSCR value gets a single-character symbol, so that a table row is
+// one short string which can easily be diffed between hardware and emulators.
+class TransitionTable
+{
+public:
+  TransitionTable() : num_symbols(0), overflowed(false) {}
+
+  char Add(u32 fpscr)
+  {
+    for (int i = 0; i < num_symbols; ++i)
+      if (values[i] == fpscr)
+        return symbols[i];
+
+    if (num_symbols == MAX_SYMBOLS)
+    {
+      overflowed = true;
+      return '?';
+    }
+    values[num_symbols] = fpscr;
+    return symbols[num_symbols++];
+  }
+
+  void PrintDictionary() const
+  {
+    network_printf("dict");
+    for (int i = 0; i < num_symbols; ++i)
+      network_printf(" %c=%08x", symbols[i], values[i]);
+    if (overflowed)
+      network_printf(" ?=overflow");
+    network_printf("\n");
+  }
+
+private:
+  static const int MAX_SYMBOLS = 62;
+  const char* const symbols = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  u32 values[MAX_SYMBOLS];
+  int num_symbols;
+  bool overflowed;
+};
+
+// Checks architectural invariants of the resulting FPSCR.
+static void CheckTransition(const char* name, u32 before, u32 after, u64 a, u64 b, u64 c)
+{
+  DO_TEST((after & before & FPSCR_STICKY) == (before & FPSCR_STICKY),
+          "%s(0x%016llx, 0x%016llx, 0x%016llx) cleared sticky bits:\n"
+          "  before 0x%08x\n"
+          "   after 0x%08x",
+          name, a, b, c, before, after);
+
+  const bool vx_expected = (after & FPSCR_ANY_VX) != 0;
+  DO_TEST(((after & FPSCR_VX) != 0) == vx_expected,
+          "%s(0x%016llx, 0x%016llx, 0x%016llx): VX is not the summary of VX* bits (0x%08x)", name,
+          a, b, c, after);
+
+  const u32 new_exceptions = (after & ~before) & (FPSCR_STICKY & ~FPSCR_FX);
+  DO_TEST(!new_exceptions || (after & FPSCR_FX),
+          "%s(0x%016llx, 0x%016llx, 0x%016llx): new exception bits 0x%08x without FX (0x%08x)",
+          name, a, b, c, new_exceptions, after);
+
+  DO_TEST(!(after & (FPSCR_FEX | FPSCR_RESERVED)),
+          "%s(0x%016llx, 0x%016llx, 0x%016llx): unexpected FEX/reserved bits (0x%08x)", name, a,
+          b, c, after);
+}
+
+// Records FPSCR before and after each arithmetic FP instruction for all input categories.
+// Results are printed as one table per instruction and initial FPSCR, with rows indexed by
+// (frA, frC) and columns by frB, using the category order of the inputs array.
+static void FpscrTransitionTest()
+{
+  START_TEST();
+
+  char row[num_inputs + 1];
+  row[num_inputs] = '\0';
+
+  for (const auto& op : operations)
+  {
+    const size_t num_a = (op.operands & OPERAND_A) ? num_inputs : 1;
+    const size_t num_c = (op.operands & OPERAND_C) ? num_inputs : 1;
+    const size_t num_b = (op.operands & OPERAND_B) ? num_inputs : 1;
+
+    for (const auto& initial_state : initial_states)
+    {
+      const u32 before = initial_state[0];
+      TransitionTable table;
+      u32 digest = 2166136261u;
+
+      network_printf("table %s %d %dx%d\n", op.name, initial_state[1], (int)(num_a * num_c),
+                     (int)num_b);
+
+      for (size_t ia = 0; ia < num_a; ++ia)
+      {
+        for (size_t ic = 0; ic < num_c; ++ic)
+        {
+          for (size_t ib = 0; ib < num_b; ++ib)
+          {
+            const u64 a = (op.operands & OPERAND_A) ? inputs[ia] : inputs[2];
+            const u64 b = (op.operands & OPERAND_B) ? inputs[ib] : inputs[2];
+            const u64 c = (op.operands & OPERAND_C) ? inputs[ic] : inputs[2];
+
+            const u32 after = op.operation(before, a, b, c);
+            CheckTransition(op.name, before, after, a, b, c);
+
+            row[ib] = table.Add(after);
+            digest = (digest ^ after) * 16777619u;
+          }
+          row[num_b] = '\0';
+          network_printf("row %s\n", row);
+        }
+      }
+
+      table.PrintDictionary();
+      network_printf("digest %s %d %08x\n", op.name, initial_state[1], digest);
+    }
+
+    WPAD_ScanPads();
+    if (WPAD_ButtonsDown(0) & WPAD_BUTTON_HOME)
+      break;
+  }
+
+  // Don't leave any exception bits behind for the rest of the program
+  const u64 clear = 0;
+  asm volatile("mtfsf 0xFF, %0" ::"f"(clear));
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  FpscrTransitionTest();
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
@@ -0,0 +1,93 @@
+#include <gctypes.h>
+#include <malloc.h>
+#include <ogc/machine/processor.h>
+#include <stdlib.h>
+#include <wiiuse/wpad.h>
+#include "common/CodeBuffer.h"
+#include "common/hwtests.h"
+#include "common/timebase.h"
+#include "cputest/microbench.h"
+
+// Largest generated function: prologue, the long loop body and the loop epilogue
+static const u32 MAX_CODE_SIZE = 256;
+
+static CodeBuffer* s_code;
+static Microbench::Scratch* s_scratch;
+
+static u64 RunOnHardware(const std::vector<u32>& code, u32 iterations)
+{
+  s_code->Clear();
+  for (u32 instruction : code)
+    s_code->Emit(instruction);
+  s_code->Finalize();
+
+  const auto function = s_code->GetFunction<void (*)(u32, Microbench::Scratch*)>();
+
+  // Bring the code into the instruction cache
+  function(1, s_scratch);
+
+  u32 level;
+  _CPU_ISR_Disable(level);
+  const u64 start = GetTimebase();
+  function(iterations, s_scratch);
+  const u64 end = GetTimebase();
+  _CPU_ISR_Restore(level);
+
+  return end - start;
+}
+
+static void LatencyTest()
+{
+  START_TEST();
+
+  const Microbench::Config config;
+  DO_TEST(Microbench::Generate(Microbench::benchmarks[0], Microbench::Mode::Latency,
+                               config.long_unroll)
+                  .size() <= MAX_CODE_SIZE,
+          "Generated code doesn't fit into the code buffer");
+
+  network_printf("%s\n", Microbench::FormatHeader().c_str());
+
+  for (const auto& benchmark : Microbench::benchmarks)
+  {
+    for (auto mode : {Microbench::Mode::Latency, Microbench::Mode::Throughput})
+    {
+      if (mode == Microbench::Mode::Latency && !benchmark.has_latency)
+        continue;
+
+      const auto result = Microbench::Measure(benchmark, mode, config, RunOnHardware);
+      DO_TEST(result.centicycles != 0, "%s: no measurable difference between loop sizes",
+              benchmark.name);
+      network_printf("%s\n", Microbench::FormatResult(result).c_str());
+    }
+
+    WPAD_ScanPads();
+    if (WPAD_ButtonsDown(0) & WPAD_BUTTON_HOME)
+      break;
+  }
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  s_code = new CodeBuffer(MAX_CODE_SIZE);
+  s_scratch = (Microbench::Scratch*)memalign(32, sizeof(Microbench::Scratch));
+  s_scratch->self = (u32)s_scratch;
+  s_scratch->one_double = 1.0;
+  s_scratch->one_pair[0] = s_scratch->one_pair[1] = 1.0f;
+  s_scratch->zero_pair[0] = s_scratch->zero_pair[1] = 0.0f;
+
+  LatencyTest();
+
+  free(s_scratch);
+  delete s_code;
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
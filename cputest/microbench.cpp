@@ -0,0 +1,142 @@
+#include "cputest/microbench.h"
+
+#include <cstddef>
+#include <stdio.h>
+
+#include "common/PPCEncoder.h"
+#include "common/timebase.h"
+
+namespace Microbench
+{
+// Registers of the generated code. Only volatile registers are used, so no state needs to be
+// saved. r3 holds the iteration count until it is moved to CTR, r4 the scratch pointer.
+static const u32 GPR_CHAINS[NUM_CHAINS] = {3, 5, 6, 7, 8, 9, 10, 11};
+static const u32 FPR_CHAINS[NUM_CHAINS] = {0, 1, 2, 3, 4, 5, 6, 7};
+static const u32 GPR_ONE = 12;
+static const u32 FPR_ONE = 12;
+static const u32 FPR_ZERO = 13;
+static const u32 SCRATCH = 4;
+
+// Constant operands are chosen so that floating point and multiplicative chains never change
+// (x + 0, x * 1, ...), which keeps data-dependent timings such as division at a fixed point.
+const std::vector<Benchmark> benchmarks = {
+    {"add", "int", RegisterFile::GPR, true,
+     [](u32 d, u32 s, u32) { return PPC::ADD(d, s, GPR_ONE); }},
+    {"addi", "int", RegisterFile::GPR, true, [](u32 d, u32 s, u32) { return PPC::ADDI(d, s, 0); }},
+    {"mullw", "int", RegisterFile::GPR, true,
+     [](u32 d, u32 s, u32) { return PPC::MULLW(d, s, GPR_ONE); }},
+    {"divw", "int", RegisterFile::GPR, true,
+     [](u32 d, u32 s, u32) { return PPC::DIVW(d, s, GPR_ONE); }},
+    {"rlwinm", "int", RegisterFile::GPR, true,
+     [](u32 d, u32 s, u32) { return PPC::RLWINM(d, s, 0, 0, 31); }},
+    {"fadd", "fp", RegisterFile::FPR, true,
+     [](u32 d, u32 s, u32) { return PPC::FADD(d, s, FPR_ZERO); }},
+    {"fmul", "fp", RegisterFile::FPR, true,
+     [](u32 d, u32 s, u32) { return PPC::FMUL(d, s, FPR_ONE); }},
+    {"fmadd", "fp", RegisterFile::FPR, true,
+     [](u32 d, u32 s, u32) { return PPC::FMADD(d, s, FPR_ONE, FPR_ZERO); }},
+    {"fdiv", "fp", RegisterFile::FPR, true,
+     [](u32 d, u32 s, u32) { return PPC::FDIV(d, s, FPR_ONE); }},
+    {"ps_add", "ps", RegisterFile::FPR, true,
+     [](u32 d, u32 s, u32) { return PPC::PS_ADD(d, s, FPR_ZERO); }},
+    {"ps_mul", "ps", RegisterFile::FPR, true,
+     [](u32 d, u32 s, u32) { return PPC::PS_MUL(d, s, FPR_ONE); }},
+    {"ps_madd", "ps", RegisterFile::FPR, true,
+     [](u32 d, u32 s, u32) { return PPC::PS_MADD(d, s, FPR_ONE, FPR_ZERO); }},
+    // Chains start out pointing at scratch.self, which points to itself
+    {"lwz", "load", RegisterFile::GPR, true, [](u32 d, u32 s, u32) { return PPC::LWZ(d, 0, s); }},
+    {"lfd", "load", RegisterFile::FPR, false,
+     [](u32 d, u32, u32) { return PPC::LFD(d, offsetof(Scratch, one_double), SCRATCH); }},
+    {"psq_l", "load", RegisterFile::FPR, false,
+     [](u32 d, u32, u32) { return PPC::PSQ_L(d, offsetof(Scratch, one_pair), SCRATCH, false, 0); }},
+    {"stw", "store", RegisterFile::GPR, false,
+     [](u32, u32 s, u32 slot) {
+       return PPC::STW(s, offsetof(Scratch, store_area) + 4 * slot, SCRATCH);
+     }},
+};
+
+std::vector<u32> Generate(const Benchmark& benchmark, Mode mode, u32 unroll)
+{
+  const u32* chains = benchmark.registers == RegisterFile::GPR ? GPR_CHAINS : FPR_CHAINS;
+  std::vector<u32> code;
+
+  code.push_back(PPC::MTCTR(3));
+  code.push_back(PPC::LI(GPR_ONE, 1));
+  code.push_back(PPC::LFS(FPR_ONE, offsetof(Scratch, one_pair), SCRATCH));
+  code.push_back(PPC::LFS(FPR_ZERO, offsetof(Scratch, zero_pair), SCRATCH));
+  for (u32 i = 0; i < NUM_CHAINS; ++i)
+  {
+    if (benchmark.registers == RegisterFile::GPR)
+      code.push_back(PPC::ADDI(chains[i], SCRATCH, 0));
+    else
+      code.push_back(PPC::LFS(chains[i], offsetof(Scratch, one_pair), SCRATCH));
+  }
+
+  for (u32 i = 0; i < unroll; ++i)
+  {
+    const u32 slot = mode == Mode::Latency ? 0 : i % NUM_CHAINS;
+    code.push_back(benchmark.encode(chains[slot], chains[slot], slot));
+  }
+
+  code.push_back(PPC::BDNZ(-4 * static_cast<s32>(unroll)));
+  code.push_back(PPC::BLR());
+
+  return code;
+}
+
+static u64 MeasureFastest(const std::vector<u32>& code, const Config& config, const Runner& run)
+{
+  u64 best = ~0ull;
+  for (u32 i = 0; i < config.repetitions; ++i)
+  {
+    const u64 ticks = run(code, config.iterations);
+    if (ticks < best)
+      best = ticks;
+  }
+  return best;
+}
+
+u32 AnalyzeCentiCycles(u64 short_ticks, u64 long_ticks, const Config& config)
+{
+  if (long_ticks <= short_ticks)
+    return 0;
+
+  const u64 instructions = static_cast<u64>(config.iterations) *
+                           (config.long_unroll - config.short_unroll);
+  const u64 centicycles = (long_ticks - short_ticks) * CPU_CYCLES_PER_TIMEBASE_TICK * 100;
+  // Rounded to nearest
+  return static_cast<u32>((centicycles + instructions / 2) / instructions);
+}
+
+Result Measure(const Benchmark& benchmark, Mode mode, const Config& config, const Runner& run)
+{
+  Result result;
+  result.benchmark = &benchmark;
+  result.mode = mode;
+  result.config = config;
+  result.short_ticks = MeasureFastest(Generate(benchmark, mode, config.short_unroll), config, run);
+  result.long_ticks = MeasureFastest(Generate(benchmark, mode, config.long_unroll), config, run);
+  result.centicycles = AnalyzeCentiCycles(result.short_ticks, result.long_ticks, config);
+  return result;
+}
+
+std::string FormatHeader()
+{
+  return "bench,name,category,mode,iterations,short_unroll,long_unroll,short_ticks,long_ticks,"
+         "cycles";
+}
+
+std::string FormatResult(const Result& result)
+{
+  char line[256];
+  snprintf(line, sizeof(line), "bench,%s,%s,%s,%u,%u,%u,%llu,%llu,%u.%02u", result.benchmark->name,
+           result.benchmark->category,
+           result.mode == Mode::Latency ? "latency" : "throughput", result.config.iterations,
+           result.config.short_unroll, result.config.long_unroll,
+           static_cast<unsigned long long>(result.short_ticks),
+           static_cast<unsigned long long>(result.long_ticks), result.centicycles / 100,
+           result.centicycles % 100);
+  return line;
+}
+
+}  // namespace Microbench
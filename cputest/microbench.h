@@ -0,0 +1,97 @@
+// Instruction latency and throughput microbenchmarks.
+//
+// For each benchmark, a loop body of N copies of the instruction is generated with
+// common/PPCEncoder.h, either as a single dependent chain (latency) or as independent chains
+// interleaved round-robin (throughput). The loop is run twice with different N, and the cost
+// per instruction is derived from the difference, which cancels out call and loop overhead.
+//
+// Nothing here touches the hardware: generated code is run through a caller-supplied callback,
+// so the generator and the analysis can be exercised with a stub timer on any host.
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "common/CommonTypes.h"
+
+namespace Microbench
+{
+// Generated functions have the signature void(u32 iterations, Scratch* scratch)
+struct alignas(32) Scratch
+{
+  u32 self;             // Address of this structure, for pointer chasing loads
+  u32 padding;
+  double one_double;    // 1.0
+  float one_pair[2];    // 1.0, 1.0
+  float zero_pair[2];   // 0.0, 0.0
+  u32 store_area[8];    // Target of store benchmarks
+};
+
+enum class Mode
+{
+  Latency,
+  Throughput,
+};
+
+enum class RegisterFile
+{
+  GPR,
+  FPR,
+};
+
+struct Benchmark
+{
+  const char* name;
+  const char* category;
+  RegisterFile registers;
+  // Whether a dependent chain can be formed from the instruction alone
+  bool has_latency;
+  // d is the destination and s the dependent source register of the chain, slot the index of
+  // the chain (0 in latency mode)
+  u32 (*encode)(u32 d, u32 s, u32 slot);
+};
+
+extern const std::vector<Benchmark> benchmarks;
+
+// Number of interleaved chains in throughput mode
+constexpr u32 NUM_CHAINS = 8;
+
+// Returns the code of a complete function running the benchmark loop.
+// The loop body consists of `unroll` instructions.
+std::vector<u32> Generate(const Benchmark& benchmark, Mode mode, u32 unroll);
+
+// Runs generated code the given number of iterations and returns the elapsed timebase ticks
+using Runner = std::function<u64(const std::vector<u32>& code, u32 iterations)>;
+
+struct Config
+{
+  u32 iterations = 1000;
+  u32 short_unroll = 16;
+  u32 long_unroll = 80;
+  // Each loop is run this many times, and the fastest run is used
+  u32 repetitions = 3;
+};
+
+struct Result
+{
+  const Benchmark* benchmark;
+  Mode mode;
+  Config config;
+  u64 short_ticks;
+  u64 long_ticks;
+  // CPU cycles per instruction, in hundredths
+  u32 centicycles;
+};
+
+Result Measure(const Benchmark& benchmark, Mode mode, const Config& config, const Runner& run);
+
+// Converts the tick counts of a result into cycles per instruction
+u32 AnalyzeCentiCycles(u64 short_ticks, u64 long_ticks, const Config& config);
+
+// Machine readable output, one comma separated line per result
+std::string FormatHeader();
+std::string FormatResult(const Result& result);
+
+}  // namespace Microbench
@@ -8,6 +8,17 @@
 //#include "Common.h"
 #include "common/BitField.h"
 
+// CP registers
+#define MATINDEX_A 0x30
+#define MATINDEX_B 0x40
+#define VCD_LO 0x50
+#define VCD_HI 0x60
+#define CP_VAT_REG_A 0x70
+#define CP_VAT_REG_B 0x80
+#define CP_VAT_REG_C 0x90
+#define ARRAY_BASE 0xa0
+#define ARRAY_STRIDE 0xb0
+
 // Vertex array numbers
 enum
 {
@@ -144,8 +155,9 @@ union TVtxDesc
 {
   u64 Hex;
 
-  BitField<0, 32, u64> Hex0;
-  BitField<32, 32, u64> Hex1;
+  // The values of VCD_LO (up to Color1) and VCD_HI (the texture coordinates)
+  BitField<0, 17, u64> Low;
+  BitField<17, 16, u64> High;
 
   // Note: Access to this array is not endianness-independent.
   u8 byte[8];
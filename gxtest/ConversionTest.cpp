@@ -0,0 +1,24 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/ConversionTest.h"
+
+#include <ogc/lwp_watchdog.h>
+
+#include "common/hwtests.h"
+
+namespace ConversionTest
+{
+void PrintBenchmark(const char* name, int width, int height, u64 ticks)
+{
+  const u64 num_pixels = (u64)width * height;
+  const u64 centicycles = ticks * CPU_CYCLES_PER_TIMEBASE_TICK * 100 / num_pixels;
+  // TB_TIMER_CLOCK is in kHz
+  const u64 kilopixels_per_second = num_pixels * TB_TIMER_CLOCK / (ticks ? ticks : 1);
+  network_printf("%-24s %dx%d ticks=%8u cycles/pixel=%u.%02u rate=%u.%03u MP/s\n", name, width,
+                 height, (u32)ticks, (u32)(centicycles / 100), (u32)(centicycles % 100),
+                 (u32)(kilopixels_per_second / 1000), (u32)(kilopixels_per_second % 1000));
+}
+
+}  // namespace ConversionTest
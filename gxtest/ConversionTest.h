@@ -0,0 +1,75 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string.h>
+
+#include "common/CommonTypes.h"
+#include "common/timebase.h"
+
+// Shared parts of the tests and benchmarks of the software conversions (TextureDecoder,
+// TextureEncoder and EfbFormat), which compare an optimized implementation against its scalar
+// reference and time it:
+//
+//   const u32 mismatch = ConversionTest::Compare(reference, result, size,
+//                                                [&](u8* dst) { DecodeScalar(dst, ...); },
+//                                                [&](u8* dst) { Decode(dst, ...); });
+//   const u64 ticks = ConversionTest::GetFastestTicks([&] { Decode(dst, ...); });
+//   ConversionTest::PrintBenchmark("decode I8", width, height, ticks);
+//
+// Compare is also used by hosttest. GetFastestTicks and PrintBenchmark need the console.
+
+namespace ConversionTest
+{
+// Image sizes to compare at, with partial blocks and rows which don't fill a whole vector
+static const int SIZES[][2] = {
+    {1, 1},   {3, 5},    {4, 4},     {8, 8},    {13, 16},  {17, 9},
+    {64, 32}, {64, 64},  {100, 100}, {200, 50}, {640, 528},
+};
+
+// Index of the first byte which differs, or size if there is none
+inline u32 FindMismatch(const u8* reference, const u8* result, u32 size)
+{
+  u32 mismatch = 0;
+  while (mismatch < size && reference[mismatch] == result[mismatch])
+    ++mismatch;
+  return mismatch;
+}
+
+// Fills both outputs of size bytes with different values, so that bytes left out by either
+// implementation show up, writes them with convert_reference(reference) and
+// convert(result), and returns FindMismatch of them
+template <typename ConvertReference, typename Convert>
+u32 Compare(u8* reference, u8* result, u32 size, ConvertReference convert_reference,
+            Convert convert)
+{
+  memset(reference, 0xCD, size);
+  memset(result, 0xEF, size);
+  convert_reference(reference);
+  convert(result);
+  return FindMismatch(reference, result, size);
+}
+
+// Timebase ticks of the fastest of four calls of function
+template <typename Function>
+u64 GetFastestTicks(Function function)
+{
+  u64 best = ~0ull;
+  for (int i = 0; i < 4; ++i)
+  {
+    const u64 start = GetTimebase();
+    function();
+    const u64 end = GetTimebase();
+    if (end - start < best)
+      best = end - start;
+  }
+  return best;
+}
+
+// Prints the ticks, cycles per pixel and megapixels per second of converting width * height
+// pixels
+void PrintBenchmark(const char* name, int width, int height, u64 ticks);
+
+}  // namespace ConversionTest
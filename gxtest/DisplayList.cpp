@@ -0,0 +1,154 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef CGX_RECORD_FIFO
+#include <ogc/cache.h>
+#endif
+
+#include "gxtest/DisplayList.h"
+#include "gxtest/FifoDecoder.h"
+#include "gxtest/cgx.h"
+
+// Collects the registers loaded by a list
+class LoadedRegisters : public FifoDecoder::NullHandler
+{
+public:
+  LoadedRegisters()
+  {
+    memset(bp, 0, sizeof(bp));
+    memset(cp, 0, sizeof(cp));
+  }
+
+  void OnBP(u8 reg, u32 /*old_value*/, u32 /*new_value*/) { bp[reg] = true; }
+  void OnCP(u8 reg, u32 /*value*/) { cp[reg] = true; }
+  void OnXF(u16 address, u32 count, const u8* /*data*/)
+  {
+    xf_ranges.emplace_back(address, count);
+  }
+
+  // Bits 0-11 hold the address and bits 12-15 the number of words minus one
+  void OnIndexedXF(int /*array*/, u32 value)
+  {
+    xf_ranges.emplace_back(value & 0xFFF, ((value >> 12) & 0xF) + 1);
+  }
+
+  void OnCallDisplayList(u32 /*address*/, u32 /*size*/)
+  {
+    assert(!"Display lists can't be nested");
+  }
+
+  bool bp[0x100];
+  bool cp[0x100];
+  std::vector<std::pair<u16, u32>> xf_ranges;
+};
+
+DisplayList::DisplayList() : FifoRecorder(4 * 1024), m_data(nullptr), m_size(0)
+{
+}
+
+DisplayList::~DisplayList()
+{
+  free(m_data);
+}
+
+u32 DisplayList::LoadBPReg(u32 value)
+{
+  const u32 offset = GetOffset() + 1;
+  CGX_WRITE_BP_REG_TO(this, value);
+  return offset;
+}
+
+u32 DisplayList::LoadCPReg(u8 reg, u32 value)
+{
+  const u32 offset = GetOffset() + 2;
+  CGX_WRITE_CP_REG_TO(this, reg, value);
+  return offset;
+}
+
+u32 DisplayList::LoadXFReg(u16 address, u32 value)
+{
+  CGX_BEGIN_WRITE_XF_REGS_TO(this, address, 1);
+  const u32 offset = GetOffset();
+  U32 = value;
+  return offset;
+}
+
+void DisplayList::Finish()
+{
+  const u32 recorded_size = (u32)Size();
+  assert(recorded_size > 0);
+
+  free(m_data);
+  m_size = (recorded_size + 31) & ~31;
+  m_data = (u8*)memalign(32, m_size);
+  memcpy(m_data, Data().data(), recorded_size);
+  memset(m_data + recorded_size, 0, m_size - recorded_size);  // NOPs
+
+#ifndef CGX_RECORD_FIFO
+  DCFlushRange(m_data, m_size);
+#endif
+
+  LoadedRegisters loaded;
+  FifoDecoder::Decoder<LoadedRegisters> decoder(&loaded);
+  const u32 decoded_size = decoder.Decode(m_data, m_size);
+  assert(decoded_size == m_size);
+  (void)decoded_size;
+
+  m_bp_regs.clear();
+  m_cp_regs.clear();
+  for (int reg = 0; reg < 0x100; ++reg)
+  {
+    if (loaded.bp[reg])
+      m_bp_regs.push_back(reg);
+    if (loaded.cp[reg])
+      m_cp_regs.push_back(reg);
+  }
+  m_xf_ranges.swap(loaded.xf_ranges);
+}
+
+void DisplayList::Patch(u32 offset, u32 value)
+{
+  assert(m_data != nullptr);
+  assert(offset + 4 <= Size());
+
+  Overwrite(offset, value);
+
+  // Stored in the order the GPU reads it, like everything else in the list
+  m_data[offset] = value >> 24;
+  m_data[offset + 1] = value >> 16;
+  m_data[offset + 2] = value >> 8;
+  m_data[offset + 3] = value;
+
+#ifndef CGX_RECORD_FIFO
+  DCFlushRange(m_data + offset, 4);
+#endif
+}
+
+void DisplayList::PatchFloat(u32 offset, float value)
+{
+  u32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  Patch(offset, bits);
+}
+
+void DisplayList::Call() const
+{
+  assert(m_data != nullptr);
+
+  if (_cgxshadowenabled)
+  {
+    for (u8 reg : m_bp_regs)
+      CGX_ShadowInvalidateBPReg(reg);
+    for (u8 reg : m_cp_regs)
+      CGX_ShadowInvalidateCPReg(reg);
+    for (const auto& range : m_xf_ranges)
+      CGX_ShadowInvalidateXFRegs(range.first, range.second);
+  }
+
+  CGX_CallDisplayList(m_data, m_size);
+}
@@ -0,0 +1,73 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "common/CommonTypes.h"
+#include "gxtest/FifoRecorder.h"
+
+// Command sequence which is recorded once and then executed by the GPU from memory, so that
+// repeated setup doesn't need to go through the write-gather pipe every time:
+//
+//   DisplayList list;
+//   const u32 color = list.LoadBPReg(tev_color.hex);  // patch point
+//   GXTest::Quad().Draw(&list);
+//   list.Finish();
+//
+//   for (...)
+//   {
+//     list.Patch(color, new_tev_color.hex);
+//     list.Call();
+//     ...
+//   }
+//
+// Commands are written like with a FifoRecorder, e.g. with the CGX_*_TO macros. Display lists
+// must not call other display lists, since the GPU doesn't support nesting them.
+class DisplayList : public FifoRecorder
+{
+public:
+  DisplayList();
+  ~DisplayList();
+
+  // Append a register load and return the offset of its value, for use with Patch.
+  // For BP registers, the value includes the register address.
+  u32 LoadBPReg(u32 value);
+  u32 LoadCPReg(u8 reg, u32 value);
+  u32 LoadXFReg(u16 address, u32 value);
+
+  // Offset at which the next command will be recorded
+  u32 GetOffset() const { return (u32)Size(); }
+
+  // Copies the recorded commands into 32 byte aligned memory, pads them with NOPs to a multiple
+  // of 32 bytes and flushes them from the data cache. Needs to be called before Call, and again
+  // after recording more commands.
+  void Finish();
+
+  // Replace a 32 bit value of the finished list, e.g. at an offset returned by LoadBPReg.
+  // Patching a BP load must keep its register address. The recorded commands are patched as
+  // well, so the value is kept when Finish is called again.
+  // The GPU must not be executing the list at this point: wait for a token sent after the last
+  // call (or for the GPU to finish) first.
+  void Patch(u32 offset, u32 value);
+  void PatchFloat(u32 offset, float value);
+
+  // Makes the GPU execute the finished list. If the shadow state is enabled, it forgets about
+  // the registers loaded by the list.
+  void Call() const;
+
+  // Size of the finished list, including padding
+  u32 GetFinishedSize() const { return m_size; }
+
+private:
+  u8* m_data;
+  u32 m_size;
+
+  // Registers loaded by the finished list
+  std::vector<u8> m_bp_regs;
+  std::vector<u8> m_cp_regs;
+  std::vector<std::pair<u16, u32>> m_xf_ranges;  // address, count
+};
@@ -0,0 +1,250 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/EfbFormat.h"
+
+#include "gxtest/BPMemory.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace EfbFormat
+{
+// Ordered dither matrix, indexed by [y & 1][x & 1]
+static const int DITHER_MATRIX[2][2] = {{0, 2}, {3, 1}};
+
+// Number of bits of the red, green, blue and alpha components of a format
+static void GetComponentBits(int format, int* bits)
+{
+  switch (format)
+  {
+  case PIXELFMT_RGBA6_Z24:
+    bits[0] = bits[1] = bits[2] = bits[3] = 6;
+    break;
+  case PIXELFMT_RGB565_Z16:
+    bits[0] = 5;
+    bits[1] = 6;
+    bits[2] = 5;
+    bits[3] = 0;
+    break;
+  default:
+    bits[0] = bits[1] = bits[2] = 8;
+    bits[3] = 0;
+    break;
+  }
+}
+
+static u8 Expand(u32 value, int bits)
+{
+  return (u8)((value << (8 - bits)) | (value >> (2 * bits - 8)));
+}
+
+u32 EncodeColor(int format, const u8* rgba, int x, int y, bool dither)
+{
+  int bits[4];
+  GetComponentBits(format, bits);
+  const int offset = DITHER_MATRIX[y & 1][x & 1];
+
+  u32 value = 0;
+  for (int component = 0; component < 4; ++component)
+  {
+    if (bits[component] == 0)
+      continue;
+
+    int component_value = rgba[component];
+    if (dither && bits[component] < 8 && component < 3)
+    {
+      component_value = component_value - (component_value >> bits[component]) +
+                        offset * (1 << (8 - bits[component])) / 4;
+    }
+    value = (value << bits[component]) | (component_value >> (8 - bits[component]));
+  }
+  return value;
+}
+
+void DecodeColor(int format, u32 value, u8* rgba)
+{
+  int bits[4];
+  GetComponentBits(format, bits);
+
+  rgba[3] = 255;
+  for (int component = 3; component >= 0; --component)
+  {
+    if (bits[component] == 0)
+      continue;
+
+    const u32 component_value = value & ((1 << bits[component]) - 1);
+    rgba[component] = (bits[component] == 8) ? component_value : Expand(component_value,
+                                                                          bits[component]);
+    value >>= bits[component];
+  }
+}
+
+void EncodeRowScalar(int format, bool dither, int x, int y, int count, const u8* rgba,
+                     u32* values)
+{
+  for (int i = 0; i < count; ++i)
+    values[i] = EncodeColor(format, rgba + 4 * i, x + i, y, dither);
+}
+
+void DecodeRowScalar(int format, int count, const u32* values, u8* rgba)
+{
+  for (int i = 0; i < count; ++i)
+    DecodeColor(format, values[i], rgba + 4 * i);
+}
+
+#if defined(__SSE2__)
+
+// Pixels are handled four at a time as 32 bit lanes of R | G << 8 | B << 16 | A << 24.
+// There are no shifts of single bytes, so these are done on 16 bit lanes and masked.
+static inline __m128i ShiftBytesRight(__m128i value, int shift)
+{
+  return _mm_and_si128(_mm_srli_epi16(value, shift), _mm_set1_epi8((char)(0xFF >> shift)));
+}
+
+// Dither offsets of four pixels starting at column x, one byte per component
+static __m128i GetDitherOffsets(int format, int x, int y)
+{
+  int bits[4];
+  GetComponentBits(format, bits);
+
+  u8 offsets[16] = {};
+  for (int pixel = 0; pixel < 4; ++pixel)
+  {
+    for (int component = 0; component < 3; ++component)
+    {
+      if (bits[component] < 8)
+      {
+        offsets[4 * pixel + component] =
+            DITHER_MATRIX[y & 1][(x + pixel) & 1] * (1 << (8 - bits[component])) / 4;
+      }
+    }
+  }
+  return _mm_loadu_si128((const __m128i*)offsets);
+}
+
+// Applies the dither offsets to the red, green and blue bytes of four pixels
+static inline __m128i Dither(int format, __m128i colors, __m128i offsets)
+{
+  // value >> bits of every component which is dithered
+  __m128i carry;
+  if (format == PIXELFMT_RGB565_Z16)
+  {
+    const __m128i green = _mm_set1_epi32(0x0000FF00);
+    const __m128i red_blue = _mm_set1_epi32(0x00FF00FF);
+    carry = _mm_or_si128(_mm_and_si128(ShiftBytesRight(colors, 6), green),
+                         _mm_and_si128(ShiftBytesRight(colors, 5), red_blue));
+  }
+  else
+  {
+    carry = _mm_and_si128(ShiftBytesRight(colors, 6), _mm_set1_epi32(0x00FFFFFF));
+  }
+
+  // Can't overflow, as the offset is never larger than the carry subtracted from 255
+  return _mm_add_epi8(_mm_sub_epi8(colors, carry), offsets);
+}
+
+static inline __m128i Pack(int format, __m128i colors)
+{
+  switch (format)
+  {
+  case PIXELFMT_RGBA6_Z24:
+    return _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0xFC)), 16),
+                     _mm_slli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0xFC00)), 2)),
+        _mm_or_si128(_mm_srli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0xFC0000)), 12),
+                     _mm_srli_epi32(colors, 26)));
+  case PIXELFMT_RGB565_Z16:
+    return _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0xF8)), 8),
+                     _mm_srli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0xFC00)), 5)),
+        _mm_srli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0xF80000)), 19));
+  default:
+    // Red and blue swap places
+    return _mm_or_si128(
+        _mm_or_si128(_mm_slli_epi32(_mm_and_si128(colors, _mm_set1_epi32(0xFF)), 16),
+                     _mm_and_si128(colors, _mm_set1_epi32(0xFF00))),
+        _mm_and_si128(_mm_srli_epi32(colors, 16), _mm_set1_epi32(0xFF)));
+  }
+}
+
+// Each line combines the upper and the repeated bits of one component
+static inline __m128i Unpack(int format, __m128i values)
+{
+  const auto bits = [&](__m128i shifted, u32 mask) {
+    return _mm_and_si128(shifted, _mm_set1_epi32(mask));
+  };
+
+  switch (format)
+  {
+  case PIXELFMT_RGBA6_Z24:
+    return _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(bits(_mm_srli_epi32(values, 16), 0xFC),
+                                  bits(_mm_srli_epi32(values, 22), 0x03)),
+                     _mm_or_si128(bits(_mm_srli_epi32(values, 2), 0xFC00),
+                                  bits(_mm_srli_epi32(values, 8), 0x0300))),
+        _mm_or_si128(_mm_or_si128(bits(_mm_slli_epi32(values, 12), 0xFC0000),
+                                  bits(_mm_slli_epi32(values, 6), 0x030000)),
+                     _mm_or_si128(_mm_slli_epi32(values, 26),
+                                  bits(_mm_slli_epi32(values, 20), 0x03000000))));
+  case PIXELFMT_RGB565_Z16:
+    return _mm_or_si128(
+        _mm_or_si128(_mm_or_si128(bits(_mm_srli_epi32(values, 8), 0xF8),
+                                  bits(_mm_srli_epi32(values, 13), 0x07)),
+                     _mm_or_si128(bits(_mm_slli_epi32(values, 5), 0xFC00),
+                                  bits(_mm_srli_epi32(values, 1), 0x0300))),
+        _mm_or_si128(_mm_or_si128(bits(_mm_slli_epi32(values, 19), 0xF80000),
+                                  bits(_mm_slli_epi32(values, 14), 0x070000)),
+                     _mm_set1_epi32(0xFF000000)));
+  default:
+    return _mm_or_si128(
+        _mm_or_si128(bits(_mm_srli_epi32(values, 16), 0xFF), bits(values, 0xFF00)),
+        _mm_or_si128(bits(_mm_slli_epi32(values, 16), 0xFF0000), _mm_set1_epi32(0xFF000000)));
+  }
+}
+
+void EncodeRow(int format, bool dither, int x, int y, int count, const u8* rgba, u32* values)
+{
+  // Four is a multiple of the matrix width, so all groups of a row use the same offsets
+  const __m128i offsets = GetDitherOffsets(format, x, y);
+  dither = dither && format != PIXELFMT_RGB8_Z24;
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i colors = _mm_loadu_si128((const __m128i*)(rgba + 4 * i));
+    if (dither)
+      colors = Dither(format, colors, offsets);
+    _mm_storeu_si128((__m128i*)(values + i), Pack(format, colors));
+  }
+  EncodeRowScalar(format, dither, x + i, y, count - i, rgba + 4 * i, values + i);
+}
+
+void DecodeRow(int format, int count, const u32* values, u8* rgba)
+{
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    const __m128i stored = _mm_loadu_si128((const __m128i*)(values + i));
+    _mm_storeu_si128((__m128i*)(rgba + 4 * i), Unpack(format, stored));
+  }
+  DecodeRowScalar(format, count - i, values + i, rgba + 4 * i);
+}
+
+#else
+
+void EncodeRow(int format, bool dither, int x, int y, int count, const u8* rgba, u32* values)
+{
+  EncodeRowScalar(format, dither, x, y, count, rgba, values);
+}
+
+void DecodeRow(int format, int count, const u32* values, u8* rgba)
+{
+  DecodeRowScalar(format, count, values, rgba);
+}
+
+#endif
+
+}  // namespace EfbFormat
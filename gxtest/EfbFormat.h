@@ -0,0 +1,54 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/CommonTypes.h"
+
+// Model of how colors are stored in the EFB in each of the PE_CONTROL pixel formats
+// (PIXELFMT_RGB8_Z24, PIXELFMT_RGBA6_Z24 and PIXELFMT_RGB565_Z16) and how EFB copies expand
+// them to 8 bits again:
+//
+//   u32 value = EfbFormat::EncodeColor(PIXELFMT_RGBA6_Z24, tev_output, x, y, dither);
+//   EfbFormat::DecodeColor(PIXELFMT_RGBA6_Z24, value, copied);
+//
+// Colors are stored with R, G, B, A bytes per pixel, like in TextureDecoder. The TEV output is
+// written to the EFB with the lower 8 bits of each component, which is what the color passed to
+// EncodeColor is expected to contain already.
+//
+// Components are truncated to the number of bits of the format on write. With dithering
+// enabled in BPMEM_BLENDMODE, a 2x2 ordered dither matrix is added to the red, green and blue
+// components of formats with less than 8 bits before truncation, like in Dolphin:
+//
+//   value = value - (value >> bits) + matrix[y & 1][x & 1] * (1 << (8 - bits)) / 4
+//
+// with the matrix {{0, 2}, {3, 1}}. Formats without alpha ignore it on write and return 255
+// on copies. EFB copies expand components to 8 bits by repeating their upper bits, e.g.
+// (value << 2) | (value >> 4) for 6 bits. Stored values have the components ordered from red
+// in the most significant bits to blue (or alpha) in the least significant ones.
+
+namespace EfbFormat
+{
+// Value stored in the EFB for the given 8 bit TEV output at pixel (x, y)
+u32 EncodeColor(int format, const u8* rgba, int x, int y, bool dither);
+
+// Color returned by an RGBA8 EFB copy of the given stored value
+void DecodeColor(int format, u32 value, u8* rgba);
+
+// Converts `count` pixels of row y, starting at column x, from 8 bit TEV outputs (4 bytes per
+// pixel) to stored values. This uses the fastest implementation available for the target.
+void EncodeRow(int format, bool dither, int x, int y, int count, const u8* rgba, u32* values);
+
+// Reference implementation of EncodeRow, one pixel at a time
+void EncodeRowScalar(int format, bool dither, int x, int y, int count, const u8* rgba,
+                     u32* values);
+
+// Converts `count` stored values to the colors returned by EFB copies (4 bytes per pixel).
+// This uses the fastest implementation available for the target.
+void DecodeRow(int format, int count, const u32* values, u8* rgba);
+
+// Reference implementation of DecodeRow, one pixel at a time
+void DecodeRowScalar(int format, int count, const u32* values, u8* rgba);
+
+}  // namespace EfbFormat
@@ -0,0 +1,397 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/FifoDecoder.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+namespace FifoDecoder
+{
+static_assert(sizeof(BPMemory) == 0x100 * 4, "BPMemory must cover all BP registers");
+static_assert(sizeof(XFRegisters) == 0x100 * 4, "XFRegisters must cover all XF registers");
+
+// Sizes of the vertex component formats, in bytes
+static const u8 COMPONENT_SIZES[8] = {1, 1, 2, 2, 4, 0, 0, 0};
+static const u8 COLOR_SIZES[8] = {2, 3, 4, 2, 3, 4, 0, 0};
+
+// Size of an indexed or direct attribute with the given number of direct components
+static u32 GetAttributeSize(u32 mode, u32 direct_size)
+{
+  switch (mode)
+  {
+  case DIRECT:
+    return direct_size;
+  case INDEX8:
+    return 1;
+  case INDEX16:
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+u32 GetVertexSize(const TVtxDesc& vtx_desc, const VAT& vtx_attr)
+{
+  const UVAT_group0& g0 = vtx_attr.g0;
+  const UVAT_group1& g1 = vtx_attr.g1;
+  const UVAT_group2& g2 = vtx_attr.g2;
+
+  // Matrix indices are always sent directly, as a single byte
+  u32 size = 0;
+  for (int i = 0; i < 9; ++i)
+    size += (vtx_desc.Hex >> i) & 1;
+
+  size += GetAttributeSize(vtx_desc.Position,
+                           (g0.PosElements ? 3 : 2) * COMPONENT_SIZES[g0.PosFormat]);
+
+  // Normals, or normals with binormal and tangent (NBT). The latter can use separate indices.
+  const u32 normal_count = g0.NormalElements ? 3 : 1;
+  if (vtx_desc.Normal == DIRECT)
+    size += normal_count * 3 * COMPONENT_SIZES[g0.NormalFormat];
+  else
+    size += GetAttributeSize(vtx_desc.Normal, 0) * (g0.NormalIndex3 ? normal_count : 1);
+
+  size += GetAttributeSize(vtx_desc.Color0, COLOR_SIZES[g0.Color0Comp]);
+  size += GetAttributeSize(vtx_desc.Color1, COLOR_SIZES[g0.Color1Comp]);
+
+  const u32 tex_elements[8] = {g0.Tex0CoordElements, g1.Tex1CoordElements,
+                               g1.Tex2CoordElements, g1.Tex3CoordElements,
+                               g1.Tex4CoordElements, g2.Tex5CoordElements,
+                               g2.Tex6CoordElements, g2.Tex7CoordElements};
+  const u32 tex_formats[8] = {g0.Tex0CoordFormat, g1.Tex1CoordFormat, g1.Tex2CoordFormat,
+                              g1.Tex3CoordFormat, g1.Tex4CoordFormat, g2.Tex5CoordFormat,
+                              g2.Tex6CoordFormat, g2.Tex7CoordFormat};
+  for (int i = 0; i < 8; ++i)
+  {
+    const u32 mode = (vtx_desc.Hex >> (17 + 2 * i)) & 3;
+    size += GetAttributeSize(mode, (tex_elements[i] + 1) * COMPONENT_SIZES[tex_formats[i]]);
+  }
+
+  return size;
+}
+
+void Disassembler::Print(const char* format, ...)
+{
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  m_output->append(buffer);
+}
+
+void Disassembler::OnNop()
+{
+  Print("NOP\n");
+}
+
+void Disassembler::OnBP(u8 reg, u32 /*old_value*/, u32 new_value)
+{
+  Print("BP   %02x %-20s %06x\n", reg, GetBPRegisterName(reg), new_value);
+}
+
+void Disassembler::OnCP(u8 reg, u32 value)
+{
+  Print("CP   %02x %-20s %08x\n", reg, GetCPRegisterName(reg), value);
+}
+
+void Disassembler::OnXF(u16 address, u32 count, const u8* data)
+{
+  for (u32 i = 0; i < count; ++i)
+  {
+    const u32 value = (data[4 * i] << 24) | (data[4 * i + 1] << 16) | (data[4 * i + 2] << 8) |
+                      data[4 * i + 3];
+    float value_float;
+    memcpy(&value_float, &value, sizeof(float));
+    Print("XF %04x %-20s %08x (%g)\n", address + i, GetXFAddressName(address + i), value,
+          value_float);
+  }
+}
+
+void Disassembler::OnIndexedXF(int array, u32 value)
+{
+  // Index in the upper 16 bits, XF address in the lower 12 bits and size - 1 in between
+  Print("LOAD_INDX_%c index %u -> XF %03x, %u words\n", 'A' + array, value >> 16,
+        value & 0xFFF, ((value >> 12) & 0xF) + 1);
+}
+
+void Disassembler::OnCallDisplayList(u32 address, u32 size)
+{
+  Print("CALL_DL %08x, %u bytes\n", address, size);
+}
+
+void Disassembler::OnInvalidateVertexCache()
+{
+  Print("INVALIDATE_VTX_CACHE\n");
+}
+
+void Disassembler::OnDraw(int primitive, int vat, u16 num_vertices, const u8* /*vertices*/,
+                          u32 size)
+{
+  Print("DRAW %s VAT %d, %u vertices, %u bytes\n", GetPrimitiveName(primitive), vat,
+        num_vertices, size);
+}
+
+void Disassembler::OnUnknown(u8 opcode)
+{
+  Print("UNKNOWN %02x\n", opcode);
+}
+
+std::string Disassemble(const u8* data, u32 size)
+{
+  std::string output;
+  Disassembler disassembler(&output);
+  Decoder<Disassembler> decoder(&disassembler);
+  decoder.Decode(data, size);
+  return output;
+}
+
+const char* GetBPRegisterName(u8 reg)
+{
+  switch (reg)
+  {
+  case BPMEM_GENMODE:
+    return "GENMODE";
+  case BPMEM_IND_IMASK:
+    return "IND_IMASK";
+  case BPMEM_SCISSORTL:
+    return "SCISSORTL";
+  case BPMEM_SCISSORBR:
+    return "SCISSORBR";
+  case BPMEM_LINEPTWIDTH:
+    return "LINEPTWIDTH";
+  case BPMEM_PERF0_TRI:
+    return "PERF0_TRI";
+  case BPMEM_PERF0_QUAD:
+    return "PERF0_QUAD";
+  case BPMEM_RAS1_SS0:
+    return "RAS1_SS0";
+  case BPMEM_RAS1_SS1:
+    return "RAS1_SS1";
+  case BPMEM_IREF:
+    return "IREF";
+  case BPMEM_ZMODE:
+    return "ZMODE";
+  case BPMEM_BLENDMODE:
+    return "BLENDMODE";
+  case BPMEM_CONSTANTALPHA:
+    return "CONSTANTALPHA";
+  case BPMEM_ZCOMPARE:
+    return "ZCOMPARE";
+  case BPMEM_FIELDMASK:
+    return "FIELDMASK";
+  case BPMEM_SETDRAWDONE:
+    return "SETDRAWDONE";
+  case BPMEM_BUSCLOCK0:
+    return "BUSCLOCK0";
+  case BPMEM_PE_TOKEN_ID:
+    return "PE_TOKEN_ID";
+  case BPMEM_PE_TOKEN_INT_ID:
+    return "PE_TOKEN_INT_ID";
+  case BPMEM_EFB_TL:
+    return "EFB_TL";
+  case BPMEM_EFB_BR:
+    return "EFB_BR";
+  case BPMEM_EFB_ADDR:
+    return "EFB_ADDR";
+  case BPMEM_MIPMAP_STRIDE:
+    return "MIPMAP_STRIDE";
+  case BPMEM_COPYYSCALE:
+    return "COPYYSCALE";
+  case BPMEM_CLEAR_AR:
+    return "CLEAR_AR";
+  case BPMEM_CLEAR_GB:
+    return "CLEAR_GB";
+  case BPMEM_CLEAR_Z:
+    return "CLEAR_Z";
+  case BPMEM_TRIGGER_EFB_COPY:
+    return "TRIGGER_EFB_COPY";
+  case BPMEM_COPYFILTER0:
+    return "COPYFILTER0";
+  case BPMEM_COPYFILTER1:
+    return "COPYFILTER1";
+  case BPMEM_CLEARBBOX1:
+    return "CLEARBBOX1";
+  case BPMEM_CLEARBBOX2:
+    return "CLEARBBOX2";
+  case BPMEM_CLEAR_PIXEL_PERF:
+    return "CLEAR_PIXEL_PERF";
+  case BPMEM_REVBITS:
+    return "REVBITS";
+  case BPMEM_SCISSOROFFSET:
+    return "SCISSOROFFSET";
+  case BPMEM_PRELOAD_ADDR:
+    return "PRELOAD_ADDR";
+  case BPMEM_PRELOAD_TMEMEVEN:
+    return "PRELOAD_TMEMEVEN";
+  case BPMEM_PRELOAD_TMEMODD:
+    return "PRELOAD_TMEMODD";
+  case BPMEM_PRELOAD_MODE:
+    return "PRELOAD_MODE";
+  case BPMEM_LOADTLUT0:
+    return "LOADTLUT0";
+  case BPMEM_LOADTLUT1:
+    return "LOADTLUT1";
+  case BPMEM_TEXINVALIDATE:
+    return "TEXINVALIDATE";
+  case BPMEM_PERF1:
+    return "PERF1";
+  case BPMEM_FIELDMODE:
+    return "FIELDMODE";
+  case BPMEM_BUSCLOCK1:
+    return "BUSCLOCK1";
+  case BPMEM_FOGPARAM0:
+    return "FOGPARAM0";
+  case BPMEM_FOGBMAGNITUDE:
+    return "FOGBMAGNITUDE";
+  case BPMEM_FOGBEXPONENT:
+    return "FOGBEXPONENT";
+  case BPMEM_FOGPARAM3:
+    return "FOGPARAM3";
+  case BPMEM_FOGCOLOR:
+    return "FOGCOLOR";
+  case BPMEM_ALPHACOMPARE:
+    return "ALPHACOMPARE";
+  case BPMEM_BIAS:
+    return "BIAS";
+  case BPMEM_ZTEX2:
+    return "ZTEX2";
+  case BPMEM_BP_MASK:
+    return "BP_MASK";
+  }
+
+  // Register arrays
+  if (reg >= BPMEM_DISPLAYCOPYFILER && reg < BPMEM_DISPLAYCOPYFILER + 4)
+    return "DISPLAYCOPYFILTER";
+  if (reg >= BPMEM_IND_MTXA && reg < BPMEM_IND_MTXA + 9)
+    return "IND_MTX";
+  if (reg >= BPMEM_IND_CMD && reg < BPMEM_IND_CMD + 16)
+    return "IND_CMD";
+  if (reg >= BPMEM_TREF && reg < BPMEM_TREF + 8)
+    return "TREF";
+  if (reg >= BPMEM_SU_SSIZE && reg < BPMEM_SU_SSIZE + 16)
+    return (reg & 1) ? "SU_TSIZE" : "SU_SSIZE";
+  if (reg >= BPMEM_TX_SETMODE0 && reg < BPMEM_TEV_COLOR_ENV)
+  {
+    static const char* const names[] = {"TX_SETMODE0", "TX_SETMODE1",  "TX_SETIMAGE0",
+                                        "TX_SETIMAGE1", "TX_SETIMAGE2", "TX_SETIMAGE3",
+                                        "TX_SETTLUT",   "UNKNOWN"};
+    return names[(reg >> 2) & 7];
+  }
+  if (reg >= BPMEM_TEV_COLOR_ENV && reg < BPMEM_TEV_COLOR_ENV + 32)
+    return (reg & 1) ? "TEV_ALPHA_ENV" : "TEV_COLOR_ENV";
+  if (reg >= BPMEM_TEV_REGISTER_L && reg < BPMEM_TEV_REGISTER_L + 8)
+    return (reg & 1) ? "TEV_REGISTER_H" : "TEV_REGISTER_L";
+  if (reg >= BPMEM_FOGRANGE && reg < BPMEM_FOGRANGE + 6)
+    return "FOGRANGE";
+  if (reg >= BPMEM_TEV_KSEL && reg < BPMEM_TEV_KSEL + 8)
+    return "TEV_KSEL";
+
+  return "UNKNOWN";
+}
+
+const char* GetCPRegisterName(u8 reg)
+{
+  switch (reg & 0xF0)
+  {
+  case MATINDEX_A:
+    return "MATINDEX_A";
+  case MATINDEX_B:
+    return "MATINDEX_B";
+  case VCD_LO:
+    return "VCD_LO";
+  case VCD_HI:
+    return "VCD_HI";
+  case CP_VAT_REG_A:
+    return "VAT_A";
+  case CP_VAT_REG_B:
+    return "VAT_B";
+  case CP_VAT_REG_C:
+    return "VAT_C";
+  case ARRAY_BASE:
+    return "ARRAY_BASE";
+  case ARRAY_STRIDE:
+    return "ARRAY_STRIDE";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+const char* GetXFAddressName(u16 address)
+{
+  if (address < XFMEM_POSMATRICES_END)
+    return "POSMATRICES";
+  if (address >= XFMEM_NORMALMATRICES && address < XFMEM_NORMALMATRICES_END)
+    return "NORMALMATRICES";
+  if (address >= XFMEM_POSTMATRICES && address < XFMEM_POSTMATRICES_END)
+    return "POSTMATRICES";
+  if (address >= XFMEM_LIGHTS && address < XFMEM_LIGHTS_END)
+    return "LIGHTS";
+  if (address >= XFMEM_SETVIEWPORT && address < XFMEM_SETPROJECTION)
+    return "SETVIEWPORT";
+  if (address >= XFMEM_SETPROJECTION && address < XFMEM_SETPROJECTION + 7)
+    return "SETPROJECTION";
+  if (address >= XFMEM_SETTEXMTXINFO && address < XFMEM_SETTEXMTXINFO + 8)
+    return "SETTEXMTXINFO";
+  if (address >= XFMEM_SETPOSMTXINFO && address < XFMEM_SETPOSMTXINFO + 8)
+    return "SETPOSMTXINFO";
+
+  switch (address)
+  {
+  case XFMEM_ERROR:
+    return "ERROR";
+  case XFMEM_DIAG:
+    return "DIAG";
+  case XFMEM_STATE0:
+    return "STATE0";
+  case XFMEM_STATE1:
+    return "STATE1";
+  case XFMEM_CLOCK:
+    return "CLOCK";
+  case XFMEM_CLIPDISABLE:
+    return "CLIPDISABLE";
+  case XFMEM_SETGPMETRIC:
+    return "SETGPMETRIC";
+  case XFMEM_VTXSPECS:
+    return "VTXSPECS";
+  case XFMEM_SETNUMCHAN:
+    return "SETNUMCHAN";
+  case XFMEM_SETCHAN0_AMBCOLOR:
+    return "SETCHAN0_AMBCOLOR";
+  case XFMEM_SETCHAN1_AMBCOLOR:
+    return "SETCHAN1_AMBCOLOR";
+  case XFMEM_SETCHAN0_MATCOLOR:
+    return "SETCHAN0_MATCOLOR";
+  case XFMEM_SETCHAN1_MATCOLOR:
+    return "SETCHAN1_MATCOLOR";
+  case XFMEM_SETCHAN0_COLOR:
+    return "SETCHAN0_COLOR";
+  case XFMEM_SETCHAN1_COLOR:
+    return "SETCHAN1_COLOR";
+  case XFMEM_SETCHAN0_ALPHA:
+    return "SETCHAN0_ALPHA";
+  case XFMEM_SETCHAN1_ALPHA:
+    return "SETCHAN1_ALPHA";
+  case XFMEM_DUALTEX:
+    return "DUALTEX";
+  case XFMEM_SETMATRIXINDA:
+    return "SETMATRIXINDA";
+  case XFMEM_SETMATRIXINDB:
+    return "SETMATRIXINDB";
+  case XFMEM_SETNUMTEXGENS:
+    return "SETNUMTEXGENS";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+const char* GetPrimitiveName(int primitive)
+{
+  static const char* const names[] = {"QUADS",      "QUADS_2",   "TRIANGLES",  "TRIANGLE_STRIP",
+                                      "TRIANGLE_FAN", "LINES", "LINE_STRIP", "POINTS"};
+  return names[primitive & 7];
+}
+
+}  // namespace FifoDecoder
@@ -0,0 +1,343 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string.h>
+#include <string>
+
+#include "common/CommonTypes.h"
+#include "gxtest/BPMemory.h"
+#include "gxtest/CPMemory.h"
+#include "gxtest/XFMemory.h"
+
+// Decoder for GX command streams, as recorded by FifoRecorder or found in Dolphin FIFO logs.
+// Register loads are applied to BPMemory, the CP vertex format registers and XF memory, and are
+// reported to a handler together with draws and all other commands. Vertex data is not decoded,
+// but its size is derived from the current vertex format so that draws can be skipped quickly.
+
+namespace FifoDecoder
+{
+// Command opcodes
+enum
+{
+  OPCODE_NOP = 0x00,
+  OPCODE_LOAD_CP_REG = 0x08,
+  OPCODE_LOAD_XF_REG = 0x10,
+  OPCODE_LOAD_INDX_A = 0x20,
+  OPCODE_LOAD_INDX_B = 0x28,
+  OPCODE_LOAD_INDX_C = 0x30,
+  OPCODE_LOAD_INDX_D = 0x38,
+  OPCODE_CALL_DL = 0x40,
+  OPCODE_INVALIDATE_VTX_CACHE = 0x48,
+  OPCODE_LOAD_BP_REG = 0x61,
+  OPCODE_DRAW = 0x80,  // 0x80 - 0xbf: primitive type in bits 3-5, VAT index in bits 0-2
+};
+
+// Primitive types, i.e. bits 3-5 of draw opcodes
+enum
+{
+  PRIMITIVE_QUADS = 0,
+  PRIMITIVE_QUADS_2 = 1,
+  PRIMITIVE_TRIANGLES = 2,
+  PRIMITIVE_TRIANGLE_STRIP = 3,
+  PRIMITIVE_TRIANGLE_FAN = 4,
+  PRIMITIVE_LINES = 5,
+  PRIMITIVE_LINE_STRIP = 6,
+  PRIMITIVE_POINTS = 7,
+};
+
+// GPU state built up from the decoded register loads
+struct State
+{
+  union
+  {
+    BPMemory bp;
+    u32 bp_regs[0x100];  // 24 bit values, without the register address
+  };
+
+  union
+  {
+    XFRegisters xf;
+    u32 xf_regs[0x100];  // 0x1000 - 0x10ff
+  };
+
+  u32 xf_memory[0x800];  // Matrices and lights, 0x0000 - 0x07ff
+
+  TMatrixIndexA matrix_index_a;
+  TMatrixIndexB matrix_index_b;
+  TVtxDesc vtx_desc;
+  VAT vtx_attr[8];
+  u32 array_bases[16];
+  u32 array_strides[16];
+};
+
+// Size in bytes of a single vertex sent with the given vertex format
+u32 GetVertexSize(const TVtxDesc& vtx_desc, const VAT& vtx_attr);
+
+// Handler which ignores everything. Handlers passed to Decoder need to provide all of these
+// functions, which is easiest done by deriving from this class and hiding the ones of interest.
+// Calls are resolved at compile time, so unused callbacks cost nothing.
+class NullHandler
+{
+public:
+  void OnNop() {}
+  // Called after the (masked) write has been applied to the state
+  void OnBP(u8 /*reg*/, u32 /*old_value*/, u32 /*new_value*/) {}
+  void OnCP(u8 /*reg*/, u32 /*value*/) {}
+  // data points to count big-endian words, which have already been applied to the state
+  void OnXF(u16 /*address*/, u32 /*count*/, const u8* /*data*/) {}
+  // array is 0 - 3 for OPCODE_LOAD_INDX_A - D
+  void OnIndexedXF(int /*array*/, u32 /*value*/) {}
+  void OnCallDisplayList(u32 /*address*/, u32 /*size*/) {}
+  void OnInvalidateVertexCache() {}
+  void OnDraw(int /*primitive*/, int /*vat*/, u16 /*num_vertices*/, const u8* /*vertices*/,
+              u32 /*size*/)
+  {
+  }
+  // Unknown opcodes are skipped as if they were a single byte
+  void OnUnknown(u8 /*opcode*/) {}
+};
+
+template <typename Handler>
+class Decoder
+{
+public:
+  explicit Decoder(Handler* handler) : m_handler(handler) { Reset(); }
+
+  Decoder(const Decoder&) = delete;
+  Decoder& operator=(const Decoder&) = delete;
+
+  // Sets all registers to zero and the BP mask to 0xffffff
+  void Reset()
+  {
+    memset(&m_state, 0, sizeof(m_state));
+    m_state.bp.bpMask = 0xFFFFFF;
+    m_vertex_sizes_dirty = true;
+  }
+
+  const State& GetState() const { return m_state; }
+
+  // Decodes all complete commands in the given data and returns the number of bytes used.
+  // A command which is cut off at the end is not consumed, so that it can be passed again
+  // together with the following data.
+  u32 Decode(const u8* data, u32 size)
+  {
+    const u8* p = data;
+    const u8* const end = data + size;
+
+    while (p < end)
+    {
+      const u8 opcode = *p;
+      const u32 available = (u32)(end - p) - 1;
+      const u8* payload = p + 1;
+
+      switch (opcode)
+      {
+      case OPCODE_NOP:
+        m_handler->OnNop();
+        p = payload;
+        break;
+
+      case OPCODE_LOAD_CP_REG:
+        if (available < 5)
+          return (u32)(p - data);
+        LoadCPReg(payload[0], ReadU32(payload + 1));
+        p = payload + 5;
+        break;
+
+      case OPCODE_LOAD_XF_REG:
+      {
+        if (available < 4)
+          return (u32)(p - data);
+        const u32 header = ReadU32(payload);
+        const u32 count = ((header >> 16) & 0xF) + 1;
+        if (available < 4 + count * 4)
+          return (u32)(p - data);
+        LoadXFRegs(header & 0xFFFF, count, payload + 4);
+        p = payload + 4 + count * 4;
+        break;
+      }
+
+      case OPCODE_LOAD_INDX_A:
+      case OPCODE_LOAD_INDX_B:
+      case OPCODE_LOAD_INDX_C:
+      case OPCODE_LOAD_INDX_D:
+        if (available < 4)
+          return (u32)(p - data);
+        m_handler->OnIndexedXF((opcode - OPCODE_LOAD_INDX_A) >> 3, ReadU32(payload));
+        p = payload + 4;
+        break;
+
+      case OPCODE_CALL_DL:
+        if (available < 8)
+          return (u32)(p - data);
+        m_handler->OnCallDisplayList(ReadU32(payload), ReadU32(payload + 4));
+        p = payload + 8;
+        break;
+
+      case OPCODE_INVALIDATE_VTX_CACHE:
+        m_handler->OnInvalidateVertexCache();
+        p = payload;
+        break;
+
+      case OPCODE_LOAD_BP_REG:
+        if (available < 4)
+          return (u32)(p - data);
+        LoadBPReg(ReadU32(payload));
+        p = payload + 4;
+        break;
+
+      default:
+        if ((opcode & 0xC0) == OPCODE_DRAW)
+        {
+          if (available < 2)
+            return (u32)(p - data);
+          if (m_vertex_sizes_dirty)
+            UpdateVertexSizes();
+
+          const int vat = opcode & 7;
+          const u16 num_vertices = (payload[0] << 8) | payload[1];
+          const u32 vertices_size = num_vertices * m_vertex_sizes[vat];
+          if (available < 2 + vertices_size)
+            return (u32)(p - data);
+          m_handler->OnDraw((opcode >> 3) & 7, vat, num_vertices, payload + 2, vertices_size);
+          p = payload + 2 + vertices_size;
+        }
+        else
+        {
+          m_handler->OnUnknown(opcode);
+          p = payload;
+        }
+        break;
+      }
+    }
+
+    return size;
+  }
+
+private:
+  static u32 ReadU32(const u8* p)
+  {
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | (u32)p[3];
+  }
+
+  void LoadBPReg(u32 value)
+  {
+    const u8 reg = value >> 24;
+    const u32 old_value = m_state.bp_regs[reg];
+    const u32 mask = m_state.bp.bpMask;
+    const u32 new_value = (old_value & ~mask) | (value & mask & 0xFFFFFF);
+    m_state.bp_regs[reg] = new_value;
+
+    // The mask only applies to the write following it
+    if (reg != BPMEM_BP_MASK)
+      m_state.bp.bpMask = 0xFFFFFF;
+
+    m_handler->OnBP(reg, old_value, new_value);
+  }
+
+  void LoadCPReg(u8 reg, u32 value)
+  {
+    switch (reg & 0xF0)
+    {
+    case MATINDEX_A:
+      m_state.matrix_index_a.Hex = value;
+      break;
+    case MATINDEX_B:
+      m_state.matrix_index_b.Hex = value;
+      break;
+    case VCD_LO:
+      m_state.vtx_desc.Low = value;
+      m_vertex_sizes_dirty = true;
+      break;
+    case VCD_HI:
+      m_state.vtx_desc.High = value;
+      m_vertex_sizes_dirty = true;
+      break;
+    case CP_VAT_REG_A:
+      m_state.vtx_attr[reg & 7].g0.Hex = value;
+      m_vertex_sizes_dirty = true;
+      break;
+    case CP_VAT_REG_B:
+      m_state.vtx_attr[reg & 7].g1.Hex = value;
+      m_vertex_sizes_dirty = true;
+      break;
+    case CP_VAT_REG_C:
+      m_state.vtx_attr[reg & 7].g2.Hex = value;
+      m_vertex_sizes_dirty = true;
+      break;
+    case ARRAY_BASE:
+      m_state.array_bases[reg & 0xF] = value;
+      break;
+    case ARRAY_STRIDE:
+      m_state.array_strides[reg & 0xF] = value;
+      break;
+    }
+
+    m_handler->OnCP(reg, value);
+  }
+
+  void LoadXFRegs(u16 address, u32 count, const u8* data)
+  {
+    for (u32 i = 0; i < count; ++i)
+    {
+      const u32 word_address = address + i;
+      if (word_address < 0x800)
+        m_state.xf_memory[word_address] = ReadU32(data + 4 * i);
+      else if ((word_address & ~0xFF) == XFMEM_REGISTERS_START)
+        m_state.xf_regs[word_address & 0xFF] = ReadU32(data + 4 * i);
+    }
+
+    m_handler->OnXF(address, count, data);
+  }
+
+  void UpdateVertexSizes()
+  {
+    for (int vat = 0; vat < 8; ++vat)
+      m_vertex_sizes[vat] = GetVertexSize(m_state.vtx_desc, m_state.vtx_attr[vat]);
+    m_vertex_sizes_dirty = false;
+  }
+
+  Handler* m_handler;
+  State m_state;
+  u32 m_vertex_sizes[8];
+  bool m_vertex_sizes_dirty;
+};
+
+// Handler which writes one line of text per command
+class Disassembler : public NullHandler
+{
+public:
+  explicit Disassembler(std::string* output) : m_output(output) {}
+
+  void OnNop();
+  void OnBP(u8 reg, u32 old_value, u32 new_value);
+  void OnCP(u8 reg, u32 value);
+  void OnXF(u16 address, u32 count, const u8* data);
+  void OnIndexedXF(int array, u32 value);
+  void OnCallDisplayList(u32 address, u32 size);
+  void OnInvalidateVertexCache();
+  void OnDraw(int primitive, int vat, u16 num_vertices, const u8* vertices, u32 size);
+  void OnUnknown(u8 opcode);
+
+private:
+  void Print(const char* format, ...)
+#ifndef _MSC_VER
+      __attribute__((__format__(printf, 2, 3)))
+#endif
+      ;
+
+  std::string* m_output;
+};
+
+// Disassembles all complete commands in the given data
+std::string Disassemble(const u8* data, u32 size);
+
+const char* GetBPRegisterName(u8 reg);
+const char* GetCPRegisterName(u8 reg);
+const char* GetXFAddressName(u16 address);
+const char* GetPrimitiveName(int primitive);
+
+}  // namespace FifoDecoder
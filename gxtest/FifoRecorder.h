@@ -0,0 +1,82 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <string.h>
+#include <vector>
+
+#include "common/CommonTypes.h"
+
+// Stand-in for the write-gather pipe which records everything written to it.
+// It exposes the same members as libogc's WGPipe union, so code templated on the pipe type
+// (e.g. "pipe->U32 = value;") can target either the hardware or a recorder.
+// Data is stored in the order the GPU would receive it, i.e. big-endian, and has no hardware
+// dependencies, so recordings can also be produced and inspected on a host.
+class FifoRecorder
+{
+public:
+  template <typename T>
+  class Port
+  {
+  public:
+    explicit Port(std::vector<u8>* data) : m_data(data) {}
+
+    Port(const Port&) = delete;
+
+    void operator=(T value)
+    {
+      u8 bytes[sizeof(T)];
+      memcpy(bytes, &value, sizeof(T));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      m_data->insert(m_data->end(), bytes, bytes + sizeof(T));
+#else
+      for (size_t i = sizeof(T); i > 0; --i)
+        m_data->push_back(bytes[i - 1]);
+#endif
+    }
+
+  private:
+    std::vector<u8>* m_data;
+  };
+
+  explicit FifoRecorder(size_t reserved_size = 64 * 1024)
+      : U8(&m_data), S8(&m_data), U16(&m_data), S16(&m_data), U32(&m_data), S32(&m_data),
+        F32(&m_data)
+  {
+    m_data.reserve(reserved_size);
+  }
+
+  FifoRecorder(const FifoRecorder&) = delete;
+  FifoRecorder& operator=(const FifoRecorder&) = delete;
+
+  void Clear() { m_data.clear(); }
+  // Drops everything recorded after the first size bytes
+  void Truncate(size_t size) { m_data.resize(size); }
+
+  // Replaces four recorded bytes with value, in the same order as U32 records it
+  void Overwrite(size_t offset, u32 value)
+  {
+    m_data[offset] = value >> 24;
+    m_data[offset + 1] = value >> 16;
+    m_data[offset + 2] = value >> 8;
+    m_data[offset + 3] = value;
+  }
+
+  const std::vector<u8>& Data() const { return m_data; }
+  size_t Size() const { return m_data.size(); }
+
+private:
+  // Declared before the ports, which keep a pointer to it
+  std::vector<u8> m_data;
+
+public:
+  Port<u8> U8;
+  Port<s8> S8;
+  Port<u16> U16;
+  Port<s16> S16;
+  Port<u32> U32;
+  Port<s32> S32;
+  Port<float> F32;
+};
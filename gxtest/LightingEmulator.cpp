@@ -0,0 +1,471 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/LightingEmulator.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "gxtest/cgx_defaults.h"
+
+namespace LightingEmulator
+{
+// Layout of Vertices::m_floats
+enum
+{
+  FLOAT_POSITION = 0,  // [x, y, z]
+  FLOAT_NORMAL = 3,    // [x, y, z]
+  FLOAT_SCALE = 6,     // Contribution of the current light, before its color is applied
+  FLOAT_LIGHT = 7,     // Accumulated light color of the current channel, [COMP_*]
+  NUM_FLOATS = FLOAT_LIGHT + 4,
+};
+
+// Layout of Vertices::m_colors
+enum
+{
+  COLOR_VERTEX = 0,  // [channel][COMP_*]
+  COLOR_OUTPUT = 8,  // [channel][COMP_*]
+  COLOR_LIGHT = 16,  // [channel][COMP_*]
+  NUM_COLORS = COLOR_LIGHT + 8,
+};
+
+// One float, the reference of the vector code
+struct ScalarFloats
+{
+  static const int WIDTH = 1;
+
+  static ScalarFloats Load(const float* values) { return {*values}; }
+  static ScalarFloats Set(float value) { return {value}; }
+  void Store(float* values) const { *values = v; }
+
+  float v;
+};
+
+static inline ScalarFloats operator+(ScalarFloats a, ScalarFloats b)
+{
+  return {a.v + b.v};
+}
+static inline ScalarFloats operator-(ScalarFloats a, ScalarFloats b)
+{
+  return {a.v - b.v};
+}
+static inline ScalarFloats operator*(ScalarFloats a, ScalarFloats b)
+{
+  return {a.v * b.v};
+}
+static inline ScalarFloats operator/(ScalarFloats a, ScalarFloats b)
+{
+  return {a.v / b.v};
+}
+static inline ScalarFloats Sqrt(ScalarFloats a)
+{
+  return {sqrtf(a.v)};
+}
+
+static inline ScalarFloats ClampToPositive(ScalarFloats a)
+{
+  return {(a.v > 0.0f) ? a.v : 0.0f};
+}
+
+static inline ScalarFloats SelectIfNotNegative(ScalarFloats condition, ScalarFloats value)
+{
+  return {(condition.v >= 0.0f) ? value.v : 0.0f};
+}
+
+static inline ScalarFloats SelectIfZero(ScalarFloats condition, ScalarFloats if_zero,
+                                        ScalarFloats value)
+{
+  return {(condition.v == 0.0f) ? if_zero.v : value.v};
+}
+
+static inline ScalarFloats SafeDivide(ScalarFloats n, ScalarFloats d)
+{
+  if (d.v == 0.0f)
+    return {(n.v > 0.0f) ? FLT_MAX : 0.0f};
+  return {n.v / d.v};
+}
+
+#if defined(__SSE2__)
+// Four floats, with the same rounding as ScalarFloats in every operation
+struct Floats
+{
+  static const int WIDTH = 4;
+
+  static Floats Load(const float* values) { return {_mm_loadu_ps(values)}; }
+  static Floats Set(float value) { return {_mm_set1_ps(value)}; }
+  void Store(float* values) const { _mm_storeu_ps(values, v); }
+
+  __m128 v;
+};
+
+static inline Floats operator+(Floats a, Floats b)
+{
+  return {_mm_add_ps(a.v, b.v)};
+}
+static inline Floats operator-(Floats a, Floats b)
+{
+  return {_mm_sub_ps(a.v, b.v)};
+}
+static inline Floats operator*(Floats a, Floats b)
+{
+  return {_mm_mul_ps(a.v, b.v)};
+}
+static inline Floats operator/(Floats a, Floats b)
+{
+  return {_mm_div_ps(a.v, b.v)};
+}
+static inline Floats Sqrt(Floats a)
+{
+  return {_mm_sqrt_ps(a.v)};
+}
+
+// max(0, a), which is 0 for NaN like std::max(0.0f, a)
+static inline Floats ClampToPositive(Floats a)
+{
+  return {_mm_max_ps(a.v, _mm_setzero_ps())};
+}
+
+// condition >= 0 ? value : 0
+static inline Floats SelectIfNotNegative(Floats condition, Floats value)
+{
+  return {_mm_and_ps(_mm_cmpge_ps(condition.v, _mm_setzero_ps()), value.v)};
+}
+
+// condition == 0 ? if_zero : value
+static inline Floats SelectIfZero(Floats condition, Floats if_zero, Floats value)
+{
+  const __m128 is_zero = _mm_cmpeq_ps(condition.v, _mm_setzero_ps());
+  return {_mm_or_ps(_mm_and_ps(is_zero, if_zero.v), _mm_andnot_ps(is_zero, value.v))};
+}
+
+// n / d, except that d == 0 gives FLT_MAX for positive n and 0 otherwise
+static inline Floats SafeDivide(Floats n, Floats d)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 is_zero = _mm_cmpeq_ps(d.v, zero);
+  const __m128 quotient = _mm_div_ps(n.v, d.v);
+  const __m128 limit = _mm_and_ps(_mm_cmpgt_ps(n.v, zero), _mm_set1_ps(FLT_MAX));
+  return {_mm_or_ps(_mm_andnot_ps(is_zero, quotient), _mm_and_ps(is_zero, limit))};
+}
+#else
+using Floats = ScalarFloats;
+#endif
+
+template <typename Floats>
+static inline Floats Dot(const Floats* a, const Floats* b)
+{
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline u8 GetComponent(u32 color, int component)
+{
+  return (color >> (24 - 8 * component)) & 0xFF;
+}
+
+State::State()
+{
+  num_channels = 1;
+  for (int channel = 0; channel < 2; ++channel)
+  {
+    ambient[channel] = 0x000000FF;
+    material[channel] = 0xFFFFFFFF;
+    color[channel] = CGXDefault<LitChannel>();
+    alpha[channel] = CGXDefault<LitChannel>();
+  }
+  memset(lights, 0, sizeof(lights));
+}
+
+void State::LoadXFRegs(u16 address, u32 count, const u32* values)
+{
+  for (u32 i = 0; i < count; ++i)
+  {
+    const u32 current = address + i;
+    const u32 value = values[i];
+
+    if (current >= XFMEM_LIGHTS && current < XFMEM_LIGHTS_END)
+    {
+      u32* light_words = (u32*)lights;
+      light_words[current - XFMEM_LIGHTS] = value;
+      continue;
+    }
+
+    switch (current)
+    {
+    case XFMEM_SETNUMCHAN:
+      num_channels = value & 3;
+      break;
+    case XFMEM_SETCHAN0_AMBCOLOR:
+    case XFMEM_SETCHAN1_AMBCOLOR:
+      ambient[current - XFMEM_SETCHAN0_AMBCOLOR] = value;
+      break;
+    case XFMEM_SETCHAN0_MATCOLOR:
+    case XFMEM_SETCHAN1_MATCOLOR:
+      material[current - XFMEM_SETCHAN0_MATCOLOR] = value;
+      break;
+    case XFMEM_SETCHAN0_COLOR:
+    case XFMEM_SETCHAN1_COLOR:
+      color[current - XFMEM_SETCHAN0_COLOR].hex = value;
+      break;
+    case XFMEM_SETCHAN0_ALPHA:
+    case XFMEM_SETCHAN1_ALPHA:
+      alpha[current - XFMEM_SETCHAN0_ALPHA].hex = value;
+      break;
+    }
+  }
+}
+
+Vertices::Vertices(int count)
+    : m_count(count), m_stride((count + 3) & ~3), m_floats(NUM_FLOATS * m_stride, 0.0f),
+      m_colors(NUM_COLORS * m_stride, 0)
+{
+}
+
+float* Vertices::Position(int component)
+{
+  assert(component >= 0 && component < 3);
+  return &m_floats[(FLOAT_POSITION + component) * m_stride];
+}
+
+float* Vertices::Normal(int component)
+{
+  assert(component >= 0 && component < 3);
+  return &m_floats[(FLOAT_NORMAL + component) * m_stride];
+}
+
+u8* Vertices::Color(int channel, int component)
+{
+  assert(channel >= 0 && channel < 2);
+  return &m_colors[(COLOR_VERTEX + channel * 4 + component) * m_stride];
+}
+
+const u8* Vertices::Output(int channel, int component) const
+{
+  assert(channel >= 0 && channel < 2);
+  return &m_colors[(COLOR_OUTPUT + channel * 4 + component) * m_stride];
+}
+
+const u8* Vertices::Light(int channel, int component) const
+{
+  assert(channel >= 0 && channel < 2);
+  return &m_colors[(COLOR_LIGHT + channel * 4 + component) * m_stride];
+}
+
+// Computes how much of the light's color reaches each vertex, i.e. the attenuation times the
+// diffuse factor, with the same sequence of single precision operations as Dolphin
+template <typename Floats>
+static void ComputeLightScale(const Light& light, LitChannel chan, const float* const pos[3],
+                              const float* const normal[3], float* scale, int count)
+{
+  const Floats one = Floats::Set(1.0f);
+  const Floats light_pos[3] = {Floats::Set(light.pos[0]), Floats::Set(light.pos[1]),
+                               Floats::Set(light.pos[2])};
+  const Floats light_dir[3] = {Floats::Set(light.dir[0]), Floats::Set(light.dir[1]),
+                               Floats::Set(light.dir[2])};
+  const Floats cosatt[3] = {Floats::Set(light.cosatt[0]), Floats::Set(light.cosatt[1]),
+                            Floats::Set(light.cosatt[2])};
+
+  // Specular lights with a diffuse function use the normalized distance coefficients
+  float distatt_values[3] = {light.distatt[0], light.distatt[1], light.distatt[2]};
+  if (chan.attnfunc == ATTN_SPEC && chan.diffusefunc != DIFFUSE_NONE)
+  {
+    const float length = sqrtf(distatt_values[0] * distatt_values[0] +
+                               distatt_values[1] * distatt_values[1] +
+                               distatt_values[2] * distatt_values[2]);
+    for (float& value : distatt_values)
+      value = value / length;
+  }
+  const Floats distatt[3] = {Floats::Set(distatt_values[0]), Floats::Set(distatt_values[1]),
+                             Floats::Set(distatt_values[2])};
+
+  for (int i = 0; i < count; i += Floats::WIDTH)
+  {
+    const Floats n[3] = {Floats::Load(normal[0] + i), Floats::Load(normal[1] + i),
+                         Floats::Load(normal[2] + i)};
+    Floats ldir[3] = {light_pos[0] - Floats::Load(pos[0] + i),
+                      light_pos[1] - Floats::Load(pos[1] + i),
+                      light_pos[2] - Floats::Load(pos[2] + i)};
+
+    Floats attn = one;
+    switch (chan.attnfunc)
+    {
+    case ATTN_NONE:
+    case ATTN_DIR:
+    {
+      // Like in Dolphin, a light at the position of the vertex shines along the normal
+      const Floats length = Sqrt(Dot(ldir, ldir));
+      for (int component = 0; component < 3; ++component)
+        ldir[component] = SelectIfZero(length, n[component], ldir[component] / length);
+      break;
+    }
+    case ATTN_SPEC:
+    {
+      const Floats length = Sqrt(Dot(ldir, ldir));
+      for (Floats& value : ldir)
+        value = value / length;
+      attn = SelectIfNotNegative(Dot(ldir, n), ClampToPositive(Dot(light_dir, n)));
+      const Floats attn2 = attn * attn;
+      const Floats cos_attn = one * cosatt[0] + attn * cosatt[1] + attn2 * cosatt[2];
+      const Floats dist_attn = one * distatt[0] + attn * distatt[1] + attn2 * distatt[2];
+      attn = SafeDivide(ClampToPositive(cos_attn), dist_attn);
+      break;
+    }
+    case ATTN_SPOT:
+    {
+      const Floats dist2 = Dot(ldir, ldir);
+      const Floats dist = Sqrt(dist2);
+      for (Floats& value : ldir)
+        value = value / dist;
+      attn = ClampToPositive(Dot(ldir, light_dir));
+      const Floats cos_attn = cosatt[0] + cosatt[1] * attn + cosatt[2] * attn * attn;
+      const Floats dist_attn = distatt[0] + distatt[1] * dist + distatt[2] * dist2;
+      attn = SafeDivide(ClampToPositive(cos_attn), dist_attn);
+      break;
+    }
+    }
+
+    Floats result = attn;
+    if (chan.diffusefunc == DIFFUSE_SIGN)
+      result = attn * Dot(ldir, n);
+    else if (chan.diffusefunc == DIFFUSE_CLAMP)
+      result = attn * ClampToPositive(Dot(ldir, n));
+    result.Store(scale + i);
+  }
+}
+
+// Evaluates the color (components 0-2) or alpha (component 3) part of a channel
+static void EvaluatePart(const State& state, int channel, LitChannel chan, int first, int last,
+                         Vertices* vertices, float* const light[4], float* scale,
+                         u8* const clamped_light[4], u8* const output[4], bool scalar)
+{
+  const int count = vertices->Count();
+  const int stride = (count + 3) & ~3;
+  const float* const pos[3] = {vertices->Position(0), vertices->Position(1),
+                               vertices->Position(2)};
+  const float* const normal[3] = {vertices->Normal(0), vertices->Normal(1), vertices->Normal(2)};
+
+  if (!chan.enablelighting)
+  {
+    for (int component = first; component <= last; ++component)
+    {
+      std::fill(clamped_light[component], clamped_light[component] + count, 255);
+      if (chan.matsource)
+        std::copy(vertices->Color(channel, component), vertices->Color(channel, component) + count,
+                  output[component]);
+      else
+        std::fill(output[component], output[component] + count,
+                  GetComponent(state.material[channel], component));
+    }
+    return;
+  }
+
+  for (int component = first; component <= last; ++component)
+  {
+    if (chan.ambsource)
+    {
+      const u8* color = vertices->Color(channel, component);
+      for (int i = 0; i < count; ++i)
+        light[component][i] = color[i];
+    }
+    else
+    {
+      std::fill(light[component], light[component] + stride,
+                (float)GetComponent(state.ambient[channel], component));
+    }
+  }
+
+  const u32 mask = chan.GetFullLightMask();
+  for (int index = 0; index < 8; ++index)
+  {
+    if (!(mask & (1 << index)))
+      continue;
+
+    const Light& current = state.lights[index];
+    if (scalar)
+      ComputeLightScale<ScalarFloats>(current, chan, pos, normal, scale, stride);
+    else
+      ComputeLightScale<Floats>(current, chan, pos, normal, scale, stride);
+    for (int component = first; component <= last; ++component)
+    {
+      const float color = GetComponent(current.color, component);
+      float* __restrict values = light[component];
+      for (int i = 0; i < stride; ++i)
+        values[i] += color * scale[i];
+    }
+  }
+
+  for (int component = first; component <= last; ++component)
+  {
+    const u8* vertex_material = vertices->Color(channel, component);
+    const int register_material = GetComponent(state.material[channel], component);
+    for (int i = 0; i < count; ++i)
+    {
+      const float value = light[component][i];
+      const int clamped = (value > 0.0f) ? (value < 255.0f ? (int)value : 255) : 0;
+      const int material = chan.matsource ? vertex_material[i] : register_material;
+      clamped_light[component][i] = clamped;
+      output[component][i] = ApplyMaterial(material, clamped);
+    }
+  }
+}
+
+void Vertices::EvaluateChannels(const State& state, bool scalar)
+{
+  const int stride = m_stride;
+  float* const light[4] = {
+      &m_floats[(FLOAT_LIGHT + 0) * stride],
+      &m_floats[(FLOAT_LIGHT + 1) * stride],
+      &m_floats[(FLOAT_LIGHT + 2) * stride],
+      &m_floats[(FLOAT_LIGHT + 3) * stride],
+  };
+  float* scale = &m_floats[FLOAT_SCALE * stride];
+
+  for (int channel = 0; channel < 2; ++channel)
+  {
+    u8* const output[4] = {
+        &m_colors[(COLOR_OUTPUT + channel * 4 + 0) * stride],
+        &m_colors[(COLOR_OUTPUT + channel * 4 + 1) * stride],
+        &m_colors[(COLOR_OUTPUT + channel * 4 + 2) * stride],
+        &m_colors[(COLOR_OUTPUT + channel * 4 + 3) * stride],
+    };
+    u8* const clamped_light[4] = {
+        &m_colors[(COLOR_LIGHT + channel * 4 + 0) * stride],
+        &m_colors[(COLOR_LIGHT + channel * 4 + 1) * stride],
+        &m_colors[(COLOR_LIGHT + channel * 4 + 2) * stride],
+        &m_colors[(COLOR_LIGHT + channel * 4 + 3) * stride],
+    };
+
+    if (channel >= state.num_channels)
+    {
+      for (u8* values : output)
+        std::fill(values, values + stride, 0);
+      for (u8* values : clamped_light)
+        std::fill(values, values + stride, 0);
+      continue;
+    }
+
+    EvaluatePart(state, channel, state.color[channel], COMP_R, COMP_B, this, light, scale,
+                 clamped_light, output, scalar);
+    EvaluatePart(state, channel, state.alpha[channel], COMP_A, COMP_A, this, light, scale,
+                 clamped_light, output, scalar);
+  }
+}
+
+void Evaluate(const State& state, Vertices* vertices)
+{
+  vertices->EvaluateChannels(state, false);
+}
+
+void EvaluateScalar(const State& state, Vertices* vertices)
+{
+  vertices->EvaluateChannels(state, true);
+}
+
+}  // namespace LightingEmulator
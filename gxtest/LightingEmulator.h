@@ -0,0 +1,136 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/CommonTypes.h"
+#include "gxtest/XFMemory.h"
+
+// Software model of the XF color channels, used as the expected result of lighting tests:
+//
+//   LightingEmulator::State state;
+//   state.LoadXFRegs(address, count, values);  // the same values that go to CGX_LoadXFRegs
+//   ...
+//   LightingEmulator::Vertices vertices(count);
+//   vertices.Position(0)[i] = ...;
+//   LightingEmulator::Evaluate(state, &vertices);
+//   ... vertices.Output(0, LightingEmulator::COMP_R)[i] ...
+//
+// Both channels are modelled with material and ambient sources, the three diffuse functions,
+// all attenuation functions and the light masks of the color and alpha parts. Light colors are
+// accumulated in single precision, truncated and clamped to 0-255 and then multiplied with the
+// material color as (material * (light + (light >> 7))) >> 8, like in Dolphin.
+// Positions and normals are used as given, i.e. they are expected to be in view space already
+// and normals should have unit length. Like in Dolphin, lights at the position of a vertex
+// shine along its normal with the none and directional attenuation functions.
+//
+// Vertices are stored with one array per component, and each light is applied to all vertices
+// at once, four at a time with SSE2 where available.
+
+namespace LightingEmulator
+{
+enum
+{
+  COMP_R = 0,
+  COMP_G = 1,
+  COMP_B = 2,
+  COMP_A = 3,
+};
+
+// Attenuation functions (LitChannel::attnfunc)
+enum
+{
+  ATTN_NONE = 0,
+  ATTN_SPEC = 1,
+  ATTN_DIR = 2,
+  ATTN_SPOT = 3,
+};
+
+// Diffuse functions (LitChannel::diffusefunc)
+enum
+{
+  DIFFUSE_NONE = 0,
+  DIFFUSE_SIGN = 1,
+  DIFFUSE_CLAMP = 2,
+};
+
+// Multiplies a light color, truncated and clamped to 0-255, with a material color
+inline int ApplyMaterial(int material, int light)
+{
+  return (material * (light + (light >> 7))) >> 8;
+}
+
+// Layout of one light in XF memory, 16 words starting at XFMEM_LIGHTS + 16 * index
+struct Light
+{
+  u32 unused[3];
+  u32 color;  // RGBA, red in the top byte
+  float cosatt[3];
+  float distatt[3];
+  float pos[3];
+  float dir[3];  // also the half angle of specular lights
+};
+
+// Lighting related XF state
+struct State
+{
+  // Starts out with the values set up by CGX_Init, with all lights zero
+  State();
+
+  // Applies an XF load. Loads of registers unrelated to lighting are ignored.
+  void LoadXFRegs(u16 address, u32 count, const u32* values);
+  void LoadXFReg(u16 address, u32 value) { LoadXFRegs(address, 1, &value); }
+
+  int num_channels;
+  u32 ambient[2];   // RGBA, red in the top byte
+  u32 material[2];  // RGBA, red in the top byte
+  LitChannel color[2];
+  LitChannel alpha[2];
+  Light lights[8];
+};
+
+// Inputs and outputs of Evaluate for a number of vertices
+class Vertices
+{
+public:
+  explicit Vertices(int count);
+
+  int Count() const { return m_count; }
+
+  // Position and normal in view space, x, y and z
+  float* Position(int component);
+  float* Normal(int component);
+
+  // Vertex colors, used where material or ambient source are set to the vertex
+  u8* Color(int channel, int component);
+
+  // Lit color of each channel after Evaluate. Channels beyond State::num_channels are zero.
+  const u8* Output(int channel, int component) const;
+
+  // Light color of each channel after Evaluate, truncated and clamped to 0-255, i.e. what the
+  // material color of Output was multiplied with. 255 where lighting is disabled.
+  const u8* Light(int channel, int component) const;
+
+private:
+  friend void Evaluate(const State& state, Vertices* vertices);
+  friend void EvaluateScalar(const State& state, Vertices* vertices);
+
+  void EvaluateChannels(const State& state, bool scalar);
+
+  int m_count;
+  int m_stride;  // count rounded up to a multiple of 4, so that vector loops need no tail
+  std::vector<float> m_floats;  // positions, normals and scratch arrays for Evaluate
+  std::vector<u8> m_colors;     // vertex colors followed by the outputs
+};
+
+// Computes the output colors of all vertices.
+// This uses the fastest implementation available for the target.
+void Evaluate(const State& state, Vertices* vertices);
+
+// Reference implementation of Evaluate, one vertex at a time
+void EvaluateScalar(const State& state, Vertices* vertices);
+
+}  // namespace LightingEmulator
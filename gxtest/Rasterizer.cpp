@@ -0,0 +1,208 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/Rasterizer.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace Rasterizer
+{
+// Offset of the EFB origin in screen coordinates, see CGX_SetViewport
+static const int SCREEN_OFFSET = 342;
+
+Viewport GetViewport(float origin_x, float origin_y, float width, float height, float near,
+                     float far)
+{
+  Viewport viewport;
+  viewport.wd = width * 0.5f;
+  viewport.ht = -height * 0.5f;
+  viewport.z_range = (far - near) * 16777215.0f;
+  viewport.x_orig = 342.0f + origin_x + width * 0.5f;
+  viewport.y_orig = 342.0f + origin_y + height * 0.5f;
+  viewport.far_z = far * 16777215.0f;
+  return viewport;
+}
+
+// Rounds a screen coordinate to the subpixel grid. The product is computed in double
+// precision, which holds it exactly for any grid up to 2^29 steps per pixel.
+static s64 Snap(float value, int subpixel_steps)
+{
+  return (s64)floor((double)value * subpixel_steps + 0.5) - (s64)SCREEN_OFFSET * subpixel_steps;
+}
+
+ScreenVertex Transform(const Config& config, const Viewport& viewport, float x, float y)
+{
+  // Separate single precision multiply and add, without fusing them
+  const float scaled_x = x * viewport.wd;
+  const float scaled_y = y * viewport.ht;
+  const float screen_x = scaled_x + viewport.x_orig;
+  const float screen_y = scaled_y + viewport.y_orig;
+
+  ScreenVertex vertex;
+  vertex.x = Snap(screen_x, config.subpixel_steps);
+  vertex.y = Snap(screen_y, config.subpixel_steps);
+  return vertex;
+}
+
+// Positive if p is on the inner side of the edge from a to b, for triangles with a positive area
+static s64 EdgeFunction(const ScreenVertex& a, const ScreenVertex& b, s64 px, s64 py)
+{
+  return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+// With y pointing down and a positive area, left edges point up and top edges point right
+static bool IsTopLeft(const ScreenVertex& a, const ScreenVertex& b)
+{
+  return (b.y < a.y) || (b.y == a.y && b.x > a.x);
+}
+
+bool CoversTriangle(const Config& config, const ScreenVertex* vertices, int px, int py)
+{
+  ScreenVertex v0 = vertices[0];
+  ScreenVertex v1 = vertices[1];
+  ScreenVertex v2 = vertices[2];
+
+  const s64 area = EdgeFunction(v0, v1, v2.x, v2.y);
+  if (area == 0)
+    return false;
+  if (area < 0)
+    std::swap(v1, v2);
+
+  const s64 sample_x = (s64)px * config.subpixel_steps + config.sample_x;
+  const s64 sample_y = (s64)py * config.subpixel_steps + config.sample_y;
+
+  const ScreenVertex* edges[3][2] = {{&v0, &v1}, {&v1, &v2}, {&v2, &v0}};
+  for (const auto& edge : edges)
+  {
+    const s64 value = EdgeFunction(*edge[0], *edge[1], sample_x, sample_y);
+    if (value < 0 || (value == 0 && !IsTopLeft(*edge[0], *edge[1])))
+      return false;
+  }
+  return true;
+}
+
+Quad GetQuad()
+{
+  const Quad quad = {{-1.0f, 1.0f, 1.0f, -1.0f}, {1.0f, 1.0f, -1.0f, -1.0f}};
+  return quad;
+}
+
+bool CoversQuad(const Config& config, const Viewport& viewport, const Quad& quad, int px,
+                int py)
+{
+  ScreenVertex vertices[4];
+  for (int i = 0; i < 4; ++i)
+    vertices[i] = Transform(config, viewport, quad.x[i], quad.y[i]);
+
+  const ScreenVertex second[3] = {vertices[0], vertices[2], vertices[3]};
+  return CoversTriangle(config, vertices, px, py) || CoversTriangle(config, second, px, py);
+}
+
+// Vertices of a triangle while it is being clipped, in clip space
+struct ClipPolygon
+{
+  int count;
+  float x[7];
+  float y[7];
+};
+
+// Distance of a vertex to one of the edges of the square from -limit to limit, positive inside
+static float GetEdgeDistance(int edge, float limit, float x, float y)
+{
+  switch (edge)
+  {
+  case 0:
+    return limit - x;
+  case 1:
+    return limit + x;
+  case 2:
+    return limit - y;
+  default:
+    return limit + y;
+  }
+}
+
+static bool IsInsideGuardband(float guardband, float x, float y)
+{
+  return x <= guardband && x >= -guardband && y <= guardband && y >= -guardband;
+}
+
+// Sutherland-Hodgman clipping against one edge, in single precision
+static void ClipAgainstEdge(int edge, float limit, const ClipPolygon& in, ClipPolygon* out)
+{
+  out->count = 0;
+  for (int i = 0; i < in.count; ++i)
+  {
+    const int next = (i + 1) % in.count;
+    const float d0 = GetEdgeDistance(edge, limit, in.x[i], in.y[i]);
+    const float d1 = GetEdgeDistance(edge, limit, in.x[next], in.y[next]);
+
+    if (d0 >= 0.0f)
+    {
+      out->x[out->count] = in.x[i];
+      out->y[out->count] = in.y[i];
+      ++out->count;
+    }
+    if ((d0 >= 0.0f) != (d1 >= 0.0f))
+    {
+      const float t = d0 / (d0 - d1);
+      out->x[out->count] = in.x[i] + t * (in.x[next] - in.x[i]);
+      out->y[out->count] = in.y[i] + t * (in.y[next] - in.y[i]);
+      ++out->count;
+    }
+  }
+}
+
+int ClipQuad(const Config& config, const ClipConfig& clip, const Viewport& viewport,
+             const Quad& quad, ScreenVertex (*triangles)[3])
+{
+  static const int indices[2][3] = {{0, 1, 2}, {0, 2, 3}};
+
+  int num_triangles = 0;
+  for (const auto& triangle : indices)
+  {
+    ClipPolygon polygon;
+    polygon.count = 3;
+    bool inside = true;
+    for (int i = 0; i < 3; ++i)
+    {
+      polygon.x[i] = quad.x[triangle[i]];
+      polygon.y[i] = quad.y[triangle[i]];
+      inside = inside && IsInsideGuardband(clip.guardband, polygon.x[i], polygon.y[i]);
+    }
+
+    if (!inside && clip.mode == CLIP_REJECT)
+      continue;
+
+    if (!inside && (clip.mode == CLIP_GUARDBAND || clip.mode == CLIP_VIEWPORT))
+    {
+      const float limit = (clip.mode == CLIP_GUARDBAND) ? clip.guardband : 1.0f;
+      for (int edge = 0; edge < 4 && polygon.count > 0; ++edge)
+      {
+        ClipPolygon clipped;
+        ClipAgainstEdge(edge, limit, polygon, &clipped);
+        polygon = clipped;
+      }
+    }
+
+    // Triangle fan
+    if (polygon.count < 3)
+      continue;
+    const ScreenVertex first = Transform(config, viewport, polygon.x[0], polygon.y[0]);
+    ScreenVertex previous = Transform(config, viewport, polygon.x[1], polygon.y[1]);
+    for (int i = 2; i < polygon.count; ++i)
+    {
+      const ScreenVertex current = Transform(config, viewport, polygon.x[i], polygon.y[i]);
+      triangles[num_triangles][0] = first;
+      triangles[num_triangles][1] = previous;
+      triangles[num_triangles][2] = current;
+      ++num_triangles;
+      previous = current;
+    }
+  }
+  return num_triangles;
+}
+
+}  // namespace Rasterizer
@@ -0,0 +1,111 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/CommonTypes.h"
+
+// Reference model of which pixels a primitive covers, used to interpret rasterization tests:
+//
+//   Rasterizer::Viewport viewport = Rasterizer::GetViewport(xpos, 0.0f, 100.0f, 100.0f);
+//   bool covered = Rasterizer::CoversQuad(Rasterizer::DEFAULT_CONFIG, viewport,
+//                                         Rasterizer::GetQuad(), 50, 0);
+//
+// Vertices go through the viewport transform with the same single precision math as the XF,
+// including the offset of 342 which CGX_SetViewport adds. The screen coordinates are then
+// rounded to a grid of subpixel steps, the offset is removed, and each pixel is sampled at one
+// point of that grid with edge functions and a top-left fill rule. The grid size and the sample
+// location are parameters, so that several candidate models can be checked against hardware.
+//
+// Only orthographic projections with an identity position matrix are modelled, i.e. clip space
+// coordinates are the vertex positions and w is 1. ClipQuad models clipping against the
+// guardband, in one of several ways; depth clipping is not modelled.
+
+namespace Rasterizer
+{
+// XF viewport registers, in the order of XFMEM_SETVIEWPORT. Screen x is x * wd + x_orig.
+struct Viewport
+{
+  float wd;
+  float ht;
+  float z_range;
+  float x_orig;
+  float y_orig;
+  float far_z;
+};
+
+// The registers loaded by CGX_SetViewport, computed in the same order
+Viewport GetViewport(float origin_x, float origin_y, float width, float height,
+                     float near = 0.0f, float far = 1.0f);
+
+struct Config
+{
+  // Screen coordinates are rounded to the nearest multiple of 1 / subpixel_steps pixels
+  int subpixel_steps;
+
+  // Location of the sample within each pixel, in subpixel steps from its top left corner
+  int sample_x;
+  int sample_y;
+};
+
+// The model of single-sampled rendering: pixels are sampled at (7/12, 1/2), and screen
+// coordinates keep enough precision that single float steps around 342 are resolved.
+// SubsampleLocationTest checks this against hardware.
+const Config DEFAULT_CONFIG = {12 * 4096, 7 * 4096, 6 * 4096};
+
+// Position after the viewport transform, in subpixel steps from the top left of the EFB
+struct ScreenVertex
+{
+  s64 x;
+  s64 y;
+};
+
+ScreenVertex Transform(const Config& config, const Viewport& viewport, float x, float y);
+
+// Whether the sample of pixel (px, py) is inside the triangle. Samples exactly on an edge are
+// covered for top and left edges only. Both windings are covered, as culling is disabled.
+bool CoversTriangle(const Config& config, const ScreenVertex* vertices, int px, int py);
+
+// Vertex positions of a quad, in the order of GXTest::Quad (top left, top right, bottom right,
+// bottom left)
+struct Quad
+{
+  float x[4];
+  float y[4];
+};
+
+// The default positions of GXTest::Quad, which span the whole viewport
+Quad GetQuad();
+
+// Whether the sample of pixel (px, py) is covered by either of the triangles (0, 1, 2) and
+// (0, 2, 3) which the quad is drawn as
+bool CoversQuad(const Config& config, const Viewport& viewport, const Quad& quad, int px,
+                int py);
+
+// How triangles with vertices outside the guardband are handled; triangles which are completely
+// inside are always rasterized as they are. The guardband spans -guardband * w to
+// guardband * w in x and y; vertices exactly on its edge are inside.
+enum ClipMode
+{
+  CLIP_NONE,       // Triangles are rasterized as they are
+  CLIP_GUARDBAND,  // Triangles are clipped against the guardband edges
+  CLIP_VIEWPORT,   // Triangles are clipped against the viewport edges (-w to w) instead
+  CLIP_REJECT,     // Triangles with any vertex outside the guardband are dropped
+};
+
+struct ClipConfig
+{
+  ClipMode mode;
+  float guardband;
+};
+
+// A triangle clipped by four edges has at most 7 vertices, i.e. 5 triangles
+static const int MAX_CLIPPED_TRIANGLES = 2 * 5;
+
+// Clips the triangles (0, 1, 2) and (0, 2, 3) of the quad and applies the viewport transform to
+// the result. Returns the number of triangles written to `triangles`.
+int ClipQuad(const Config& config, const ClipConfig& clip, const Viewport& viewport,
+             const Quad& quad, ScreenVertex (*triangles)[3]);
+
+}  // namespace Rasterizer
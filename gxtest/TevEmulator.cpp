@@ -0,0 +1,588 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/TevEmulator.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <initializer_list>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "gxtest/cgx_defaults.h"
+
+namespace TevEmulator
+{
+// Layout of Pixels::m_values: the registers, then scratch arrays for the inputs of one stage
+enum
+{
+  ARRAY_REGISTERS = 0,                   // [REG_*][COMP_*]
+  ARRAY_RASTERIZED = 16,                 // Swapped rasterized color of the current stage
+  ARRAY_TEXTURE = ARRAY_RASTERIZED + 4,  // Swapped texture color of the current stage
+  ARRAY_KONST = ARRAY_TEXTURE + 4,       // Konst color (r, g, b) and alpha of the current stage
+  ARRAY_ZERO = ARRAY_KONST + 4,
+  ARRAY_ONE = ARRAY_ZERO + 1,
+  ARRAY_HALF = ARRAY_ONE + 1,
+  ARRAY_RESULT = ARRAY_HALF + 1,  // Combiner results, before they are written to the registers
+  NUM_ARRAYS = ARRAY_RESULT + 4,
+};
+
+// Layout of Pixels::m_inputs
+enum
+{
+  INPUT_RASTERIZED = 0,  // [channel][COMP_*]
+  INPUT_TEXTURE = 8,     // [texmap][COMP_*]
+  NUM_INPUTS = INPUT_TEXTURE + 32,
+};
+
+// Color channel selections of TwoTevStageOrders
+static const int COLORCHAN_COLOR0A0 = 0;
+static const int COLORCHAN_COLOR1A1 = 1;
+
+State::State()
+{
+  genmode = CGXDefault<GenMode>();
+  for (int stage = 0; stage < 16; ++stage)
+  {
+    color[stage] = CGXDefault<TevStageCombiner::ColorCombiner>(stage);
+    alpha[stage] = CGXDefault<TevStageCombiner::AlphaCombiner>(stage);
+  }
+  for (int i = 0; i < 8; ++i)
+  {
+    orders[i] = CGXDefault<TwoTevStageOrders>(i);
+    ksel[i] = CGXDefault<TevKSel>(i);
+  }
+  std::fill(&registers[0][0], &registers[0][0] + 16, 0);
+  std::fill(&konst[0][0], &konst[0][0] + 16, 0);
+}
+
+void State::LoadBPReg(u32 value)
+{
+  const u8 reg = value >> 24;
+
+  if (reg == BPMEM_GENMODE)
+  {
+    genmode.hex = value;
+  }
+  else if (reg >= BPMEM_TREF && reg < BPMEM_TREF + 8)
+  {
+    orders[reg - BPMEM_TREF].hex = value;
+  }
+  else if (reg >= BPMEM_TEV_COLOR_ENV && reg < BPMEM_TEV_COLOR_ENV + 32)
+  {
+    const int stage = (reg - BPMEM_TEV_COLOR_ENV) / 2;
+    if ((reg - BPMEM_TEV_COLOR_ENV) & 1)
+      alpha[stage].hex = value;
+    else
+      color[stage].hex = value;
+  }
+  else if (reg >= BPMEM_TEV_REGISTER_L && reg < BPMEM_TEV_REGISTER_L + 8)
+  {
+    // Bit 23 selects the konst colors
+    TevReg tevreg;
+    tevreg.hex = 0;
+    s16* values;
+    if ((reg - BPMEM_TEV_REGISTER_L) & 1)
+    {
+      tevreg.high = value;
+      values = tevreg.type_bg ? konst[(reg - BPMEM_TEV_REGISTER_L) / 2] :
+                                registers[(reg - BPMEM_TEV_REGISTER_L) / 2];
+      values[COMP_B] = (s16)tevreg.blue;
+      values[COMP_G] = (s16)tevreg.green;
+    }
+    else
+    {
+      tevreg.low = value;
+      values = tevreg.type_ra ? konst[(reg - BPMEM_TEV_REGISTER_L) / 2] :
+                                registers[(reg - BPMEM_TEV_REGISTER_L) / 2];
+      values[COMP_R] = (s16)tevreg.red;
+      values[COMP_A] = (s16)tevreg.alpha;
+    }
+  }
+  else if (reg >= BPMEM_TEV_KSEL && reg < BPMEM_TEV_KSEL + 8)
+  {
+    ksel[reg - BPMEM_TEV_KSEL].hex = value;
+  }
+}
+
+Pixels::Pixels(int count)
+    : m_count(count), m_stride((count + 15) & ~15), m_inputs(NUM_INPUTS * m_stride, 0),
+      m_values(NUM_ARRAYS * m_stride, 0)
+{
+  for (int component = 0; component < 4; ++component)
+    m_output_regs[component] = REG_PREV;
+}
+
+u8* Pixels::Rasterized(int channel, int component)
+{
+  assert(channel >= 0 && channel < 2);
+  return &m_inputs[(INPUT_RASTERIZED + channel * 4 + component) * m_stride];
+}
+
+u8* Pixels::Texture(int texmap, int component)
+{
+  assert(texmap >= 0 && texmap < 8);
+  return &m_inputs[(INPUT_TEXTURE + texmap * 4 + component) * m_stride];
+}
+
+const s16* Pixels::Register(int reg, int component) const
+{
+  return Array(ARRAY_REGISTERS + reg * 4 + component);
+}
+
+const s16* Pixels::Output(int component) const
+{
+  return Register(m_output_regs[component], component);
+}
+
+static void Fill(s16* values, int count, s16 value)
+{
+  std::fill(values, values + count, value);
+}
+
+// Copies an input color with a swap table applied
+static void LoadSwapped(s16* const dst[4], const u8* const src[4], const int swap[4], int count)
+{
+  for (int component = 0; component < 4; ++component)
+  {
+    s16* __restrict out = dst[component];
+    const u8* values = src[swap[component]];
+    for (int i = 0; i < count; ++i)
+      out[i] = values[i];
+  }
+}
+
+// Source component of each output component, for the given swap table
+static void GetSwapTable(const State& state, int table, int swap[4])
+{
+  swap[COMP_R] = state.ksel[table * 2].swap1;
+  swap[COMP_G] = state.ksel[table * 2].swap2;
+  swap[COMP_B] = state.ksel[table * 2 + 1].swap1;
+  swap[COMP_A] = state.ksel[table * 2 + 1].swap2;
+}
+
+// Value of a konst selection for the given component, see GX_TEV_KCSEL_* and GX_TEV_KASEL_*.
+// Selections 0-7 are fractions of 1, 12-15 the whole konst color (color only) and 16-31 single
+// components of one of the konst colors.
+static s16 GetKonstValue(const State& state, int selection, int component)
+{
+  static const s16 fractions[8] = {255, 223, 191, 159, 128, 96, 64, 32};
+
+  if (selection < 8)
+    return fractions[selection];
+  if (selection < 12)
+    return 0;
+  if (selection < 16)
+    return (component == COMP_A) ? 0 : state.konst[selection - 12][component];
+  return state.konst[(selection - 16) & 3][(selection - 16) >> 2];
+}
+
+static inline int SignExtend11(int value)
+{
+  return ((value & 0x7FF) ^ 0x400) - 0x400;
+}
+
+// One pixel at a time, the reference of the vector code
+template <bool subtract, bool clamp>
+static void CombineRegularScalar(s16* out, const s16* a, const s16* b, const s16* c,
+                                 const s16* d, int count, int bias, int shift)
+{
+  const int lshift = (shift == TEVSCALE_2) ? 1 : (shift == TEVSCALE_4) ? 2 : 0;
+  const int rshift = (shift == TEVDIVIDE_2) ? 1 : 0;
+  const int round = (shift == TEVDIVIDE_2) ? 0 : subtract ? 127 : 128;
+  const int bias_value = (bias == TevBias_ADDHALF) ? 128 : (bias == TevBias_SUBHALF) ? -128 : 0;
+
+  for (int i = 0; i < count; ++i)
+  {
+    const int in_a = a[i] & 0xFF;
+    const int in_b = b[i] & 0xFF;
+    const int in_c = (c[i] & 0xFF) + ((c[i] & 0xFF) >> 7);
+    const int in_d = SignExtend11(d[i]);
+
+    int lerp = (((in_a * (256 - in_c) + in_b * in_c) << lshift) + round) >> 8;
+    if (subtract)
+      lerp = -lerp;
+    int result = (((in_d + bias_value) * (1 << lshift)) + lerp) >> rshift;
+
+    if (clamp)
+      result = std::min(std::max(result, 0), 255);
+    else
+      result = std::min(std::max(result, -1024), 1023);
+    out[i] = result;
+  }
+}
+
+#if defined(__SSE2__)
+// Eight pixels at a time in 16 bit lanes. Only the lerp needs more than 16 bits once it is
+// scaled, so that part is done in 32 bit lanes.
+template <bool subtract, bool clamp>
+static void CombineRegular(s16* out, const s16* a, const s16* b, const s16* c, const s16* d,
+                           int count, int bias, int shift)
+{
+  const int lshift_value = (shift == TEVSCALE_2) ? 1 : (shift == TEVSCALE_4) ? 2 : 0;
+  const __m128i lshift = _mm_cvtsi32_si128(lshift_value);
+  const __m128i rshift = _mm_cvtsi32_si128((shift == TEVDIVIDE_2) ? 1 : 0);
+  const __m128i round = _mm_set1_epi32((shift == TEVDIVIDE_2) ? 0 : subtract ? 127 : 128);
+  const __m128i bias_value =
+      _mm_set1_epi16((bias == TevBias_ADDHALF) ? 128 : (bias == TevBias_SUBHALF) ? -128 : 0);
+  const __m128i mask = _mm_set1_epi16(0xFF);
+  const __m128i c256 = _mm_set1_epi16(256);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i min = _mm_set1_epi16(clamp ? 0 : -1024);
+  const __m128i max = _mm_set1_epi16(clamp ? 255 : 1023);
+
+  for (int i = 0; i < count; i += 8)
+  {
+    const __m128i in_a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(a + i)), mask);
+    const __m128i in_b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(b + i)), mask);
+    __m128i in_c = _mm_and_si128(_mm_loadu_si128((const __m128i*)(c + i)), mask);
+    in_c = _mm_add_epi16(in_c, _mm_srli_epi16(in_c, 7));
+    __m128i in_d = _mm_loadu_si128((const __m128i*)(d + i));
+    in_d = _mm_srai_epi16(_mm_slli_epi16(in_d, 5), 5);  // sign-extend 11 bits
+
+    // At most 255 * 256, which fits into unsigned 16 bit lanes
+    const __m128i weighted = _mm_add_epi16(_mm_mullo_epi16(in_a, _mm_sub_epi16(c256, in_c)),
+                                           _mm_mullo_epi16(in_b, in_c));
+    __m128i lerp_lo = _mm_unpacklo_epi16(weighted, zero);
+    __m128i lerp_hi = _mm_unpackhi_epi16(weighted, zero);
+    lerp_lo = _mm_srli_epi32(_mm_add_epi32(_mm_sll_epi32(lerp_lo, lshift), round), 8);
+    lerp_hi = _mm_srli_epi32(_mm_add_epi32(_mm_sll_epi32(lerp_hi, lshift), round), 8);
+    __m128i lerp = _mm_packs_epi32(lerp_lo, lerp_hi);
+    if (subtract)
+      lerp = _mm_sub_epi16(zero, lerp);
+
+    __m128i result = _mm_sll_epi16(_mm_add_epi16(in_d, bias_value), lshift);
+    result = _mm_sra_epi16(_mm_add_epi16(result, lerp), rshift);
+    result = _mm_min_epi16(_mm_max_epi16(result, min), max);
+    _mm_storeu_si128((__m128i*)(out + i), result);
+  }
+}
+#else
+template <bool subtract, bool clamp>
+static void CombineRegular(s16* out, const s16* a, const s16* b, const s16* c, const s16* d,
+                           int count, int bias, int shift)
+{
+  CombineRegularScalar<subtract, clamp>(out, a, b, c, d, count, bias, shift);
+}
+#endif
+
+// Comparison values of the R8, GR16 and BGR24 compare modes, where rgb points to the
+// red, green and blue arrays
+static inline int GetCompareValue(const s16* const rgb[3], int mode, int i)
+{
+  switch (mode)
+  {
+  case TEVCMP_R8:
+    return rgb[COMP_R][i] & 0xFF;
+  case TEVCMP_GR16:
+    return ((rgb[COMP_G][i] & 0xFF) << 8) | (rgb[COMP_R][i] & 0xFF);
+  default:
+    return ((rgb[COMP_B][i] & 0xFF) << 16) | ((rgb[COMP_G][i] & 0xFF) << 8) |
+           (rgb[COMP_R][i] & 0xFF);
+  }
+}
+
+// d + (a > b ? c : 0) or d + (a == b ? c : 0), where a and b are the values compared by the
+// compare mode and c and d are those of the component being computed
+static void CombineCompare(s16* __restrict out, const s16* const a[3], const s16* const b[3],
+                           int compare_component, const s16* c, const s16* d, int count, int mode,
+                           bool equal, bool clamp)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    int in_a, in_b;
+    if (mode == TEVCMP_RGB8)
+    {
+      in_a = a[compare_component][i] & 0xFF;
+      in_b = b[compare_component][i] & 0xFF;
+    }
+    else
+    {
+      in_a = GetCompareValue(a, mode, i);
+      in_b = GetCompareValue(b, mode, i);
+    }
+
+    const bool pass = equal ? (in_a == in_b) : (in_a > in_b);
+    int result = SignExtend11(d[i]) + (pass ? (c[i] & 0xFF) : 0);
+
+    if (clamp)
+      result = std::min(std::max(result, 0), 255);
+    else
+      result = std::min(std::max(result, -1024), 1023);
+    out[i] = result;
+  }
+}
+
+template <bool subtract, bool clamp>
+static void CombineRegular(s16* out, const s16* a, const s16* b, const s16* c, const s16* d,
+                           int count, int bias, int shift, bool scalar)
+{
+  if (scalar)
+    CombineRegularScalar<subtract, clamp>(out, a, b, c, d, count, bias, shift);
+  else
+    CombineRegular<subtract, clamp>(out, a, b, c, d, count, bias, shift);
+}
+
+static void Combine(s16* out, const s16* a, const s16* b, const s16* c, const s16* d, int count,
+                    int bias, int op, int clamp, int shift, bool scalar)
+{
+  if (op == TEVOP_SUB)
+  {
+    if (clamp)
+      CombineRegular<true, true>(out, a, b, c, d, count, bias, shift, scalar);
+    else
+      CombineRegular<true, false>(out, a, b, c, d, count, bias, shift, scalar);
+  }
+  else
+  {
+    if (clamp)
+      CombineRegular<false, true>(out, a, b, c, d, count, bias, shift, scalar);
+    else
+      CombineRegular<false, false>(out, a, b, c, d, count, bias, shift, scalar);
+  }
+}
+
+// Array read by a color combiner input for the given component
+static const s16* GetColorInput(int arg, int component, const s16* const arrays[NUM_ARRAYS])
+{
+  switch (arg)
+  {
+  case TEVCOLORARG_CPREV:
+  case TEVCOLORARG_C0:
+  case TEVCOLORARG_C1:
+  case TEVCOLORARG_C2:
+    return arrays[ARRAY_REGISTERS + (arg / 2) * 4 + component];
+  case TEVCOLORARG_APREV:
+  case TEVCOLORARG_A0:
+  case TEVCOLORARG_A1:
+  case TEVCOLORARG_A2:
+    return arrays[ARRAY_REGISTERS + (arg / 2) * 4 + COMP_A];
+  case TEVCOLORARG_TEXC:
+    return arrays[ARRAY_TEXTURE + component];
+  case TEVCOLORARG_TEXA:
+    return arrays[ARRAY_TEXTURE + COMP_A];
+  case TEVCOLORARG_RASC:
+    return arrays[ARRAY_RASTERIZED + component];
+  case TEVCOLORARG_RASA:
+    return arrays[ARRAY_RASTERIZED + COMP_A];
+  case TEVCOLORARG_ONE:
+    return arrays[ARRAY_ONE];
+  case TEVCOLORARG_HALF:
+    return arrays[ARRAY_HALF];
+  case TEVCOLORARG_KONST:
+    return arrays[ARRAY_KONST + component];
+  default:
+    return arrays[ARRAY_ZERO];
+  }
+}
+
+// Array read by an alpha combiner input
+static const s16* GetAlphaInput(int arg, const s16* const arrays[NUM_ARRAYS])
+{
+  switch (arg)
+  {
+  case TEVALPHAARG_APREV:
+  case TEVALPHAARG_A0:
+  case TEVALPHAARG_A1:
+  case TEVALPHAARG_A2:
+    return arrays[ARRAY_REGISTERS + arg * 4 + COMP_A];
+  case TEVALPHAARG_TEXA:
+    return arrays[ARRAY_TEXTURE + COMP_A];
+  case TEVALPHAARG_RASA:
+    return arrays[ARRAY_RASTERIZED + COMP_A];
+  case TEVALPHAARG_KONST:
+    return arrays[ARRAY_KONST + COMP_A];
+  default:
+    return arrays[ARRAY_ZERO];
+  }
+}
+
+static bool IsColorInputUsed(const TevStageCombiner::ColorCombiner& cc, int arg1, int arg2)
+{
+  for (int arg : {(int)cc.a, (int)cc.b, (int)cc.c, (int)cc.d})
+  {
+    if (arg == arg1 || arg == arg2)
+      return true;
+  }
+  return false;
+}
+
+static bool IsAlphaInputUsed(const TevStageCombiner::AlphaCombiner& ac, int arg)
+{
+  return (int)ac.a == arg || (int)ac.b == arg || (int)ac.c == arg || (int)ac.d == arg;
+}
+
+void Pixels::EvaluateStages(const State& state, bool scalar)
+{
+  // The padding is evaluated as well, so that loops don't need to handle the remainder
+  const int count = m_stride;
+  const int stride = m_stride;
+
+  s16* arrays[NUM_ARRAYS];
+  for (int i = 0; i < NUM_ARRAYS; ++i)
+    arrays[i] = Array(i);
+  const s16* const* const_arrays = arrays;
+
+  for (int reg = 0; reg < 4; ++reg)
+  {
+    for (int component = 0; component < 4; ++component)
+      Fill(arrays[ARRAY_REGISTERS + reg * 4 + component], stride, state.registers[reg][component]);
+  }
+  Fill(arrays[ARRAY_ZERO], stride, 0);
+  Fill(arrays[ARRAY_ONE], stride, 255);
+  Fill(arrays[ARRAY_HALF], stride, 128);
+
+  const int num_stages = state.genmode.numtevstages + 1;
+  for (int stage = 0; stage < num_stages; ++stage)
+  {
+    const TevStageCombiner::ColorCombiner& cc = state.color[stage];
+    const TevStageCombiner::AlphaCombiner& ac = state.alpha[stage];
+    TwoTevStageOrders order = state.orders[stage / 2];
+    TevKSel ksel = state.ksel[stage / 2];
+    const int odd = stage & 1;
+
+    const bool uses_rasterized = IsColorInputUsed(cc, TEVCOLORARG_RASC, TEVCOLORARG_RASA) ||
+                                 IsAlphaInputUsed(ac, TEVALPHAARG_RASA);
+    const bool uses_texture = IsColorInputUsed(cc, TEVCOLORARG_TEXC, TEVCOLORARG_TEXA) ||
+                              IsAlphaInputUsed(ac, TEVALPHAARG_TEXA);
+    int swap[4];
+
+    // Rasterized color, of which only the two color channels are modelled
+    const int colorchan = order.getColorChan(odd);
+    if (uses_rasterized && (colorchan == COLORCHAN_COLOR0A0 || colorchan == COLORCHAN_COLOR1A1))
+    {
+      const u8* src[4];
+      for (int component = 0; component < 4; ++component)
+        src[component] = Rasterized(colorchan, component);
+      GetSwapTable(state, ac.rswap, swap);
+      LoadSwapped(arrays + ARRAY_RASTERIZED, src, swap, count);
+    }
+    else if (uses_rasterized)
+    {
+      for (int component = 0; component < 4; ++component)
+        Fill(arrays[ARRAY_RASTERIZED + component], stride, 0);
+    }
+
+    if (uses_texture && order.getEnable(odd))
+    {
+      const u8* src[4];
+      for (int component = 0; component < 4; ++component)
+        src[component] = Texture(order.getTexMap(odd), component);
+      GetSwapTable(state, ac.tswap, swap);
+      LoadSwapped(arrays + ARRAY_TEXTURE, src, swap, count);
+    }
+    else if (uses_texture)
+    {
+      for (int component = 0; component < 4; ++component)
+        Fill(arrays[ARRAY_TEXTURE + component], stride, 255);
+    }
+
+    if (IsColorInputUsed(cc, TEVCOLORARG_KONST, TEVCOLORARG_KONST))
+    {
+      for (int component = 0; component < 3; ++component)
+      {
+        Fill(arrays[ARRAY_KONST + component], stride,
+             GetKonstValue(state, ksel.getKC(odd), component));
+      }
+    }
+    if (IsAlphaInputUsed(ac, TEVALPHAARG_KONST))
+      Fill(arrays[ARRAY_KONST + COMP_A], stride, GetKonstValue(state, ksel.getKA(odd), COMP_A));
+
+    // Both combiners read their inputs before either of them writes its result. Without compare
+    // modes, every result only depends on inputs of the same pixel and component (or alpha,
+    // which the color combiner doesn't write), so results can go straight to the registers.
+    const bool compare = cc.bias == TevBias_COMPARE || ac.bias == TevBias_COMPARE;
+    s16* color_out[3];
+    s16* alpha_out;
+    for (int component = 0; component < 3; ++component)
+    {
+      color_out[component] = compare ? arrays[ARRAY_RESULT + component] :
+                                       arrays[ARRAY_REGISTERS + cc.dest * 4 + component];
+    }
+    alpha_out = compare ? arrays[ARRAY_RESULT + COMP_A] :
+                          arrays[ARRAY_REGISTERS + ac.dest * 4 + COMP_A];
+
+    const s16* color_a[3];
+    const s16* color_b[3];
+    for (int component = 0; component < 3; ++component)
+    {
+      color_a[component] = GetColorInput(cc.a, component, const_arrays);
+      color_b[component] = GetColorInput(cc.b, component, const_arrays);
+    }
+
+    for (int component = 0; component < 3; ++component)
+    {
+      const s16* c = GetColorInput(cc.c, component, const_arrays);
+      const s16* d = GetColorInput(cc.d, component, const_arrays);
+
+      if (cc.bias == TevBias_COMPARE)
+      {
+        CombineCompare(color_out[component], color_a, color_b, component, c, d, count, cc.shift,
+                       cc.op == 1, cc.clamp);
+      }
+      else
+      {
+        Combine(color_out[component], color_a[component], color_b[component], c, d, count,
+                cc.bias, cc.op, cc.clamp, cc.shift, scalar);
+      }
+    }
+
+    {
+      const s16* a = GetAlphaInput(ac.a, const_arrays);
+      const s16* b = GetAlphaInput(ac.b, const_arrays);
+      const s16* c = GetAlphaInput(ac.c, const_arrays);
+      const s16* d = GetAlphaInput(ac.d, const_arrays);
+
+      if (ac.bias == TevBias_COMPARE)
+      {
+        // Except for A8 (which has the same value as RGB8), the compare modes use the a and b
+        // inputs of the color combiner
+        if (ac.shift == TEVCMP_RGB8)
+        {
+          const s16* const alpha_a[3] = {a, a, a};
+          const s16* const alpha_b[3] = {b, b, b};
+          CombineCompare(alpha_out, alpha_a, alpha_b, COMP_R, c, d, count, TEVCMP_RGB8,
+                         ac.op == 1, ac.clamp);
+        }
+        else
+        {
+          CombineCompare(alpha_out, color_a, color_b, COMP_R, c, d, count, ac.shift, ac.op == 1,
+                         ac.clamp);
+        }
+      }
+      else
+      {
+        Combine(alpha_out, a, b, c, d, count, ac.bias, ac.op, ac.clamp, ac.shift, scalar);
+      }
+    }
+
+    if (compare)
+    {
+      for (int component = 0; component < 3; ++component)
+      {
+        std::copy(color_out[component], color_out[component] + count,
+                  arrays[ARRAY_REGISTERS + cc.dest * 4 + component]);
+      }
+      std::copy(alpha_out, alpha_out + count, arrays[ARRAY_REGISTERS + ac.dest * 4 + COMP_A]);
+    }
+
+    for (int component = 0; component < 3; ++component)
+      m_output_regs[component] = cc.dest;
+    m_output_regs[COMP_A] = ac.dest;
+  }
+}
+
+void Evaluate(const State& state, Pixels* pixels)
+{
+  pixels->EvaluateStages(state, false);
+}
+
+void EvaluateScalar(const State& state, Pixels* pixels)
+{
+  pixels->EvaluateStages(state, true);
+}
+
+}  // namespace TevEmulator
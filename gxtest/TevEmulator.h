@@ -0,0 +1,115 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <vector>
+
+#include "common/CommonTypes.h"
+#include "gxtest/BPMemory.h"
+
+// Software model of the texture environment (TEV), used as the expected result of TEV tests:
+//
+//   TevEmulator::State state;
+//   state.LoadBPReg(cc.hex);  // the same values that are loaded with CGX_LOAD_BP_REG
+//   ...
+//   TevEmulator::Pixels pixels(count);
+//   pixels.Rasterized(0, TevEmulator::COMP_R)[i] = ...;
+//   TevEmulator::Evaluate(state, &pixels);
+//   ... pixels.Output(TevEmulator::COMP_R)[i] ...
+//
+// All 16 stages are modelled with every color and alpha input, konst selection, swap tables,
+// compare modes and clamping. Inputs a, b and c are truncated to their lower 8 bits and d to 11
+// bits (sign-extended), and unclamped results saturate to -1024 to 1023, like in Dolphin.
+// Indirect texturing and bump alpha are not modelled; bump alpha color channels read as zero.
+//
+// Pixels are stored with one array per component, and each stage is evaluated for all pixels
+// at once with loops that compilers vectorize.
+
+namespace TevEmulator
+{
+// Registers, in the order of the dest field of the combiners (GX_TEVPREV, GX_TEVREG0-2)
+enum
+{
+  REG_PREV = 0,
+  REG_C0 = 1,
+  REG_C1 = 2,
+  REG_C2 = 3,
+};
+
+enum
+{
+  COMP_R = 0,
+  COMP_G = 1,
+  COMP_B = 2,
+  COMP_A = 3,
+};
+
+// TEV related BP registers
+struct State
+{
+  // Starts out with the values of CGXDefault, all registers zero and swap tables as set up
+  // by CGX_Init
+  State();
+
+  // Applies a BP register load. Loads of registers unrelated to the TEV are ignored.
+  void LoadBPReg(u32 value);
+
+  GenMode genmode;
+  TevStageCombiner::ColorCombiner color[16];
+  TevStageCombiner::AlphaCombiner alpha[16];
+  TwoTevStageOrders orders[8];
+  TevKSel ksel[8];
+
+  // Initial values of the registers and konst colors, as [REG_*][COMP_*].
+  // These are 11 bit signed values.
+  s16 registers[4][4];
+  s16 konst[4][4];
+};
+
+// Inputs and outputs of Evaluate for a number of pixels
+class Pixels
+{
+public:
+  explicit Pixels(int count);
+
+  int Count() const { return m_count; }
+
+  // Rasterized color of color channel 0 or 1, zero initialized
+  u8* Rasterized(int channel, int component);
+
+  // Texture color of each texture map, zero initialized. Stages without texturing read 255.
+  u8* Texture(int texmap, int component);
+
+  // Register values after Evaluate
+  const s16* Register(int reg, int component) const;
+
+  // Output of the last stage after Evaluate, i.e. its destination registers. This is what
+  // GXTest::GetTevOutput reads back; the EFB only gets the lower 8 bits.
+  const s16* Output(int component) const;
+
+private:
+  friend void Evaluate(const State& state, Pixels* pixels);
+  friend void EvaluateScalar(const State& state, Pixels* pixels);
+
+  void EvaluateStages(const State& state, bool scalar);
+
+  s16* Array(int index) { return &m_values[index * m_stride]; }
+  const s16* Array(int index) const { return &m_values[index * m_stride]; }
+
+  int m_count;
+  int m_stride;  // count rounded up to a multiple of 16, so that vector loops need no tail
+  std::vector<u8> m_inputs;
+  std::vector<s16> m_values;  // registers followed by scratch arrays for Evaluate
+  int m_output_regs[4];
+};
+
+// Runs all enabled stages on the given pixels.
+// This uses the fastest implementation available for the target.
+void Evaluate(const State& state, Pixels* pixels);
+
+// Reference implementation of Evaluate, one pixel at a time
+void EvaluateScalar(const State& state, Pixels* pixels);
+
+}  // namespace TevEmulator
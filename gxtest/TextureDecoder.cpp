@@ -0,0 +1,767 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/TextureDecoder.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace TextureDecoder
+{
+static const int BLOCK_SIZE = 4;
+static const int BLOCK_BYTES = 64;
+
+const int ALL_FORMATS[11] = {
+    FORMAT_I4, FORMAT_I8, FORMAT_IA4, FORMAT_IA8, FORMAT_RGB565, FORMAT_RGB5A3,
+    FORMAT_RGBA8, FORMAT_C4, FORMAT_C8, FORMAT_C14X2, FORMAT_CMPR,
+};
+
+const char* GetFormatName(int format)
+{
+  switch (format)
+  {
+  case FORMAT_I4:
+    return "I4";
+  case FORMAT_I8:
+    return "I8";
+  case FORMAT_IA4:
+    return "IA4";
+  case FORMAT_IA8:
+    return "IA8";
+  case FORMAT_RGB565:
+    return "RGB565";
+  case FORMAT_RGB5A3:
+    return "RGB5A3";
+  case FORMAT_RGBA8:
+    return "RGBA8";
+  case FORMAT_C4:
+    return "C4";
+  case FORMAT_C8:
+    return "C8";
+  case FORMAT_C14X2:
+    return "C14X2";
+  case FORMAT_CMPR:
+    return "CMPR";
+  default:
+    return "unknown";
+  }
+}
+
+bool IsPaletteFormat(int format)
+{
+  return format == FORMAT_C4 || format == FORMAT_C8 || format == FORMAT_C14X2;
+}
+
+int GetPaletteSize(int format)
+{
+  switch (format)
+  {
+  case FORMAT_C4:
+    return 16;
+  case FORMAT_C8:
+    return 256;
+  case FORMAT_C14X2:
+    return 16384;
+  default:
+    return 0;
+  }
+}
+
+int GetBlockWidth(int format)
+{
+  switch (format)
+  {
+  case FORMAT_I4:
+  case FORMAT_I8:
+  case FORMAT_IA4:
+  case FORMAT_C4:
+  case FORMAT_C8:
+  case FORMAT_CMPR:
+    return 8;
+  default:
+    return 4;
+  }
+}
+
+int GetBlockHeight(int format)
+{
+  return (format == FORMAT_I4 || format == FORMAT_C4 || format == FORMAT_CMPR) ? 8 : 4;
+}
+
+int GetBlockBytes(int format)
+{
+  return format == FORMAT_RGBA8 ? 64 : 32;
+}
+
+u32 GetTextureSize(int format, int width, int height)
+{
+  const u32 width_blocks = (width + GetBlockWidth(format) - 1) / GetBlockWidth(format);
+  const u32 height_blocks = (height + GetBlockHeight(format) - 1) / GetBlockHeight(format);
+  return width_blocks * height_blocks * GetBlockBytes(format);
+}
+
+u32 GetRGBA8TextureSize(int width, int height)
+{
+  const u32 width_blocks = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  const u32 height_blocks = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  return width_blocks * height_blocks * BLOCK_BYTES;
+}
+
+// Decodes the visible part of a block at pixel position (x, y)
+static void DecodeBlockScalar(u8* dst, const u8* block, int x, int y, int width, int height)
+{
+  for (int row = 0; row < BLOCK_SIZE && y + row < height; ++row)
+  {
+    for (int col = 0; col < BLOCK_SIZE && x + col < width; ++col)
+    {
+      const int index = row * BLOCK_SIZE + col;
+      u8* pixel = dst + ((y + row) * width + x + col) * 4;
+      pixel[0] = block[2 * index + 1];
+      pixel[1] = block[32 + 2 * index];
+      pixel[2] = block[32 + 2 * index + 1];
+      pixel[3] = block[2 * index];
+    }
+  }
+}
+
+void DetileRGBA8Scalar(u8* dst, const u8* src, int width, int height)
+{
+  const u8* block = src;
+  for (int y = 0; y < height; y += BLOCK_SIZE)
+  {
+    for (int x = 0; x < width; x += BLOCK_SIZE)
+    {
+      DecodeBlockScalar(dst, block, x, y, width, height);
+      block += BLOCK_BYTES;
+    }
+  }
+}
+
+static inline u8 Expand3(u32 value)
+{
+  return (value << 5) | (value << 2) | (value >> 1);
+}
+
+static inline u8 Expand4(u32 value)
+{
+  return (value << 4) | value;
+}
+
+static inline u8 Expand5(u32 value)
+{
+  return (value << 3) | (value >> 2);
+}
+
+static inline u8 Expand6(u32 value)
+{
+  return (value << 2) | (value >> 4);
+}
+
+static inline u16 Read16(const u8* data)
+{
+  return (data[0] << 8) | data[1];
+}
+
+static void SetPixel(u8* pixel, u8 r, u8 g, u8 b, u8 a)
+{
+  pixel[0] = r;
+  pixel[1] = g;
+  pixel[2] = b;
+  pixel[3] = a;
+}
+
+// Decodes a 16 bit texel or TLUT entry in one of the TLUT formats
+static void DecodeColor16(int tlut_format, u16 value, u8* pixel)
+{
+  switch (tlut_format)
+  {
+  case TLUT_IA8:
+    SetPixel(pixel, value & 0xFF, value & 0xFF, value & 0xFF, value >> 8);
+    break;
+  case TLUT_RGB565:
+    SetPixel(pixel, Expand5(value >> 11), Expand6((value >> 5) & 0x3F), Expand5(value & 0x1F),
+             0xFF);
+    break;
+  default:
+    if (value & 0x8000)
+    {
+      SetPixel(pixel, Expand5((value >> 10) & 0x1F), Expand5((value >> 5) & 0x1F),
+               Expand5(value & 0x1F), 0xFF);
+    }
+    else
+    {
+      SetPixel(pixel, Expand4((value >> 8) & 0xF), Expand4((value >> 4) & 0xF),
+               Expand4(value & 0xF), Expand3((value >> 12) & 0x7));
+    }
+    break;
+  }
+}
+
+// The four colors of a CMPR sub-block
+static void GetCmprColors(const u8* sub_block, u8 (*colors)[4])
+{
+  const u16 c0 = Read16(sub_block);
+  const u16 c1 = Read16(sub_block + 2);
+  DecodeColor16(TLUT_RGB565, c0, colors[0]);
+  DecodeColor16(TLUT_RGB565, c1, colors[1]);
+
+  for (int component = 0; component < 3; ++component)
+  {
+    const int v0 = colors[0][component];
+    const int v1 = colors[1][component];
+    if (c0 > c1)
+    {
+      colors[2][component] = (5 * v0 + 3 * v1) >> 3;
+      colors[3][component] = (3 * v0 + 5 * v1) >> 3;
+    }
+    else
+    {
+      colors[2][component] = colors[3][component] = (v0 + v1 + 1) >> 1;
+    }
+  }
+  colors[2][3] = 0xFF;
+  colors[3][3] = (c0 > c1) ? 0xFF : 0;
+}
+
+// Index of a pixel of a palette format
+static u32 GetPaletteIndex(int format, const u8* block, int index)
+{
+  switch (format)
+  {
+  case FORMAT_C4:
+    return (index & 1) ? (block[index / 2] & 0xF) : (block[index / 2] >> 4);
+  case FORMAT_C8:
+    return block[index];
+  default:
+    return Read16(block + 2 * index) & 0x3FFF;
+  }
+}
+
+// Decodes the pixel in the given row and column of a block
+static void DecodeTexelScalar(u8* pixel, const u8* block, int format, int row, int col,
+                              const u8* tlut, int tlut_format)
+{
+  const int index = row * GetBlockWidth(format) + col;
+
+  switch (format)
+  {
+  case FORMAT_I4:
+  {
+    const u8 value = Expand4((index & 1) ? (block[index / 2] & 0xF) : (block[index / 2] >> 4));
+    SetPixel(pixel, value, value, value, value);
+    break;
+  }
+  case FORMAT_I8:
+    SetPixel(pixel, block[index], block[index], block[index], block[index]);
+    break;
+  case FORMAT_IA4:
+  {
+    const u8 intensity = Expand4(block[index] & 0xF);
+    SetPixel(pixel, intensity, intensity, intensity, Expand4(block[index] >> 4));
+    break;
+  }
+  case FORMAT_IA8:
+    DecodeColor16(TLUT_IA8, Read16(block + 2 * index), pixel);
+    break;
+  case FORMAT_RGB565:
+    DecodeColor16(TLUT_RGB565, Read16(block + 2 * index), pixel);
+    break;
+  case FORMAT_RGB5A3:
+    DecodeColor16(TLUT_RGB5A3, Read16(block + 2 * index), pixel);
+    break;
+  case FORMAT_RGBA8:
+    SetPixel(pixel, block[2 * index + 1], block[32 + 2 * index], block[32 + 2 * index + 1],
+             block[2 * index]);
+    break;
+  case FORMAT_CMPR:
+  {
+    // Sub-blocks in the order top left, top right, bottom left, bottom right
+    const u8* sub_block = block + 8 * ((row / 4) * 2 + col / 4);
+    u8 colors[4][4];
+    GetCmprColors(sub_block, colors);
+    const int selection = (sub_block[4 + row % 4] >> (6 - 2 * (col % 4))) & 3;
+    memcpy(pixel, colors[selection], 4);
+    break;
+  }
+  default:
+  {
+    const u32 entry = GetPaletteIndex(format, block, index);
+    DecodeColor16(tlut_format, Read16(tlut + 2 * entry), pixel);
+    break;
+  }
+  }
+}
+
+// Decodes the visible part of a block of any format at pixel position (x, y)
+static void DecodeAnyBlockScalar(u8* dst, const u8* block, int format, int x, int y, int width,
+                                 int height, const u8* tlut, int tlut_format)
+{
+  for (int row = 0; row < GetBlockHeight(format) && y + row < height; ++row)
+  {
+    for (int col = 0; col < GetBlockWidth(format) && x + col < width; ++col)
+    {
+      DecodeTexelScalar(dst + ((y + row) * width + x + col) * 4, block, format, row, col, tlut,
+                        tlut_format);
+    }
+  }
+}
+
+void DecodeScalar(u8* dst, const u8* src, int width, int height, int format, const u8* tlut,
+                  int tlut_format)
+{
+  const u8* block = src;
+  for (int y = 0; y < height; y += GetBlockHeight(format))
+  {
+    for (int x = 0; x < width; x += GetBlockWidth(format))
+    {
+      DecodeAnyBlockScalar(dst, block, format, x, y, width, height, tlut, tlut_format);
+      block += GetBlockBytes(format);
+    }
+  }
+}
+
+#if defined(__SSE2__)
+
+// Decodes a complete block, with dst pointing at its top left pixel
+static inline void DecodeBlock(u8* dst, const u8* block, int stride)
+{
+  for (int half = 0; half < 2; ++half)
+  {
+    // 16 bit lanes of A | R << 8 and G | B << 8 for 8 pixels (two rows)
+    const __m128i ar = _mm_loadu_si128((const __m128i*)(block + 16 * half));
+    const __m128i gb = _mm_loadu_si128((const __m128i*)(block + 32 + 16 * half));
+
+    // 32 bit lanes of A | R << 8 | G << 16 | B << 24, rotated into R G B A byte order
+    __m128i row0 = _mm_unpacklo_epi16(ar, gb);
+    __m128i row1 = _mm_unpackhi_epi16(ar, gb);
+    row0 = _mm_or_si128(_mm_srli_epi32(row0, 8), _mm_slli_epi32(row0, 24));
+    row1 = _mm_or_si128(_mm_srli_epi32(row1, 8), _mm_slli_epi32(row1, 24));
+
+    _mm_storeu_si128((__m128i*)(dst + (2 * half) * stride), row0);
+    _mm_storeu_si128((__m128i*)(dst + (2 * half + 1) * stride), row1);
+  }
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static inline void DecodeBlock(u8* dst, const u8* block, int stride)
+{
+  // Deinterleave into separate A, R and G, B vectors of 16 pixels each
+  const uint8x16x2_t ar = vld2q_u8(block);
+  const uint8x16x2_t gb = vld2q_u8(block + 32);
+
+  uint8x16x4_t rgba;
+  rgba.val[0] = ar.val[1];
+  rgba.val[1] = gb.val[0];
+  rgba.val[2] = gb.val[1];
+  rgba.val[3] = ar.val[0];
+
+  u8 pixels[BLOCK_BYTES];
+  vst4q_u8(pixels, rgba);
+  for (int row = 0; row < BLOCK_SIZE; ++row)
+    vst1q_u8(dst + row * stride, vld1q_u8(pixels + 16 * row));
+}
+
+#else
+
+// Works on words containing two AR or GB pairs. On big-endian targets such as Broadway, each
+// output pixel is then an R G B A word, which GCC assembles with rlwinm/rlwimi. Paired single
+// loads and stores are of no help here, as they can't rearrange bytes.
+static inline void DecodeBlock(u8* dst, const u8* block, int stride)
+{
+  for (int row = 0; row < BLOCK_SIZE; ++row)
+  {
+    u8* out = dst + row * stride;
+    for (int pair = 0; pair < 2; ++pair)
+    {
+      const u8* ar = block + 8 * row + 4 * pair;
+      const u8* gb = ar + 32;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      u32 ar_word, gb_word;
+      memcpy(&ar_word, ar, 4);  // A0 R0 A1 R1
+      memcpy(&gb_word, gb, 4);  // G0 B0 G1 B1
+      const u32 pixel0 =
+          ((ar_word << 8) & 0xFF000000) | ((gb_word >> 8) & 0x00FFFF00) | (ar_word >> 24);
+      const u32 pixel1 = (ar_word << 24) | ((gb_word << 8) & 0x00FFFF00) | ((ar_word >> 8) & 0xFF);
+      memcpy(out + 8 * pair, &pixel0, 4);
+      memcpy(out + 8 * pair + 4, &pixel1, 4);
+#else
+      const u8 pixels[8] = {ar[1], gb[0], gb[1], ar[0], ar[3], gb[2], gb[3], ar[2]};
+      memcpy(out + 8 * pair, pixels, 8);
+#endif
+    }
+  }
+}
+
+#endif
+
+void DetileRGBA8(u8* dst, const u8* src, int width, int height)
+{
+  const int stride = width * 4;
+  const int full_width = width & ~(BLOCK_SIZE - 1);
+  const int full_height = height & ~(BLOCK_SIZE - 1);
+
+  const u8* block = src;
+  for (int y = 0; y < height; y += BLOCK_SIZE)
+  {
+    u8* row = dst + y * stride;
+
+#if defined(GEKKO)
+    // Whole output cache lines are overwritten if a row of two blocks is 32 byte aligned, so
+    // they can be allocated without reading them from memory first.
+    const bool zero_lines = ((uintptr_t)row & 31) == 0 && (stride & 31) == 0 && y < full_height;
+#endif
+
+    int x = 0;
+    if (y < full_height)
+    {
+      for (; x < full_width; x += BLOCK_SIZE)
+      {
+#if defined(GEKKO)
+        if (zero_lines && (x & 7) == 0 && x + 2 * BLOCK_SIZE <= full_width)
+        {
+          for (int line = 0; line < BLOCK_SIZE; ++line)
+            asm volatile("dcbz 0,%0" : : "b"(row + line * stride + x * 4) : "memory");
+        }
+#endif
+        DecodeBlock(row + x * 4, block, stride);
+        block += BLOCK_BYTES;
+      }
+    }
+
+    // Partial blocks at the right and bottom edges
+    for (; x < width; x += BLOCK_SIZE)
+    {
+      DecodeBlockScalar(dst, block, x, y, width, height);
+      block += BLOCK_BYTES;
+    }
+  }
+}
+
+// Palette formats and CMPR are decoded with tables of whole pixels, which are looked up with
+// 32 bit loads and stores. Pixels are kept in memory order, so this works on any host.
+static void DecodePalette(const u8* tlut, int tlut_format, int count, u32* palette)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    u8 pixel[4];
+    DecodeColor16(tlut_format, Read16(tlut + 2 * i), pixel);
+    memcpy(&palette[i], pixel, 4);
+  }
+}
+
+static void DecodePaletteBlock(u8* dst, const u8* block, int format, int stride,
+                               const u32* palette)
+{
+  const int block_width = GetBlockWidth(format);
+  for (int row = 0; row < GetBlockHeight(format); ++row)
+  {
+    u8* out = dst + row * stride;
+    for (int col = 0; col < block_width; ++col)
+      memcpy(out + 4 * col, &palette[GetPaletteIndex(format, block, row * block_width + col)], 4);
+  }
+}
+
+static void DecodeCmprBlock(u8* dst, const u8* block, int stride)
+{
+  for (int sub = 0; sub < 4; ++sub)
+  {
+    const u8* sub_block = block + 8 * sub;
+    u8 colors[4][4];
+    GetCmprColors(sub_block, colors);
+
+    u8* sub_dst = dst + (sub / 2) * 4 * stride + (sub % 2) * 16;
+    for (int row = 0; row < 4; ++row)
+    {
+      const u8 selections = sub_block[4 + row];
+      u8* out = sub_dst + row * stride;
+      memcpy(out, colors[selections >> 6], 4);
+      memcpy(out + 4, colors[(selections >> 4) & 3], 4);
+      memcpy(out + 8, colors[(selections >> 2) & 3], 4);
+      memcpy(out + 12, colors[selections & 3], 4);
+    }
+  }
+}
+
+#if defined(__SSE2__)
+
+// The 16 bit formats are decoded with the same code for SSE2 and AVX2 vectors. Texels are
+// loaded into 16 bit lanes, so the bytes of each texel are swapped, and are converted into
+// lanes of R | G << 8 and B | A << 8, which are then interleaved into pixels.
+static inline __m128i Splat16(__m128i, int value)
+{
+  return _mm_set1_epi16((short)value);
+}
+static inline __m128i And(__m128i a, __m128i b)
+{
+  return _mm_and_si128(a, b);
+}
+static inline __m128i Or(__m128i a, __m128i b)
+{
+  return _mm_or_si128(a, b);
+}
+static inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+static inline __m128i ShiftLeft16(__m128i value, int shift)
+{
+  return _mm_slli_epi16(value, shift);
+}
+static inline __m128i ShiftRight16(__m128i value, int shift)
+{
+  return _mm_srli_epi16(value, shift);
+}
+static inline __m128i SignMask16(__m128i value)
+{
+  return _mm_srai_epi16(value, 15);
+}
+
+#if defined(__AVX2__)
+static inline __m256i Splat16(__m256i, int value)
+{
+  return _mm256_set1_epi16((short)value);
+}
+static inline __m256i And(__m256i a, __m256i b)
+{
+  return _mm256_and_si256(a, b);
+}
+static inline __m256i Or(__m256i a, __m256i b)
+{
+  return _mm256_or_si256(a, b);
+}
+static inline __m256i Select(__m256i mask, __m256i a, __m256i b)
+{
+  return _mm256_or_si256(_mm256_and_si256(mask, a), _mm256_andnot_si256(mask, b));
+}
+static inline __m256i ShiftLeft16(__m256i value, int shift)
+{
+  return _mm256_slli_epi16(value, shift);
+}
+static inline __m256i ShiftRight16(__m256i value, int shift)
+{
+  return _mm256_srli_epi16(value, shift);
+}
+static inline __m256i SignMask16(__m256i value)
+{
+  return _mm256_srai_epi16(value, 15);
+}
+#endif
+
+template <typename V>
+static inline V Mask16(V value, int mask)
+{
+  return And(value, Splat16(value, mask));
+}
+
+template <typename V>
+static inline V Expand5(V value)
+{
+  return Or(ShiftLeft16(value, 3), ShiftRight16(value, 2));
+}
+
+template <typename V>
+static inline V Expand4(V value)
+{
+  return Or(ShiftLeft16(value, 4), value);
+}
+
+template <typename V>
+static inline void DecodeTexels16(int format, V loaded, V* rg, V* ba)
+{
+  const V texels = Or(ShiftLeft16(loaded, 8), ShiftRight16(loaded, 8));
+
+  switch (format)
+  {
+  case FORMAT_IA8:
+  {
+    const V intensity = Mask16(texels, 0xFF);
+    *rg = Or(intensity, ShiftLeft16(intensity, 8));
+    *ba = Or(intensity, ShiftLeft16(ShiftRight16(texels, 8), 8));
+    break;
+  }
+  case FORMAT_RGB565:
+  {
+    const V green = Mask16(ShiftRight16(texels, 5), 0x3F);
+    *rg = Or(Expand5(ShiftRight16(texels, 11)),
+             ShiftLeft16(Or(ShiftLeft16(green, 2), ShiftRight16(green, 4)), 8));
+    *ba = Or(Expand5(Mask16(texels, 0x1F)), Splat16(texels, 0xFF00));
+    break;
+  }
+  default:
+  {
+    const V rgb555_rg = Or(Expand5(Mask16(ShiftRight16(texels, 10), 0x1F)),
+                           ShiftLeft16(Expand5(Mask16(ShiftRight16(texels, 5), 0x1F)), 8));
+    const V rgb555_ba = Or(Expand5(Mask16(texels, 0x1F)), Splat16(texels, 0xFF00));
+
+    const V alpha = Mask16(ShiftRight16(texels, 12), 0x7);
+    const V alpha8 = Or(Or(ShiftLeft16(alpha, 5), ShiftLeft16(alpha, 2)), ShiftRight16(alpha, 1));
+    const V argb3444_rg = Or(Expand4(Mask16(ShiftRight16(texels, 8), 0xF)),
+                             ShiftLeft16(Expand4(Mask16(ShiftRight16(texels, 4), 0xF)), 8));
+    const V argb3444_ba = Or(Expand4(Mask16(texels, 0xF)), ShiftLeft16(alpha8, 8));
+
+    const V is_rgb555 = SignMask16(texels);
+    *rg = Select(is_rgb555, rgb555_rg, argb3444_rg);
+    *ba = Select(is_rgb555, rgb555_ba, argb3444_ba);
+    break;
+  }
+  }
+}
+
+// Decodes a complete 4x4 block of a 16 bit format
+static inline void Decode16BitBlock(u8* dst, const u8* block, int format, int stride)
+{
+#if defined(__AVX2__)
+  // Rows 0 and 1 end up in the lower half, rows 2 and 3 in the upper one
+  __m256i rg, ba;
+  DecodeTexels16(format, _mm256_loadu_si256((const __m256i*)block), &rg, &ba);
+  const __m256i even_rows = _mm256_unpacklo_epi16(rg, ba);
+  const __m256i odd_rows = _mm256_unpackhi_epi16(rg, ba);
+  _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(even_rows));
+  _mm_storeu_si128((__m128i*)(dst + stride), _mm256_castsi256_si128(odd_rows));
+  _mm_storeu_si128((__m128i*)(dst + 2 * stride), _mm256_extracti128_si256(even_rows, 1));
+  _mm_storeu_si128((__m128i*)(dst + 3 * stride), _mm256_extracti128_si256(odd_rows, 1));
+#else
+  for (int half = 0; half < 2; ++half)
+  {
+    __m128i rg, ba;
+    DecodeTexels16(format, _mm_loadu_si128((const __m128i*)(block + 16 * half)), &rg, &ba);
+    _mm_storeu_si128((__m128i*)(dst + 2 * half * stride), _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)(dst + (2 * half + 1) * stride), _mm_unpackhi_epi16(rg, ba));
+  }
+#endif
+}
+
+// Stores two rows of 8 intensity values (I8 and I4) as pixels
+static inline void StoreIntensityRows(u8* dst, __m128i intensity, int stride)
+{
+  const __m128i row0 = _mm_unpacklo_epi8(intensity, intensity);
+  const __m128i row1 = _mm_unpackhi_epi8(intensity, intensity);
+  _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(row0, row0));
+  _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(row0, row0));
+  _mm_storeu_si128((__m128i*)(dst + stride), _mm_unpacklo_epi16(row1, row1));
+  _mm_storeu_si128((__m128i*)(dst + stride + 16), _mm_unpackhi_epi16(row1, row1));
+}
+
+// Decodes a complete block of one of the formats without palette, except RGBA8 and CMPR
+static inline bool DecodeBlockFast(u8* dst, const u8* block, int format, int stride)
+{
+  const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+
+  switch (format)
+  {
+  case FORMAT_I4:
+    // Two rows of 4 bytes at a time, with the first pixel in the upper nibble
+    for (int row = 0; row < 8; row += 2)
+    {
+      const __m128i bytes = _mm_loadl_epi64((const __m128i*)(block + 4 * row));
+      const __m128i nibbles = _mm_unpacklo_epi8(
+          _mm_and_si128(_mm_srli_epi16(bytes, 4), low_nibbles), _mm_and_si128(bytes, low_nibbles));
+      StoreIntensityRows(dst + row * stride, _mm_or_si128(nibbles, _mm_slli_epi16(nibbles, 4)),
+                         stride);
+    }
+    return true;
+  case FORMAT_I8:
+    for (int row = 0; row < 4; row += 2)
+    {
+      StoreIntensityRows(dst + row * stride,
+                         _mm_loadu_si128((const __m128i*)(block + 8 * row)), stride);
+    }
+    return true;
+  case FORMAT_IA4:
+    for (int row = 0; row < 4; row += 2)
+    {
+      const __m128i bytes = _mm_loadu_si128((const __m128i*)(block + 8 * row));
+      const __m128i intensity = _mm_and_si128(bytes, low_nibbles);
+      const __m128i alpha = _mm_and_si128(_mm_srli_epi16(bytes, 4), low_nibbles);
+      const __m128i intensity8 = _mm_or_si128(intensity, _mm_slli_epi16(intensity, 4));
+      const __m128i alpha8 = _mm_or_si128(alpha, _mm_slli_epi16(alpha, 4));
+
+      for (int half = 0; half < 2; ++half)
+      {
+        const __m128i ii = half ? _mm_unpackhi_epi8(intensity8, intensity8) :
+                                  _mm_unpacklo_epi8(intensity8, intensity8);
+        const __m128i ia = half ? _mm_unpackhi_epi8(intensity8, alpha8) :
+                                  _mm_unpacklo_epi8(intensity8, alpha8);
+        u8* out = dst + (row + half) * stride;
+        _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(ii, ia));
+        _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(ii, ia));
+      }
+    }
+    return true;
+  case FORMAT_IA8:
+  case FORMAT_RGB565:
+  case FORMAT_RGB5A3:
+    Decode16BitBlock(dst, block, format, stride);
+    return true;
+  default:
+    return false;
+  }
+}
+
+#else
+
+static inline bool DecodeBlockFast(u8* dst, const u8* block, int format, int stride)
+{
+  return false;
+}
+
+#endif
+
+void Decode(u8* dst, const u8* src, int width, int height, int format, const u8* tlut,
+            int tlut_format)
+{
+  if (format == FORMAT_RGBA8)
+  {
+    DetileRGBA8(dst, src, width, height);
+    return;
+  }
+
+  std::vector<u32> palette;
+  if (IsPaletteFormat(format))
+  {
+    palette.resize(GetPaletteSize(format));
+    DecodePalette(tlut, tlut_format, GetPaletteSize(format), palette.data());
+  }
+
+  const int stride = width * 4;
+  const int block_width = GetBlockWidth(format);
+  const int block_height = GetBlockHeight(format);
+
+  const u8* block = src;
+  for (int y = 0; y < height; y += block_height)
+  {
+    for (int x = 0; x < width; x += block_width)
+    {
+      u8* out = dst + y * stride + x * 4;
+      const bool complete = x + block_width <= width && y + block_height <= height;
+
+      if (!complete)
+        DecodeAnyBlockScalar(dst, block, format, x, y, width, height, tlut, tlut_format);
+      else if (format == FORMAT_CMPR)
+        DecodeCmprBlock(out, block, stride);
+      else if (IsPaletteFormat(format))
+        DecodePaletteBlock(out, block, format, stride, palette.data());
+      else if (!DecodeBlockFast(out, block, format, stride))
+        DecodeAnyBlockScalar(dst, block, format, x, y, width, height, tlut, tlut_format);
+
+      block += GetBlockBytes(format);
+    }
+  }
+}
+
+}  // namespace TextureDecoder
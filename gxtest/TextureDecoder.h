@@ -0,0 +1,90 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/CommonTypes.h"
+
+// Conversion of tiled GX texture data (e.g. the result of EFB copies) into linear images.
+// Linear images are stored row by row with R, G, B, A bytes per pixel, regardless of the
+// endianness of the host.
+//
+// Components with less than 8 bits are expanded by repeating their upper bits, e.g.
+// (value << 3) | (value >> 2) for 5 bits. Intensity formats put the intensity into R, G and B.
+// IA4 has alpha in the upper nibble and IA8 has it in the first byte. RGB5A3 texels with the
+// top bit set are RGB555, all others are A3RGB4. Palette formats look up the TLUT, whose entries
+// are in one of the TLUT formats, and C14X2 ignores the upper two bits of its indices.
+// CMPR blocks consist of four 4x4 DXT1 sub-blocks, with the two interpolated colors computed as
+// (5 * c0 + 3 * c1) >> 3 and (3 * c0 + 5 * c1) >> 3 if c0 > c1. Otherwise, the third color is the
+// average (c0 + c1 + 1) >> 1 and the fourth one is the same with alpha 0, like in Dolphin.
+
+namespace TextureDecoder
+{
+// The same values as GX_TF_* in libogc
+enum
+{
+  FORMAT_I4 = 0x0,
+  FORMAT_I8 = 0x1,
+  FORMAT_IA4 = 0x2,
+  FORMAT_IA8 = 0x3,
+  FORMAT_RGB565 = 0x4,
+  FORMAT_RGB5A3 = 0x5,
+  FORMAT_RGBA8 = 0x6,
+  FORMAT_C4 = 0x8,
+  FORMAT_C8 = 0x9,
+  FORMAT_C14X2 = 0xA,
+  FORMAT_CMPR = 0xE,
+};
+
+// The same values as GX_TL_* in libogc
+enum
+{
+  TLUT_IA8 = 0x0,
+  TLUT_RGB565 = 0x1,
+  TLUT_RGB5A3 = 0x2,
+};
+
+// Every format above, e.g. for tests that go through all of them
+extern const int ALL_FORMATS[11];
+
+const char* GetFormatName(int format);
+
+// Whether the format uses a TLUT
+bool IsPaletteFormat(int format);
+
+// Number of TLUT entries which the indices of a palette format can address
+int GetPaletteSize(int format);
+
+// Size of the 4x4, 8x4 or 8x8 pixel blocks of a format, which are always 32 bytes large, except
+// for the 64 bytes of RGBA8 blocks
+int GetBlockWidth(int format);
+int GetBlockHeight(int format);
+int GetBlockBytes(int format);
+
+// Size in bytes of a tiled texture, with the dimensions rounded up to whole blocks
+u32 GetTextureSize(int format, int width, int height);
+
+// Size in bytes of a tiled RGBA8 texture. Textures are made of 4x4 pixel blocks, so the
+// dimensions are rounded up to the next multiple of 4.
+u32 GetRGBA8TextureSize(int width, int height);
+
+// Converts a tiled texture into a linear image of width * height * 4 bytes. For palette formats,
+// tlut holds GetPaletteSize(format) big-endian entries in tlut_format; it is unused otherwise.
+// This uses the fastest implementation available for the target.
+void Decode(u8* dst, const u8* src, int width, int height, int format, const u8* tlut = nullptr,
+            int tlut_format = TLUT_IA8);
+
+// Reference implementation of Decode, one pixel at a time
+void DecodeScalar(u8* dst, const u8* src, int width, int height, int format,
+                  const u8* tlut = nullptr, int tlut_format = TLUT_IA8);
+
+// Converts a tiled RGBA8 texture into a linear image of width * height * 4 bytes.
+// Each 4x4 block is stored as 64 bytes: 16 AR pairs followed by 16 GB pairs.
+// This uses the fastest implementation available for the target.
+void DetileRGBA8(u8* dst, const u8* src, int width, int height);
+
+// Reference implementation of DetileRGBA8, one pixel at a time
+void DetileRGBA8Scalar(u8* dst, const u8* src, int width, int height);
+
+}  // namespace TextureDecoder
@@ -0,0 +1,570 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/TextureEncoder.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace TextureEncoder
+{
+const int ALL_FORMATS[23] = {
+    FORMAT_I4,  FORMAT_I8,  FORMAT_IA4, FORMAT_IA8, FORMAT_RGB565, FORMAT_RGB5A3, FORMAT_RGBA8,
+    FORMAT_Z8,  FORMAT_Z16, FORMAT_Z24X8,
+    FORMAT_R4,  FORMAT_RA4, FORMAT_RA8, FORMAT_A8,  FORMAT_R8,     FORMAT_G8,     FORMAT_B8,
+    FORMAT_RG8, FORMAT_GB8,
+    FORMAT_Z4,  FORMAT_Z8M, FORMAT_Z8L, FORMAT_Z16L,
+};
+
+// How texels are computed from a pixel. Depth formats use the encoding of the color format with
+// the same copy register value.
+enum Encoding
+{
+  ENCODING_I4,
+  ENCODING_I8,
+  ENCODING_IA4,
+  ENCODING_IA8,
+  ENCODING_RGB565,
+  ENCODING_RGB5A3,
+  ENCODING_RGBA8,
+  ENCODING_R4,
+  ENCODING_RA4,
+  ENCODING_RA8,
+  ENCODING_A8,
+  ENCODING_R8,
+  ENCODING_G8,
+  ENCODING_B8,
+  ENCODING_RG8,
+  ENCODING_GB8,
+};
+
+static Encoding GetEncoding(int format)
+{
+  switch (format)
+  {
+  case FORMAT_I4:
+    return ENCODING_I4;
+  case FORMAT_I8:
+    return ENCODING_I8;
+  case FORMAT_IA4:
+    return ENCODING_IA4;
+  case FORMAT_IA8:
+    return ENCODING_IA8;
+  case FORMAT_RGB565:
+    return ENCODING_RGB565;
+  case FORMAT_RGB5A3:
+    return ENCODING_RGB5A3;
+  case FORMAT_RGBA8:
+  case FORMAT_Z24X8:
+    return ENCODING_RGBA8;
+  case FORMAT_R4:
+  case FORMAT_Z4:
+    return ENCODING_R4;
+  case FORMAT_RA4:
+    return ENCODING_RA4;
+  case FORMAT_RA8:
+    return ENCODING_RA8;
+  case FORMAT_A8:
+    return ENCODING_A8;
+  case FORMAT_R8:
+  case FORMAT_Z8:
+    return ENCODING_R8;
+  case FORMAT_G8:
+  case FORMAT_Z8M:
+    return ENCODING_G8;
+  case FORMAT_B8:
+  case FORMAT_Z8L:
+    return ENCODING_B8;
+  case FORMAT_RG8:
+  case FORMAT_Z16:
+    return ENCODING_RG8;
+  default:
+    return ENCODING_GB8;
+  }
+}
+
+const char* GetFormatName(int format)
+{
+  switch (format)
+  {
+  case FORMAT_I4:
+    return "I4";
+  case FORMAT_I8:
+    return "I8";
+  case FORMAT_IA4:
+    return "IA4";
+  case FORMAT_IA8:
+    return "IA8";
+  case FORMAT_RGB565:
+    return "RGB565";
+  case FORMAT_RGB5A3:
+    return "RGB5A3";
+  case FORMAT_RGBA8:
+    return "RGBA8";
+  case FORMAT_Z8:
+    return "Z8";
+  case FORMAT_Z16:
+    return "Z16";
+  case FORMAT_Z24X8:
+    return "Z24X8";
+  case FORMAT_R4:
+    return "R4";
+  case FORMAT_RA4:
+    return "RA4";
+  case FORMAT_RA8:
+    return "RA8";
+  case FORMAT_A8:
+    return "A8";
+  case FORMAT_R8:
+    return "R8";
+  case FORMAT_G8:
+    return "G8";
+  case FORMAT_B8:
+    return "B8";
+  case FORMAT_RG8:
+    return "RG8";
+  case FORMAT_GB8:
+    return "GB8";
+  case FORMAT_Z4:
+    return "Z4";
+  case FORMAT_Z8M:
+    return "Z8M";
+  case FORMAT_Z8L:
+    return "Z8L";
+  case FORMAT_Z16L:
+    return "Z16L";
+  default:
+    return "unknown";
+  }
+}
+
+bool IsDepthFormat(int format)
+{
+  return (format & 0x10) != 0;
+}
+
+static int GetBitsPerPixel(Encoding encoding)
+{
+  switch (encoding)
+  {
+  case ENCODING_I4:
+  case ENCODING_R4:
+    return 4;
+  case ENCODING_I8:
+  case ENCODING_IA4:
+  case ENCODING_RA4:
+  case ENCODING_A8:
+  case ENCODING_R8:
+  case ENCODING_G8:
+  case ENCODING_B8:
+    return 8;
+  case ENCODING_RGBA8:
+    return 32;
+  default:
+    return 16;
+  }
+}
+
+int GetBlockWidth(int format)
+{
+  return GetBitsPerPixel(GetEncoding(format)) <= 8 ? 8 : 4;
+}
+
+int GetBlockHeight(int format)
+{
+  return GetBitsPerPixel(GetEncoding(format)) == 4 ? 8 : 4;
+}
+
+int GetBlockBytes(int format)
+{
+  return GetEncoding(format) == ENCODING_RGBA8 ? 64 : 32;
+}
+
+u32 GetTextureSize(int format, int width, int height)
+{
+  const u32 width_blocks = (width + GetBlockWidth(format) - 1) / GetBlockWidth(format);
+  const u32 height_blocks = (height + GetBlockHeight(format) - 1) / GetBlockHeight(format);
+  return width_blocks * height_blocks * GetBlockBytes(format);
+}
+
+void DepthToColors(u8* rgba, const u32* depth, int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    rgba[4 * i] = depth[i] >> 16;
+    rgba[4 * i + 1] = depth[i] >> 8;
+    rgba[4 * i + 2] = depth[i];
+    rgba[4 * i + 3] = 0xFF;
+  }
+}
+
+static int GetIntensity(const u8* pixel)
+{
+  return ((66 * pixel[0] + 129 * pixel[1] + 25 * pixel[2] + 128) >> 8) + 16;
+}
+
+// Texel of a pixel, with the first byte in memory in the upper bits of 16 bit texels.
+// RGBA8 texels are returned as A, R, G, B from the upper to the lower bits.
+static u32 GetTexel(Encoding encoding, const u8* pixel)
+{
+  const int r = pixel[0];
+  const int g = pixel[1];
+  const int b = pixel[2];
+  const int a = pixel[3];
+
+  switch (encoding)
+  {
+  case ENCODING_I4:
+    return GetIntensity(pixel) >> 4;
+  case ENCODING_I8:
+    return GetIntensity(pixel);
+  case ENCODING_IA4:
+    return (a & 0xF0) | (GetIntensity(pixel) >> 4);
+  case ENCODING_IA8:
+    return (a << 8) | GetIntensity(pixel);
+  case ENCODING_RGB565:
+    return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+  case ENCODING_RGB5A3:
+    if ((a >> 5) == 7)
+      return 0x8000 | ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+    return ((a >> 5) << 12) | ((r >> 4) << 8) | ((g >> 4) << 4) | (b >> 4);
+  case ENCODING_RGBA8:
+    return ((u32)a << 24) | (r << 16) | (g << 8) | b;
+  case ENCODING_R4:
+    return r >> 4;
+  case ENCODING_RA4:
+    return (a & 0xF0) | (r >> 4);
+  case ENCODING_RA8:
+    return (a << 8) | r;
+  case ENCODING_A8:
+    return a;
+  case ENCODING_R8:
+    return r;
+  case ENCODING_G8:
+    return g;
+  case ENCODING_B8:
+    return b;
+  case ENCODING_RG8:
+    return (g << 8) | r;
+  default:
+    return (b << 8) | g;
+  }
+}
+
+// Encodes the block at pixel position (x, y), which may be partially outside the image
+static void EncodeBlockScalar(Encoding encoding, u8* block, const u8* rgba, int x, int y,
+                              int width, int height)
+{
+  static const u8 zero[4] = {};
+  const int bits = GetBitsPerPixel(encoding);
+  const int block_width = bits <= 8 ? 8 : 4;
+  const int block_height = bits == 4 ? 8 : 4;
+
+  memset(block, 0, encoding == ENCODING_RGBA8 ? 64 : 32);
+  for (int row = 0; row < block_height; ++row)
+  {
+    for (int col = 0; col < block_width; ++col)
+    {
+      const bool inside = x + col < width && y + row < height;
+      const u8* pixel = inside ? rgba + ((y + row) * width + x + col) * 4 : zero;
+      const u32 texel = GetTexel(encoding, pixel);
+      const int index = row * block_width + col;
+
+      switch (bits)
+      {
+      case 4:
+        block[index / 2] |= (index & 1) ? texel : texel << 4;
+        break;
+      case 8:
+        block[index] = texel;
+        break;
+      case 16:
+        block[2 * index] = texel >> 8;
+        block[2 * index + 1] = texel;
+        break;
+      default:
+        // AR pairs of all pixels followed by GB pairs
+        block[2 * index] = texel >> 24;
+        block[2 * index + 1] = texel >> 16;
+        block[32 + 2 * index] = texel >> 8;
+        block[32 + 2 * index + 1] = texel;
+        break;
+      }
+    }
+  }
+}
+
+void EncodeScalar(int format, u8* dst, const u8* rgba, int width, int height)
+{
+  const Encoding encoding = GetEncoding(format);
+  u8* block = dst;
+  for (int y = 0; y < height; y += GetBlockHeight(format))
+  {
+    for (int x = 0; x < width; x += GetBlockWidth(format))
+    {
+      EncodeBlockScalar(encoding, block, rgba, x, y, width, height);
+      block += GetBlockBytes(format);
+    }
+  }
+}
+
+void DownscaleScalar(u8* dst, const u8* rgba, int width, int height)
+{
+  const int stride = width * 4;
+  for (int y = 0; y < height / 2; ++y)
+  {
+    const u8* top = rgba + 2 * y * stride;
+    const u8* bottom = top + stride;
+    for (int x = 0; x < width / 2; ++x)
+    {
+      for (int component = 0; component < 4; ++component)
+      {
+        const int i = 8 * x + component;
+        *dst++ = (top[i] + top[i + 4] + bottom[i] + bottom[i + 4] + 2) >> 2;
+      }
+    }
+  }
+}
+
+#if defined(__SSE2__)
+
+// Pixels are converted four at a time, from 32 bit lanes of R | G << 8 | B << 16 | A << 24 to
+// 32 bit lanes holding the texel. Texels of 16 bits have their first byte in memory in the
+// lower bits, so that they can be stored directly.
+
+static inline __m128i Mask(__m128i value, u32 mask)
+{
+  return _mm_and_si128(value, _mm_set1_epi32(mask));
+}
+
+static inline __m128i Component(__m128i pixels, int component)
+{
+  return Mask(_mm_srli_epi32(pixels, 8 * component), 0xFF);
+}
+
+static inline __m128i Intensity(__m128i pixels)
+{
+  // 66 * R + 25 * B and 129 * G, with 16 bit factors in each half of the 32 bit lanes
+  const __m128i rb = _mm_madd_epi16(Mask(pixels, 0x00FF00FF), _mm_set1_epi32(66 | (25 << 16)));
+  const __m128i g = _mm_madd_epi16(Component(pixels, 1), _mm_set1_epi32(129));
+  const __m128i sum = _mm_add_epi32(_mm_add_epi32(rb, g), _mm_set1_epi32(128));
+  return _mm_add_epi32(_mm_srli_epi32(sum, 8), _mm_set1_epi32(16));
+}
+
+// Swaps the two lower bytes of each lane, for texels which are computed with the first byte in
+// the upper bits
+static inline __m128i SwapBytes16(__m128i value)
+{
+  return _mm_or_si128(Mask(_mm_srli_epi32(value, 8), 0xFF), Mask(_mm_slli_epi32(value, 8), 0xFF00));
+}
+
+static inline __m128i GetTexels(Encoding encoding, __m128i pixels)
+{
+  switch (encoding)
+  {
+  case ENCODING_I4:
+    return _mm_srli_epi32(Intensity(pixels), 4);
+  case ENCODING_I8:
+    return Intensity(pixels);
+  case ENCODING_IA4:
+    return _mm_or_si128(Mask(_mm_srli_epi32(pixels, 24), 0xF0),
+                        _mm_srli_epi32(Intensity(pixels), 4));
+  case ENCODING_IA8:
+    return _mm_or_si128(_mm_srli_epi32(pixels, 24), _mm_slli_epi32(Intensity(pixels), 8));
+  case ENCODING_RGB565:
+  {
+    const __m128i texels =
+        _mm_or_si128(_mm_or_si128(_mm_slli_epi32(Mask(pixels, 0xF8), 8),
+                                  _mm_srli_epi32(Mask(pixels, 0xFC00), 5)),
+                     _mm_srli_epi32(Mask(pixels, 0xF80000), 19));
+    return SwapBytes16(texels);
+  }
+  case ENCODING_RGB5A3:
+  {
+    const __m128i opaque =
+        _mm_or_si128(_mm_or_si128(_mm_slli_epi32(Mask(pixels, 0xF8), 7),
+                                  _mm_srli_epi32(Mask(pixels, 0xF800), 6)),
+                     _mm_or_si128(_mm_srli_epi32(Mask(pixels, 0xF80000), 19),
+                                  _mm_set1_epi32(0x8000)));
+    const __m128i translucent =
+        _mm_or_si128(_mm_or_si128(_mm_slli_epi32(Mask(_mm_srli_epi32(pixels, 29), 0x7), 12),
+                                  _mm_slli_epi32(Mask(pixels, 0xF0), 4)),
+                     _mm_or_si128(_mm_srli_epi32(Mask(pixels, 0xF000), 8),
+                                  _mm_srli_epi32(Mask(pixels, 0xF00000), 20)));
+    const __m128i is_opaque = _mm_cmpgt_epi32(_mm_srli_epi32(pixels, 24), _mm_set1_epi32(0xDF));
+    return SwapBytes16(_mm_or_si128(_mm_and_si128(is_opaque, opaque),
+                                    _mm_andnot_si128(is_opaque, translucent)));
+  }
+  case ENCODING_R4:
+    return Mask(_mm_srli_epi32(pixels, 4), 0xF);
+  case ENCODING_RA4:
+    return _mm_or_si128(Mask(_mm_srli_epi32(pixels, 24), 0xF0),
+                        Mask(_mm_srli_epi32(pixels, 4), 0xF));
+  case ENCODING_RA8:
+    return _mm_or_si128(_mm_srli_epi32(pixels, 24), _mm_slli_epi32(Mask(pixels, 0xFF), 8));
+  case ENCODING_A8:
+    return _mm_srli_epi32(pixels, 24);
+  case ENCODING_R8:
+    return Component(pixels, 0);
+  case ENCODING_G8:
+    return Component(pixels, 1);
+  case ENCODING_B8:
+    return Component(pixels, 2);
+  case ENCODING_RG8:
+    return _mm_or_si128(Component(pixels, 1), _mm_slli_epi32(Mask(pixels, 0xFF), 8));
+  default:
+    return _mm_or_si128(Component(pixels, 2), Mask(pixels, 0xFF00));
+  }
+}
+
+// Packs the lower 16 bits of the lanes of two vectors, without saturation
+static inline __m128i Pack16(__m128i low, __m128i high)
+{
+  return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(low, 16), 16),
+                         _mm_srai_epi32(_mm_slli_epi32(high, 16), 16));
+}
+
+static inline __m128i LoadPixels(const u8* rgba)
+{
+  return _mm_loadu_si128((const __m128i*)rgba);
+}
+
+// Encodes a block which is completely inside the image, with rgba pointing at its top left pixel
+static void EncodeBlock(Encoding encoding, u8* block, const u8* rgba, int stride)
+{
+  switch (GetBitsPerPixel(encoding))
+  {
+  case 4:
+    for (int row = 0; row < 8; ++row)
+    {
+      const u8* pixels = rgba + row * stride;
+      const __m128i texels = Pack16(GetTexels(encoding, LoadPixels(pixels)),
+                                    GetTexels(encoding, LoadPixels(pixels + 16)));
+      // Pairs of texels in each 32 bit lane, the first one goes into the upper nibble
+      const __m128i pairs =
+          _mm_or_si128(Mask(_mm_slli_epi32(texels, 4), 0xF0), _mm_srli_epi32(texels, 16));
+      const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(pairs, pairs), pairs);
+      const u32 value = _mm_cvtsi128_si32(bytes);
+      memcpy(block + 4 * row, &value, 4);
+    }
+    break;
+  case 8:
+    for (int row = 0; row < 4; ++row)
+    {
+      const u8* pixels = rgba + row * stride;
+      const __m128i texels = _mm_packs_epi32(GetTexels(encoding, LoadPixels(pixels)),
+                                             GetTexels(encoding, LoadPixels(pixels + 16)));
+      _mm_storel_epi64((__m128i*)(block + 8 * row), _mm_packus_epi16(texels, texels));
+    }
+    break;
+  case 16:
+    for (int row = 0; row < 4; row += 2)
+    {
+      const __m128i texels = Pack16(GetTexels(encoding, LoadPixels(rgba + row * stride)),
+                                    GetTexels(encoding, LoadPixels(rgba + (row + 1) * stride)));
+      _mm_storeu_si128((__m128i*)(block + 8 * row), texels);
+    }
+    break;
+  default:
+    for (int row = 0; row < 4; row += 2)
+    {
+      const __m128i pixels0 = LoadPixels(rgba + row * stride);
+      const __m128i pixels1 = LoadPixels(rgba + (row + 1) * stride);
+      const auto ar = [](__m128i pixels) {
+        return _mm_or_si128(_mm_srli_epi32(pixels, 24), _mm_slli_epi32(Mask(pixels, 0xFF), 8));
+      };
+      const auto gb = [](__m128i pixels) { return Mask(_mm_srli_epi32(pixels, 8), 0xFFFF); };
+      _mm_storeu_si128((__m128i*)(block + 8 * row), Pack16(ar(pixels0), ar(pixels1)));
+      _mm_storeu_si128((__m128i*)(block + 32 + 8 * row), Pack16(gb(pixels0), gb(pixels1)));
+    }
+    break;
+  }
+}
+
+void Encode(int format, u8* dst, const u8* rgba, int width, int height)
+{
+  const Encoding encoding = GetEncoding(format);
+  const int block_width = GetBlockWidth(format);
+  const int block_height = GetBlockHeight(format);
+  const int block_bytes = GetBlockBytes(format);
+
+  u8* block = dst;
+  for (int y = 0; y < height; y += block_height)
+  {
+    for (int x = 0; x < width; x += block_width)
+    {
+      if (x + block_width <= width && y + block_height <= height)
+        EncodeBlock(encoding, block, rgba + (y * width + x) * 4, width * 4);
+      else
+        EncodeBlockScalar(encoding, block, rgba, x, y, width, height);
+      block += block_bytes;
+    }
+  }
+}
+
+// Sums of the 2x2 boxes of four input pixels from each row, as 16 bit components of two
+// output pixels
+static inline __m128i SumBoxes(__m128i top, __m128i bottom)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+  const __m128i right =
+      _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+  return _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+}
+
+void Downscale(u8* dst, const u8* rgba, int width, int height)
+{
+  const int stride = width * 4;
+  const int dst_width = width / 2;
+  const __m128i rounding = _mm_set1_epi16(2);
+
+  for (int y = 0; y < height / 2; ++y)
+  {
+    const u8* top = rgba + 2 * y * stride;
+    const u8* bottom = top + stride;
+    u8* out = dst + y * dst_width * 4;
+
+    int x = 0;
+    for (; x + 4 <= dst_width; x += 4)
+    {
+      const __m128i sums0 = SumBoxes(_mm_loadu_si128((const __m128i*)(top + 8 * x)),
+                                     _mm_loadu_si128((const __m128i*)(bottom + 8 * x)));
+      const __m128i sums1 = SumBoxes(_mm_loadu_si128((const __m128i*)(top + 8 * x + 16)),
+                                     _mm_loadu_si128((const __m128i*)(bottom + 8 * x + 16)));
+      _mm_storeu_si128((__m128i*)(out + 4 * x),
+                       _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(sums0, rounding), 2),
+                                        _mm_srli_epi16(_mm_add_epi16(sums1, rounding), 2)));
+    }
+
+    // The remaining pixels of the row, as a two row image
+    if (x < dst_width)
+    {
+      u8 rows[2 * 3 * 8];
+      const int remaining = dst_width - x;
+      memcpy(rows, top + 8 * x, 8 * remaining);
+      memcpy(rows + 8 * remaining, bottom + 8 * x, 8 * remaining);
+      DownscaleScalar(out + 4 * x, rows, 2 * remaining, 2);
+    }
+  }
+}
+
+#else
+
+void Encode(int format, u8* dst, const u8* rgba, int width, int height)
+{
+  EncodeScalar(format, dst, rgba, width, height);
+}
+
+void Downscale(u8* dst, const u8* rgba, int width, int height)
+{
+  DownscaleScalar(dst, rgba, width, height);
+}
+
+#endif
+
+}  // namespace TextureEncoder
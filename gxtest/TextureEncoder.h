@@ -0,0 +1,92 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include "common/CommonTypes.h"
+
+// Conversion of linear images into the tiled texture formats written by EFB copies.
+// Linear images are stored row by row with R, G, B, A bytes per pixel, like in TextureDecoder.
+//
+// Intensity formats (I4, I8, IA4, IA8) convert colors with
+//   I = ((66 * R + 129 * G + 25 * B + 128) >> 8) + 16
+// Components are truncated to the bits of the format, e.g. R >> 3 for RGB565. Two component
+// formats store their components in reverse order, e.g. A before I for IA8 and G before R for
+// RG8. RGB5A3 uses the RGB555 encoding if the upper three bits of alpha are all set.
+//
+// Depth copies read the 24 bit depth value as a color with the upper byte in R, the middle one in
+// G and the lower one in B, see DepthToColors. Each depth format then matches the color format
+// which is selected by the same copy register value: Z4 is encoded like R4, Z8 like R8, Z8M like
+// G8, Z8L like B8, Z16 like RG8, Z16L like GB8 and Z24X8 like RGBA8.
+//
+// Copies with scale_down average each 2x2 box of pixels before encoding, see Downscale.
+
+namespace TextureEncoder
+{
+// The same values as GX_TF_* and GX_CTF_* in libogc
+enum
+{
+  FORMAT_I4 = 0x00,
+  FORMAT_I8 = 0x01,
+  FORMAT_IA4 = 0x02,
+  FORMAT_IA8 = 0x03,
+  FORMAT_RGB565 = 0x04,
+  FORMAT_RGB5A3 = 0x05,
+  FORMAT_RGBA8 = 0x06,
+  FORMAT_Z8 = 0x11,
+  FORMAT_Z16 = 0x13,
+  FORMAT_Z24X8 = 0x16,
+  FORMAT_R4 = 0x20,
+  FORMAT_RA4 = 0x22,
+  FORMAT_RA8 = 0x23,
+  FORMAT_A8 = 0x27,
+  FORMAT_R8 = 0x28,
+  FORMAT_G8 = 0x29,
+  FORMAT_B8 = 0x2A,
+  FORMAT_RG8 = 0x2B,
+  FORMAT_GB8 = 0x2C,
+  FORMAT_Z4 = 0x30,
+  FORMAT_Z8M = 0x39,
+  FORMAT_Z8L = 0x3A,
+  FORMAT_Z16L = 0x3C,
+};
+
+// Every format above, e.g. for tests that go through all of them
+extern const int ALL_FORMATS[23];
+
+const char* GetFormatName(int format);
+
+// Whether the format copies the depth buffer instead of the color buffer
+bool IsDepthFormat(int format);
+
+// Size of the 4x4, 8x4 or 8x8 pixel blocks of a format, which are always 32 bytes large, except
+// for the 64 bytes of RGBA8 and Z24X8 blocks
+int GetBlockWidth(int format);
+int GetBlockHeight(int format);
+int GetBlockBytes(int format);
+
+// Size in bytes of a tiled texture, with the dimensions rounded up to whole blocks
+u32 GetTextureSize(int format, int width, int height);
+
+// Converts 24 bit depth values to the colors which depth copies are encoded from
+void DepthToColors(u8* rgba, const u32* depth, int count);
+
+// Converts a linear image of width * height pixels into a tiled texture of GetTextureSize
+// bytes. Pixels of partial blocks outside the image are encoded as if they were zero.
+// This uses the fastest implementation available for the target.
+void Encode(int format, u8* dst, const u8* rgba, int width, int height);
+
+// Reference implementation of Encode, one pixel at a time
+void EncodeScalar(int format, u8* dst, const u8* rgba, int width, int height);
+
+// Halves a linear image like an EFB copy with scale_down. Each component of an output pixel is
+// (a + b + c + d + 2) >> 2 of the 2x2 input pixels it covers. The output has width / 2 by
+// height / 2 pixels, so an odd last row or column is dropped.
+// This uses the fastest implementation available for the target.
+void Downscale(u8* dst, const u8* rgba, int width, int height);
+
+// Reference implementation of Downscale, one component at a time
+void DownscaleScalar(u8* dst, const u8* rgba, int width, int height);
+
+}  // namespace TextureEncoder
@@ -4,6 +4,50 @@
 
 #pragma once
 
+#include "common/BitField.h"
+#include "common/CommonTypes.h"
+
+// XF memory: matrices and lights
+#define XFMEM_POSMATRICES 0x000
+#define XFMEM_POSMATRICES_END 0x100
+#define XFMEM_NORMALMATRICES 0x400
+#define XFMEM_NORMALMATRICES_END 0x460
+#define XFMEM_POSTMATRICES 0x500
+#define XFMEM_POSTMATRICES_END 0x600
+#define XFMEM_LIGHTS 0x600
+#define XFMEM_LIGHTS_END 0x680
+
+// XF registers
+#define XFMEM_REGISTERS_START 0x1000
+#define XFMEM_ERROR 0x1000
+#define XFMEM_DIAG 0x1001
+#define XFMEM_STATE0 0x1002
+#define XFMEM_STATE1 0x1003
+#define XFMEM_CLOCK 0x1004
+#define XFMEM_CLIPDISABLE 0x1005
+#define XFMEM_SETGPMETRIC 0x1006
+#define XFMEM_VTXSPECS 0x1008
+#define XFMEM_SETNUMCHAN 0x1009
+#define XFMEM_SETCHAN0_AMBCOLOR 0x100a
+#define XFMEM_SETCHAN1_AMBCOLOR 0x100b
+#define XFMEM_SETCHAN0_MATCOLOR 0x100c
+#define XFMEM_SETCHAN1_MATCOLOR 0x100d
+#define XFMEM_SETCHAN0_COLOR 0x100e
+#define XFMEM_SETCHAN1_COLOR 0x100f
+#define XFMEM_SETCHAN0_ALPHA 0x1010
+#define XFMEM_SETCHAN1_ALPHA 0x1011
+#define XFMEM_DUALTEX 0x1012
+#define XFMEM_SETMATRIXINDA 0x1018
+#define XFMEM_SETMATRIXINDB 0x1019
+#define XFMEM_SETVIEWPORT 0x101a
+#define XFMEM_SETZSCALE 0x101c
+#define XFMEM_SETZOFFSET 0x101f
+#define XFMEM_SETPROJECTION 0x1020
+#define XFMEM_SETNUMTEXGENS 0x103f
+#define XFMEM_SETTEXMTXINFO 0x1040
+#define XFMEM_SETPOSMTXINFO 0x1050
+#define XFMEM_REGISTERS_END 0x1058
+
 union LitChannel
 {
   BitField<0, 1, u32> matsource;
@@ -21,3 +65,50 @@ union LitChannel
     return enablelighting ? (lightMask0_3 | (lightMask4_7 << 4)) : 0;
   }
 };
+
+struct Viewport
+{
+  float wd;
+  float ht;
+  float zRange;
+  float xOrig;
+  float yOrig;
+  float farZ;
+};
+
+struct Projection
+{
+  float rawProjection[6];
+  u32 type;  // 0 = perspective, 1 = orthographic
+};
+
+// XF registers 0x1000 - 0x10ff
+struct XFRegisters
+{
+  u32 error;              // 0x1000
+  u32 diag;               // 0x1001
+  u32 state0;             // 0x1002
+  u32 state1;             // 0x1003
+  u32 xfClock;            // 0x1004
+  u32 clipDisable;        // 0x1005
+  u32 perf0;              // 0x1006
+  u32 perf1;              // 0x1007
+  u32 hostinfo;           // 0x1008 number of textures, colors, normals from vertex input
+  u32 numChan;            // 0x1009
+  u32 ambColor[2];        // 0x100a, 0x100b
+  u32 matColor[2];        // 0x100c, 0x100d
+  LitChannel color[2];    // 0x100e, 0x100f
+  LitChannel alpha[2];    // 0x1010, 0x1011
+  u32 dualTexTrans;       // 0x1012
+  u32 unk13[5];           // 0x1013 - 0x1017
+  u32 MatrixIndexA;       // 0x1018
+  u32 MatrixIndexB;       // 0x1019
+  Viewport viewport;      // 0x101a - 0x101f
+  Projection projection;  // 0x1020 - 0x1026
+  u32 unk27[24];          // 0x1027 - 0x103e
+  u32 numTexGen;          // 0x103f
+  u32 texMtxInfo[8];      // 0x1040 - 0x1047
+  u32 unk48[8];           // 0x1048 - 0x104f
+  u32 postMtxInfo[8];     // 0x1050 - 0x1057
+  u32 unk58[0xa8];        // 0x1058 - 0x10ff
+};
@@ -4,19 +4,24 @@
 
 #include <assert.h>
 #include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef CGX_RECORD_FIFO
 #include <ogc/cache.h>
 #include <ogc/gx.h>
 #include <ogc/irq.h>
 #include <ogc/machine/processor.h>
 #include <ogc/system.h>
-#include <string.h>
+#endif
 
 #include "common/CommonTypes.h"
 #include "gxtest/BPMemory.h"
 #include "gxtest/CPMemory.h"
+#include "gxtest/TextureEncoder.h"
 #include "gxtest/XFMemory.h"
 
 #include "cgx.h"
+#include "cgx_defaults.h"
 
 typedef float f32;
 
@@ -33,69 +38,315 @@ typedef union
 
 // static CWGPipe* const wgPipe = (CWGPipe*)0xCC008000;
 
-// TODO: Get rid of these definitions!
-// struct GXFifoObj;
-extern "C" {
-GXFifoObj* GX_Init(void* base, u32 size);
-}
+#ifdef CGX_RECORD_FIFO
+// Large enough for most tests to never reallocate
+FifoRecorder cgx_fifo_recorder(16 * 1024 * 1024);
 
+// Token of the last CGX_SetToken call, which the "GPU" reaches immediately
+static u16 _cgxlasttoken = 0;
+
+// Recording of CGX_BeginDisplayList, as an offset into cgx_fifo_recorder
+static size_t _cgxdisplayliststart;
+static void* _cgxdisplaylist;
+static u32 _cgxdisplaylistsize;
+#else
 static void __CGXFinishInterruptHandler(u32 irq, void* ctx);
+static void __CGXFifoInterruptHandler(u32 irq, void* ctx);
+static vu16* const _cpReg = (u16*)0xCC000000;
 static vu16* const _peReg = (u16*)0xCC001000;
+static vu32* const _piReg = (u32*)0xCC003000;
 static lwpq_t _cgxwaitfinish;
 static vu32 _cgxfinished = 0;
 
-#define CGX_LOAD_BP_REG(x)                                                                         \
-  do                                                                                               \
-  {                                                                                                \
-    wgPipe->U8 = 0x61;                                                                             \
-    wgPipe->U32 = (u32)(x);                                                                        \
-  } while (0)
-
-#define CGX_LOAD_CP_REG(x, y)                                                                      \
-  do                                                                                               \
-  {                                                                                                \
-    wgPipe->U8 = 0x08;                                                                             \
-    wgPipe->U8 = (u8)(x);                                                                          \
-    wgPipe->U32 = (u32)(y);                                                                        \
-  } while (0)
-
-#define CGX_BEGIN_LOAD_XF_REGS(x, n)                                                               \
-  do                                                                                               \
-  {                                                                                                \
-    wgPipe->U8 = 0x10;                                                                             \
-    wgPipe->U32 = (u32)(((((n)&0xffff) - 1) << 16) | ((x)&0xffff));                                \
-  } while (0)
+// CP control register (_cpReg[1]) bits
+#define CP_CTRL_GP_READ_ENABLE 0x01
+#define CP_CTRL_HI_WATERMARK_INT 0x04
+#define CP_CTRL_LO_WATERMARK_INT 0x08
+#define CP_CTRL_GP_LINK 0x10
+
+// CP status (_cpReg[0]) and clear (_cpReg[2]) register bits
+#define CP_STATUS_HI_WATERMARK 0x01
+#define CP_STATUS_LO_WATERMARK 0x02
+
+// The FIFO is shared by the CPU and the GPU ("linked mode"). When the CPU gets too far ahead,
+// the high watermark interrupt suspends the thread writing to it until the GPU has caught up
+// to the low watermark. It is set up again by every CGX_Init, so reinitializing is cheap.
+#define CGX_FIFO_SIZE (256 * 1024)
+#define CGX_FIFO_HI_WATERMARK (CGX_FIFO_SIZE - 16 * 1024)
+#define CGX_FIFO_LO_WATERMARK ((CGX_FIFO_SIZE / 2) & ~31)
+static u8 _cgxfifo[CGX_FIFO_SIZE] __attribute__((aligned(32)));
+static lwp_t _cgxfifothread;
+static u16 _cgxcpcontrol;
+
+// CPU side FIFO which was active before CGX_BeginDisplayList
+static u32 _cgxsavedpififo[3];
+#endif
+
+// Address of main memory as seen by the GPU
+static u32 GetPhysicalAddress(const void* ptr)
+{
+#ifdef CGX_RECORD_FIFO
+  // There is no physical address on a host, so only the low bits end up in the recording
+  return (u32)(uintptr_t)ptr & 0x3FFFFFFF;
+#else
+  return MEM_VIRTUAL_TO_PHYSICAL(ptr);
+#endif
+}
+
+#ifndef CGX_RECORD_FIFO
+// 32 bit CP registers are split into two 16 bit halves, low half first
+static void WriteCPReg32(int index, u32 value)
+{
+  _cpReg[index] = value & 0xFFFF;
+  _cpReg[index + 1] = value >> 16;
+}
+
+static void SetCPControl(u16 value)
+{
+  _cgxcpcontrol = value;
+  _cpReg[1] = value;
+}
+
+static void InitFifo()
+{
+  // Stop the GPU from reading while its FIFO is changed
+  SetCPControl(0);
+  _cpReg[2] = CP_STATUS_HI_WATERMARK | CP_STATUS_LO_WATERMARK;
+
+  // Nothing may be left in the cache to be written back over commands later on
+  memset(_cgxfifo, 0, CGX_FIFO_SIZE);
+  DCFlushRange(_cgxfifo, CGX_FIFO_SIZE);
+
+  const u32 base = GetPhysicalAddress(_cgxfifo);
+  const u32 end = base + CGX_FIFO_SIZE - 4;
+
+  // GPU side: ring buffer bounds, watermarks, read-write distance, write and read pointers
+  WriteCPReg32(16, base);
+  WriteCPReg32(18, end);
+  WriteCPReg32(20, CGX_FIFO_HI_WATERMARK);
+  WriteCPReg32(22, CGX_FIFO_LO_WATERMARK);
+  WriteCPReg32(24, 0);
+  WriteCPReg32(26, base);
+  WriteCPReg32(28, base);
+  ppcsync();
+
+  // CPU side: the same ring buffer
+  _piReg[3] = base;
+  _piReg[4] = end;
+  _piReg[5] = base;
+  ppcsync();
+
+  // Route stores to 0xCC008000 through the write-gather pipe (HID2[WPE])
+  mtwpar(0x0C008000);
+  mthid2(mfhid2() | 0x40000000);
+
+  _cgxfifothread = LWP_GetSelf();
+  IRQ_Request(IRQ_PI_CP, __CGXFifoInterruptHandler, NULL);
+  __UnmaskIrq(IRQMASK(IRQ_PI_CP));
+
+  SetCPControl(CP_CTRL_GP_READ_ENABLE | CP_CTRL_HI_WATERMARK_INT | CP_CTRL_GP_LINK);
+}
+
+static void __CGXFifoInterruptHandler(u32 irq, void* ctx)
+{
+  const u16 status = _cpReg[0];
+
+  if ((_cgxcpcontrol & CP_CTRL_HI_WATERMARK_INT) && (status & CP_STATUS_HI_WATERMARK))
+  {
+    // Wait for the GPU to drain the FIFO
+    SetCPControl((_cgxcpcontrol & ~CP_CTRL_HI_WATERMARK_INT) | CP_CTRL_LO_WATERMARK_INT);
+    _cpReg[2] = CP_STATUS_HI_WATERMARK;
+    LWP_SuspendThread(_cgxfifothread);
+  }
+  else if ((_cgxcpcontrol & CP_CTRL_LO_WATERMARK_INT) && (status & CP_STATUS_LO_WATERMARK))
+  {
+    SetCPControl((_cgxcpcontrol & ~CP_CTRL_LO_WATERMARK_INT) | CP_CTRL_HI_WATERMARK_INT);
+    _cpReg[2] = CP_STATUS_LO_WATERMARK;
+    LWP_ResumeThread(_cgxfifothread);
+  }
+}
+#endif
+
+// Register state which all tests start with. Everything that the suite relies on is set
+// explicitly, so that nothing depends on what ran before.
+static void LoadDefaultState()
+{
+  // Same as libogc's initial "revision bits"
+  for (int i = 0; i < 8; ++i)
+  {
+    CGX_LOAD_CP_REG(CP_VAT_REG_A + i, 0x40000000);  // ByteDequant
+    CGX_LOAD_CP_REG(CP_VAT_REG_B + i, 0x80000000);  // VCacheEnhance
+    CGX_LOAD_CP_REG(CP_VAT_REG_C + i, 0);
+  }
+  CGX_LoadXFReg(XFMEM_ERROR, 0x3F);
+  CGX_LoadXFReg(XFMEM_DUALTEX, 1);
+  CGX_LOAD_BP_REG((BPMEM_REVBITS << 24) | 0x0F);
+
+  // Vertex format: set up by each draw, matrix 0 for positions
+  CGX_LOAD_CP_REG(VCD_LO, 0);
+  CGX_LOAD_CP_REG(VCD_HI, 0);
+  CGX_LOAD_CP_REG(MATINDEX_A, 0);
+  CGX_LOAD_CP_REG(MATINDEX_B, 0);
+  CGX_LoadXFReg(XFMEM_SETMATRIXINDA, 0);
+  CGX_LoadXFReg(XFMEM_SETMATRIXINDB, 0);
+  wgPipe->U8 = 0x48;  // invalidate vertex cache
+
+  // Transform: identity position matrix, orthographic projection onto the whole EFB
+  f32 model[3][4];
+  memset(model, 0, sizeof(model));
+  model[0][0] = 1;
+  model[1][1] = 1;
+  model[2][2] = 1;
+  CGX_LoadPosMatrixDirect(model, 0);
+
+  float projection[4][4];
+  memset(projection, 0, sizeof(projection));
+  projection[0][0] = 1;
+  projection[1][1] = 1;
+  projection[2][2] = -1;
+  CGX_LoadProjectionMatrixOrthographic(projection);
+
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+  CGX_LoadXFReg(XFMEM_CLIPDISABLE, 0);
+
+  // Lighting: one unlit color channel which passes on vertex colors, no texture coordinates
+  CGX_LoadXFReg(XFMEM_VTXSPECS, 1);  // one vertex color
+  CGX_LoadXFReg(XFMEM_SETNUMCHAN, 1);
+  CGX_LoadXFReg(XFMEM_SETCHAN0_AMBCOLOR, 0x000000FF);
+  CGX_LoadXFReg(XFMEM_SETCHAN1_AMBCOLOR, 0x000000FF);
+  CGX_LoadXFReg(XFMEM_SETCHAN0_MATCOLOR, 0xFFFFFFFF);
+  CGX_LoadXFReg(XFMEM_SETCHAN1_MATCOLOR, 0xFFFFFFFF);
+  for (u16 address = XFMEM_SETCHAN0_COLOR; address <= XFMEM_SETCHAN1_ALPHA; ++address)
+    CGX_LoadXFReg(address, CGXDefault<LitChannel>().hex);
+  CGX_LoadXFReg(XFMEM_SETNUMTEXGENS, 0);
+
+  // Rasterization: scissor rectangle covering the EFB, with the same offset of 342 as the
+  // viewport. The scissor offset register holds half of that.
+  X12Y12 scissor;
+  scissor.hex = BPMEM_SCISSORTL << 24;
+  scissor.x = 342;
+  scissor.y = 342;
+  CGX_LOAD_BP_REG(scissor.hex);
+  scissor.hex = BPMEM_SCISSORBR << 24;
+  scissor.x = 342 + 640 - 1;
+  scissor.y = 342 + 528 - 1;
+  CGX_LOAD_BP_REG(scissor.hex);
+  CGX_LOAD_BP_REG((BPMEM_SCISSOROFFSET << 24) | (171 << 10) | 171);
+  CGX_LOAD_BP_REG((BPMEM_LINEPTWIDTH << 24) | (6 << 8) | 6);
+  CGX_LOAD_BP_REG(CGXDefault<GenMode>().hex);
+
+  // Texturing: no indirect stages, no z textures
+  CGX_LOAD_BP_REG((BPMEM_IND_IMASK << 24) | 0);
+  CGX_LOAD_BP_REG((BPMEM_IREF << 24) | 0);
+  for (int stage = 0; stage < 16; ++stage)
+    CGX_LOAD_BP_REG((BPMEM_IND_CMD + stage) << 24);
+  CGX_LOAD_BP_REG(BPMEM_ZTEX2 << 24);
+
+  // TEV: stage 0 passes on the rasterized color, everything else outputs zero
+  for (int stage = 0; stage < 16; ++stage)
+  {
+    auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(stage);
+    auto ac = CGXDefault<TevStageCombiner::AlphaCombiner>(stage);
+    if (stage == 0)
+    {
+      cc.d = TEVCOLORARG_RASC;
+      ac.d = TEVALPHAARG_RASA;
+    }
+    CGX_LOAD_BP_REG(cc.hex);
+    CGX_LOAD_BP_REG(ac.hex);
+  }
+  for (int index = 0; index < 8; ++index)
+  {
+    CGX_LOAD_BP_REG(CGXDefault<TwoTevStageOrders>(index).hex);
+    CGX_LOAD_BP_REG(CGXDefault<TevKSel>(index).hex);
+  }
+  for (int index = 0; index < 4; ++index)
+  {
+    for (int konst = 0; konst < 2; ++konst)
+    {
+      auto tevreg = CGXDefault<TevReg>(index, konst != 0);
+      CGX_LOAD_BP_REG(tevreg.low);
+      CGX_LOAD_BP_REG(tevreg.high);
+    }
+  }
+  CGX_LOAD_BP_REG(BPMEM_FOGPARAM3 << 24);  // fog off
+
+  // Pixel engine: no alpha test, depth test or blending; RGB8 EFB with 24 bit depth
+  CGX_LOAD_BP_REG(CGXDefault<AlphaTest>().hex);
+  CGX_LOAD_BP_REG(CGXDefault<ZMode>().hex);
+  CGX_LOAD_BP_REG(CGXDefault<BlendMode>().hex);
+  CGX_LOAD_BP_REG(BPMEM_CONSTANTALPHA << 24);
+
+  PE_CONTROL ctrl;
+  ctrl.hex = BPMEM_ZCOMPARE << 24;
+  ctrl.pixel_format = PIXELFMT_RGB8_Z24;
+  ctrl.zformat = ZC_LINEAR;
+  ctrl.early_ztest = 0;
+  CGX_LOAD_BP_REG(ctrl.hex);
+  CGX_LOAD_BP_REG((BPMEM_FIELDMASK << 24) | 3);
+  CGX_LOAD_BP_REG(BPMEM_FIELDMODE << 24);
+
+  // EFB copies: clear to dark green with maximum depth, without antialiasing or vertical
+  // filtering (one sample at the pixel center, all weight on the center line)
+  CGX_LOAD_BP_REG((BPMEM_CLEAR_AR << 24) | 0xFF00);
+  CGX_LOAD_BP_REG((BPMEM_CLEAR_GB << 24) | 0x2700);
+  CGX_LOAD_BP_REG((BPMEM_CLEAR_Z << 24) | 0xFFFFFF);
+  for (int i = 0; i < 4; ++i)
+    CGX_LOAD_BP_REG(((BPMEM_DISPLAYCOPYFILER + i) << 24) | 0x666666);
+  CGX_LOAD_BP_REG((BPMEM_COPYFILTER0 << 24) | (22 << 18) | (21 << 12));
+  CGX_LOAD_BP_REG((BPMEM_COPYFILTER1 << 24) | 21);
+  CGX_LOAD_BP_REG((BPMEM_COPYYSCALE << 24) | 0x100);
+
+  // Start counting tokens from zero
+  CGX_LOAD_BP_REG(BPMEM_PE_TOKEN_ID << 24);
+}
 
 void CGX_Init()
 {
-  // TODO: Is this leaking memory?
-  void* gp_fifo = NULL;
-  gp_fifo = memalign(32, 256 * 1024);
-  memset(gp_fifo, 0, 256 * 1024);
+  CGX_InvalidateShadowState();
 
-  GX_Init(gp_fifo, 256 * 1024);
+#ifdef CGX_RECORD_FIFO
+  cgx_fifo_recorder.Clear();
+  _cgxlasttoken = 0;
+#else
+  static bool initialized = false;
+  if (!initialized)
+  {
+    LWP_InitQueue(&_cgxwaitfinish);
+    initialized = true;
+  }
 
-  LWP_InitQueue(&_cgxwaitfinish);
+  InitFifo();
 
   IRQ_Request(IRQ_PI_PEFINISH, __CGXFinishInterruptHandler, NULL);
   __UnmaskIrq(IRQMASK(IRQ_PI_PEFINISH));
   _peReg[5] = 0x0F;
+#endif
+
+  LoadDefaultState();
 }
 
 void CGX_SetViewport(float origin_x, float origin_y, float width, float height, float near, f32 far)
 {
-  CGX_BEGIN_LOAD_XF_REGS(0x101a, 6);
-  wgPipe->F32 = width * 0.5f;
-  wgPipe->F32 = -height * 0.5f;
-  wgPipe->F32 = (far - near) * 16777215.0f;
-  wgPipe->F32 = 342.0f + origin_x + width * 0.5f;
-  wgPipe->F32 = 342.0f + origin_y + height * 0.5f;
-  wgPipe->F32 = far * 16777215.0f;
+  const f32 viewport[6] = {
+      width * 0.5f,
+      -height * 0.5f,
+      (far - near) * 16777215.0f,
+      342.0f + origin_x + width * 0.5f,
+      342.0f + origin_y + height * 0.5f,
+      far * 16777215.0f,
+  };
+  u32 values[6];
+  memcpy(values, viewport, sizeof(values));
+  CGX_LoadXFRegs(XFMEM_SETVIEWPORT, 6, values);
 }
 
-static inline void WriteMtxPS4x2(register f32 mt[3][4], register void* wgpipe)
+#ifndef CGX_RECORD_FIFO
+// Paired-single copies of whole matrix rows to the write-gather pipe, as done by libogc.
+// With GQR0 set up for unquantized floats (as libogc does at startup), each psq_st writes
+// two floats at once.
+static inline void WriteMtxPS4x2(register f32 mt[2][4], register volatile void* wgpipe)
 {
-  // Untested
   register f32 tmp0, tmp1, tmp2, tmp3;
 
   __asm__ __volatile__("psq_l %0,0(%4),0,0\n\
@@ -111,52 +362,121 @@ static inline void WriteMtxPS4x2(register f32 mt[3][4], register void* wgpipe)
                        : "memory");
 }
 
+static inline void WriteMtxPS4x3(register f32 mt[3][4], register volatile void* wgpipe)
+{
+  register f32 tmp0, tmp1, tmp2, tmp3, tmp4, tmp5;
+
+  __asm__ __volatile__("psq_l %0,0(%6),0,0\n\
+		psq_l %1,8(%6),0,0\n\
+		psq_l %2,16(%6),0,0\n\
+		psq_l %3,24(%6),0,0\n\
+		psq_l %4,32(%6),0,0\n\
+		psq_l %5,40(%6),0,0\n\
+		psq_st %0,0(%7),0,0\n\
+		psq_st %1,0(%7),0,0\n\
+		psq_st %2,0(%7),0,0\n\
+		psq_st %3,0(%7),0,0\n\
+		psq_st %4,0(%7),0,0\n\
+		psq_st %5,0(%7),0,0"
+                       : "=&f"(tmp0), "=&f"(tmp1), "=&f"(tmp2), "=&f"(tmp3), "=&f"(tmp4),
+                         "=&f"(tmp5)
+                       : "b"(mt), "b"(wgpipe)
+                       : "memory");
+}
+#else
+static void WriteMtxPS4x2(f32 mt[2][4], FifoRecorder* fifo)
+{
+  for (int row = 0; row < 2; ++row)
+    for (int col = 0; col < 4; ++col)
+      fifo->F32 = mt[row][col];
+}
+
+static void WriteMtxPS4x3(f32 mt[3][4], FifoRecorder* fifo)
+{
+  for (int row = 0; row < 3; ++row)
+    for (int col = 0; col < 4; ++col)
+      fifo->F32 = mt[row][col];
+}
+#endif
+
+// Same command stream as libogc's GX_LoadProjectionMtx
+static void LoadProjectionMatrix(f32 p0, f32 p1, f32 p2, f32 p3, f32 p4, f32 p5, u32 type)
+{
+  const f32 projection[6] = {p0, p1, p2, p3, p4, p5};
+  u32 values[7];
+  memcpy(values, projection, sizeof(projection));
+  values[6] = type;
+  CGX_LoadXFRegs(XFMEM_SETPROJECTION, 7, values);
+}
+
+// Same command stream as libogc's GX_LoadPosMtxImm
 void CGX_LoadPosMatrixDirect(f32 mt[3][4], u32 index)
 {
-  // Untested
-  /*	CGX_BEGIN_LOAD_XF_REGS((index<<2)&0xFF, 12);
-    WriteMtxPS4x2(mt, (void*)wgPipe);*/
-  GX_LoadPosMtxImm(mt, index);
+  CGX_BEGIN_LOAD_XF_REGS((index << 2) & 0xFF, 12);
+  WriteMtxPS4x3(mt, wgPipe);
+}
+
+// Same command stream as libogc's GX_LoadTexMtxImm with GX_MTX2x4
+void CGX_LoadTexMatrix2x4Direct(f32 mt[2][4], u32 index)
+{
+  CGX_BEGIN_LOAD_XF_REGS((index << 2) & 0xFF, 8);
+  WriteMtxPS4x2(mt, wgPipe);
 }
 
 void CGX_LoadProjectionMatrixPerspective(float mtx[4][4])
 {
-  // Untested
-  /*	CGX_BEGIN_LOAD_XF_REGS(0x1020, 7);
-    wgPipe->F32 = mtx[0][0];
-    wgPipe->F32 = mtx[0][2];
-    wgPipe->F32 = mtx[1][1];
-    wgPipe->F32 = mtx[1][2];
-    wgPipe->F32 = mtx[2][2];
-    wgPipe->F32 = mtx[2][3];
-    wgPipe->U32 = 0;*/
-  GX_LoadProjectionMtx(mtx, 0);
+  LoadProjectionMatrix(mtx[0][0], mtx[0][2], mtx[1][1], mtx[1][2], mtx[2][2], mtx[2][3], 0);
 }
 
 void CGX_LoadProjectionMatrixOrthographic(float mtx[4][4])
 {
-  // Untested
-  /*	CGX_BEGIN_LOAD_XF_REGS(0x1020, 7);
-    wgPipe->F32 = mtx[0][0];
-    wgPipe->F32 = mtx[0][3];
-    wgPipe->F32 = mtx[1][1];
-    wgPipe->F32 = mtx[1][3];
-    wgPipe->F32 = mtx[2][2];
-    wgPipe->F32 = mtx[2][3];
-    wgPipe->U32 = 1;*/
-  GX_LoadProjectionMtx(mtx, 1);
+  LoadProjectionMatrix(mtx[0][0], mtx[0][3], mtx[1][1], mtx[1][3], mtx[2][2], mtx[2][3], 1);
+}
+
+static u32 GetKnownBPReg(u32 fallback);
+
+// Clearing copies only write the clear depth with depth updates enabled, and blend the clear
+// color like any other pixel. So like libogc's GX_CopyTex and GX_CopyDisp, the copy is triggered
+// with an always passing depth test with updates and without blending or logic operations.
+// The previous ZMode and BlendMode are loaded again afterwards.
+static void TriggerEfbCopy(const UPE_Copy& reg)
+{
+  ZMode zmode;
+  BlendMode blendmode;
+  if (reg.clear)
+  {
+    zmode.hex = GetKnownBPReg(CGXDefault<ZMode>().hex);
+    blendmode.hex = GetKnownBPReg(CGXDefault<BlendMode>().hex);
+
+    ZMode clear_zmode = zmode;
+    clear_zmode.testenable = 1;
+    clear_zmode.func = COMPARE_ALWAYS;
+    clear_zmode.updateenable = 1;
+    CGX_LOAD_BP_REG(clear_zmode.hex);
+
+    BlendMode clear_blendmode = blendmode;
+    clear_blendmode.blendenable = 0;
+    clear_blendmode.logicopenable = 0;
+    CGX_LOAD_BP_REG(clear_blendmode.hex);
+  }
+
+  CGX_LOAD_BP_REG(reg.Hex);
+
+  if (reg.clear)
+  {
+    CGX_LOAD_BP_REG(zmode.hex);
+    CGX_LOAD_BP_REG(blendmode.hex);
+  }
 }
 
-void CGX_DoEfbCopyTex(u16 left, u16 top, u16 width, u16 height, u8 dest_format,
-                      bool copy_to_intensity, void* dest, bool scale_down, bool clear)
+void CGX_DoEfbCopyTex(u16 left, u16 top, u16 width, u16 height, u8 dest_format, void* dest,
+                      bool scale_down, bool clear)
 {
   assert(left <= 1023);
   assert(top <= 1023);
   assert(width <= 1023);
   assert(height <= 1023);
 
-  // TODO: GX_TF_Z16 seems to have special treatment in libogc? oO
-
   X10Y10 coords;
   coords.hex = BPMEM_EFB_TL << 24;
   coords.x = left;
@@ -168,22 +488,38 @@ void CGX_DoEfbCopyTex(u16 left, u16 top, u16 width, u16 height, u8 dest_format,
   coords.y = height - 1;
   CGX_LOAD_BP_REG(coords.hex);
 
-  // TODO: this one is hardcoded against dest_format=RGBA8...
-  CGX_LOAD_BP_REG((BPMEM_MIPMAP_STRIDE << 24) | (((width + 3) >> 2) * 2));
+  // The stride is the number of cache lines per row of blocks of the destination texture
+  const int dest_width = scale_down ? width / 2 : width;
+  const int block_width = TextureEncoder::GetBlockWidth(dest_format);
+  const int cache_lines = TextureEncoder::GetBlockBytes(dest_format) / 32;
+  const u32 stride = (dest_width + block_width - 1) / block_width * cache_lines;
+  CGX_LOAD_BP_REG((BPMEM_MIPMAP_STRIDE << 24) | stride);
+
+  CGX_LOAD_BP_REG((BPMEM_EFB_ADDR << 24) | (GetPhysicalAddress(dest) >> 5));
 
-  CGX_LOAD_BP_REG((BPMEM_EFB_ADDR << 24) | (MEM_VIRTUAL_TO_PHYSICAL(dest) >> 5));
+  // Only the lower four bits select the encoding, except for Z16 which is encoded like RG8.
+  // The upper bits of the libogc value tell whether the color or depth buffer is read, which
+  // is set by the EFB pixel format instead.
+  const u8 copy_format = (dest_format == 0x13 /* Z16 */) ? 0xB : (dest_format & 0xF);
+  const bool intensity = dest_format <= 0x03;  // I4, I8, IA4 or IA8
 
   UPE_Copy reg;
   reg.Hex = BPMEM_TRIGGER_EFB_COPY << 24;
-  reg.target_pixel_format = ((dest_format << 1) & 0xE) | (dest_format >> 3);
+  reg.target_pixel_format = ((copy_format << 1) & 0xE) | (copy_format >> 3);
   reg.half_scale = scale_down;
   reg.clear = clear;
-  reg.intensity_fmt = copy_to_intensity;
+  reg.intensity_fmt = intensity;
+  reg.auto_conv = 1;  // Set by GX_SetTexCopyDst for every texture copy
   reg.clamp0 = 1;
   reg.clamp1 = 1;
-  CGX_LOAD_BP_REG(reg.Hex);
-
-  DCFlushRange(dest, GX_GetTexBufferSize(width, height, GX_TF_RGBA8, GX_FALSE, 1));
+  TriggerEfbCopy(reg);
+
+#ifndef CGX_RECORD_FIFO
+  const int dest_height = scale_down ? height / 2 : height;
+  const int block_height = TextureEncoder::GetBlockHeight(dest_format);
+  const u32 height_blocks = (dest_height + block_height - 1) / block_height;
+  DCFlushRange(dest, stride * height_blocks * 32);
+#endif
 }
 
 void CGX_DoEfbCopyXfb(u16 left, u16 top, u16 width, u16 src_height, u16 dst_height, void* dest,
@@ -193,30 +529,34 @@ void CGX_DoEfbCopyXfb(u16 left, u16 top, u16 width, u16 src_height, u16 dst_heig
   assert(top <= 1023);
   assert(width <= 1023);
   assert(src_height <= 1023);
+  assert(dst_height > 0);
 
-  /*	UPE_Copy reg;
-    reg.Hex = BPMEM_TRIGGER_EFB_COPY<<24;
-    reg.clear = clear;
-    reg.copy_to_xfb = 1;
+  X10Y10 coords;
+  coords.hex = BPMEM_EFB_TL << 24;
+  coords.x = left;
+  coords.y = top;
+  CGX_LOAD_BP_REG(coords.hex);
 
-    X10Y10 coords;
-    coords.hex = 0;
-    coords.x = left;
-    coords.y = top;
-    CGX_LOAD_BP_REG((BPMEM_EFB_TL << 24) | coords.hex);
-    coords.x = width - 1;
-    coords.y = height - 1;
-    CGX_LOAD_BP_REG((BPMEM_EFB_BR << 24) | coords.hex);
+  coords.hex = BPMEM_EFB_BR << 24;
+  coords.x = width - 1;
+  coords.y = src_height - 1;
+  CGX_LOAD_BP_REG(coords.hex);
 
-    CGX_LOAD_BP_REG((BPMEM_EFB_ADDR<<24) | (MEM_VIRTUAL_TO_PHYSICAL(dest)>>5));
+  CGX_LOAD_BP_REG((BPMEM_EFB_ADDR << 24) | (GetPhysicalAddress(dest) >> 5));
+  CGX_LOAD_BP_REG((BPMEM_MIPMAP_STRIDE << 24) | (width >> 4));
 
-    CGX_LOAD_BP_REG((BPMEM_MIPMAP_STRIDE<<24) | (width >> 4));
-    CGX_LOAD_BP_REG(reg.Hex);*/
+  // Number of EFB lines per XFB line, in 1.8 fixed point (the same as GX_SetDispCopyYScale)
+  const u32 yscale = (u32)(256.0f * src_height / dst_height) & 0x1FF;
+  CGX_LOAD_BP_REG((BPMEM_COPYYSCALE << 24) | yscale);
 
-  GX_SetDispCopySrc(left, top, width, src_height);
-  GX_SetDispCopyDst(width, dst_height);
-  // SetCopyFilter, SetFieldMode, SetDispCopyGamma
-  GX_CopyDisp(dest, clear);
+  UPE_Copy reg;
+  reg.Hex = BPMEM_TRIGGER_EFB_COPY << 24;
+  reg.clamp0 = 1;
+  reg.clamp1 = 1;
+  reg.scale_invert = (yscale != 0x100);
+  reg.clear = clear;
+  reg.copy_to_xfb = 1;
+  TriggerEfbCopy(reg);
 }
 
 void CGX_ForcePipelineFlush()
@@ -231,6 +571,13 @@ void CGX_ForcePipelineFlush()
   wgPipe->U32 = 0;
 }
 
+#ifdef CGX_RECORD_FIFO
+void CGX_WaitForGpuToFinish()
+{
+  CGX_LOAD_BP_REG(0x45000002);  // draw done
+  CGX_ForcePipelineFlush();
+}
+#else
 static void __CGXFinishInterruptHandler(u32 irq, void* ctx)
 {
   _peReg[5] = (_peReg[5] & ~0x08) | 0x08;
@@ -255,3 +602,315 @@ void CGX_WaitForGpuToFinish()
 
   _CPU_ISR_Restore(level);
 }
+#endif
+
+void CGX_SetToken(u16 token)
+{
+  CGX_LOAD_BP_REG((BPMEM_PE_TOKEN_ID << 24) | token);
+  CGX_ForcePipelineFlush();
+#ifdef CGX_RECORD_FIFO
+  _cgxlasttoken = token;
+#endif
+}
+
+u16 CGX_GetToken()
+{
+#ifdef CGX_RECORD_FIFO
+  return _cgxlasttoken;
+#else
+  return _peReg[7];
+#endif
+}
+
+void CGX_WaitForToken(u16 token)
+{
+  while ((s16)(CGX_GetToken() - token) < 0)
+  {
+  }
+}
+
+void CGX_CallDisplayList(const void* list, u32 size)
+{
+  assert(((uintptr_t)list & 31) == 0);
+  assert((size & 31) == 0);
+
+  wgPipe->U8 = 0x40;
+  wgPipe->U32 = GetPhysicalAddress(list);
+  wgPipe->U32 = size;
+}
+
+#ifdef CGX_RECORD_FIFO
+void CGX_BeginDisplayList(void* buffer, u32 size)
+{
+  assert(((uintptr_t)buffer & 31) == 0);
+
+  _cgxdisplayliststart = cgx_fifo_recorder.Size();
+  _cgxdisplaylist = buffer;
+  _cgxdisplaylistsize = size;
+}
+
+u32 CGX_EndDisplayList()
+{
+  // The commands are moved from the recording into the buffer, as they wouldn't have reached
+  // the GPU either. There's no write-gather pipe to flush, so only the padding is added.
+  const std::vector<u8>& data = cgx_fifo_recorder.Data();
+  const u32 size = (u32)(data.size() - _cgxdisplayliststart);
+  const u32 padded_size = (size + 31) & ~31;
+  if (padded_size > _cgxdisplaylistsize)
+  {
+    cgx_fifo_recorder.Truncate(_cgxdisplayliststart);
+    return 0;
+  }
+
+  memcpy(_cgxdisplaylist, data.data() + _cgxdisplayliststart, size);
+  memset((u8*)_cgxdisplaylist + size, 0, padded_size - size);
+  cgx_fifo_recorder.Truncate(_cgxdisplayliststart);
+  return padded_size;
+}
+#else
+void CGX_BeginDisplayList(void* buffer, u32 size)
+{
+  assert(((uintptr_t)buffer & 31) == 0);
+  assert(size >= 32);
+
+  // Everything so far has to go to the GPU, not into the list
+  CGX_ForcePipelineFlush();
+  ppcsync();
+
+  DCInvalidateRange(buffer, size);
+
+  // Unlink the FIFOs, so that the GPU doesn't try to read from the list
+  SetCPControl(_cgxcpcontrol &
+               ~(CP_CTRL_GP_LINK | CP_CTRL_HI_WATERMARK_INT | CP_CTRL_LO_WATERMARK_INT));
+
+  _cgxsavedpififo[0] = _piReg[3];
+  _cgxsavedpififo[1] = _piReg[4];
+  _cgxsavedpififo[2] = _piReg[5];
+
+  const u32 base = GetPhysicalAddress(buffer);
+  _piReg[3] = base;
+  _piReg[4] = base + size - 4;
+  _piReg[5] = base;
+  ppcsync();
+}
+
+u32 CGX_EndDisplayList()
+{
+  // Pads the last bytes in the pipe to a full 32 byte burst
+  CGX_ForcePipelineFlush();
+  ppcsync();
+
+  const u32 base = _piReg[3];
+  const u32 write_pointer = _piReg[5];
+  const bool wrapped = (write_pointer & 0x20000000) != 0;  // buffer overflowed
+  const u32 size = (write_pointer & 0x1FFFFFE0) - (base & 0x1FFFFFE0);
+
+  _piReg[3] = _cgxsavedpififo[0];
+  _piReg[4] = _cgxsavedpififo[1];
+  _piReg[5] = _cgxsavedpififo[2];
+  ppcsync();
+
+  SetCPControl(CP_CTRL_GP_READ_ENABLE | CP_CTRL_HI_WATERMARK_INT | CP_CTRL_GP_LINK);
+
+  return wrapped ? 0 : size;
+}
+#endif
+
+// Last values loaded through CGX. TEV konst registers share their addresses with the TEV color
+// registers and are told apart by bit 23, so they get slots of their own.
+struct CGXShadowState
+{
+  u32 bp[0x100];
+  bool bp_valid[0x100];
+  u32 tev_konst[8];
+  bool tev_konst_valid[8];
+  u32 bp_mask;  // Applies to the next BP load only
+
+  u32 cp[0x100];
+  bool cp_valid[0x100];
+
+  u32 xf[0x100];  // XF registers 0x1000 - 0x10ff
+  bool xf_valid[0x100];
+
+  CGXShadowStats stats;
+};
+
+bool _cgxshadowenabled = false;
+static CGXShadowState _cgxshadow;
+
+// BP registers whose loads trigger an action, so that loading the same value again matters
+static bool IsTriggerBPReg(u8 reg)
+{
+  switch (reg)
+  {
+  case BPMEM_SETDRAWDONE:
+  case BPMEM_PE_TOKEN_ID:
+  case BPMEM_PE_TOKEN_INT_ID:
+  case BPMEM_TRIGGER_EFB_COPY:
+  case BPMEM_CLEARBBOX1:
+  case BPMEM_CLEARBBOX2:
+  case BPMEM_CLEAR_PIXEL_PERF:
+  case BPMEM_PRELOAD_MODE:
+  case BPMEM_LOADTLUT0:
+  case BPMEM_LOADTLUT1:
+  case BPMEM_TEXINVALIDATE:
+  case BPMEM_PERF1:
+  case BPMEM_BP_MASK:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void CGX_ShadowLoadBPReg(u32 value)
+{
+  const u8 reg = value >> 24;
+  const u32 data = value & 0xFFFFFF;
+  const u32 mask = _cgxshadow.bp_mask;
+  _cgxshadow.bp_mask = (reg == BPMEM_BP_MASK) ? data : 0xFFFFFF;
+  ++_cgxshadow.stats.bp_loads;
+
+  u32* slot = &_cgxshadow.bp[reg];
+  bool* valid = &_cgxshadow.bp_valid[reg];
+  if (reg >= BPMEM_TEV_REGISTER_L && reg < BPMEM_TEV_REGISTER_L + 8)
+  {
+    if (!(data & 0x800000))
+    {
+      CGX_WRITE_BP_REG(value);
+      return;
+    }
+    slot = &_cgxshadow.tev_konst[reg - BPMEM_TEV_REGISTER_L];
+    valid = &_cgxshadow.tev_konst_valid[reg - BPMEM_TEV_REGISTER_L];
+  }
+  else if (IsTriggerBPReg(reg))
+  {
+    CGX_WRITE_BP_REG(value);
+    return;
+  }
+
+  // A masked load is always sent, as it also resets the mask. Partially known values are no
+  // better than unknown ones, though.
+  if (mask != 0xFFFFFF)
+  {
+    *slot = (*slot & ~mask) | (data & mask);
+    CGX_WRITE_BP_REG(value);
+    return;
+  }
+
+  if (*valid && *slot == data)
+  {
+    ++_cgxshadow.stats.bp_elided;
+    return;
+  }
+
+  *slot = data;
+  *valid = true;
+  CGX_WRITE_BP_REG(value);
+}
+
+void CGX_ShadowLoadCPReg(u8 reg, u32 value)
+{
+  ++_cgxshadow.stats.cp_loads;
+
+  if (_cgxshadow.cp_valid[reg] && _cgxshadow.cp[reg] == value)
+  {
+    ++_cgxshadow.stats.cp_elided;
+    return;
+  }
+
+  _cgxshadow.cp[reg] = value;
+  _cgxshadow.cp_valid[reg] = true;
+  CGX_WRITE_CP_REG(reg, value);
+}
+
+void CGX_ShadowInvalidateBPReg(u8 reg)
+{
+  _cgxshadow.bp_valid[reg] = false;
+  if (reg >= BPMEM_TEV_REGISTER_L && reg < BPMEM_TEV_REGISTER_L + 8)
+    _cgxshadow.tev_konst_valid[reg - BPMEM_TEV_REGISTER_L] = false;
+}
+
+void CGX_ShadowInvalidateCPReg(u8 reg)
+{
+  _cgxshadow.cp_valid[reg] = false;
+}
+
+void CGX_ShadowInvalidateXFRegs(u16 address, u32 count)
+{
+  for (u32 i = 0; i < count; ++i)
+  {
+    const u32 word_address = address + i;
+    if ((word_address & ~0xFF) == XFMEM_REGISTERS_START)
+      _cgxshadow.xf_valid[word_address & 0xFF] = false;
+  }
+}
+
+void CGX_LoadXFRegs(u16 address, u32 count, const u32* values)
+{
+  // Only XF registers are tracked, not matrices or lights
+  const bool tracked = _cgxshadowenabled && address >= XFMEM_REGISTERS_START &&
+                       address + count <= XFMEM_REGISTERS_START + 0x100;
+  if (tracked)
+  {
+    const u32 first = address - XFMEM_REGISTERS_START;
+    _cgxshadow.stats.xf_loads += count;
+
+    bool unchanged = true;
+    for (u32 i = 0; i < count && unchanged; ++i)
+      unchanged = _cgxshadow.xf_valid[first + i] && _cgxshadow.xf[first + i] == values[i];
+    if (unchanged)
+    {
+      _cgxshadow.stats.xf_elided += count;
+      return;
+    }
+
+    for (u32 i = 0; i < count; ++i)
+    {
+      _cgxshadow.xf[first + i] = values[i];
+      _cgxshadow.xf_valid[first + i] = true;
+    }
+  }
+  else if (_cgxshadowenabled)
+  {
+    CGX_ShadowInvalidateXFRegs(address, count);
+  }
+
+  CGX_BEGIN_WRITE_XF_REGS(address, count);
+  for (u32 i = 0; i < count; ++i)
+    wgPipe->U32 = values[i];
+}
+
+// The last value loaded into the BP register which fallback addresses, or fallback if the shadow
+// state doesn't know it
+static u32 GetKnownBPReg(u32 fallback)
+{
+  const u8 reg = fallback >> 24;
+  if (!_cgxshadowenabled || !_cgxshadow.bp_valid[reg])
+    return fallback;
+  return (reg << 24) | _cgxshadow.bp[reg];
+}
+
+void CGX_EnableShadowState(bool enable)
+{
+  CGX_InvalidateShadowState();
+  _cgxshadow.bp_mask = 0xFFFFFF;
+  _cgxshadowenabled = enable;
+}
+
+void CGX_InvalidateShadowState()
+{
+  memset(_cgxshadow.bp_valid, 0, sizeof(_cgxshadow.bp_valid));
+  memset(_cgxshadow.tev_konst_valid, 0, sizeof(_cgxshadow.tev_konst_valid));
+  memset(_cgxshadow.cp_valid, 0, sizeof(_cgxshadow.cp_valid));
+  memset(_cgxshadow.xf_valid, 0, sizeof(_cgxshadow.xf_valid));
+}
+
+CGXShadowStats CGX_GetShadowStats()
+{
+  return _cgxshadow.stats;
+}
+
+void CGX_ResetShadowStats()
+{
+  memset(&_cgxshadow.stats, 0, sizeof(_cgxshadow.stats));
+}
@@ -11,11 +11,26 @@
 // They are based directly on Dolphin's register definitions, hence
 // (hopefully) minimizing potential for mistakes.
 
-#include <ogc/gx.h>
+#pragma once
 
 #include "common/CommonTypes.h"
 
-#pragma once
+// Defining CGX_RECORD_FIFO replaces the write-gather pipe with a FifoRecorder, so the exact
+// command stream of a test can be produced without a GPU, e.g. on a host (see hosttest).
+// Everything that writes to wgPipe, including the macros below, then appends to
+// cgx_fifo_recorder instead. Functions which wait for the GPU return immediately and
+// readbacks yield zeros.
+// Hardware builds are not affected by this at all.
+#ifdef CGX_RECORD_FIFO
+#include "gxtest/FifoRecorder.h"
+
+typedef float f32;
+
+extern FifoRecorder cgx_fifo_recorder;
+#define wgPipe (&cgx_fifo_recorder)
+#else
+#include <ogc/gx.h>
+#endif
 
 /*typedef float f32;
 
@@ -33,26 +48,67 @@ typedef union
 static CWGPipe* const wgPipe = (CWGPipe*)0xCC008000;
 */
 
+// Optional shadow state, see CGX_EnableShadowState
+extern bool _cgxshadowenabled;
+void CGX_ShadowLoadBPReg(u32 value);
+void CGX_ShadowLoadCPReg(u8 reg, u32 value);
+void CGX_ShadowInvalidateBPReg(u8 reg);
+void CGX_ShadowInvalidateCPReg(u8 reg);
+void CGX_ShadowInvalidateXFRegs(u16 address, u32 count);
+
+// Unconditional register writes, which bypass the shadow state.
+// The _TO variants write to any pipe-like object instead of wgPipe, e.g. a DisplayList.
+#define CGX_WRITE_BP_REG_TO(pipe, x)                                                               \
+  do                                                                                               \
+  {                                                                                                \
+    (pipe)->U8 = 0x61;                                                                             \
+    (pipe)->U32 = (u32)(x);                                                                        \
+  } while (0)
+
+#define CGX_WRITE_CP_REG_TO(pipe, x, y)                                                            \
+  do                                                                                               \
+  {                                                                                                \
+    (pipe)->U8 = 0x08;                                                                             \
+    (pipe)->U8 = (u8)(x);                                                                          \
+    (pipe)->U32 = (u32)(y);                                                                        \
+  } while (0)
+
+#define CGX_BEGIN_WRITE_XF_REGS_TO(pipe, x, n)                                                     \
+  do                                                                                               \
+  {                                                                                                \
+    (pipe)->U8 = 0x10;                                                                             \
+    (pipe)->U32 = (u32)(((((n)&0xffff) - 1) << 16) | ((x)&0xffff));                                \
+  } while (0)
+
+#define CGX_WRITE_BP_REG(x) CGX_WRITE_BP_REG_TO(wgPipe, x)
+#define CGX_WRITE_CP_REG(x, y) CGX_WRITE_CP_REG_TO(wgPipe, x, y)
+#define CGX_BEGIN_WRITE_XF_REGS(x, n) CGX_BEGIN_WRITE_XF_REGS_TO(wgPipe, x, n)
+
 #define CGX_LOAD_BP_REG(x)                                                                         \
   do                                                                                               \
   {                                                                                                \
-    wgPipe->U8 = 0x61;                                                                             \
-    wgPipe->U32 = (u32)(x);                                                                        \
+    if (_cgxshadowenabled)                                                                         \
+      CGX_ShadowLoadBPReg((u32)(x));                                                               \
+    else                                                                                           \
+      CGX_WRITE_BP_REG(x);                                                                         \
   } while (0)
 
 #define CGX_LOAD_CP_REG(x, y)                                                                      \
   do                                                                                               \
   {                                                                                                \
-    wgPipe->U8 = 0x08;                                                                             \
-    wgPipe->U8 = (u8)(x);                                                                          \
-    wgPipe->U32 = (u32)(y);                                                                        \
+    if (_cgxshadowenabled)                                                                         \
+      CGX_ShadowLoadCPReg((u8)(x), (u32)(y));                                                      \
+    else                                                                                           \
+      CGX_WRITE_CP_REG(x, y);                                                                      \
   } while (0)
 
+// The values written after this are unknown to the shadow state, so it forgets about them
 #define CGX_BEGIN_LOAD_XF_REGS(x, n)                                                               \
   do                                                                                               \
   {                                                                                                \
-    wgPipe->U8 = 0x10;                                                                             \
-    wgPipe->U32 = (u32)(((((n)&0xffff) - 1) << 16) | ((x)&0xffff));                                \
+    if (_cgxshadowenabled)                                                                         \
+      CGX_ShadowInvalidateXFRegs((x), (n));                                                        \
+    CGX_BEGIN_WRITE_XF_REGS(x, n);                                                                 \
   } while (0)
 
 void CGX_Init();
@@ -60,18 +116,92 @@ void CGX_Init();
 void CGX_SetViewport(float origin_x, float origin_y, float width, float height, float near,
                      f32 far);
 
+// Matrix loads write the XF registers directly and produce the same command streams as
+// libogc's GX_LoadPosMtxImm, GX_LoadTexMtxImm (GX_MTX2x4) and GX_LoadProjectionMtx.
+// index is a libogc matrix index, e.g. GX_PNMTX0 or GX_TEXMTX0.
+// Matrices are copied with paired-single stores, which requires GQR0 to be zero.
 void CGX_LoadPosMatrixDirect(f32 mt[3][4], u32 index);
+void CGX_LoadTexMatrix2x4Direct(f32 mt[2][4], u32 index);
 void CGX_LoadProjectionMatrixPerspective(float mtx[4][4]);
 void CGX_LoadProjectionMatrixOrthographic(float mtx[4][4]);
 
-void CGX_DoEfbCopyTex(u16 left, u16 top, u16 width, u16 height, u8 dest_format,
-                      bool copy_to_intensity, void* dest, bool scale_down = false,
-                      bool clear = false);
+// Copies an EFB rectangle to a texture in dest_format, one of libogc's GX_TF_* and GX_CTF_*
+// copy formats (see TextureEncoder). Intensity formats convert the colors to intensity.
+// The depth formats (GX_TF_Z*, GX_CTF_Z*) need the EFB pixel format set to PIXELFMT_Z24 while
+// copying, like libogc's GX_CopyTex does.
+// With clear, the copied rectangle is cleared to the color and depth of BPMEM_CLEAR_AR,
+// BPMEM_CLEAR_GB and BPMEM_CLEAR_Z afterwards. For this, the copy enables an always passing depth
+// test with updates and disables blending and logic operations. The ZMode and BlendMode are
+// restored after it from the shadow state, or to the ones of CGX_Init if it doesn't know them.
+void CGX_DoEfbCopyTex(u16 left, u16 top, u16 width, u16 height, u8 dest_format, void* dest,
+                      bool scale_down = false, bool clear = false);
 
 // TODO: Add support for other parameters...
+// Clearing works like in CGX_DoEfbCopyTex.
 void CGX_DoEfbCopyXfb(u16 left, u16 top, u16 width, u16 src_height, u16 dst_height, void* dest,
                       bool clear = false);
 
 void CGX_ForcePipelineFlush();
 
 void CGX_WaitForGpuToFinish();
+
+// Fences based on PE tokens. The GPU stores a token once it has processed all commands before it.
+// Note that the token is not visible until the command has been flushed out of the
+// write-gather pipe, which CGX_SetToken does.
+void CGX_SetToken(u16 token);
+u16 CGX_GetToken();
+
+// Busy-waits until the GPU has reached the given token (or a later one, counting modulo 2^16)
+void CGX_WaitForToken(u16 token);
+
+// Makes the GPU execute the commands in the given memory, which must be 32 byte aligned and
+// flushed from the data cache. size must be a multiple of 32.
+// The shadow state isn't told about the loads in the list, so the registers they touch need to be
+// invalidated. DisplayList::Call takes care of that.
+void CGX_CallDisplayList(const void* list, u32 size);
+
+// Redirects everything written to the write-gather pipe into the given buffer, which must be
+// 32 byte aligned, until CGX_EndDisplayList. The GPU doesn't execute any of it in the meantime.
+// Like libogc's GX_BeginDispList, but without touching libogc's state.
+void CGX_BeginDisplayList(void* buffer, u32 size);
+
+// Returns the number of bytes written since CGX_BeginDisplayList, padded to a multiple of 32,
+// or 0 if the buffer was too small.
+u32 CGX_EndDisplayList();
+
+// Loads `count` consecutive XF registers (or words of XF memory).
+// With the shadow state enabled, the load is dropped if it wouldn't change any of the registers.
+void CGX_LoadXFRegs(u16 address, u32 count, const u32* values);
+
+inline void CGX_LoadXFReg(u16 address, u32 value)
+{
+  CGX_LoadXFRegs(address, 1, &value);
+}
+
+// Shadow state
+// Tests often reload registers with the values they already have, e.g. once per test case.
+// With the shadow state enabled, CGX remembers the last value loaded into each BP and CP
+// register and each XF register from 0x1000 on, and drops loads which wouldn't change it.
+// This only covers loads done through CGX; anything else (e.g. libogc's GX functions) needs to
+// be followed by CGX_InvalidateShadowState. Loads which trigger an action rather than just
+// setting state (e.g. EFB copies, PE tokens and the BP mask) are never dropped, and neither are
+// TEV color registers, which libogc deliberately writes several times in a row.
+struct CGXShadowStats
+{
+  u32 bp_loads;
+  u32 bp_elided;
+  u32 cp_loads;
+  u32 cp_elided;
+  u32 xf_loads;  // in words
+  u32 xf_elided;
+};
+
+// Disabled by default. Enabling it starts with all registers unknown.
+void CGX_EnableShadowState(bool enable);
+
+// Forgets all register values, so that the following loads are sent to the GPU.
+// Use this before deliberately loading a register with the value it already has.
+void CGX_InvalidateShadowState();
+
+CGXShadowStats CGX_GetShadowStats();
+void CGX_ResetShadowStats();
@@ -81,8 +81,8 @@ TwoTevStageOrders CGXDefault<TwoTevStageOrders>(int index)
 {
   TwoTevStageOrders orders;
   orders.hex = (BPMEM_TREF + index) << 24;
-  orders.texmap0 = GX_TEXMAP_NULL;
-  orders.texcoord0 = GX_TEXCOORDNULL;
+  orders.texmap0 = 7;    // equivalent to GX_TEXMAP_NULL
+  orders.texcoord0 = 7;  // equivalent to GX_TEXCOORDNULL
   orders.enable0 = 0;
   orders.colorchan0 = 0;  // equivalent to GX_COLOR0A0
   return orders;
@@ -99,3 +99,62 @@ TevReg CGXDefault<TevReg>(int index, bool is_konst_color)
   tevreg.type_bg = is_konst_color;
   return tevreg;
 }
+
+template <>
+BlendMode CGXDefault<BlendMode>()
+{
+  BlendMode blendmode;
+  blendmode.hex = BPMEM_BLENDMODE << 24;
+  blendmode.blendenable = 0;
+  blendmode.logicopenable = 0;
+  blendmode.dither = 0;
+  blendmode.colorupdate = 1;
+  blendmode.alphaupdate = 1;
+  blendmode.dstfactor = 0;  // equivalent to GX_BL_ZERO
+  blendmode.srcfactor = 1;  // equivalent to GX_BL_ONE
+  blendmode.subtract = 0;
+  blendmode.logicmode = 0;
+  return blendmode;
+}
+
+template <>
+AlphaTest CGXDefault<AlphaTest>()
+{
+  AlphaTest alphatest;
+  alphatest.hex = BPMEM_ALPHACOMPARE << 24;
+  alphatest.ref0 = 0;
+  alphatest.ref1 = 0;
+  alphatest.comp0 = ALPHACMP_ALWAYS;
+  alphatest.comp1 = ALPHACMP_ALWAYS;
+  alphatest.logic = 0;  // AND
+  return alphatest;
+}
+
+// Swap tables as set up by libogc: RGBA, RRRA, GGGA, BBBA. Each table is spread over two
+// registers, the first of which holds red and green, the second blue and alpha.
+template <>
+TevKSel CGXDefault<TevKSel>(int index)
+{
+  static const u8 swap_tables[4][4] = {{0, 1, 2, 3}, {0, 0, 0, 3}, {1, 1, 1, 3}, {2, 2, 2, 3}};
+
+  TevKSel ksel;
+  ksel.hex = (BPMEM_TEV_KSEL + index) << 24;
+  ksel.swap1 = swap_tables[index / 2][(index & 1) * 2];
+  ksel.swap2 = swap_tables[index / 2][(index & 1) * 2 + 1];
+  ksel.kcsel0 = 0;  // equivalent to GX_TEV_KCSEL_1
+  ksel.kasel0 = 0;  // equivalent to GX_TEV_KASEL_1
+  ksel.kcsel1 = 0;
+  ksel.kasel1 = 0;
+  return ksel;
+}
+
+template <>
+LitChannel CGXDefault<LitChannel>()
+{
+  LitChannel chan;
+  chan.hex = 0;
+  chan.matsource = 1;  // from vertex
+  chan.enablelighting = 0;
+  chan.ambsource = 0;  // from register
+  return chan;
+}
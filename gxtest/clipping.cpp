@@ -2,13 +2,16 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <initializer_list>
 #include <math.h>
 #include <ogcsys.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include <wiiuse/wpad.h>
 #include "common/hwtests.h"
+#include "gxtest/Rasterizer.h"
 #include "gxtest/cgx.h"
 #include "gxtest/cgx_defaults.h"
 #include "gxtest/util.h"
@@ -43,6 +46,10 @@ void ClipTest()
   ctrl.early_ztest = 0;
   CGX_LOAD_BP_REG(ctrl.hex);
 
+  // Most of the state below is the same for each step
+  CGX_EnableShadowState(true);
+  CGX_ResetShadowStats();
+
   for (int step = 0; step < 16; ++step)
   {
     auto zmode = CGXDefault<ZMode>();
@@ -79,8 +86,7 @@ void ClipTest()
     CGX_LOAD_BP_REG(tevreg.low);
     CGX_LOAD_BP_REG(tevreg.high);
 
-    CGX_BEGIN_LOAD_XF_REGS(0x1005, 1);
-    wgPipe->U32 = 0;  // 0 = enable clipping, 1 = disable clipping
+    CGX_LoadXFReg(XFMEM_CLIPDISABLE, 0);  // 0 = enable clipping, 1 = disable clipping
 
     bool expect_quad_to_be_drawn = true;
     int test_x = 125, test_y = 25;  // Somewhere within the viewport
@@ -157,8 +163,7 @@ void ClipTest()
     // Depth clipping tests
     case 7:  // Everything behind z=w plane, depth clipping enabled
     case 8:  // Everything behind z=w plane, depth clipping disabled
-      CGX_BEGIN_LOAD_XF_REGS(0x1005, 1);
-      wgPipe->U32 = step - 7;  // 0 = enable clipping, 1 = disable clipping
+      CGX_LoadXFReg(XFMEM_CLIPDISABLE, step - 7);  // 0 = enable clipping, 1 = disable clipping
 
       test_quad.AtDepth(1.1);
       expect_quad_to_be_drawn = false;
@@ -166,8 +171,7 @@ void ClipTest()
 
     case 9:   // Everything in front of z=0 plane, depth clipping enabled
     case 10:  // Everything in front of z=0 plane, depth clipping disabled
-      CGX_BEGIN_LOAD_XF_REGS(0x1005, 1);
-      wgPipe->U32 = step - 9;  // 0 = enable clipping, 1 = disable clipping
+      CGX_LoadXFReg(XFMEM_CLIPDISABLE, step - 9);  // 0 = enable clipping, 1 = disable clipping
 
       test_quad.AtDepth(-0.00001);
       expect_quad_to_be_drawn = false;
@@ -181,16 +185,14 @@ void ClipTest()
       // number, which by IEEE would be non-zero but which in fact is
       // treated as zero.
       // In particular, the value by IEEE is -0.00000011920928955078125.
-      CGX_BEGIN_LOAD_XF_REGS(0x1005, 1);
-      wgPipe->U32 = step - 11;  // 0 = enable clipping, 1 = disable clipping
+      CGX_LoadXFReg(XFMEM_CLIPDISABLE, step - 11);  // 0 = enable clipping, 1 = disable clipping
 
       test_quad.AtDepth(1.0000001);
       break;
 
     case 13:  // One vertex behind z=w plane, depth clipping enabled
     case 14:  // One vertex behind z=w plane, depth clipping disabled
-      CGX_BEGIN_LOAD_XF_REGS(0x1005, 1);
-      wgPipe->U32 = step - 13;  // 0 = enable clipping, 1 = disable clipping
+      CGX_LoadXFReg(XFMEM_CLIPDISABLE, step - 13);  // 0 = enable clipping, 1 = disable clipping
 
       test_quad.VertexTopLeft(-1.0f, 1.0f, 1.5f);
 
@@ -200,8 +202,7 @@ void ClipTest()
       break;
 
     case 15:  // Three vertices with a very large value for z, depth clipping disabled
-      CGX_BEGIN_LOAD_XF_REGS(0x1005, 1);
-      wgPipe->U32 = 1;  // 0 = enable clipping, 1 = disable clipping
+      CGX_LoadXFReg(XFMEM_CLIPDISABLE, 1);  // 0 = enable clipping, 1 = disable clipping
 
       test_quad.VertexTopLeft(-1.0f, 1.0f, 65537.f);
       test_quad.VertexTopRight(1.0f, 1.0f, 65537.f);
@@ -229,6 +230,314 @@ void ClipTest()
     GXTest::DebugDisplayEfbContents();
   }
 
+  const CGXShadowStats stats = CGX_GetShadowStats();
+  network_printf("Shadow state dropped %u of %u BP, %u of %u CP and %u of %u XF loads\n",
+                 stats.bp_elided, stats.bp_loads, stats.cp_elided, stats.cp_loads,
+                 stats.xf_elided, stats.xf_loads);
+  CGX_EnableShadowState(false);
+
+  END_TEST();
+}
+
+// The sweep draws each case into its own cell of the EFB, with the scissor rectangle limited to
+// the cell. Viewports are at most 12 pixels wide, so that the guardband fits into a cell.
+static const int CELL_SIZE = 32;
+static const int CELLS_PER_ROW = 640 / CELL_SIZE;
+static const int CELLS_PER_BATCH = CELLS_PER_ROW * (528 / CELL_SIZE);
+static const int NUM_SWEEP_BATCHES = 16;
+static const int MAX_REPORTED_CASES = 8;
+
+static const Rasterizer::ClipMode clip_modes[] = {
+    Rasterizer::CLIP_NONE, Rasterizer::CLIP_GUARDBAND, Rasterizer::CLIP_VIEWPORT,
+    Rasterizer::CLIP_REJECT,
+};
+static const char* clip_mode_names[] = {"none", "guardband", "viewport", "reject"};
+static const int NUM_CLIP_MODES = sizeof(clip_modes) / sizeof(clip_modes[0]);
+
+struct ClipCase
+{
+  Rasterizer::Viewport viewport;
+  Rasterizer::Quad quad;
+};
+
+// One bit per pixel of a cell, one u32 per row
+struct CoverageMask
+{
+  u32 rows[CELL_SIZE];
+};
+
+static float GetRandomFloat(float min, float max)
+{
+  return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+// Mostly close to the edges of the viewport (1) and the guardband (2), sometimes exactly on them
+static float GetRandomCoordinate()
+{
+  static const float edges[] = {-2.0f, -1.0f, 1.0f, 2.0f};
+  const float edge = edges[rand() % 4];
+  switch (rand() % 4)
+  {
+  case 0:
+    return edge;
+  case 1:
+    return GetRandomFloat(-3.0f, 3.0f);
+  default:
+    return edge + GetRandomFloat(-0.5f, 0.5f);
+  }
+}
+
+static ClipCase GenerateClipCase(int cell)
+{
+  const int cell_x = (cell % CELLS_PER_ROW) * CELL_SIZE;
+  const int cell_y = (cell / CELLS_PER_ROW) * CELL_SIZE;
+  const float width = GetRandomFloat(4.0f, 12.0f);
+  const float height = GetRandomFloat(4.0f, 12.0f);
+  const float center_x = cell_x + CELL_SIZE / 2 + GetRandomFloat(-1.0f, 1.0f);
+  const float center_y = cell_y + CELL_SIZE / 2 + GetRandomFloat(-1.0f, 1.0f);
+
+  ClipCase clip_case;
+  clip_case.viewport = Rasterizer::GetViewport(center_x - width / 2, center_y - height / 2,
+                                               width, height);
+  for (int i = 0; i < 4; ++i)
+  {
+    clip_case.quad.x[i] = GetRandomCoordinate();
+    clip_case.quad.y[i] = GetRandomCoordinate();
+  }
+  return clip_case;
+}
+
+static void SetScissor(int left, int top, int width, int height)
+{
+  X12Y12 scissor;
+  scissor.hex = BPMEM_SCISSORTL << 24;
+  scissor.x = 342 + left;
+  scissor.y = 342 + top;
+  CGX_LOAD_BP_REG(scissor.hex);
+  scissor.hex = BPMEM_SCISSORBR << 24;
+  scissor.x = 342 + left + width - 1;
+  scissor.y = 342 + top + height - 1;
+  CGX_LOAD_BP_REG(scissor.hex);
+}
+
+static void DrawClipCases(const ClipCase* cases, int count)
+{
+  // Clear the whole batch area to black
+  SetScissor(0, 0, 640, 528);
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+  GXTest::Quad().ColorRGBA(0, 0, 0, 0xff).Draw();
+
+  for (int i = 0; i < count; ++i)
+  {
+    SetScissor((i % CELLS_PER_ROW) * CELL_SIZE, (i / CELLS_PER_ROW) * CELL_SIZE, CELL_SIZE,
+               CELL_SIZE);
+
+    u32 viewport[6];
+    memcpy(viewport, &cases[i].viewport, sizeof(viewport));
+    CGX_LoadXFRegs(XFMEM_SETVIEWPORT, 6, viewport);
+
+    const Rasterizer::Quad& quad = cases[i].quad;
+    GXTest::Quad()
+        .VertexTopLeft(quad.x[0], quad.y[0], 1.0f)
+        .VertexTopRight(quad.x[1], quad.y[1], 1.0f)
+        .VertexBottomRight(quad.x[2], quad.y[2], 1.0f)
+        .VertexBottomLeft(quad.x[3], quad.y[3], 1.0f)
+        .ColorRGBA(0xff, 0xff, 0xff, 0xff)
+        .Draw();
+  }
+}
+
+// Coverage of a cell according to the model. The sample location within a pixel isn't known
+// exactly, so pixels are sampled at the corners of the square from 2/12 to 10/12 of a pixel:
+// pixels with all of them inside one triangle are surely covered, pixels with any of them (or a
+// vertex) inside one are possibly covered. This way, the comparison is about clipping, not
+// about where exactly edges end up.
+static void GetModelCoverage(const ClipCase& clip_case, Rasterizer::ClipMode mode, int cell,
+                             CoverageMask* sure, CoverageMask* possible)
+{
+  static const int STEPS = 12;
+  const Rasterizer::Config configs[4] = {
+      {STEPS, 2, 2}, {STEPS, 10, 2}, {STEPS, 2, 10}, {STEPS, 10, 10},
+  };
+  const Rasterizer::ClipConfig clip = {mode, 2.0f};
+
+  Rasterizer::ScreenVertex triangles[Rasterizer::MAX_CLIPPED_TRIANGLES][3];
+  const int num_triangles =
+      Rasterizer::ClipQuad(configs[0], clip, clip_case.viewport, clip_case.quad, triangles);
+
+  const int cell_x = (cell % CELLS_PER_ROW) * CELL_SIZE;
+  const int cell_y = (cell / CELLS_PER_ROW) * CELL_SIZE;
+  memset(sure, 0, sizeof(*sure));
+  memset(possible, 0, sizeof(*possible));
+
+  for (int t = 0; t < num_triangles; ++t)
+  {
+    // Only the pixels within the bounding box of the triangle, and within the cell
+    s64 min_x = triangles[t][0].x, max_x = min_x;
+    s64 min_y = triangles[t][0].y, max_y = min_y;
+    for (int v = 1; v < 3; ++v)
+    {
+      min_x = std::min(min_x, triangles[t][v].x);
+      max_x = std::max(max_x, triangles[t][v].x);
+      min_y = std::min(min_y, triangles[t][v].y);
+      max_y = std::max(max_y, triangles[t][v].y);
+    }
+    const int left = (int)std::max<s64>(cell_x, min_x / STEPS - 1);
+    const int right = (int)std::min<s64>(cell_x + CELL_SIZE - 1, max_x / STEPS + 1);
+    const int top = (int)std::max<s64>(cell_y, min_y / STEPS - 1);
+    const int bottom = (int)std::min<s64>(cell_y + CELL_SIZE - 1, max_y / STEPS + 1);
+
+    for (int y = top; y <= bottom; ++y)
+    {
+      for (int x = left; x <= right; ++x)
+      {
+        int num_covered = 0;
+        for (const Rasterizer::Config& config : configs)
+          num_covered += Rasterizer::CoversTriangle(config, triangles[t], x, y);
+
+        bool has_vertex = false;
+        for (int v = 0; v < 3; ++v)
+        {
+          has_vertex |= triangles[t][v].x >= x * STEPS && triangles[t][v].x < (x + 1) * STEPS &&
+                        triangles[t][v].y >= y * STEPS && triangles[t][v].y < (y + 1) * STEPS;
+        }
+
+        const u32 bit = 1u << (x - cell_x);
+        if (num_covered == 4)
+          sure->rows[y - cell_y] |= bit;
+        if (num_covered > 0 || has_vertex)
+          possible->rows[y - cell_y] |= bit;
+      }
+    }
+  }
+}
+
+static void PrintCoverage(const CoverageMask& hardware, const CoverageMask& sure,
+                          const CoverageMask& possible)
+{
+  // # covered as expected, . uncovered as expected, + unexpectedly covered, - unexpectedly not
+  for (int y = 0; y < CELL_SIZE; ++y)
+  {
+    char row[CELL_SIZE + 1];
+    for (int x = 0; x < CELL_SIZE; ++x)
+    {
+      const u32 bit = 1u << x;
+      const bool covered = (hardware.rows[y] & bit) != 0;
+      if (covered && !(possible.rows[y] & bit))
+        row[x] = '+';
+      else if (!covered && (sure.rows[y] & bit))
+        row[x] = '-';
+      else
+        row[x] = covered ? '#' : '.';
+    }
+    row[CELL_SIZE] = '\0';
+    network_printf("  %s\n", row);
+  }
+}
+
+// Draws thousands of random quads straddling the viewport and guardband edges and compares the
+// coverage of each against the reference clipper in each of its clip modes. Batches are
+// compared while the GPU draws the next one.
+static void ClipSweepTest()
+{
+  START_TEST();
+
+  auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+  cc.d = TEVCOLORARG_RASC;
+  CGX_LOAD_BP_REG(cc.hex);
+  CGX_LoadXFReg(XFMEM_CLIPDISABLE, 0);
+
+  GXTest::ReadbackQueue queue;
+  std::vector<ClipCase> batches[2];
+  int slots[2] = {-1, -1};
+
+  int num_cases = 0;
+  int mismatches[NUM_CLIP_MODES] = {};
+  int num_reported = 0;
+
+  auto check_batch = [&](int batch) {
+    const std::vector<ClipCase>& cases = batches[batch % 2];
+    queue.Wait(slots[batch % 2]);
+
+    std::vector<CoverageMask> hardware(cases.size());
+    for (int i = 0; i < (int)cases.size(); ++i)
+    {
+      const int cell_x = (i % CELLS_PER_ROW) * CELL_SIZE;
+      const int cell_y = (i / CELLS_PER_ROW) * CELL_SIZE;
+      for (int y = 0; y < CELL_SIZE; ++y)
+      {
+        u32 row = 0;
+        for (int x = 0; x < CELL_SIZE; ++x)
+          row |= (queue.Read(slots[batch % 2], cell_x + x, cell_y + y).r > 0x7f) << x;
+        hardware[i].rows[y] = row;
+      }
+    }
+
+    for (int i = 0; i < (int)cases.size(); ++i)
+    {
+      // Whether the case matches each clip mode
+      bool any_match = false;
+      for (int mode = 0; mode < NUM_CLIP_MODES; ++mode)
+      {
+        CoverageMask sure, possible;
+        GetModelCoverage(cases[i], clip_modes[mode], i, &sure, &possible);
+        bool match = true;
+        for (int y = 0; y < CELL_SIZE; ++y)
+        {
+          match &= (hardware[i].rows[y] & ~possible.rows[y]) == 0 &&
+                   (sure.rows[y] & ~hardware[i].rows[y]) == 0;
+        }
+        mismatches[mode] += !match;
+        any_match |= match;
+      }
+
+      // Cases which no clip mode explains are printed along with the coverage that guardband
+      // clipping gives
+      DO_TEST(any_match, "Batch %d case %d matches no clip mode", batch, i);
+      if (!any_match && num_reported < MAX_REPORTED_CASES)
+      {
+        ++num_reported;
+        const ClipCase& clip_case = cases[i];
+        network_printf("  viewport wd=%f ht=%f x_orig=%f y_orig=%f\n", clip_case.viewport.wd,
+                       clip_case.viewport.ht, clip_case.viewport.x_orig,
+                       clip_case.viewport.y_orig);
+        network_printf("  quad (%f, %f) (%f, %f) (%f, %f) (%f, %f)\n", clip_case.quad.x[0],
+                       clip_case.quad.y[0], clip_case.quad.x[1], clip_case.quad.y[1],
+                       clip_case.quad.x[2], clip_case.quad.y[2], clip_case.quad.x[3],
+                       clip_case.quad.y[3]);
+        CoverageMask sure, possible;
+        GetModelCoverage(clip_case, Rasterizer::CLIP_GUARDBAND, i, &sure, &possible);
+        PrintCoverage(hardware[i], sure, possible);
+      }
+    }
+    num_cases += (int)cases.size();
+  };
+
+  for (int batch = 0; batch < NUM_SWEEP_BATCHES; ++batch)
+  {
+    std::vector<ClipCase>& cases = batches[batch % 2];
+    cases.resize(CELLS_PER_BATCH);
+    for (int i = 0; i < CELLS_PER_BATCH; ++i)
+      cases[i] = GenerateClipCase(i);
+
+    DrawClipCases(cases.data(), CELLS_PER_BATCH);
+    slots[batch % 2] = queue.Submit(0, 0, 640, 528);
+
+    if (batch > 0)
+      check_batch(batch - 1);
+  }
+  check_batch(NUM_SWEEP_BATCHES - 1);
+
+  for (int mode = 0; mode < NUM_CLIP_MODES; ++mode)
+  {
+    network_printf("Clip mode %-9s: %d of %d cases differ from hardware\n",
+                   clip_mode_names[mode], mismatches[mode], num_cases);
+  }
+
+  // Restore the state set up by Init
+  SetScissor(0, 0, 640, 528);
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+
   END_TEST();
 }
 
@@ -240,6 +549,7 @@ int main()
   GXTest::Init();
 
   ClipTest();
+  ClipSweepTest();
 
   network_printf("Shutting down...\n");
   network_shutdown();
@@ -0,0 +1,249 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <malloc.h>
+#include <ogcsys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+#include "gxtest/ConversionTest.h"
+#include "gxtest/TextureDecoder.h"
+
+static const int MAX_WIDTH = 640;
+static const int MAX_HEIGHT = 528;
+
+static u8* s_tiled;
+static u8* s_reference;
+static u8* s_result;
+static u8* s_tlut;
+
+static void FillRandom(u8* data, u32 size)
+{
+  for (u32 i = 0; i < size; ++i)
+    data[i] = rand();
+}
+
+// Checks the layout against a block with known contents
+static void KnownBlockTest()
+{
+  START_TEST();
+
+  u8 block[64];
+  for (int i = 0; i < 64; ++i)
+    block[i] = i;
+
+  u8 pixels[4 * 4 * 4];
+  TextureDecoder::DetileRGBA8Scalar(pixels, block, 4, 4);
+
+  for (int i = 0; i < 16; ++i)
+  {
+    // AR pairs first, then GB pairs
+    const u8* pixel = pixels + 4 * i;
+    DO_TEST(pixel[0] == 2 * i + 1 && pixel[1] == 32 + 2 * i && pixel[2] == 32 + 2 * i + 1 &&
+                pixel[3] == 2 * i,
+            "Pixel %d: got %d %d %d %d", i, pixel[0], pixel[1], pixel[2], pixel[3]);
+  }
+
+  END_TEST();
+}
+
+// Checks both kinds of CMPR sub-blocks: c0 > c1 interpolates two colors, c0 <= c1 has the
+// average and a transparent color
+static void CmprKnownBlockTest()
+{
+  START_TEST();
+
+  // Red and blue as RGB565, with the four selections 0, 1, 2 and 3 in each row
+  static const u8 sub_blocks[2][8] = {
+      {0xF8, 0x00, 0x00, 0x1F, 0x1B, 0x1B, 0x1B, 0x1B},
+      {0x00, 0x1F, 0xF8, 0x00, 0x1B, 0x1B, 0x1B, 0x1B},
+  };
+  static const u8 expected[2][4][4] = {
+      {{255, 0, 0, 255}, {0, 0, 255, 255}, {159, 0, 95, 255}, {95, 0, 159, 255}},
+      {{0, 0, 255, 255}, {255, 0, 0, 255}, {128, 0, 128, 255}, {128, 0, 128, 0}},
+  };
+
+  u8 block[32];
+  for (int sub = 0; sub < 4; ++sub)
+    memcpy(block + 8 * sub, sub_blocks[sub % 2], 8);
+
+  u8 pixels[8 * 8 * 4];
+  TextureDecoder::DecodeScalar(pixels, block, 8, 8, TextureDecoder::FORMAT_CMPR);
+
+  for (int y = 0; y < 8; ++y)
+  {
+    for (int x = 0; x < 8; ++x)
+    {
+      const u8* pixel = pixels + 4 * (y * 8 + x);
+      const u8* color = expected[x / 4][x % 4];
+      DO_TEST(!memcmp(pixel, color, 4), "Pixel (%d, %d): got %d %d %d %d, expected %d %d %d %d",
+              x, y, pixel[0], pixel[1], pixel[2], pixel[3], color[0], color[1], color[2],
+              color[3]);
+    }
+  }
+
+  END_TEST();
+}
+
+// Compares the optimized detiler against the scalar one, including partial blocks
+static void DetileMatchesScalarTest()
+{
+  START_TEST();
+
+  for (const auto& size : ConversionTest::SIZES)
+  {
+    const int width = size[0];
+    const int height = size[1];
+    const u32 linear_size = width * height * 4;
+
+    FillRandom(s_tiled, TextureDecoder::GetRGBA8TextureSize(width, height));
+    const u32 mismatch = ConversionTest::Compare(
+        s_reference, s_result, linear_size,
+        [&](u8* dst) { TextureDecoder::DetileRGBA8Scalar(dst, s_tiled, width, height); },
+        [&](u8* dst) { TextureDecoder::DetileRGBA8(dst, s_tiled, width, height); });
+
+    DO_TEST(mismatch == linear_size, "%dx%d: first mismatch at pixel (%d, %d)", width, height,
+            (mismatch / 4) % width, (mismatch / 4) / width);
+  }
+
+  END_TEST();
+}
+
+// Compares the optimized decoders against the scalar ones for every format and TLUT format
+static void DecodeMatchesScalarTest()
+{
+  START_TEST();
+
+  static const int tlut_formats[] = {
+      TextureDecoder::TLUT_IA8, TextureDecoder::TLUT_RGB565, TextureDecoder::TLUT_RGB5A3,
+  };
+
+  for (const auto& size : ConversionTest::SIZES)
+  {
+    const int width = size[0];
+    const int height = size[1];
+    const u32 linear_size = width * height * 4;
+
+    for (int format : TextureDecoder::ALL_FORMATS)
+    {
+      FillRandom(s_tiled, TextureDecoder::GetTextureSize(format, width, height));
+
+      for (int tlut_format : tlut_formats)
+      {
+        FillRandom(s_tlut, TextureDecoder::GetPaletteSize(format) * 2);
+        const u32 mismatch = ConversionTest::Compare(
+            s_reference, s_result, linear_size,
+            [&](u8* dst) {
+              TextureDecoder::DecodeScalar(dst, s_tiled, width, height, format, s_tlut,
+                                           tlut_format);
+            },
+            [&](u8* dst) {
+              TextureDecoder::Decode(dst, s_tiled, width, height, format, s_tlut, tlut_format);
+            });
+
+        DO_TEST(mismatch == linear_size, "%s (TLUT format %d) %dx%d: first mismatch at pixel "
+                                         "(%d, %d)",
+                TextureDecoder::GetFormatName(format), tlut_format, width, height,
+                (mismatch / 4) % width, (mismatch / 4) / width);
+
+        // The TLUT format only matters for palette formats
+        if (!TextureDecoder::IsPaletteFormat(format))
+          break;
+      }
+    }
+  }
+
+  END_TEST();
+}
+
+static void DetileBenchmark()
+{
+  START_TEST();
+
+  FillRandom(s_tiled, TextureDecoder::GetRGBA8TextureSize(MAX_WIDTH, MAX_HEIGHT));
+
+  static const struct
+  {
+    const char* name;
+    void (*detile)(u8*, const u8*, int, int);
+  } implementations[] = {
+      {"detile scalar", TextureDecoder::DetileRGBA8Scalar},
+      {"detile optimized", TextureDecoder::DetileRGBA8},
+  };
+
+  for (const auto& implementation : implementations)
+  {
+    const u64 ticks = ConversionTest::GetFastestTicks(
+        [&] { implementation.detile(s_result, s_tiled, MAX_WIDTH, MAX_HEIGHT); });
+    ConversionTest::PrintBenchmark(implementation.name, MAX_WIDTH, MAX_HEIGHT, ticks);
+  }
+
+  END_TEST();
+}
+
+static void DecodeBenchmark()
+{
+  START_TEST();
+
+  FillRandom(s_tlut, 16384 * 2);
+
+  static const struct
+  {
+    const char* name;
+    void (*decode)(u8*, const u8*, int, int, int, const u8*, int);
+  } implementations[] = {
+      {"scalar", TextureDecoder::DecodeScalar},
+      {"optimized", TextureDecoder::Decode},
+  };
+
+  for (int format : TextureDecoder::ALL_FORMATS)
+  {
+    FillRandom(s_tiled, TextureDecoder::GetTextureSize(format, MAX_WIDTH, MAX_HEIGHT));
+
+    for (const auto& implementation : implementations)
+    {
+      const u64 ticks = ConversionTest::GetFastestTicks([&] {
+        implementation.decode(s_result, s_tiled, MAX_WIDTH, MAX_HEIGHT, format, s_tlut,
+                              TextureDecoder::TLUT_RGB5A3);
+      });
+
+      char name[32];
+      snprintf(name, sizeof(name), "decode %s %s", TextureDecoder::GetFormatName(format),
+               implementation.name);
+      ConversionTest::PrintBenchmark(name, MAX_WIDTH, MAX_HEIGHT, ticks);
+    }
+  }
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  s_tiled = (u8*)memalign(32, TextureDecoder::GetRGBA8TextureSize(MAX_WIDTH, MAX_HEIGHT));
+  s_reference = (u8*)memalign(32, MAX_WIDTH * MAX_HEIGHT * 4);
+  s_result = (u8*)memalign(32, MAX_WIDTH * MAX_HEIGHT * 4);
+  s_tlut = (u8*)memalign(32, 16384 * 2);
+
+  KnownBlockTest();
+  CmprKnownBlockTest();
+  DetileMatchesScalarTest();
+  DecodeMatchesScalarTest();
+  DetileBenchmark();
+  DecodeBenchmark();
+
+  free(s_tiled);
+  free(s_reference);
+  free(s_result);
+  free(s_tlut);
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
@@ -0,0 +1,302 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <ogc/lwp_watchdog.h>
+#include <ogcsys.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+#include "common/timebase.h"
+#include "gxtest/DisplayList.h"
+#include "gxtest/FifoDecoder.h"
+#include "gxtest/XFMemory.h"
+#include "gxtest/cgx.h"
+#include "gxtest/cgx_defaults.h"
+#include "gxtest/util.h"
+
+// Checks that display lists draw the same as direct commands, that patch points take effect and
+// that the shadow state stays correct around them. Also measures how much CPU time they save.
+
+static const int GRID_SIZE = 8;
+static const int CELL_WIDTH = 640 / GRID_SIZE;
+static const int CELL_HEIGHT = 528 / GRID_SIZE;
+
+static GXTest::Vec4<u8> GetCellColor(int cell)
+{
+  GXTest::Vec4<u8> color;
+  color.r = (cell * 29) & 0xFF;
+  color.g = 255 - cell * 3;
+  color.b = cell * 4;
+  color.a = 255;
+  return color;
+}
+
+static TevReg GetTevColor(const GXTest::Vec4<u8>& color)
+{
+  auto tevreg = CGXDefault<TevReg>(1, false);  // c0
+  tevreg.red = color.r;
+  tevreg.green = color.g;
+  tevreg.blue = color.b;
+  tevreg.alpha = color.a;
+  return tevreg;
+}
+
+static void SetCellViewport(int cell)
+{
+  CGX_SetViewport((cell % GRID_SIZE) * CELL_WIDTH, (cell / GRID_SIZE) * CELL_HEIGHT, CELL_WIDTH,
+                  CELL_HEIGHT, 0.0f, 1.0f);
+}
+
+// Checks the center of each of the first num_cells cells against the given colors
+static void CheckCells(int num_cells, const GXTest::Vec4<u8>* colors, const char* name)
+{
+  CGX_WaitForGpuToFinish();
+  for (int cell = 0; cell < num_cells; ++cell)
+  {
+    const int x = (cell % GRID_SIZE) * CELL_WIDTH + CELL_WIDTH / 2;
+    const int y = (cell / GRID_SIZE) * CELL_HEIGHT + CELL_HEIGHT / 2;
+    const GXTest::Vec4<u8> result = GXTest::PeekEfbColor(x, y);
+    DO_TEST(result.r == colors[cell].r && result.g == colors[cell].g && result.b == colors[cell].b,
+            "%s: cell %d is %d %d %d, expected %d %d %d", name, cell, result.r, result.g, result.b,
+            colors[cell].r, colors[cell].g, colors[cell].b);
+  }
+}
+
+// Counts the commands of a recording
+class CountingHandler : public FifoDecoder::NullHandler
+{
+public:
+  CountingHandler() : bp_loads(0), draws(0), vertices(0) {}
+
+  void OnBP(u8 reg, u32 old_value, u32 new_value) { ++bp_loads; }
+  void OnDraw(int primitive, int vat, u16 num_vertices, const u8* data, u32 size)
+  {
+    ++draws;
+    vertices += num_vertices;
+  }
+
+  int bp_loads;
+  int draws;
+  int vertices;
+};
+
+// Checks the recorded commands and patch point offsets, without involving the GPU
+static void RecordingTest()
+{
+  START_TEST();
+
+  const TevReg tevreg = GetTevColor(GetCellColor(5));
+
+  DisplayList list;
+  const u32 low = list.LoadBPReg(tevreg.low);
+  const u32 high = list.LoadBPReg(tevreg.high);
+  GXTest::Quad().AtDepth(0.5f).Draw(&list);
+  list.Finish();
+
+  const std::vector<u8>& data = list.Data();
+  auto read_u32 = [&](u32 offset) {
+    return ((u32)data[offset] << 24) | ((u32)data[offset + 1] << 16) |
+           ((u32)data[offset + 2] << 8) | (u32)data[offset + 3];
+  };
+  DO_TEST(read_u32(low) == tevreg.low, "Low patch point holds 0x%08x", read_u32(low));
+  DO_TEST(read_u32(high) == tevreg.high, "High patch point holds 0x%08x", read_u32(high));
+
+  DO_TEST(list.GetFinishedSize() % 32 == 0 && list.GetFinishedSize() >= data.size() &&
+              list.GetFinishedSize() < data.size() + 32,
+          "Finished size %u for %u recorded bytes", list.GetFinishedSize(), (u32)data.size());
+
+  CountingHandler handler;
+  FifoDecoder::Decoder<CountingHandler> decoder(&handler);
+  const u32 decoded = decoder.Decode(data.data(), (u32)data.size());
+  const FifoDecoder::State& state = decoder.GetState();
+  DO_TEST(decoded == data.size(), "Decoded %u of %u bytes", decoded, (u32)data.size());
+  DO_TEST(handler.bp_loads == 2, "%d BP loads", handler.bp_loads);
+  DO_TEST(handler.draws == 1 && handler.vertices == 4, "%d draws with %d vertices", handler.draws,
+          handler.vertices);
+  DO_TEST(state.vtx_desc.Position == VTXATTR_DIRECT && state.vtx_desc.Color0 == VTXATTR_NONE,
+          "Vertex descriptor 0x%08x", (u32)state.vtx_desc.Low);
+  DO_TEST(state.xf.projection.type == 1, "Projection type %u", state.xf.projection.type);
+
+  // Patches are kept when more commands are recorded and the list is finished again
+  list.Patch(low, tevreg.high);
+  list.LoadBPReg(tevreg.low);
+  list.Finish();
+  DO_TEST(read_u32(low) == tevreg.high, "Low patch point holds 0x%08x after finishing again",
+          read_u32(low));
+
+  END_TEST();
+}
+
+// Draws every cell from the same list, with the color patched in between
+static void PatchTest()
+{
+  START_TEST();
+
+  GXTest::Vec4<u8> colors[GRID_SIZE * GRID_SIZE];
+
+  DisplayList list;
+  const TevReg initial = GetTevColor(GetCellColor(0));
+  const u32 low = list.LoadBPReg(initial.low);
+  const u32 high = list.LoadBPReg(initial.high);
+  GXTest::Quad().Draw(&list);
+  list.Finish();
+
+  for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; ++cell)
+  {
+    colors[cell] = GetCellColor(cell);
+    const TevReg tevreg = GetTevColor(colors[cell]);
+
+    // The previous call needs to be done before the list can be changed
+    CGX_WaitForGpuToFinish();
+    list.Patch(low, tevreg.low);
+    list.Patch(high, tevreg.high);
+
+    SetCellViewport(cell);
+    list.Call();
+  }
+  CheckCells(GRID_SIZE * GRID_SIZE, colors, "Patched");
+
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+
+  END_TEST();
+}
+
+// Registers loaded by a list must not be elided when they are loaded directly afterwards.
+// The list switches the TEV stage from c0 to c1, which the shadow state would otherwise keep
+// filtering, so a stale shadow leaves the second quad with the color of the first one.
+static void ShadowStateTest()
+{
+  START_TEST();
+
+  const GXTest::Vec4<u8> colors[2] = {GetCellColor(10), GetCellColor(20)};
+  const TevReg c0 = GetTevColor(colors[0]);
+  auto c1 = CGXDefault<TevReg>(2, false);
+  c1.red = colors[1].r;
+  c1.green = colors[1].g;
+  c1.blue = colors[1].b;
+  c1.alpha = colors[1].a;
+
+  auto direct = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+  direct.d = TEVCOLORARG_C0;
+  auto listed = direct;
+  listed.d = TEVCOLORARG_C1;
+
+  DisplayList list;
+  list.LoadBPReg(listed.hex);
+  GXTest::Quad().Draw(&list);
+  list.Finish();
+
+  CGX_EnableShadowState(true);
+
+  CGX_LOAD_BP_REG(c0.low);
+  CGX_LOAD_BP_REG(c0.high);
+  CGX_LOAD_BP_REG(c1.low);
+  CGX_LOAD_BP_REG(c1.high);
+  CGX_LOAD_BP_REG(direct.hex);
+  SetCellViewport(1);
+  list.Call();
+
+  // Same value as before the call, which the shadow state must send again
+  SetCellViewport(0);
+  CGX_LOAD_BP_REG(direct.hex);
+  GXTest::Quad().Draw();
+
+  CheckCells(2, colors, "Shadowed");
+
+  CGX_EnableShadowState(false);
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+
+  END_TEST();
+}
+
+// CPU time to submit many small quads with direct commands versus display list calls. The
+// GPU is waited for separately, so that only the submission is measured.
+static void SubmissionBenchmark()
+{
+  START_TEST();
+
+  static const int NUM_QUADS = 4096;
+
+  DisplayList list;
+  GXTest::Quad().Draw(&list);
+  list.Finish();
+
+  for (int use_list = 0; use_list < 2; ++use_list)
+  {
+    CGX_WaitForGpuToFinish();
+    const u64 start = GetTimebase();
+    for (int i = 0; i < NUM_QUADS; ++i)
+    {
+      CGX_SetViewport((i % 160) * 4, ((i / 160) % 132) * 4, 4, 4, 0.0f, 1.0f);
+      if (use_list)
+        list.Call();
+      else
+        GXTest::Quad().Draw();
+    }
+    const u64 submitted = GetTimebase();
+    CGX_WaitForGpuToFinish();
+    const u64 end = GetTimebase();
+
+    const u32 submit_ticks = (u32)(submitted - start);
+    const u32 total_ticks = (u32)(end - start);
+    network_printf("displaylist %-6s quads=%d submit_ticks=%8u cycles/quad=%5u total_ticks=%8u "
+                   "(%6u us)\n",
+                   use_list ? "call" : "direct", NUM_QUADS, submit_ticks,
+                   (u32)((u64)submit_ticks * CPU_CYCLES_PER_TIMEBASE_TICK / NUM_QUADS), total_ticks,
+                   total_ticks / (TB_TIMER_CLOCK / 1000));
+  }
+  network_printf("displaylist quad: %u bytes per direct draw, %u byte list per call\n",
+                 (u32)list.Size(), list.GetFinishedSize());
+
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+
+  END_TEST();
+}
+
+static void SetupState()
+{
+  CGX_LOAD_BP_REG(CGXDefault<TwoTevStageOrders>(0).hex);
+
+  auto genmode = CGXDefault<GenMode>();
+  genmode.numtevstages = 0;  // One stage
+  CGX_LOAD_BP_REG(genmode.hex);
+
+  auto ac = CGXDefault<TevStageCombiner::AlphaCombiner>(0);
+  ac.d = TEVALPHAARG_A0;
+  CGX_LOAD_BP_REG(ac.hex);
+
+  auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+  cc.d = TEVCOLORARG_C0;
+  CGX_LOAD_BP_REG(cc.hex);
+
+  PE_CONTROL ctrl;
+  ctrl.hex = BPMEM_ZCOMPARE << 24;
+  ctrl.pixel_format = PIXELFMT_RGB8_Z24;
+  ctrl.zformat = ZC_LINEAR;
+  ctrl.early_ztest = 0;
+  CGX_LOAD_BP_REG(ctrl.hex);
+
+  auto zmode = CGXDefault<ZMode>();
+  CGX_LOAD_BP_REG(zmode.hex);
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  GXTest::Init();
+  SetupState();
+
+  RecordingTest();
+  PatchTest();
+  ShadowStateTest();
+  SubmissionBenchmark();
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
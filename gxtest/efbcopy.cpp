@@ -0,0 +1,353 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <malloc.h>
+#include <ogcsys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+#include "gxtest/ConversionTest.h"
+#include "gxtest/TextureDecoder.h"
+#include "gxtest/TextureEncoder.h"
+#include "gxtest/XFMemory.h"
+#include "gxtest/cgx.h"
+#include "gxtest/cgx_defaults.h"
+#include "gxtest/util.h"
+
+// Size of the EFB area with the test pattern, a multiple of the block size of every format
+static const int PATTERN_WIDTH = 64;
+static const int PATTERN_HEIGHT = 32;
+
+static const int BENCHMARK_WIDTH = 640;
+static const int BENCHMARK_HEIGHT = 528;
+
+static const int MAX_REPORTED_MISMATCHES = 16;
+
+static void SetPixelFormat(int format)
+{
+  PE_CONTROL ctrl;
+  ctrl.hex = BPMEM_ZCOMPARE << 24;
+  ctrl.pixel_format = format;
+  ctrl.zformat = ZC_LINEAR;
+  ctrl.early_ztest = 0;
+  CGX_LOAD_BP_REG(ctrl.hex);
+}
+
+// Fills the pattern area at the given EFB position with pixels of random colors and depths.
+// This doesn't wait for the GPU, so that several patterns can be drawn and copied in one go.
+static void DrawPattern(int left, int top)
+{
+  LitChannel chan;
+  chan.hex = 0;
+  chan.matsource = 1;  // from vertex
+  CGX_LoadXFReg(XFMEM_SETCHAN0_COLOR, chan.hex);
+  CGX_LoadXFReg(XFMEM_SETCHAN0_ALPHA, chan.hex);
+
+  auto zmode = CGXDefault<ZMode>();
+  zmode.testenable = 1;
+  zmode.updateenable = 1;
+  CGX_LOAD_BP_REG(zmode.hex);
+
+  for (int y = 0; y < PATTERN_HEIGHT; ++y)
+  {
+    for (int x = 0; x < PATTERN_WIDTH; ++x)
+    {
+      CGX_SetViewport(left + x, top + y, 1.0f, 1.0f, 0.0f, 1.0f);
+      GXTest::Quad()
+          .AtDepth(0.05f + 0.9f * (rand() / (float)RAND_MAX))
+          .ColorRGBA(rand(), rand(), rand(), rand())
+          .Draw();
+    }
+  }
+
+  CGX_LOAD_BP_REG(CGXDefault<ZMode>().hex);
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+}
+
+// Copies the pattern in every format and compares the result against TextureEncoder, which is
+// given the colors of an RGBA8 copy and the depth values read from the EFB.
+static void EncoderMatchesCopyTest()
+{
+  START_TEST();
+
+  static u8 colors[PATTERN_WIDTH * PATTERN_HEIGHT * 4];
+  static u8 depth_colors[PATTERN_WIDTH * PATTERN_HEIGHT * 4];
+  static u8 expected[PATTERN_WIDTH * PATTERN_HEIGHT * 4];
+
+  // 6 bits of alpha, so that formats with alpha get something else than 255
+  SetPixelFormat(PIXELFMT_RGBA6_Z24);
+  DrawPattern(0, 0);
+
+  GXTest::CopyToTestBuffer(0, 0, PATTERN_WIDTH - 1, PATTERN_HEIGHT - 1);
+  CGX_ForcePipelineFlush();
+  CGX_WaitForGpuToFinish();
+  TextureDecoder::DetileRGBA8(colors, GXTest::GetTestBuffer(), PATTERN_WIDTH, PATTERN_HEIGHT);
+
+  static u32 depth[PATTERN_WIDTH * PATTERN_HEIGHT];
+  for (int y = 0; y < PATTERN_HEIGHT; ++y)
+  {
+    for (int x = 0; x < PATTERN_WIDTH; ++x)
+      depth[y * PATTERN_WIDTH + x] = GXTest::PeekEfbDepth(x, y);
+  }
+  TextureEncoder::DepthToColors(depth_colors, depth, PATTERN_WIDTH * PATTERN_HEIGHT);
+
+  for (int format : TextureEncoder::ALL_FORMATS)
+  {
+    const bool is_depth = TextureEncoder::IsDepthFormat(format);
+    if (is_depth)
+      SetPixelFormat(PIXELFMT_Z24);
+
+    GXTest::CopyToTestBuffer(0, 0, PATTERN_WIDTH - 1, PATTERN_HEIGHT - 1, format);
+    CGX_ForcePipelineFlush();
+    CGX_WaitForGpuToFinish();
+
+    if (is_depth)
+      SetPixelFormat(PIXELFMT_RGBA6_Z24);
+
+    TextureEncoder::Encode(format, expected, is_depth ? depth_colors : colors, PATTERN_WIDTH,
+                           PATTERN_HEIGHT);
+
+    const u8* result = GXTest::GetTestBuffer();
+    const u32 size = TextureEncoder::GetTextureSize(format, PATTERN_WIDTH, PATTERN_HEIGHT);
+    u32 num_mismatches = 0;
+    u32 first_mismatch = size;
+    for (u32 i = 0; i < size; ++i)
+    {
+      if (result[i] != expected[i])
+      {
+        ++num_mismatches;
+        if (first_mismatch == size)
+          first_mismatch = i;
+      }
+    }
+
+    DO_TEST(num_mismatches == 0, "%s: %u of %u bytes differ, first at %u (got 0x%02x, expected "
+                                 "0x%02x)",
+            TextureEncoder::GetFormatName(format), num_mismatches, size, first_mismatch,
+            first_mismatch < size ? result[first_mismatch] : 0,
+            first_mismatch < size ? expected[first_mismatch] : 0);
+  }
+
+  END_TEST();
+}
+
+// Draws a differently seeded pattern per batch entry and copies each one at full and at half
+// scale, all before waiting for the GPU once. Every texel of the half scale copies is compared
+// against TextureEncoder::Downscale of the full scale one.
+static void ScaleDownTest()
+{
+  START_TEST();
+
+  static const int NUM_PATTERNS = 4;
+  static const int HALF_WIDTH = PATTERN_WIDTH / 2;
+  static const int HALF_HEIGHT = PATTERN_HEIGHT / 2;
+
+  static u8 colors[PATTERN_WIDTH * PATTERN_HEIGHT * 4];
+  static u8 expected[HALF_WIDTH * HALF_HEIGHT * 4];
+  static u8 result[HALF_WIDTH * HALF_HEIGHT * 4];
+  int num_mismatches = 0;
+
+  u8* full_copies[NUM_PATTERNS];
+  u8* half_copies[NUM_PATTERNS];
+  const u32 full_size =
+      TextureEncoder::GetTextureSize(TextureEncoder::FORMAT_RGBA8, PATTERN_WIDTH, PATTERN_HEIGHT);
+  const u32 half_size =
+      TextureEncoder::GetTextureSize(TextureEncoder::FORMAT_RGBA8, HALF_WIDTH, HALF_HEIGHT);
+
+  // 6 bits of alpha, so that alpha is averaged as well
+  SetPixelFormat(PIXELFMT_RGBA6_Z24);
+  for (int i = 0; i < NUM_PATTERNS; ++i)
+  {
+    full_copies[i] = (u8*)memalign(32, full_size);
+    half_copies[i] = (u8*)memalign(32, half_size);
+
+    const int left = i * PATTERN_WIDTH;
+    srand(i + 1);
+    DrawPattern(left, 0);
+
+    CGX_DoEfbCopyTex(left, 0, PATTERN_WIDTH, PATTERN_HEIGHT, TextureEncoder::FORMAT_RGBA8,
+                     full_copies[i]);
+    CGX_DoEfbCopyTex(left, 0, PATTERN_WIDTH, PATTERN_HEIGHT, TextureEncoder::FORMAT_RGBA8,
+                     half_copies[i], true);
+  }
+  CGX_ForcePipelineFlush();
+  CGX_WaitForGpuToFinish();
+
+  for (int i = 0; i < NUM_PATTERNS; ++i)
+  {
+    TextureDecoder::DetileRGBA8(colors, full_copies[i], PATTERN_WIDTH, PATTERN_HEIGHT);
+    TextureDecoder::DetileRGBA8(result, half_copies[i], HALF_WIDTH, HALF_HEIGHT);
+    TextureEncoder::Downscale(expected, colors, PATTERN_WIDTH, PATTERN_HEIGHT);
+
+    for (int y = 0; y < HALF_HEIGHT; ++y)
+    {
+      for (int x = 0; x < HALF_WIDTH; ++x)
+      {
+        const u8* got = result + 4 * (y * HALF_WIDTH + x);
+        const u8* want = expected + 4 * (y * HALF_WIDTH + x);
+        if (!memcmp(got, want, 4))
+          continue;
+
+        ++num_mismatches;
+        if (num_mismatches <= MAX_REPORTED_MISMATCHES)
+        {
+          DO_TEST(false, "Pattern %d, texel (%d, %d): got %d %d %d %d, expected %d %d %d %d", i,
+                  x, y, got[0], got[1], got[2], got[3], want[0], want[1], want[2], want[3]);
+        }
+      }
+    }
+
+    free(full_copies[i]);
+    free(half_copies[i]);
+  }
+
+  DO_TEST(num_mismatches == 0, "%d of %d half scale texels differ", num_mismatches,
+          NUM_PATTERNS * HALF_WIDTH * HALF_HEIGHT);
+
+  END_TEST();
+}
+
+// Clears rectangles next to each other with different clear colors and depths, using one copy
+// each, and checks every pixel of them in the EFB afterwards
+static void ClearTest()
+{
+  START_TEST();
+
+  static const int RECT_SIZE = 16;
+  static const struct
+  {
+    u8 r, g, b;
+    u32 z;
+  } clear_values[] = {
+      {0x00, 0x00, 0x00, 0x000000}, {0xFF, 0xFF, 0xFF, 0xFFFFFF}, {0x12, 0x34, 0x56, 0x789ABC},
+      {0xFE, 0x01, 0x80, 0x800000}, {0x7F, 0xC3, 0x3C, 0x0000FF}, {0x55, 0xAA, 0x0F, 0xF0F0F0},
+  };
+  const int num_values = sizeof(clear_values) / sizeof(clear_values[0]);
+
+  u8* scratch = (u8*)memalign(
+      32, TextureEncoder::GetTextureSize(TextureEncoder::FORMAT_RGBA8, RECT_SIZE, RECT_SIZE));
+
+  SetPixelFormat(PIXELFMT_RGB8_Z24);
+  for (int i = 0; i < num_values; ++i)
+  {
+    const auto& value = clear_values[i];
+    CGX_LOAD_BP_REG((BPMEM_CLEAR_AR << 24) | (0xFF << 8) | value.r);
+    CGX_LOAD_BP_REG((BPMEM_CLEAR_GB << 24) | (value.g << 8) | value.b);
+    CGX_LOAD_BP_REG((BPMEM_CLEAR_Z << 24) | value.z);
+    CGX_DoEfbCopyTex(i * RECT_SIZE, 0, RECT_SIZE, RECT_SIZE, TextureEncoder::FORMAT_RGBA8,
+                     scratch, false, true);
+  }
+  CGX_ForcePipelineFlush();
+  CGX_WaitForGpuToFinish();
+
+  int num_mismatches = 0;
+  for (int i = 0; i < num_values; ++i)
+  {
+    const auto& value = clear_values[i];
+    for (int y = 0; y < RECT_SIZE; ++y)
+    {
+      for (int x = i * RECT_SIZE; x < (i + 1) * RECT_SIZE; ++x)
+      {
+        const GXTest::Vec4<u8> color = GXTest::PeekEfbColor(x, y);
+        const u32 depth = GXTest::PeekEfbDepth(x, y);
+        if (color.r == value.r && color.g == value.g && color.b == value.b && depth == value.z)
+          continue;
+
+        ++num_mismatches;
+        if (num_mismatches <= MAX_REPORTED_MISMATCHES)
+        {
+          DO_TEST(false, "Clear %d, pixel (%d, %d): got %02x%02x%02x z=%06x, expected "
+                         "%02x%02x%02x z=%06x",
+                  i, x, y, color.r, color.g, color.b, depth, value.r, value.g, value.b, value.z);
+        }
+      }
+    }
+  }
+  DO_TEST(num_mismatches == 0, "%d of %d cleared pixels differ", num_mismatches,
+          num_values * RECT_SIZE * RECT_SIZE);
+
+  // Restore the clear color and depth of CGX_Init
+  CGX_LOAD_BP_REG((BPMEM_CLEAR_AR << 24) | 0xFF00);
+  CGX_LOAD_BP_REG((BPMEM_CLEAR_GB << 24) | 0x2700);
+  CGX_LOAD_BP_REG((BPMEM_CLEAR_Z << 24) | 0xFFFFFF);
+
+  free(scratch);
+
+  END_TEST();
+}
+
+// On the console, Encode is the same code as EncodeScalar, so only that is timed. The SIMD
+// versions of hosts are compared against it in hosttest.
+static void EncoderBenchmark()
+{
+  START_TEST();
+
+  const u32 linear_size = BENCHMARK_WIDTH * BENCHMARK_HEIGHT * 4;
+  u8* pixels = (u8*)memalign(32, linear_size);
+  u8* texture = (u8*)memalign(32, linear_size);
+  for (u32 i = 0; i < linear_size; ++i)
+    pixels[i] = rand();
+
+  for (int format : TextureEncoder::ALL_FORMATS)
+  {
+    // Depth formats use the same encoders as color formats
+    if (TextureEncoder::IsDepthFormat(format))
+      continue;
+
+    const u64 ticks = ConversionTest::GetFastestTicks([&] {
+      TextureEncoder::Encode(format, texture, pixels, BENCHMARK_WIDTH, BENCHMARK_HEIGHT);
+    });
+
+    char name[32];
+    snprintf(name, sizeof(name), "encode %s", TextureEncoder::GetFormatName(format));
+    ConversionTest::PrintBenchmark(name, BENCHMARK_WIDTH, BENCHMARK_HEIGHT, ticks);
+  }
+
+  free(pixels);
+  free(texture);
+
+  END_TEST();
+}
+
+// Like EncoderBenchmark, only the Downscale of the console is timed
+static void DownscaleBenchmark()
+{
+  START_TEST();
+
+  const u32 linear_size = BENCHMARK_WIDTH * BENCHMARK_HEIGHT * 4;
+  u8* pixels = (u8*)memalign(32, linear_size);
+  u8* downscaled = (u8*)memalign(32, linear_size / 4);
+  for (u32 i = 0; i < linear_size; ++i)
+    pixels[i] = rand();
+
+  const u64 ticks = ConversionTest::GetFastestTicks(
+      [&] { TextureEncoder::Downscale(downscaled, pixels, BENCHMARK_WIDTH, BENCHMARK_HEIGHT); });
+  ConversionTest::PrintBenchmark("downscale", BENCHMARK_WIDTH, BENCHMARK_HEIGHT, ticks);
+
+  free(pixels);
+  free(downscaled);
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  GXTest::Init();
+
+  EncoderMatchesCopyTest();
+  ScaleDownTest();
+  ClearTest();
+  EncoderBenchmark();
+  DownscaleBenchmark();
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
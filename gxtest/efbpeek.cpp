@@ -0,0 +1,204 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <ogc/lwp_watchdog.h>
+#include <ogcsys.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+#include "common/timebase.h"
+#include "gxtest/cgx.h"
+#include "gxtest/cgx_defaults.h"
+#include "gxtest/util.h"
+
+// The EFB is filled with a grid of differently colored quads at different depths
+static const int GRID_SIZE = 8;
+static const int CELL_WIDTH = 640 / GRID_SIZE;
+static const int CELL_HEIGHT = 528 / GRID_SIZE;
+
+static GXTest::Vec4<u8> GetCellColor(int cell)
+{
+  GXTest::Vec4<u8> color;
+  color.r = cell * 4;
+  color.g = 255 - cell * 3;
+  color.b = (cell * 37) & 0xFF;
+  color.a = 255;
+  return color;
+}
+
+static float GetCellDepth(int cell)
+{
+  return (cell + 1) / (float)(GRID_SIZE * GRID_SIZE + 1);
+}
+
+static int GetCell(int x, int y)
+{
+  return (y / CELL_HEIGHT) * GRID_SIZE + x / CELL_WIDTH;
+}
+
+static void DrawGrid()
+{
+  for (int cell = 0; cell < GRID_SIZE * GRID_SIZE; ++cell)
+  {
+    const GXTest::Vec4<u8> color = GetCellColor(cell);
+    CGX_SetViewport((cell % GRID_SIZE) * CELL_WIDTH, (cell / GRID_SIZE) * CELL_HEIGHT, CELL_WIDTH,
+                    CELL_HEIGHT, 0.0f, 1.0f);
+    GXTest::Quad().AtDepth(GetCellDepth(cell)).ColorRGBA(color.r, color.g, color.b, 255).Draw();
+  }
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+}
+
+static void SetupState()
+{
+  CGX_LOAD_BP_REG(CGXDefault<TwoTevStageOrders>(0).hex);
+
+  CGX_BEGIN_LOAD_XF_REGS(0x1009, 1);
+  wgPipe->U32 = 1;  // 1 color channel
+
+  LitChannel chan;
+  chan.hex = 0;
+  chan.matsource = 1;                 // from vertex
+  CGX_BEGIN_LOAD_XF_REGS(0x100e, 1);  // color channel 1
+  wgPipe->U32 = chan.hex;
+  CGX_BEGIN_LOAD_XF_REGS(0x1010, 1);  // alpha channel 1
+  wgPipe->U32 = chan.hex;
+
+  auto genmode = CGXDefault<GenMode>();
+  genmode.numtevstages = 0;  // One stage
+  CGX_LOAD_BP_REG(genmode.hex);
+
+  auto ac = CGXDefault<TevStageCombiner::AlphaCombiner>(0);
+  ac.d = TEVALPHAARG_RASA;
+  CGX_LOAD_BP_REG(ac.hex);
+
+  auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+  cc.d = TEVCOLORARG_RASC;
+  CGX_LOAD_BP_REG(cc.hex);
+
+  PE_CONTROL ctrl;
+  ctrl.hex = BPMEM_ZCOMPARE << 24;
+  ctrl.pixel_format = PIXELFMT_RGB8_Z24;
+  ctrl.zformat = ZC_LINEAR;
+  ctrl.early_ztest = 0;
+  CGX_LOAD_BP_REG(ctrl.hex);
+
+  // Write depth unconditionally
+  auto zmode = CGXDefault<ZMode>();
+  zmode.testenable = 1;
+  zmode.func = COMPARE_ALWAYS;
+  zmode.updateenable = 1;
+  CGX_LOAD_BP_REG(zmode.hex);
+}
+
+// Pseudo-random probe positions, away from cell borders
+static void GetProbe(int index, int* x, int* y)
+{
+  const int cell = (index * 23) % (GRID_SIZE * GRID_SIZE);
+  *x = (cell % GRID_SIZE) * CELL_WIDTH + 2 + (index * 7) % (CELL_WIDTH - 4);
+  *y = (cell / GRID_SIZE) * CELL_HEIGHT + 2 + (index * 13) % (CELL_HEIGHT - 4);
+}
+
+// Compares peeked values against an EFB copy and the drawn scene
+static void PeekConsistencyTest()
+{
+  START_TEST();
+
+  DrawGrid();
+
+  GXTest::ReadbackQueue queue(1);
+  const int slot = queue.Submit(0, 0, 640, 528);
+  queue.Wait(slot);
+
+  for (int i = 0; i < 1024; ++i)
+  {
+    int x, y;
+    GetProbe(i, &x, &y);
+    const int cell = GetCell(x, y);
+
+    const GXTest::Vec4<u8> peeked = GXTest::PeekEfbColor(x, y);
+    const GXTest::Vec4<u8> copied = queue.Read(slot, x, y);
+    const GXTest::Vec4<u8> drawn = GetCellColor(cell);
+    DO_TEST(peeked.r == copied.r && peeked.g == copied.g && peeked.b == copied.b,
+            "(%d, %d): peeked %d %d %d, copied %d %d %d", x, y, peeked.r, peeked.g, peeked.b,
+            copied.r, copied.g, copied.b);
+    DO_TEST(peeked.r == drawn.r && peeked.g == drawn.g && peeked.b == drawn.b,
+            "(%d, %d): peeked %d %d %d, drawn %d %d %d", x, y, peeked.r, peeked.g, peeked.b,
+            drawn.r, drawn.g, drawn.b);
+
+    // With the orthographic projection used by Quad, depth is (1 - z) * 0xFFFFFF
+    const u32 depth = GXTest::PeekEfbDepth(x, y);
+    const int expected_depth = (int)((1.0f - GetCellDepth(cell)) * 16777215.0f);
+    DO_TEST(abs((int)depth - expected_depth) <= 256, "(%d, %d): depth 0x%06x, expected ~0x%06x",
+            x, y, depth, expected_depth);
+  }
+
+  END_TEST();
+}
+
+// Time to read back N pixels of a finished frame: an EFB copy of the whole frame versus
+// direct EFB reads. Both include waiting for the GPU.
+static void PeekVersusCopyBenchmark()
+{
+  START_TEST();
+
+  GXTest::ReadbackQueue queue(1);
+
+  for (int pixels : {1, 4, 16, 64, 256, 1024, 4096})
+  {
+    u32 checksum_copy = 0;
+    u32 checksum_peek = 0;
+
+    DrawGrid();
+    const u64 copy_start = GetTimebase();
+    const int slot = queue.Submit(0, 0, 640, 528);
+    queue.Wait(slot);
+    for (int i = 0; i < pixels; ++i)
+    {
+      int x, y;
+      GetProbe(i, &x, &y);
+      checksum_copy += queue.Read(slot, x, y).g;
+    }
+    const u64 copy_end = GetTimebase();
+
+    DrawGrid();
+    const u64 peek_start = GetTimebase();
+    CGX_WaitForGpuToFinish();
+    for (int i = 0; i < pixels; ++i)
+    {
+      int x, y;
+      GetProbe(i, &x, &y);
+      checksum_peek += GXTest::PeekEfbColor(x, y).g;
+    }
+    const u64 peek_end = GetTimebase();
+
+    DO_TEST(checksum_copy == checksum_peek, "%d pixels: copy checksum %u, peek checksum %u",
+            pixels, checksum_copy, checksum_peek);
+
+    const u32 copy_ticks = (u32)(copy_end - copy_start);
+    const u32 peek_ticks = (u32)(peek_end - peek_start);
+    network_printf("efbpeek pixels=%4d copy_ticks=%8u (%6u us) peek_ticks=%8u (%6u us)\n", pixels,
+                   copy_ticks, copy_ticks / (TB_TIMER_CLOCK / 1000), peek_ticks,
+                   peek_ticks / (TB_TIMER_CLOCK / 1000));
+  }
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  GXTest::Init();
+  SetupState();
+
+  PeekConsistencyTest();
+  PeekVersusCopyBenchmark();
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
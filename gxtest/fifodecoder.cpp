@@ -0,0 +1,372 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <algorithm>
+#include <initializer_list>
+#include <ogc/lwp_watchdog.h>
+#include <ogcsys.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+#include "common/timebase.h"
+#include "gxtest/FifoDecoder.h"
+#include "gxtest/FifoRecorder.h"
+#include "gxtest/cgx_defaults.h"
+
+// Checks FifoDecoder against command streams built with FifoRecorder, and measures how fast it
+// gets through them.
+
+static void RecordBP(FifoRecorder* fifo, u32 value)
+{
+  fifo->U8 = FifoDecoder::OPCODE_LOAD_BP_REG;
+  fifo->U32 = value;
+}
+
+static void RecordCP(FifoRecorder* fifo, u8 reg, u32 value)
+{
+  fifo->U8 = FifoDecoder::OPCODE_LOAD_CP_REG;
+  fifo->U8 = reg;
+  fifo->U32 = value;
+}
+
+static void RecordXFHeader(FifoRecorder* fifo, u16 address, u32 count)
+{
+  fifo->U8 = FifoDecoder::OPCODE_LOAD_XF_REG;
+  fifo->U32 = ((count - 1) << 16) | address;
+}
+
+// Same vertex format as GXTest::Quad: direct positions (3 floats) and colors (RGBA8)
+static void RecordQuadFormat(FifoRecorder* fifo)
+{
+  TVtxDesc vtxdesc;
+  vtxdesc.Hex = 0;
+  vtxdesc.Position = VTXATTR_DIRECT;
+  vtxdesc.Color0 = VTXATTR_DIRECT;
+  RecordCP(fifo, VCD_LO, vtxdesc.Low);
+  RecordCP(fifo, VCD_HI, vtxdesc.High);
+
+  VAT vtxattr;
+  vtxattr.g0.Hex = 0;
+  vtxattr.g1.Hex = 0;
+  vtxattr.g2.Hex = 0;
+  vtxattr.g0.PosElements = VA_TYPE_POS_XYZ;
+  vtxattr.g0.PosFormat = VA_FMT_F32;
+  vtxattr.g0.Color0Elements = VA_TYPE_CLR_RGBA;
+  vtxattr.g0.Color0Comp = VA_FMT_RGBA8;
+  vtxattr.g0.ByteDequant = 1;
+  RecordCP(fifo, CP_VAT_REG_A, vtxattr.g0.Hex);
+  RecordCP(fifo, CP_VAT_REG_B, vtxattr.g1.Hex);
+  RecordCP(fifo, CP_VAT_REG_C, vtxattr.g2.Hex);
+}
+
+static void RecordQuad(FifoRecorder* fifo, u32 color)
+{
+  fifo->U8 = FifoDecoder::OPCODE_DRAW | (FifoDecoder::PRIMITIVE_QUADS << 3);
+  fifo->U16 = 4;
+  for (int i = 0; i < 4; ++i)
+  {
+    fifo->F32 = (i == 1 || i == 2) ? 1.0f : -1.0f;
+    fifo->F32 = (i < 2) ? 1.0f : -1.0f;
+    fifo->F32 = 1.0f;
+    fifo->U32 = color;
+  }
+}
+
+// Counts commands and draws
+class CountingHandler : public FifoDecoder::NullHandler
+{
+public:
+  void OnBP(u8 reg, u32 old_value, u32 new_value) { ++num_bp; }
+  void OnCP(u8 reg, u32 value) { ++num_cp; }
+  void OnXF(u16 address, u32 count, const u8* data) { num_xf += count; }
+  void OnDraw(int primitive, int vat, u16 num_vertices, const u8* vertices, u32 size)
+  {
+    ++num_draws;
+    vertex_bytes += size;
+  }
+  void OnUnknown(u8 opcode) { ++num_unknown; }
+
+  u32 num_bp = 0;
+  u32 num_cp = 0;
+  u32 num_xf = 0;
+  u32 num_draws = 0;
+  u32 vertex_bytes = 0;
+  u32 num_unknown = 0;
+};
+
+static void DecodeStateTest()
+{
+  START_TEST();
+
+  FifoRecorder fifo;
+
+  auto genmode = CGXDefault<GenMode>();
+  genmode.numtevstages = 3;
+  RecordBP(&fifo, genmode.hex);
+
+  // Only the masked bits of the next write are applied
+  auto zmode = CGXDefault<ZMode>();
+  zmode.testenable = 1;
+  zmode.func = COMPARE_NEVER;
+  zmode.updateenable = 0;
+  RecordBP(&fifo, zmode.hex);
+  RecordBP(&fifo, (BPMEM_BP_MASK << 24) | 0x00000E);
+  RecordBP(&fifo, (BPMEM_ZMODE << 24) | 0xFFFFFE);
+  RecordBP(&fifo, (BPMEM_PE_TOKEN_ID << 24) | 0x1234);
+
+  RecordXFHeader(&fifo, XFMEM_SETVIEWPORT, 6);
+  fifo.F32 = 320.0f;
+  fifo.F32 = -264.0f;
+  fifo.F32 = 16777215.0f;
+  fifo.F32 = 662.0f;
+  fifo.F32 = 606.0f;
+  fifo.F32 = 16777215.0f;
+
+  RecordQuadFormat(&fifo);
+  RecordQuad(&fifo, 0xFF8000FF);
+  RecordQuad(&fifo, 0x00FF00FF);
+
+  CountingHandler handler;
+  FifoDecoder::Decoder<CountingHandler> decoder(&handler);
+  const u32 consumed = decoder.Decode(fifo.Data().data(), fifo.Size());
+  const FifoDecoder::State& state = decoder.GetState();
+
+  DO_TEST(consumed == fifo.Size(), "Consumed %u of %u bytes", consumed, (u32)fifo.Size());
+  DO_TEST(handler.num_bp == 5, "Decoded %u BP writes", handler.num_bp);
+  DO_TEST(handler.num_cp == 5, "Decoded %u CP writes", handler.num_cp);
+  DO_TEST(handler.num_xf == 6, "Decoded %u XF writes", handler.num_xf);
+  DO_TEST(handler.num_draws == 2, "Decoded %u draws", handler.num_draws);
+  DO_TEST(handler.vertex_bytes == 2 * 4 * 16, "Decoded %u bytes of vertices",
+          handler.vertex_bytes);
+  DO_TEST(handler.num_unknown == 0, "Decoded %u unknown opcodes", handler.num_unknown);
+
+  DO_TEST(state.bp.genMode.numtevstages == 3, "numtevstages is %d",
+          (int)state.bp.genMode.numtevstages);
+  // The masked write only replaces func (bits 1-3)
+  DO_TEST(state.bp.zmode.testenable == 1 && state.bp.zmode.func == COMPARE_ALWAYS &&
+              state.bp.zmode.updateenable == 0,
+          "ZMode is %06x after masked write", state.bp.zmode.hex & 0xFFFFFF);
+  DO_TEST(state.bp.bpMask == 0xFFFFFF, "BP mask is %06x", state.bp.bpMask);
+  DO_TEST(state.bp.petoken == 0x1234, "PE token is %x", state.bp.petoken);
+  DO_TEST(state.xf.viewport.wd == 320.0f && state.xf.viewport.yOrig == 606.0f,
+          "Viewport %f %f", state.xf.viewport.wd, state.xf.viewport.yOrig);
+  DO_TEST(FifoDecoder::GetVertexSize(state.vtx_desc, state.vtx_attr[0]) == 16,
+          "Vertex size is %u", FifoDecoder::GetVertexSize(state.vtx_desc, state.vtx_attr[0]));
+
+  END_TEST();
+}
+
+// Vertex sizes of various formats, compared against hand-computed values
+static void VertexSizeTest()
+{
+  START_TEST();
+
+  TVtxDesc desc;
+  VAT vat;
+  vat.g0.Hex = vat.g1.Hex = vat.g2.Hex = 0;
+
+  // Position matrix index, 2D s16 positions, indexed normals, 8 bit indexed colors
+  desc.Hex = 0;
+  desc.PosMatIdx = 1;
+  desc.Position = VTXATTR_DIRECT;
+  desc.Normal = VTXATTR_INDEX16;
+  desc.Color0 = VTXATTR_INDEX8;
+  vat.g0.PosElements = VA_TYPE_POS_XY;
+  vat.g0.PosFormat = VA_FMT_S16;
+  u32 size = FifoDecoder::GetVertexSize(desc, vat);
+  DO_TEST(size == 1 + 4 + 2 + 1, "Size %u", size);
+
+  // NBT with one index per vector
+  vat.g0.NormalElements = VA_TYPE_NRM_NBT;
+  vat.g0.NormalIndex3 = 1;
+  size = FifoDecoder::GetVertexSize(desc, vat);
+  DO_TEST(size == 1 + 4 + 6 + 1, "Size %u", size);
+
+  // Direct NBT as floats, RGB565 color, two float texture coordinates
+  desc.Normal = VTXATTR_DIRECT;
+  desc.Color0 = VTXATTR_DIRECT;
+  desc.Tex0Coord = VTXATTR_DIRECT;
+  desc.Tex7Coord = VTXATTR_DIRECT;
+  vat.g0.NormalFormat = VA_FMT_F32;
+  vat.g0.Color0Comp = VA_FMT_RGB565;
+  vat.g0.Tex0CoordElements = VA_TYPE_TEX_ST;
+  vat.g0.Tex0CoordFormat = VA_FMT_F32;
+  vat.g2.Tex7CoordElements = VA_TYPE_TEX_S;
+  vat.g2.Tex7CoordFormat = VA_FMT_U8;
+  size = FifoDecoder::GetVertexSize(desc, vat);
+  DO_TEST(size == 1 + 4 + 36 + 2 + 8 + 1, "Size %u", size);
+
+  END_TEST();
+}
+
+// VCD_LO holds the descriptor up to Color1 in 17 bits, and VCD_HI the texture coordinates. These
+// are the values GX_SetVtxDesc writes for direct positions, colors and texture coordinate 0 and
+// 8 bit indexed texture coordinate 1.
+static void VertexDescriptorTest()
+{
+  START_TEST();
+
+  FifoRecorder fifo;
+  RecordCP(&fifo, VCD_LO, 0x00002200);
+  RecordCP(&fifo, VCD_HI, 0x00000009);
+
+  VAT vtxattr;
+  vtxattr.g0.Hex = 0;
+  vtxattr.g1.Hex = 0;
+  vtxattr.g2.Hex = 0;
+  vtxattr.g0.PosElements = VA_TYPE_POS_XYZ;
+  vtxattr.g0.PosFormat = VA_FMT_F32;
+  vtxattr.g0.Color0Elements = VA_TYPE_CLR_RGBA;
+  vtxattr.g0.Color0Comp = VA_FMT_RGBA8;
+  vtxattr.g0.Tex0CoordElements = VA_TYPE_TEX_ST;
+  vtxattr.g0.Tex0CoordFormat = VA_FMT_F32;
+  RecordCP(&fifo, CP_VAT_REG_A, vtxattr.g0.Hex);
+  RecordCP(&fifo, CP_VAT_REG_B, vtxattr.g1.Hex);
+  RecordCP(&fifo, CP_VAT_REG_C, vtxattr.g2.Hex);
+
+  // Position, color, texture coordinate 0 and the index of texture coordinate 1
+  fifo.U8 = FifoDecoder::OPCODE_DRAW | (FifoDecoder::PRIMITIVE_QUADS << 3);
+  fifo.U16 = 4;
+  for (int i = 0; i < 4; ++i)
+  {
+    fifo.F32 = 0.0f;
+    fifo.F32 = 0.0f;
+    fifo.F32 = 1.0f;
+    fifo.U32 = 0xFFFFFFFF;
+    fifo.F32 = 0.0f;
+    fifo.F32 = 1.0f;
+    fifo.U8 = i;
+  }
+
+  CountingHandler handler;
+  FifoDecoder::Decoder<CountingHandler> decoder(&handler);
+  const u32 consumed = decoder.Decode(fifo.Data().data(), fifo.Size());
+  const TVtxDesc& desc = decoder.GetState().vtx_desc;
+
+  DO_TEST(consumed == fifo.Size(), "Consumed %u of %u bytes", consumed, (u32)fifo.Size());
+  DO_TEST(desc.Position == VTXATTR_DIRECT && desc.Color0 == VTXATTR_DIRECT &&
+              desc.Color1 == VTXATTR_NONE,
+          "VCD_LO decoded to %05x", (u32)desc.Low);
+  DO_TEST(desc.Tex0Coord == VTXATTR_DIRECT && desc.Tex1Coord == VTXATTR_INDEX8 &&
+              desc.Tex2Coord == VTXATTR_NONE,
+          "VCD_HI decoded to %04x", (u32)desc.High);
+  DO_TEST(handler.num_draws == 1 && handler.vertex_bytes == 4 * 25,
+          "Decoded %u draws with %u bytes of vertices", handler.num_draws, handler.vertex_bytes);
+  DO_TEST(handler.num_unknown == 0, "Decoded %u unknown opcodes", handler.num_unknown);
+
+  END_TEST();
+}
+
+// Feeding the stream in arbitrary pieces gives the same result as decoding it at once
+static void SplitStreamTest()
+{
+  START_TEST();
+
+  FifoRecorder fifo;
+  RecordQuadFormat(&fifo);
+  for (int i = 0; i < 64; ++i)
+  {
+    RecordBP(&fifo, (BPMEM_TEV_REGISTER_L << 24) | i);
+    RecordXFHeader(&fifo, XFMEM_SETCHAN0_AMBCOLOR, 1);
+    fifo.U32 = i * 0x01010101;
+    RecordQuad(&fifo, i);
+  }
+
+  const std::string expected = FifoDecoder::Disassemble(fifo.Data().data(), fifo.Size());
+
+  for (u32 piece_size : {1, 2, 3, 7, 64})
+  {
+    std::string output;
+    FifoDecoder::Disassembler disassembler(&output);
+    FifoDecoder::Decoder<FifoDecoder::Disassembler> decoder(&disassembler);
+
+    // Unconsumed bytes are carried over to the next piece
+    std::vector<u8> pending;
+    for (u32 offset = 0; offset < fifo.Size(); offset += piece_size)
+    {
+      const u32 end = std::min<u32>(offset + piece_size, fifo.Size());
+      pending.insert(pending.end(), fifo.Data().begin() + offset, fifo.Data().begin() + end);
+      const u32 consumed = decoder.Decode(pending.data(), pending.size());
+      pending.erase(pending.begin(), pending.begin() + consumed);
+    }
+
+    DO_TEST(pending.empty(), "Pieces of %u bytes: %u bytes left over", piece_size,
+            (u32)pending.size());
+    DO_TEST(output == expected, "Pieces of %u bytes: disassembly differs", piece_size);
+  }
+
+  // Show what the disassembly looks like
+  const size_t excerpt_end = expected.rfind('\n', 1024);
+  network_printf("%.*s", (int)excerpt_end + 1, expected.c_str());
+
+  END_TEST();
+}
+
+// Decoding rate for streams dominated by register loads and by vertex data
+static void DecodeBenchmark()
+{
+  START_TEST();
+
+  FifoRecorder register_fifo(1024 * 1024);
+  while (register_fifo.Size() < 1024 * 1024 - 64)
+  {
+    RecordBP(&register_fifo, (BPMEM_TEV_COLOR_ENV << 24) | (register_fifo.Size() & 0xFFFF));
+    RecordCP(&register_fifo, ARRAY_BASE, register_fifo.Size());
+    RecordXFHeader(&register_fifo, XFMEM_SETCHAN0_MATCOLOR, 1);
+    register_fifo.U32 = 0xFFFFFFFF;
+  }
+
+  FifoRecorder draw_fifo(1024 * 1024);
+  RecordQuadFormat(&draw_fifo);
+  while (draw_fifo.Size() < 1024 * 1024 - 128)
+    RecordQuad(&draw_fifo, 0xFFFFFFFF);
+
+  const struct
+  {
+    const char* name;
+    const FifoRecorder* fifo;
+  } streams[] = {{"registers", &register_fifo}, {"draws", &draw_fifo}};
+
+  for (const auto& stream : streams)
+  {
+    CountingHandler handler;
+    FifoDecoder::Decoder<CountingHandler> decoder(&handler);
+
+    u64 best = ~0ull;
+    for (int i = 0; i < 4; ++i)
+    {
+      const u64 start = GetTimebase();
+      decoder.Decode(stream.fifo->Data().data(), stream.fifo->Size());
+      const u64 end = GetTimebase();
+      if (end - start < best)
+        best = end - start;
+    }
+
+    DO_TEST(handler.num_unknown == 0, "%s: %u unknown opcodes", stream.name, handler.num_unknown);
+    network_printf("fifodecoder %-9s %u bytes ticks=%8u rate=%u KiB/s\n", stream.name,
+                   (u32)stream.fifo->Size(), (u32)best,
+                   (u32)((u64)stream.fifo->Size() * TB_TIMER_CLOCK * 1000 / 1024 / best));
+  }
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  DecodeStateTest();
+  VertexSizeTest();
+  VertexDescriptorTest();
+  SplitStreamTest();
+  DecodeBenchmark();
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
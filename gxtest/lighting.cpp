@@ -2,13 +2,19 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <initializer_list>
 #include <math.h>
+#include <ogc/lwp_watchdog.h>
 #include <ogcsys.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include <wiiuse/wpad.h>
 #include "common/hwtests.h"
+#include "common/timebase.h"
+#include "gxtest/LightingEmulator.h"
+#include "gxtest/XFMemory.h"
 #include "gxtest/cgx.h"
 #include "gxtest/cgx_defaults.h"
 #include "gxtest/util.h"
@@ -45,52 +51,457 @@ void LightingTest()
   ctrl.early_ztest = 0;
   CGX_LOAD_BP_REG(ctrl.hex);
 
+  auto zmode = CGXDefault<ZMode>();
+  CGX_LOAD_BP_REG(zmode.hex);
+
+  auto tevreg = CGXDefault<TevReg>(1, false);  // c0
+  tevreg.red = 0xff;
+  CGX_LOAD_BP_REG(tevreg.low);
+  CGX_LOAD_BP_REG(tevreg.high);
+
+  CGX_BEGIN_LOAD_XF_REGS(0x1005, 1);
+  wgPipe->U32 = 0;  // 0 = enable clipping, 1 = disable clipping
+
+  auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+  cc.d = TEVCOLORARG_RASC;
+  CGX_LOAD_BP_REG(cc.hex);
+
   // Test to check how the hardware rounds the final computation of the
   // lit color of a vertex.  The formula is basically just
   // (material color * lighting color), but the rounding isn't obvious
   // because the hardware uses fixed-point math and takes some shortcuts.
-  for (int step = 0; step < 256 * 256; ++step)
+  // All cases are drawn into separate tiles of the EFB, with only the
+  // ambient and material registers reloaded in between.
+  GXTest::GetTileColors(256 * 256,
+                        [](int step) {
+                          int matcolor = step & 255;
+                          int ambcolor = step >> 8;
+
+                          CGX_BEGIN_LOAD_XF_REGS(0x100a, 1);
+                          wgPipe->U32 = (ambcolor << 24) | 255;
+
+                          CGX_BEGIN_LOAD_XF_REGS(0x100c, 1);
+                          wgPipe->U32 = (matcolor << 24) | 255;
+                        },
+                        [](int step, const GXTest::Vec4<u8>& result) {
+                          int matcolor = step & 255;
+                          int ambcolor = step >> 8;
+
+                          int expected = (matcolor * (ambcolor + (ambcolor >> 7))) >> 8;
+                          DO_TEST(result.r == expected,
+                                  "lighting test failed at amb %d mat %d actual %d", ambcolor,
+                                  matcolor, result.r);
+                        });
+
+  END_TEST();
+}
+
+// The sweep draws each case as a single point of 4x4 pixels into its own tile of the EFB.
+// With only one vertex, the lit color isn't interpolated, and the vertex position can be
+// anything as the viewport is moved to put it into the tile.
+static const int LIGHT_TILE_SIZE = 4;
+static const int LIGHT_TILES_PER_ROW = 640 / LIGHT_TILE_SIZE;
+static const int LIGHT_BATCH_SIZE = LIGHT_TILES_PER_ROW * (528 / LIGHT_TILE_SIZE);
+static const int NUM_LIGHT_BATCHES = 4;
+static const int MAX_REPORTED_MISMATCHES = 16;
+
+struct LightCase
+{
+  u32 ambient;
+  u32 material;
+  u32 vertex_color;
+  LitChannel color;
+  LitChannel alpha;
+  LightingEmulator::Light lights[8];
+  float position[3];
+  float normal[3];
+};
+
+static float GetRandomFloat(float min, float max)
+{
+  return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static u32 GetRandomColor()
+{
+  return ((u32)(rand() & 0xFFFF) << 16) | (u32)(rand() & 0xFFFF);
+}
+
+static void GetRandomDirection(float* direction)
+{
+  float length;
+  do
+  {
+    for (int i = 0; i < 3; ++i)
+      direction[i] = GetRandomFloat(-1.0f, 1.0f);
+    length = sqrtf(direction[0] * direction[0] + direction[1] * direction[1] +
+                   direction[2] * direction[2]);
+  } while (length < 0.1f || length > 1.0f);
+
+  for (int i = 0; i < 3; ++i)
+    direction[i] /= length;
+}
+
+static LitChannel GetRandomLitChannel()
+{
+  LitChannel chan;
+  chan.hex = 0;
+  chan.matsource = rand() & 1;
+  chan.ambsource = rand() & 1;
+  chan.enablelighting = (rand() & 7) != 0;
+  chan.diffusefunc = rand() % 3;
+  chan.attnfunc = rand() & 3;
+  chan.lightMask0_3 = rand() & 15;
+  chan.lightMask4_7 = rand() & 15;
+  return chan;
+}
+
+static LightCase GenerateLightCase()
+{
+  LightCase light_case;
+  light_case.ambient = GetRandomColor();
+  light_case.material = GetRandomColor();
+  light_case.vertex_color = GetRandomColor();
+  light_case.color = GetRandomLitChannel();
+  light_case.alpha = GetRandomLitChannel();
+
+  for (LightingEmulator::Light& light : light_case.lights)
+  {
+    memset(&light, 0, sizeof(light));
+    light.color = GetRandomColor();
+    for (int i = 0; i < 3; ++i)
+      light.pos[i] = GetRandomFloat(-3.0f, 3.0f);
+    GetRandomDirection(light.dir);
+
+    // Often the usual values, which switch off the angular or distance attenuation
+    if (rand() & 1)
+    {
+      light.cosatt[0] = 1.0f;
+      light.cosatt[1] = light.cosatt[2] = 0.0f;
+    }
+    else
+    {
+      for (float& value : light.cosatt)
+        value = GetRandomFloat(-1.0f, 1.0f);
+    }
+
+    // Positive, so that the attenuation never divides by zero
+    light.distatt[0] = GetRandomFloat(0.25f, 2.0f);
+    light.distatt[1] = GetRandomFloat(0.0f, 1.0f);
+    light.distatt[2] = GetRandomFloat(0.0f, 1.0f);
+  }
+
+  light_case.position[0] = GetRandomFloat(-1.0f, 1.0f);
+  light_case.position[1] = GetRandomFloat(-1.0f, 1.0f);
+  light_case.position[2] = GetRandomFloat(0.1f, 0.9f);
+  GetRandomDirection(light_case.normal);
+  return light_case;
+}
+
+// Loads the registers of a case with load(address, count, values), which is either
+// CGX_LoadXFRegs or the software model. Only lights used by either part are loaded.
+template <typename Load>
+static void LoadLightCase(const LightCase& light_case, Load load)
+{
+  load(XFMEM_SETCHAN0_AMBCOLOR, 1, &light_case.ambient);
+  load(XFMEM_SETCHAN0_MATCOLOR, 1, &light_case.material);
+  load(XFMEM_SETCHAN0_COLOR, 1, &light_case.color.hex);
+  load(XFMEM_SETCHAN0_ALPHA, 1, &light_case.alpha.hex);
+
+  const u32 mask = light_case.color.GetFullLightMask() | light_case.alpha.GetFullLightMask();
+  for (int index = 0; index < 8; ++index)
+  {
+    if (!(mask & (1 << index)))
+      continue;
+
+    u32 words[16];
+    memcpy(words, &light_case.lights[index], sizeof(words));
+    load(XFMEM_LIGHTS + 16 * index + 3, 13, &words[3]);
+  }
+}
+
+// Whether the result of a part of a channel only depends on integer math, i.e. it doesn't use
+// lights or none of its lights uses a diffuse function or any attenuation
+static bool IsIntegerOnly(const LitChannel& chan)
+{
+  if (!chan.enablelighting || chan.GetFullLightMask() == 0)
+    return true;
+  return chan.diffusefunc == LightingEmulator::DIFFUSE_NONE &&
+         (chan.attnfunc == LightingEmulator::ATTN_NONE ||
+          chan.attnfunc == LightingEmulator::ATTN_DIR);
+}
+
+// Lit color of a case according to the software model, along with the clamped light and the
+// material color it was computed from
+struct ExpectedColor
+{
+  int color[4];
+  int light[4];
+  int material[4];
+};
+
+static ExpectedColor GetExpectedColor(const LightCase& light_case)
+{
+  LightingEmulator::State state;
+  LoadLightCase(light_case, [&](u16 address, u32 count, const u32* values) {
+    state.LoadXFRegs(address, count, values);
+  });
+
+  LightingEmulator::Vertices vertices(1);
+  for (int i = 0; i < 3; ++i)
+  {
+    vertices.Position(i)[0] = light_case.position[i];
+    vertices.Normal(i)[0] = light_case.normal[i];
+  }
+  for (int component = 0; component < 4; ++component)
+    vertices.Color(0, component)[0] = (light_case.vertex_color >> (24 - 8 * component)) & 0xFF;
+  LightingEmulator::Evaluate(state, &vertices);
+
+  ExpectedColor expected;
+  for (int component = 0; component < 4; ++component)
+  {
+    const LitChannel& chan = (component < 3) ? light_case.color : light_case.alpha;
+    const u32 material = chan.matsource ? light_case.vertex_color : light_case.material;
+    expected.color[component] = vertices.Output(0, component)[0];
+    expected.light[component] = vertices.Light(0, component)[0];
+    expected.material[component] = (material >> (24 - 8 * component)) & 0xFF;
+  }
+  return expected;
+}
+
+// Results which go through floating point math may have a light color which is off by one, as
+// the XF doesn't round like IEEE floats. The material color is applied after that, so the
+// result can be off by more than one, e.g. where the light crosses 128.
+static bool IsCloseEnough(const LightCase& light_case, const ExpectedColor& expected,
+                          int component, int result)
+{
+  if (result == expected.color[component])
+    return true;
+  if (IsIntegerOnly((component < 3) ? light_case.color : light_case.alpha))
+    return false;
+
+  const int light = expected.light[component];
+  for (int candidate = std::max(light - 1, 0); candidate <= std::min(light + 1, 255); ++candidate)
   {
-    int matcolor = step & 255;
-    int ambcolor = step >> 8;
+    if (result == LightingEmulator::ApplyMaterial(expected.material[component], candidate))
+      return true;
+  }
+  return false;
+}
+
+static void DrawLightCases(const std::vector<LightCase>& cases)
+{
+  for (int i = 0; i < (int)cases.size(); ++i)
+  {
+    const LightCase& light_case = cases[i];
+    LoadLightCase(light_case, [](u16 address, u32 count, const u32* values) {
+      CGX_LoadXFRegs(address, count, values);
+    });
+
+    // Put the vertex into the center of the tile
+    const float center_x = (i % LIGHT_TILES_PER_ROW) * LIGHT_TILE_SIZE + LIGHT_TILE_SIZE / 2;
+    const float center_y = (i / LIGHT_TILES_PER_ROW) * LIGHT_TILE_SIZE + LIGHT_TILE_SIZE / 2;
+    const float viewport[6] = {
+        1.0f,
+        -1.0f,
+        16777215.0f,
+        342.0f + center_x - light_case.position[0],
+        342.0f + center_y + light_case.position[1],
+        16777215.0f,
+    };
+    u32 viewport_values[6];
+    memcpy(viewport_values, viewport, sizeof(viewport_values));
+    CGX_LoadXFRegs(XFMEM_SETVIEWPORT, 6, viewport_values);
+
+    wgPipe->U8 = 0xB8;  // draw points
+    wgPipe->U16 = 1;
+    for (float value : light_case.position)
+      wgPipe->F32 = value;
+    for (float value : light_case.normal)
+      wgPipe->F32 = value;
+    wgPipe->U32 = light_case.vertex_color;
+  }
+}
+
+// Compares the lit color of random vertices, lights and channel configurations against the
+// software model. Every batch is drawn twice, once with the color and once with the alpha of
+// the channel as TEV output, since the EFB has no alpha channel in RGB8.
+// Results which go through floating point math may be computed from a light color which is off
+// by one; all others must match exactly.
+static void LightSweepTest()
+{
+  START_TEST();
 
-    auto zmode = CGXDefault<ZMode>();
-    CGX_LOAD_BP_REG(zmode.hex);
+  // One vertex color and one normal, with an identity normal matrix
+  CGX_LoadXFReg(XFMEM_VTXSPECS, 1 | (1 << 2));
+  const float identity[9] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  u32 normal_matrix[9];
+  memcpy(normal_matrix, identity, sizeof(normal_matrix));
+  CGX_LoadXFRegs(XFMEM_NORMALMATRICES, 9, normal_matrix);
 
-    auto tevreg = CGXDefault<TevReg>(1, false);  // c0
-    tevreg.red = 0xff;
-    CGX_LOAD_BP_REG(tevreg.low);
-    CGX_LOAD_BP_REG(tevreg.high);
+  TVtxDesc vtxdesc;
+  vtxdesc.Hex = 0;
+  vtxdesc.Position = VTXATTR_DIRECT;
+  vtxdesc.Normal = VTXATTR_DIRECT;
+  vtxdesc.Color0 = VTXATTR_DIRECT;
+  CGX_LOAD_CP_REG(VCD_LO, vtxdesc.Low);
+  CGX_LOAD_CP_REG(VCD_HI, vtxdesc.High);
 
-    CGX_BEGIN_LOAD_XF_REGS(0x1005, 1);
-    wgPipe->U32 = 0;  // 0 = enable clipping, 1 = disable clipping
+  VAT vtxattr;
+  vtxattr.g0.Hex = 0;
+  vtxattr.g1.Hex = 0;
+  vtxattr.g2.Hex = 0;
+  vtxattr.g0.PosElements = VA_TYPE_POS_XYZ;
+  vtxattr.g0.PosFormat = VA_FMT_F32;
+  vtxattr.g0.NormalElements = VA_TYPE_NRM_XYZ;
+  vtxattr.g0.NormalFormat = VA_FMT_F32;
+  vtxattr.g0.Color0Elements = VA_TYPE_CLR_RGBA;
+  vtxattr.g0.Color0Comp = VA_FMT_RGBA8;
+  vtxattr.g0.ByteDequant = 1;
+  CGX_LOAD_CP_REG(CP_VAT_REG_A, vtxattr.g0.Hex);
+  CGX_LOAD_CP_REG(CP_VAT_REG_B, vtxattr.g1.Hex);
+  CGX_LOAD_CP_REG(CP_VAT_REG_C, vtxattr.g2.Hex);
 
-    CGX_BEGIN_LOAD_XF_REGS(0x100a, 1);
-    wgPipe->U32 = (ambcolor << 24) | 255;
+  // Points of 4 pixels, in units of 1/6 pixel
+  CGX_LOAD_BP_REG((BPMEM_LINEPTWIDTH << 24) | ((6 * LIGHT_TILE_SIZE) << 8) | 6);
 
-    CGX_BEGIN_LOAD_XF_REGS(0x100c, 1);
-    wgPipe->U32 = (matcolor << 24) | 255;
+  GXTest::ReadbackQueue queue(4);
+  std::vector<LightCase> batches[2];
+  int slots[2][2];
 
-    int test_x = 125, test_y = 25;  // Somewhere within the viewport
+  int num_cases = 0;
+  int num_inexact = 0;
+  int num_failures = 0;
 
-    CGX_SetViewport(0.0f, 0.0f, 201.0f, 50.0f, 0.0f, 1.0f);
-    auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
-    cc.d = TEVCOLORARG_RASC;
-    CGX_LOAD_BP_REG(cc.hex);
-    GXTest::Quad().ColorRGBA(0, 0, 0, 0xff).Draw();
+  auto check_batch = [&](int batch) {
+    const std::vector<LightCase>& cases = batches[batch % 2];
+    queue.Wait(slots[batch % 2][0]);
+    queue.Wait(slots[batch % 2][1]);
+
+    for (int i = 0; i < (int)cases.size(); ++i)
+    {
+      const int x = (i % LIGHT_TILES_PER_ROW) * LIGHT_TILE_SIZE + 1;
+      const int y = (i / LIGHT_TILES_PER_ROW) * LIGHT_TILE_SIZE + 1;
+      const GXTest::Vec4<u8> color = queue.Read(slots[batch % 2][0], x, y);
+      const GXTest::Vec4<u8> alpha = queue.Read(slots[batch % 2][1], x, y);
+      const int result[4] = {color.r, color.g, color.b, alpha.r};
+
+      const ExpectedColor expected_color = GetExpectedColor(cases[i]);
+      const int* expected = expected_color.color;
+
+      bool exact = true;
+      bool close = true;
+      for (int component = 0; component < 4; ++component)
+      {
+        exact &= result[component] == expected[component];
+        close &= IsCloseEnough(cases[i], expected_color, component, result[component]);
+      }
+      num_inexact += !exact && close;
+
+      if (!close)
+      {
+        ++num_failures;
+        if (num_failures <= MAX_REPORTED_MISMATCHES)
+        {
+          const LightCase& light_case = cases[i];
+          DO_TEST(false,
+                  "Batch %d case %d: got %d %d %d %d, expected %d %d %d %d (color 0x%08x "
+                  "alpha 0x%08x)",
+                  batch, i, result[0], result[1], result[2], result[3], expected[0], expected[1],
+                  expected[2], expected[3], light_case.color.hex, light_case.alpha.hex);
+        }
+      }
+    }
+    num_cases += (int)cases.size();
+  };
+
+  for (int batch = 0; batch < NUM_LIGHT_BATCHES; ++batch)
+  {
+    std::vector<LightCase>& cases = batches[batch % 2];
+    cases.resize(LIGHT_BATCH_SIZE);
+    for (LightCase& light_case : cases)
+      light_case = GenerateLightCase();
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+      cc.d = pass ? TEVCOLORARG_RASA : TEVCOLORARG_RASC;
+      CGX_LOAD_BP_REG(cc.hex);
+
+      DrawLightCases(cases);
+      slots[batch % 2][pass] = queue.Submit(0, 0, 640, 528);
+    }
+
+    if (batch > 0)
+      check_batch(batch - 1);
+  }
+  check_batch(NUM_LIGHT_BATCHES - 1);
+
+  DO_TEST(num_failures == 0, "%d of %d lit colors differ from the model by more than allowed",
+          num_failures, num_cases);
+  network_printf("Lighting sweep: %d cases, %d inexact\n", num_cases, num_inexact);
+
+  // Restore the state set up by Init
+  CGX_LOAD_BP_REG((BPMEM_LINEPTWIDTH << 24) | (6 << 8) | 6);
+  CGX_LoadXFReg(XFMEM_VTXSPECS, 1);
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+  auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+  cc.d = TEVCOLORARG_RASC;
+  CGX_LOAD_BP_REG(cc.hex);
+
+  END_TEST();
+}
+
+// Time the software model needs for a large number of vertices with all eight lights
+static void SoftwareLightingBenchmark()
+{
+  START_TEST();
+
+  static const int NUM_VERTICES = 16384;
+
+  LightingEmulator::Vertices vertices(NUM_VERTICES);
+  for (int i = 0; i < NUM_VERTICES; ++i)
+  {
+    float normal[3];
+    GetRandomDirection(normal);
+    for (int component = 0; component < 3; ++component)
+    {
+      vertices.Position(component)[i] = GetRandomFloat(-1.0f, 1.0f);
+      vertices.Normal(component)[i] = normal[component];
+    }
+  }
+
+  const LightCase light_case = GenerateLightCase();
+  for (int attnfunc = 0; attnfunc < 4; ++attnfunc)
+  {
+    LitChannel chan;
+    chan.hex = 0;
+    chan.enablelighting = 1;
+    chan.diffusefunc = LightingEmulator::DIFFUSE_CLAMP;
+    chan.attnfunc = attnfunc;
+    chan.lightMask0_3 = 15;
+    chan.lightMask4_7 = 15;
 
-    GXTest::CopyToTestBuffer(0, 0, 199, 49);
-    CGX_WaitForGpuToFinish();
+    LightingEmulator::State state;
+    LoadLightCase(light_case, [&](u16 address, u32 count, const u32* values) {
+      state.LoadXFRegs(address, count, values);
+    });
+    state.LoadXFReg(XFMEM_SETCHAN0_COLOR, chan.hex);
+    state.LoadXFReg(XFMEM_SETCHAN0_ALPHA, chan.hex);
+    for (int index = 0; index < 8; ++index)
+    {
+      u32 words[16];
+      memcpy(words, &light_case.lights[index], sizeof(words));
+      state.LoadXFRegs(XFMEM_LIGHTS + 16 * index + 3, 13, &words[3]);
+    }
 
-    GXTest::Vec4<u8> result = GXTest::ReadTestBuffer(test_x, test_y, 200);
-    int expected = (matcolor * (ambcolor + (ambcolor >> 7))) >> 8;
-    DO_TEST(result.r == expected, "lighting test failed at amb %d mat %d actual %d", ambcolor,
-            matcolor, result.r);
+    const u64 start = GetTimebase();
+    LightingEmulator::Evaluate(state, &vertices);
+    const u64 end = GetTimebase();
 
-    GXTest::DebugDisplayEfbContents();
-    WPAD_ScanPads();
-    if (WPAD_ButtonsDown(0) & WPAD_BUTTON_HOME)
-      break;
+    const u32 us = (u32)((end - start) / (TB_TIMER_CLOCK / 1000));
+    network_printf("software lighting: attnfunc %d, 8 lights, %d vertices in %7u us\n", attnfunc,
+                   NUM_VERTICES, us);
   }
 
   END_TEST();
@@ -104,6 +515,8 @@ int main()
   GXTest::Init();
 
   LightingTest();
+  LightSweepTest();
+  SoftwareLightingBenchmark();
 
   network_printf("Shutting down...\n");
   network_shutdown();
@@ -7,12 +7,34 @@
 #include <ogcsys.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include <wiiuse/wpad.h>
 #include "common/hwtests.h"
+#include "gxtest/Rasterizer.h"
 #include "gxtest/cgx.h"
 #include "gxtest/cgx_defaults.h"
 #include "gxtest/util.h"
 
+// Coverage of a single pixel as seen on hardware, along with everything the reference
+// rasterizer needs to compute it
+struct CoverageSample
+{
+  Rasterizer::Viewport viewport;
+  Rasterizer::Quad quad;
+  int x;
+  int y;
+  bool covered;
+};
+
+static std::vector<CoverageSample> s_coverage_samples;
+
+static void AddCoverageSample(const Rasterizer::Viewport& viewport, const Rasterizer::Quad& quad,
+                              int x, int y, bool covered)
+{
+  CoverageSample sample = {viewport, quad, x, y, covered};
+  s_coverage_samples.push_back(sample);
+}
+
 void CoordinatePrecisionTest()
 {
   START_TEST();
@@ -39,7 +61,10 @@ void CoordinatePrecisionTest()
   CGX_LOAD_BP_REG(cc.hex);
 
   // Test at which coordinates a pixel is considered to be within a primitive.
-  // TODO: Not sure how to interpret the results, yet.
+  // The left edge of the quad is at screen x 342 + xpos + 50, so pixel 50 is covered as long as
+  // that edge is at or left of its sample. The two values of xpos put the edge on neighbouring
+  // single floats around 392 + 7/12, which are about 3e-5 pixels apart, and only the first one
+  // covers the pixel. SubsampleLocationTest turns this into a sample location.
   for (float xpos = 0.583328247070f; xpos <= 0.583328306675f; xpos = nextafterf(xpos, +1.0f))
   {
     CGX_SetViewport(xpos, 0.0f, 100.0f, 100.0f, 0.0f, 1.0f);
@@ -70,6 +95,11 @@ void CoordinatePrecisionTest()
     DO_TEST(result.r == expectation,
             "Incorrect rasterization (result=%d,expected=%d,screencoord=%.6f,subsample_index=%d)",
             result.r, expectation, xpos, subsample_index);
+
+    Rasterizer::Quad quad = Rasterizer::GetQuad();
+    quad.x[0] = quad.x[3] = 0.0f;
+    AddCoverageSample(Rasterizer::GetViewport(xpos, 0.0f, 100.0f, 100.0f), quad, 50, 0,
+                      result.r == 255);
   }
 
   // Test for the default pixel subsample location by creating tiny viewports (smaller than the
@@ -119,6 +149,11 @@ void CoordinatePrecisionTest()
     DO_TEST(result.r == expectation,
             "Incorrect rasterization (result=%d,expected=%d,screencoord=%.12f,subsample_index=%d)",
             result.r, expectation, xpos, subsample_index);
+
+    const Rasterizer::Viewport viewport = {
+        vp_width, -50.0f, 16777215.0f, 342.0f + xpos + vp_width, 392.0f, 16777215.0f,
+    };
+    AddCoverageSample(viewport, Rasterizer::GetQuad(), 0, 0, result.r == 255);
   }
 
   // Guardband clipping indeed uses floating point math!
@@ -161,6 +196,90 @@ void CoordinatePrecisionTest()
   END_TEST();
 }
 
+// Checks the coverage seen by CoordinatePrecisionTest against the reference rasterizer with
+// every sample location on a few subpixel grids, and reports the locations that explain all of
+// it. A grid of 12 steps is what the multisampling patterns use; finer grids tell whether setup
+// keeps more precision than that. The finest one is 12 * 4096 steps, so that it still contains
+// 7/12 and also resolves single float steps of screen coordinates around 342. It is the grid of
+// Rasterizer::DEFAULT_CONFIG, whose sample location has to be among the best fitting ones.
+static void SubsampleLocationTest()
+{
+  START_TEST();
+
+  static const int grids[] = {12, 16, 4096, 12 * 4096};
+
+  const std::vector<CoverageSample>& samples = s_coverage_samples;
+  for (size_t i = 1; i < samples.size(); ++i)
+  {
+    if (samples[i].covered != samples[i - 1].covered)
+    {
+      network_printf("rasterization coverage of pixel (%d, %d) changes to %d at x_orig=%.9f\n",
+                     samples[i].x, samples[i].y, samples[i].covered, samples[i].viewport.x_orig);
+    }
+  }
+
+  for (int subpixel_steps : grids)
+  {
+    // Number of samples each sample location gets wrong
+    std::vector<int> mismatches(subpixel_steps);
+    for (int sample_x = 0; sample_x < subpixel_steps; ++sample_x)
+    {
+      const Rasterizer::Config config = {subpixel_steps, sample_x, subpixel_steps / 2};
+      for (const CoverageSample& sample : samples)
+      {
+        if (Rasterizer::CoversQuad(config, sample.viewport, sample.quad, sample.x, sample.y) !=
+            sample.covered)
+        {
+          ++mismatches[sample_x];
+        }
+      }
+    }
+
+    // Matching locations are printed as ranges, as fine grids can have many of them
+    int best = 0;
+    int num_matching = 0;
+    for (int sample_x = 0; sample_x < subpixel_steps; ++sample_x)
+    {
+      if (mismatches[sample_x] < mismatches[best])
+        best = sample_x;
+      if (mismatches[sample_x] != 0)
+        continue;
+
+      int last = sample_x;
+      while (last + 1 < subpixel_steps && mismatches[last + 1] == 0)
+        ++last;
+      network_printf("rasterization grid 1/%d: sample x=%d..%d (%.9f to %.9f) matches all %d "
+                     "samples\n",
+                     subpixel_steps, sample_x, last, (double)sample_x / subpixel_steps,
+                     (double)last / subpixel_steps, (int)samples.size());
+      num_matching += last - sample_x + 1;
+      sample_x = last;
+    }
+    if (num_matching == 0)
+    {
+      network_printf("rasterization grid 1/%d: no sample location matches, best is x=%d (%.9f) "
+                     "with %d of %d samples wrong\n",
+                     subpixel_steps, best, (double)best / subpixel_steps, mismatches[best],
+                     (int)samples.size());
+    }
+
+    // The sample location of the reference model has to fit at least as well as any other one
+    // on its grid. The small viewports of CoordinatePrecisionTest leave ties between neighbouring
+    // locations, so only the number of mismatches is compared.
+    if (subpixel_steps == Rasterizer::DEFAULT_CONFIG.subpixel_steps)
+    {
+      const int assumed = Rasterizer::DEFAULT_CONFIG.sample_x;
+      DO_TEST(mismatches[assumed] == mismatches[best],
+              "Reference rasterizer samples at x=%d (%.9f) with %d of %d samples wrong, but x=%d "
+              "(%.9f) has only %d wrong",
+              assumed, (double)assumed / subpixel_steps, mismatches[assumed], (int)samples.size(),
+              best, (double)best / subpixel_steps, mismatches[best]);
+    }
+  }
+
+  END_TEST();
+}
+
 int main()
 {
   network_init();
@@ -169,6 +288,7 @@ int main()
   GXTest::Init();
 
   CoordinatePrecisionTest();
+  SubsampleLocationTest();
 
   network_printf("Shutting down...\n");
   network_shutdown();
@@ -4,35 +4,43 @@
 
 #include <initializer_list>
 #include <math.h>
+#include <ogc/lwp_watchdog.h>
 #include <ogcsys.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wiiuse/wpad.h>
 #include "common/hwtests.h"
+#include "common/timebase.h"
+#include "gxtest/ConversionTest.h"
+#include "gxtest/EfbFormat.h"
+#include "gxtest/TevEmulator.h"
 #include "gxtest/cgx.h"
 #include "gxtest/cgx_defaults.h"
 #include "gxtest/util.h"
 
-int TevCombinerExpectation(int a, int b, int c, int d, int shift, int bias, int op, int clamp)
+// Randomly configured single TEV stage with the inputs in c0, c1, c2 and prev
+struct RandomTestCase
 {
-  a &= 255;
-  b &= 255;
-  c &= 255;
-
-  // TODO: Does not handle compare mode, yet
-  c = c + (c >> 7);
-  u16 lshift = (shift == 1) ? 1 : (shift == 2) ? 2 : 0;
-  u16 rshift = (shift == 3) ? 1 : 0;
-  int round_bias = (shift == 3) ? 0 : ((op == 1) ? 127 : 128);
-  int expected = (((a * (256 - c) + b * c) << lshift) + round_bias) >> 8;  // lerp
-  expected = (d << lshift) + expected * ((op == 1) ? (-1) : 1);
-  expected += ((bias == 2) ? -128 : (bias == 1) ? 128 : 0) << lshift;
-  expected >>= rshift;
-  if (clamp)
-    expected = (expected < 0) ? 0 : (expected > 255) ? 255 : expected;
-  else
-    expected = (expected < -1024) ? -1024 : (expected > 1023) ? 1023 : expected;
-  return expected;
+  TevStageCombiner::ColorCombiner cc;
+  int a, b, c, d;
+};
+
+// Loads the registers which differ between test cases with load(value), which is either
+// CGX_LOAD_BP_REG or the software TEV
+template <typename Load>
+static void LoadRandomTestCase(const RandomTestCase& test_case, Load load)
+{
+  load(test_case.cc.hex);
+
+  const int values[4] = {test_case.d, test_case.a, test_case.b, test_case.c};
+  for (int reg = 0; reg < 4; ++reg)
+  {
+    auto tevreg = CGXDefault<TevReg>(reg, false);
+    tevreg.red = values[reg];
+    load(tevreg.low);
+    load(tevreg.high);
+  }
 }
 
 void TevCombinerTest()
@@ -56,105 +64,46 @@ void TevCombinerTest()
   CGX_LOAD_BP_REG(ac.hex);
 
   // Test if we can reliably extract all bits of the tev combiner output...
-  auto tevreg = CGXDefault<TevReg>(1, false);  // c0
-  for (int i = 0; i < 2; ++i)
-    for (tevreg.red = -1024; tevreg.red != 1023; tevreg.red = tevreg.red + 1)
-    {
-      CGX_LOAD_BP_REG(tevreg.low);
-      CGX_LOAD_BP_REG(tevreg.high);
-
-      auto genmode = CGXDefault<GenMode>();
-      genmode.numtevstages = 0;  // One stage
-      CGX_LOAD_BP_REG(genmode.hex);
-
-      auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
-      cc.d = TEVCOLORARG_C0;
-      CGX_LOAD_BP_REG(cc.hex);
-
-      PE_CONTROL ctrl;
-      ctrl.hex = BPMEM_ZCOMPARE << 24;
-      ctrl.zformat = ZC_LINEAR;
-      ctrl.early_ztest = 0;
-      if (i == 0)
-      {
-        // 8 bits per channel: No worries about GetTevOutput making
-        // mistakes when writing to framebuffer or when performing
-        // an EFB copy.
-        ctrl.pixel_format = PIXELFMT_RGB8_Z24;
-        CGX_LOAD_BP_REG(ctrl.hex);
-
-        int result = GXTest::GetTevOutput(genmode, cc, ac).r;
+  {
+    auto genmode = CGXDefault<GenMode>();
+    genmode.numtevstages = 0;  // One stage
+    CGX_LOAD_BP_REG(genmode.hex);
 
-        DO_TEST(result == tevreg.red, "Got %d, expected %d", result, (s32)tevreg.red);
-      }
-      else
-      {
-        // TODO: This doesn't quite work, yet.
-        break;
+    auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+    cc.d = TEVCOLORARG_C0;
+    CGX_LOAD_BP_REG(cc.hex);
 
-        // 6 bits per channel: Implement GetTevOutput functionality
-        // manually, to verify how tev output is truncated to 6 bit
-        // and how EFB copies upscale that to 8 bit again.
-        ctrl.pixel_format = PIXELFMT_RGBA6_Z24;
-        CGX_LOAD_BP_REG(ctrl.hex);
+    // 8 bits per channel: No worries about GetTevOutput making
+    // mistakes when writing to framebuffer or when performing
+    // an EFB copy.
+    PE_CONTROL ctrl;
+    ctrl.hex = BPMEM_ZCOMPARE << 24;
+    ctrl.pixel_format = PIXELFMT_RGB8_Z24;
+    ctrl.zformat = ZC_LINEAR;
+    ctrl.early_ztest = 0;
+    CGX_LOAD_BP_REG(ctrl.hex);
 
-        GXTest::Quad().AtDepth(1.0).ColorRGBA(255, 255, 255, 255).Draw();
-        GXTest::CopyToTestBuffer(0, 0, 99, 9);
-        CGX_ForcePipelineFlush();
-        CGX_WaitForGpuToFinish();
-        u16 result = GXTest::ReadTestBuffer(5, 5, 100).r;
-
-        int expected = (((tevreg.red + 1) >> 2) & 0xFF) << 2;
-        expected = expected | (expected >> 6);
-        DO_TEST(result == expected, "Run %d: Got %d, expected %d", (int)tevreg.red, result,
-                expected);
-      }
-    }
+    const int count = 2047;  // -1024 to 1022
+    static GXTest::Vec4<int> results[count];
+    GXTest::GetTevOutputs(genmode, cc, ac, count,
+                          [](int i) {
+                            auto tevreg = CGXDefault<TevReg>(1, false);  // c0
+                            tevreg.red = -1024 + i;
+                            CGX_LOAD_BP_REG(tevreg.low);
+                            CGX_LOAD_BP_REG(tevreg.high);
+                          },
+                          results);
+
+    for (int i = 0; i < count; ++i)
+      DO_TEST(results[i].r == -1024 + i, "Got %d, expected %d", results[i].r, -1024 + i);
+  }
 
   // Now: Randomized testing of tev combiners.
-  for (int i = 0x000000; i < 0x000F000; ++i)
   {
-    if ((i & 0xFF00) == i)
-      network_printf("progress: %x\n", i);
-
     auto genmode = CGXDefault<GenMode>();
     genmode.numtevstages = 0;  // One stage
     CGX_LOAD_BP_REG(genmode.hex);
 
-    // Randomly configured TEV stage, output in PREV.
-    auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
-    cc.a = TEVCOLORARG_C0;
-    cc.b = TEVCOLORARG_C1;
-    cc.c = TEVCOLORARG_C2;
-    cc.d = TEVCOLORARG_ZERO;  // TEVCOLORARG_CPREV; // NOTE: TEVCOLORARG_CPREV doesn't actually seem
-                              // to fetch its data from PREV when used in the first stage?
-    cc.shift = rand() % 4;
-    cc.bias = rand() % 3;
-    cc.op = rand() % 2;
-    cc.clamp = rand() % 2;
-    CGX_LOAD_BP_REG(cc.hex);
-
-    int a = -1024 + (rand() % 2048);
-    int b = -1024 + (rand() % 2048);
-    int c = -1024 + (rand() % 2048);
-    int d = 0;                              //-1024 + (rand() % 2048);
-    tevreg = CGXDefault<TevReg>(1, false);  // c0
-    tevreg.red = a;
-    CGX_LOAD_BP_REG(tevreg.low);
-    CGX_LOAD_BP_REG(tevreg.high);
-    tevreg = CGXDefault<TevReg>(2, false);  // c1
-    tevreg.red = b;
-    CGX_LOAD_BP_REG(tevreg.low);
-    CGX_LOAD_BP_REG(tevreg.high);
-    tevreg = CGXDefault<TevReg>(3, false);  // c2
-    tevreg.red = c;
-    CGX_LOAD_BP_REG(tevreg.low);
-    CGX_LOAD_BP_REG(tevreg.high);
-    tevreg = CGXDefault<TevReg>(0, false);  // prev
-    tevreg.red = d;
-    CGX_LOAD_BP_REG(tevreg.low);
-    CGX_LOAD_BP_REG(tevreg.high);
-
     PE_CONTROL ctrl;
     ctrl.hex = BPMEM_ZCOMPARE << 24;
     ctrl.pixel_format = PIXELFMT_RGB8_Z24;
@@ -162,17 +111,70 @@ void TevCombinerTest()
     ctrl.early_ztest = 0;
     CGX_LOAD_BP_REG(ctrl.hex);
 
-    int result = GXTest::GetTevOutput(genmode, cc, ac).r;
+    // Cases are generated and evaluated in chunks, so that the test can be aborted in between
+    const int total = 0xF000;
+    const int chunk_size = 0x1000;
+    static RandomTestCase cases[chunk_size];
+    static GXTest::Vec4<int> results[chunk_size];
+    TevEmulator::Pixels pixels(1);
+
+    for (int first = 0; first < total; first += chunk_size)
+    {
+      network_printf("progress: %x\n", first);
 
-    int expected = TevCombinerExpectation(a, b, c, d, cc.shift, cc.bias, cc.op, cc.clamp);
-    DO_TEST(result == expected, "Mismatch on a=%d, b=%d, c=%d, d=%d, shift=%d, bias=%d, op=%d, "
-                                "clamp=%d: expected %d, got %d",
-            a, b, c, d, (u32)cc.shift, (u32)cc.bias, (u32)cc.op, (u32)cc.clamp, expected, result);
+      for (RandomTestCase& test_case : cases)
+      {
+        // Randomly configured TEV stage, output in PREV.
+        auto& cc = test_case.cc;
+        cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+        cc.a = TEVCOLORARG_C0;
+        cc.b = TEVCOLORARG_C1;
+        cc.c = TEVCOLORARG_C2;
+        cc.d = TEVCOLORARG_ZERO;  // TEVCOLORARG_CPREV; // NOTE: TEVCOLORARG_CPREV doesn't actually
+                                  // seem to fetch its data from PREV when used in the first stage?
+        cc.shift = rand() % 4;
+        cc.bias = rand() % 3;
+        cc.op = rand() % 2;
+        cc.clamp = rand() % 2;
+
+        test_case.a = -1024 + (rand() % 2048);
+        test_case.b = -1024 + (rand() % 2048);
+        test_case.c = -1024 + (rand() % 2048);
+        test_case.d = 0;  //-1024 + (rand() % 2048);
+      }
 
-    WPAD_ScanPads();
+      GXTest::GetTevOutputs(genmode, cases[0].cc, ac, chunk_size,
+                            [](int i) {
+                              LoadRandomTestCase(cases[i], [](u32 value) {
+                                CGX_LOAD_BP_REG(value);
+                              });
+                            },
+                            results);
 
-    if (WPAD_ButtonsDown(0) & WPAD_BUTTON_HOME)
-      break;
+      for (int i = 0; i < chunk_size; ++i)
+      {
+        const RandomTestCase& test_case = cases[i];
+        const auto& cc = test_case.cc;
+
+        TevEmulator::State state;
+        state.LoadBPReg(genmode.hex);
+        state.LoadBPReg(ac.hex);
+        LoadRandomTestCase(test_case, [&](u32 value) { state.LoadBPReg(value); });
+        TevEmulator::Evaluate(state, &pixels);
+
+        int result = results[i].r;
+        int expected = pixels.Output(TevEmulator::COMP_R)[0];
+        DO_TEST(result == expected, "Mismatch on a=%d, b=%d, c=%d, d=%d, shift=%d, bias=%d, "
+                                    "op=%d, clamp=%d: expected %d, got %d",
+                test_case.a, test_case.b, test_case.c, test_case.d, (u32)cc.shift,
+                (u32)cc.bias, (u32)cc.op, (u32)cc.clamp, expected, result);
+      }
+
+      WPAD_ScanPads();
+
+      if (WPAD_ButtonsDown(0) & WPAD_BUTTON_HOME)
+        break;
+    }
   }
 
   // Testing compare mode: (a.r > b.r) ? c.a : 0
@@ -210,8 +212,8 @@ void TevCombinerTest()
     ctrl.early_ztest = 0;
     CGX_LOAD_BP_REG(ctrl.hex);
 
-    tevreg = CGXDefault<TevReg>(1, false);  // c0
-    tevreg.red = 127;                       // 127 is always NOT less than 127.
+    auto tevreg = CGXDefault<TevReg>(1, false);  // c0
+    tevreg.red = 127;                            // 127 is always NOT less than 127.
     CGX_LOAD_BP_REG(tevreg.low);
     CGX_LOAD_BP_REG(tevreg.high);
 
@@ -234,6 +236,127 @@ void TevCombinerTest()
   END_TEST();
 }
 
+// Pixels of each tile which are checked by EfbFormatTest, one for each position in the dither
+// matrix
+static const int EFB_FORMAT_PIXELS[4][2] = {{1, 1}, {2, 1}, {1, 2}, {2, 2}};
+
+// Color of c0 in case i of EfbFormatTest. Each component goes through all 2048 TEV values, with
+// different offsets so that the components of a case differ.
+static int GetEfbFormatTestValue(int i, int component)
+{
+  return ((i + 683 * component) & 0x7FF) - 1024;
+}
+
+// Writes every TEV output value to the EFB in each pixel format, with and without dithering, and
+// compares the colors returned by RGBA8 EFB copies against EfbFormat.
+void EfbFormatTest()
+{
+  START_TEST();
+
+  static const int TILE_SIZE = 4;
+  static const int TILES_PER_ROW = 640 / TILE_SIZE;
+  static const int COUNT = 2048;
+  static const int HEIGHT = (COUNT + TILES_PER_ROW - 1) / TILES_PER_ROW * TILE_SIZE;
+
+  CGX_LOAD_BP_REG(CGXDefault<TwoTevStageOrders>(0).hex);
+
+  auto genmode = CGXDefault<GenMode>();
+  genmode.numtevstages = 0;  // One stage
+  CGX_LOAD_BP_REG(genmode.hex);
+
+  auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(0);
+  cc.d = TEVCOLORARG_C0;
+  CGX_LOAD_BP_REG(cc.hex);
+
+  auto ac = CGXDefault<TevStageCombiner::AlphaCombiner>(0);
+  ac.d = TEVALPHAARG_A0;
+  CGX_LOAD_BP_REG(ac.hex);
+
+  GXTest::ReadbackQueue queue(1);
+
+  for (int format : {PIXELFMT_RGB8_Z24, PIXELFMT_RGBA6_Z24, PIXELFMT_RGB565_Z16})
+  {
+    for (int dither = 0; dither < 2; ++dither)
+    {
+      PE_CONTROL ctrl;
+      ctrl.hex = BPMEM_ZCOMPARE << 24;
+      ctrl.pixel_format = format;
+      ctrl.zformat = ZC_LINEAR;
+      ctrl.early_ztest = 0;
+      CGX_LOAD_BP_REG(ctrl.hex);
+
+      auto blendmode = CGXDefault<BlendMode>();
+      blendmode.dither = dither;
+      CGX_LOAD_BP_REG(blendmode.hex);
+
+      for (int i = 0; i < COUNT; ++i)
+      {
+        auto tevreg = CGXDefault<TevReg>(1, false);  // c0
+        tevreg.red = GetEfbFormatTestValue(i, 0);
+        tevreg.green = GetEfbFormatTestValue(i, 1);
+        tevreg.blue = GetEfbFormatTestValue(i, 2);
+        tevreg.alpha = GetEfbFormatTestValue(i, 3);
+        CGX_LOAD_BP_REG(tevreg.low);
+        CGX_LOAD_BP_REG(tevreg.high);
+
+        CGX_SetViewport((i % TILES_PER_ROW) * TILE_SIZE, (i / TILES_PER_ROW) * TILE_SIZE,
+                        TILE_SIZE, TILE_SIZE, 0.0f, 1.0f);
+        GXTest::Quad().AtDepth(1.0).ColorRGBA(255, 255, 255, 255).Draw();
+      }
+
+      const int slot = queue.Submit(0, 0, 640, HEIGHT);
+      queue.Wait(slot);
+
+      int num_failures = 0;
+      for (int i = 0; i < COUNT; ++i)
+      {
+        // Only the lower 8 bits of the TEV output are written
+        u8 tev_output[4];
+        for (int component = 0; component < 4; ++component)
+          tev_output[component] = GetEfbFormatTestValue(i, component) & 0xFF;
+
+        for (const auto& pixel : EFB_FORMAT_PIXELS)
+        {
+          const int x = (i % TILES_PER_ROW) * TILE_SIZE + pixel[0];
+          const int y = (i / TILES_PER_ROW) * TILE_SIZE + pixel[1];
+          const GXTest::Vec4<u8> result = queue.Read(slot, x, y);
+
+          u8 expected[4];
+          EfbFormat::DecodeColor(format,
+                                 EfbFormat::EncodeColor(format, tev_output, x, y, dither != 0),
+                                 expected);
+
+          const bool match = result.r == expected[0] && result.g == expected[1] &&
+                             result.b == expected[2] && result.a == expected[3];
+          num_failures += !match;
+          if (!match && num_failures <= 16)
+          {
+            DO_TEST(false, "Format %d, dither %d, pixel (%d, %d): TEV output %d %d %d %d, got "
+                           "%d %d %d %d, expected %d %d %d %d",
+                    format, dither, x, y, tev_output[0], tev_output[1], tev_output[2],
+                    tev_output[3], result.r, result.g, result.b, result.a, expected[0],
+                    expected[1], expected[2], expected[3]);
+          }
+        }
+      }
+      DO_TEST(num_failures == 0, "Format %d, dither %d: %d of %d pixels differ", format, dither,
+              num_failures, COUNT * 4);
+    }
+  }
+
+  // Restore the state set up by Init
+  CGX_SetViewport(0.0f, 0.0f, 640.0f, 528.0f, 0.0f, 1.0f);
+  CGX_LOAD_BP_REG(CGXDefault<BlendMode>().hex);
+  PE_CONTROL ctrl;
+  ctrl.hex = BPMEM_ZCOMPARE << 24;
+  ctrl.pixel_format = PIXELFMT_RGBA6_Z24;
+  ctrl.zformat = ZC_LINEAR;
+  ctrl.early_ztest = 0;
+  CGX_LOAD_BP_REG(ctrl.hex);
+
+  END_TEST();
+}
+
 void KonstTest()
 {
   START_TEST();
@@ -293,6 +416,10 @@ void KonstTest()
   bm.logicmode = 0;
   CGX_LOAD_BP_REG(bm.hex);
 
+  // Most of the state below is the same for each step
+  CGX_EnableShadowState(true);
+  CGX_ResetShadowStats();
+
   // Test for values returned for "konst" TEV inputs.  Goes through
   // all the possible values for kasel and kcsel.
   for (int step = 0; step < 64; ++step)
@@ -380,6 +507,97 @@ void KonstTest()
     GXTest::DebugDisplayEfbContents();
   }
 
+  const CGXShadowStats stats = CGX_GetShadowStats();
+  network_printf("Shadow state dropped %u of %u BP, %u of %u CP and %u of %u XF loads\n",
+                 stats.bp_elided, stats.bp_loads, stats.cp_elided, stats.cp_loads,
+                 stats.xf_elided, stats.xf_loads);
+  CGX_EnableShadowState(false);
+
+  END_TEST();
+}
+
+// Time the software TEV takes for a whole EFB worth of pixels, which is how many cases a single
+// batch of GetTevOutputs or GetTileColors can check
+static void SoftwareTevBenchmark()
+{
+  START_TEST();
+
+  static const int NUM_PIXELS = 640 * 528;
+
+  TevEmulator::Pixels pixels(NUM_PIXELS);
+  for (int component = 0; component < 4; ++component)
+  {
+    u8* values = pixels.Rasterized(0, component);
+    for (int i = 0; i < NUM_PIXELS; ++i)
+      values[i] = rand();
+  }
+
+  for (int num_stages : {1, 4, 16})
+  {
+    // Every stage blends the rasterized color into the previous result
+    TevEmulator::State state;
+    auto genmode = CGXDefault<GenMode>();
+    genmode.numtevstages = num_stages - 1;
+    state.LoadBPReg(genmode.hex);
+    for (int stage = 0; stage < num_stages; ++stage)
+    {
+      auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(stage);
+      cc.a = TEVCOLORARG_RASC;
+      cc.b = TEVCOLORARG_CPREV;
+      cc.c = TEVCOLORARG_HALF;
+      cc.d = TEVCOLORARG_C0;
+      state.LoadBPReg(cc.hex);
+      auto ac = CGXDefault<TevStageCombiner::AlphaCombiner>(stage);
+      ac.a = TEVALPHAARG_RASA;
+      ac.b = TEVALPHAARG_APREV;
+      ac.c = TEVALPHAARG_KONST;
+      state.LoadBPReg(ac.hex);
+    }
+
+    const u64 start = GetTimebase();
+    TevEmulator::Evaluate(state, &pixels);
+    const u64 end = GetTimebase();
+
+    const u32 us = (u32)((end - start) / (TB_TIMER_CLOCK / 1000));
+    network_printf("software TEV: %2d stages, %d pixels in %7u us (%u pixels/ms)\n", num_stages,
+                   NUM_PIXELS, us, (u32)((u64)NUM_PIXELS * 1000 / (us ? us : 1)));
+  }
+
+  END_TEST();
+}
+
+// Time the conversion of a whole EFB worth of pixels in each format. On the console, EncodeRow
+// and DecodeRow are the same code as their scalar references, so only they are timed. The SIMD
+// versions of hosts are compared against the references in hosttest.
+static void EfbFormatBenchmark()
+{
+  START_TEST();
+
+  static const int WIDTH = 640;
+  static const int HEIGHT = 528;
+
+  static u8 colors[WIDTH * HEIGHT * 4];
+  static u32 values[WIDTH * HEIGHT];
+  static u8 copied[WIDTH * HEIGHT * 4];
+  for (u8& value : colors)
+    value = rand();
+
+  for (int format : {PIXELFMT_RGB8_Z24, PIXELFMT_RGBA6_Z24, PIXELFMT_RGB565_Z16})
+  {
+    const u64 encode_ticks = ConversionTest::GetFastestTicks([&] {
+      for (int y = 0; y < HEIGHT; ++y)
+        EfbFormat::EncodeRow(format, true, 0, y, WIDTH, colors + y * WIDTH * 4, values + y * WIDTH);
+    });
+    const u64 decode_ticks = ConversionTest::GetFastestTicks(
+        [&] { EfbFormat::DecodeRow(format, WIDTH * HEIGHT, values, copied); });
+
+    char name[32];
+    snprintf(name, sizeof(name), "EFB format %d encode", format);
+    ConversionTest::PrintBenchmark(name, WIDTH, HEIGHT, encode_ticks);
+    snprintf(name, sizeof(name), "EFB format %d decode", format);
+    ConversionTest::PrintBenchmark(name, WIDTH, HEIGHT, decode_ticks);
+  }
+
   END_TEST();
 }
 
@@ -391,7 +609,10 @@ int main()
   GXTest::Init();
 
   TevCombinerTest();
+  EfbFormatTest();
   KonstTest();
+  SoftwareTevBenchmark();
+  EfbFormatBenchmark();
 
   network_printf("Shutting down...\n");
   network_shutdown();
@@ -0,0 +1,557 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <ogc/lwp_watchdog.h>
+#include <ogcsys.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+#include "common/timebase.h"
+#include "gxtest/TevEmulator.h"
+#include "gxtest/cgx.h"
+#include "gxtest/cgx_defaults.h"
+#include "gxtest/util.h"
+
+// Runs seeded random multi-stage TEV programs on the GPU and compares their output against the
+// software TEV. Programs chain stages through all four registers, use compare modes in both
+// combiners and read konst values. Programs that give different results are reduced to a
+// minimal program that still does, which is then printed.
+//
+// Texture inputs are not used, since no texture is bound. The rasterized color is always white.
+
+// Set to a nonzero value to repeat an earlier run, otherwise the seed comes from the timebase
+#define FUZZ_SEED 0
+
+// GetTevOutputs appends up to three stages, and one more is needed to read back alpha
+static const int MAX_STAGES = 12;
+static const int PROGRAMS_PER_ROUND = 16384;
+static const int NUM_ROUNDS = 8;
+static const int MAX_MINIMIZED = 8;
+static const int MAX_MINIMIZE_STEPS = 256;
+
+struct Program
+{
+  int num_stages;
+
+  // Combiners of each stage, without the register address. The last stage writes to PREV.
+  TevStageCombiner::ColorCombiner color[MAX_STAGES];
+  TevStageCombiner::AlphaCombiner alpha[MAX_STAGES];
+  u8 kcsel[MAX_STAGES];
+  u8 kasel[MAX_STAGES];
+
+  // Initial register values and konst colors, as [reg][r, g, b, a]
+  s16 registers[4][4];
+  u8 konst[4][4];
+};
+
+// xorshift32, so that programs don't depend on the C library
+class Random
+{
+public:
+  explicit Random(u32 seed) : m_state(seed ? seed : 1) {}
+
+  u32 Next()
+  {
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+    return m_state;
+  }
+
+  int Range(int min, int max) { return min + (int)(Next() % (u32)(max - min + 1)); }
+
+private:
+  u32 m_state;
+};
+
+static int RandomColorArg(Random& random)
+{
+  // Everything but TEXC and TEXA
+  int arg = random.Range(0, 13);
+  return (arg >= TEVCOLORARG_TEXC) ? arg + 2 : arg;
+}
+
+static int RandomAlphaArg(Random& random)
+{
+  // Everything but TEXA
+  int arg = random.Range(0, 6);
+  return (arg >= TEVALPHAARG_TEXA) ? arg + 1 : arg;
+}
+
+static Program GenerateProgram(Random& random)
+{
+  Program program;
+  program.num_stages = random.Range(1, MAX_STAGES);
+
+  for (int stage = 0; stage < program.num_stages; ++stage)
+  {
+    const bool last = (stage == program.num_stages - 1);
+
+    auto& cc = program.color[stage];
+    cc.hex = 0;
+    cc.a = RandomColorArg(random);
+    cc.b = RandomColorArg(random);
+    cc.c = RandomColorArg(random);
+    cc.d = RandomColorArg(random);
+    cc.bias = random.Range(0, 3);
+    cc.op = random.Range(0, 1);
+    cc.clamp = random.Range(0, 1);
+    cc.shift = random.Range(0, 3);
+    cc.dest = last ? GX_TEVPREV : random.Range(0, 3);
+
+    auto& ac = program.alpha[stage];
+    ac.hex = 0;
+    ac.a = RandomAlphaArg(random);
+    ac.b = RandomAlphaArg(random);
+    ac.c = RandomAlphaArg(random);
+    ac.d = RandomAlphaArg(random);
+    ac.bias = random.Range(0, 3);
+    ac.op = random.Range(0, 1);
+    ac.clamp = random.Range(0, 1);
+    ac.shift = random.Range(0, 3);
+    ac.dest = last ? GX_TEVPREV : random.Range(0, 3);
+
+    program.kcsel[stage] = random.Range(0, 31);
+    program.kasel[stage] = random.Range(0, 31);
+  }
+
+  for (int reg = 0; reg < 4; ++reg)
+  {
+    for (int component = 0; component < 4; ++component)
+    {
+      program.registers[reg][component] = random.Range(-1024, 1023);
+      program.konst[reg][component] = random.Range(0, 255);
+    }
+  }
+
+  return program;
+}
+
+// Loads the program with load(value), which is either CGX_LOAD_BP_REG or the software TEV.
+// With read_alpha, an extra stage copies the alpha output into the color channels, without
+// changing any of its 11 bits.
+template <typename Load>
+static void LoadProgram(const Program& program, bool read_alpha, Load load)
+{
+  for (int stage = 0; stage < program.num_stages; ++stage)
+  {
+    auto cc = program.color[stage];
+    cc.hex = (cc.hex & 0xFFFFFF) | ((BPMEM_TEV_COLOR_ENV + 2 * stage) << 24);
+    load(cc.hex);
+
+    auto ac = program.alpha[stage];
+    ac.hex = (ac.hex & 0xFFFFFF) | ((BPMEM_TEV_ALPHA_ENV + 2 * stage) << 24);
+    load(ac.hex);
+  }
+
+  for (int index = 0; index < (program.num_stages + 1) / 2; ++index)
+  {
+    auto ksel = CGXDefault<TevKSel>(index);
+    ksel.kcsel0 = program.kcsel[2 * index];
+    ksel.kasel0 = program.kasel[2 * index];
+    if (2 * index + 1 < program.num_stages)
+    {
+      ksel.kcsel1 = program.kcsel[2 * index + 1];
+      ksel.kasel1 = program.kasel[2 * index + 1];
+    }
+    load(ksel.hex);
+  }
+
+  for (int reg = 0; reg < 4; ++reg)
+  {
+    auto tevreg = CGXDefault<TevReg>(reg, false);
+    tevreg.red = program.registers[reg][0];
+    tevreg.green = program.registers[reg][1];
+    tevreg.blue = program.registers[reg][2];
+    tevreg.alpha = program.registers[reg][3];
+    load(tevreg.low);
+    load(tevreg.high);
+
+    tevreg = CGXDefault<TevReg>(reg, true);
+    tevreg.red = program.konst[reg][0];
+    tevreg.green = program.konst[reg][1];
+    tevreg.blue = program.konst[reg][2];
+    tevreg.alpha = program.konst[reg][3];
+    load(tevreg.low);
+    load(tevreg.high);
+  }
+
+  if (read_alpha)
+  {
+    auto cc = CGXDefault<TevStageCombiner::ColorCombiner>(program.num_stages);
+    cc.d = TEVCOLORARG_APREV;
+    load(cc.hex);
+    auto ac = CGXDefault<TevStageCombiner::AlphaCombiner>(program.num_stages);
+    ac.d = TEVALPHAARG_APREV;
+    load(ac.hex);
+  }
+}
+
+static GXTest::Vec4<int> Emulate(const Program& program, TevEmulator::Pixels* pixels)
+{
+  TevEmulator::State state;
+  auto genmode = CGXDefault<GenMode>();
+  genmode.numtevstages = program.num_stages - 1;
+  state.LoadBPReg(genmode.hex);
+  LoadProgram(program, false, [&](u32 value) { state.LoadBPReg(value); });
+  TevEmulator::Evaluate(state, pixels);
+
+  GXTest::Vec4<int> result;
+  result.r = pixels->Output(TevEmulator::COMP_R)[0];
+  result.g = pixels->Output(TevEmulator::COMP_G)[0];
+  result.b = pixels->Output(TevEmulator::COMP_B)[0];
+  result.a = pixels->Output(TevEmulator::COMP_A)[0];
+  return result;
+}
+
+// Runs the programs on the GPU. Programs with the same number of stages are drawn in one batch,
+// once to read back the color and once more with an extra stage to read back alpha.
+static void RunOnHardware(const std::vector<Program>& programs,
+                          std::vector<GXTest::Vec4<int>>* results)
+{
+  results->resize(programs.size());
+  std::vector<GXTest::Vec4<int>> batch_results(programs.size());
+  std::vector<int> indices;
+
+  for (int num_stages = 1; num_stages <= MAX_STAGES; ++num_stages)
+  {
+    indices.clear();
+    for (int i = 0; i < (int)programs.size(); ++i)
+    {
+      if (programs[i].num_stages == num_stages)
+        indices.push_back(i);
+    }
+    if (indices.empty())
+      continue;
+
+    for (int read_alpha = 0; read_alpha < 2; ++read_alpha)
+    {
+      const int last_stage = num_stages - 1 + read_alpha;
+      auto genmode = CGXDefault<GenMode>();
+      genmode.numtevstages = last_stage;
+      const auto last_cc = CGXDefault<TevStageCombiner::ColorCombiner>(last_stage);
+      const auto last_ac = CGXDefault<TevStageCombiner::AlphaCombiner>(last_stage);
+
+      GXTest::GetTevOutputs(genmode, last_cc, last_ac, (int)indices.size(),
+                            [&](int i) {
+                              LoadProgram(programs[indices[i]], read_alpha != 0,
+                                          [](u32 value) { CGX_LOAD_BP_REG(value); });
+                            },
+                            batch_results.data());
+
+      for (int i = 0; i < (int)indices.size(); ++i)
+      {
+        GXTest::Vec4<int>& result = (*results)[indices[i]];
+        if (read_alpha)
+        {
+          result.a = batch_results[i].r;
+        }
+        else
+        {
+          result.r = batch_results[i].r;
+          result.g = batch_results[i].g;
+          result.b = batch_results[i].b;
+        }
+      }
+    }
+  }
+}
+
+static bool Matches(const GXTest::Vec4<int>& a, const GXTest::Vec4<int>& b)
+{
+  return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+// All programs which are one step simpler than the given one: a stage less, an input replaced
+// by zero, a combiner setting or konst selection reset, or a register value cleared
+static std::vector<Program> GetSimplifications(const Program& program)
+{
+  std::vector<Program> candidates;
+
+  // Removing a stage other than the last one keeps the output in PREV
+  for (int stage = 0; stage + 1 < program.num_stages; ++stage)
+  {
+    Program candidate = program;
+    for (int i = stage; i + 1 < program.num_stages; ++i)
+    {
+      candidate.color[i] = program.color[i + 1];
+      candidate.alpha[i] = program.alpha[i + 1];
+      candidate.kcsel[i] = program.kcsel[i + 1];
+      candidate.kasel[i] = program.kasel[i + 1];
+    }
+    --candidate.num_stages;
+    candidates.push_back(candidate);
+  }
+
+  for (int stage = 0; stage < program.num_stages; ++stage)
+  {
+    const auto& cc = program.color[stage];
+    const auto& ac = program.alpha[stage];
+    const u32 color_fields[] = {cc.a, cc.b, cc.c, cc.d};
+    const u32 alpha_fields[] = {ac.a, ac.b, ac.c, ac.d};
+
+    for (int arg = 0; arg < 4; ++arg)
+    {
+      if (color_fields[arg] != TEVCOLORARG_ZERO)
+      {
+        Program candidate = program;
+        auto& candidate_cc = candidate.color[stage];
+        if (arg == 0)
+          candidate_cc.a = TEVCOLORARG_ZERO;
+        else if (arg == 1)
+          candidate_cc.b = TEVCOLORARG_ZERO;
+        else if (arg == 2)
+          candidate_cc.c = TEVCOLORARG_ZERO;
+        else
+          candidate_cc.d = TEVCOLORARG_ZERO;
+        candidates.push_back(candidate);
+      }
+      if (alpha_fields[arg] != TEVALPHAARG_ZERO)
+      {
+        Program candidate = program;
+        auto& candidate_ac = candidate.alpha[stage];
+        if (arg == 0)
+          candidate_ac.a = TEVALPHAARG_ZERO;
+        else if (arg == 1)
+          candidate_ac.b = TEVALPHAARG_ZERO;
+        else if (arg == 2)
+          candidate_ac.c = TEVALPHAARG_ZERO;
+        else
+          candidate_ac.d = TEVALPHAARG_ZERO;
+        candidates.push_back(candidate);
+      }
+    }
+
+    // Bias, op, clamp and shift, which are bits 16-21 of both combiners
+    for (int bit = 16; bit < 22; ++bit)
+    {
+      if (cc.hex & (1 << bit))
+      {
+        Program candidate = program;
+        candidate.color[stage].hex &= ~(1 << bit);
+        candidates.push_back(candidate);
+      }
+      if (ac.hex & (1 << bit))
+      {
+        Program candidate = program;
+        candidate.alpha[stage].hex &= ~(1 << bit);
+        candidates.push_back(candidate);
+      }
+    }
+
+    if (cc.dest != GX_TEVPREV)
+    {
+      Program candidate = program;
+      candidate.color[stage].dest = GX_TEVPREV;
+      candidates.push_back(candidate);
+    }
+    if (ac.dest != GX_TEVPREV)
+    {
+      Program candidate = program;
+      candidate.alpha[stage].dest = GX_TEVPREV;
+      candidates.push_back(candidate);
+    }
+
+    if (program.kcsel[stage] != 0)
+    {
+      Program candidate = program;
+      candidate.kcsel[stage] = 0;
+      candidates.push_back(candidate);
+    }
+    if (program.kasel[stage] != 0)
+    {
+      Program candidate = program;
+      candidate.kasel[stage] = 0;
+      candidates.push_back(candidate);
+    }
+  }
+
+  for (int reg = 0; reg < 4; ++reg)
+  {
+    for (int component = 0; component < 4; ++component)
+    {
+      if (program.registers[reg][component] != 0)
+      {
+        Program candidate = program;
+        candidate.registers[reg][component] = 0;
+        candidates.push_back(candidate);
+      }
+      if (program.konst[reg][component] != 0)
+      {
+        Program candidate = program;
+        candidate.konst[reg][component] = 0;
+        candidates.push_back(candidate);
+      }
+    }
+  }
+
+  return candidates;
+}
+
+// Repeatedly replaces the program by the first simplification which still gives a different
+// result on hardware, until there is none left. The mismatch doesn't need to stay the same.
+static Program Minimize(const Program& program, TevEmulator::Pixels* pixels)
+{
+  Program current = program;
+  std::vector<GXTest::Vec4<int>> results;
+
+  for (int step = 0; step < MAX_MINIMIZE_STEPS; ++step)
+  {
+    const std::vector<Program> candidates = GetSimplifications(current);
+    if (candidates.empty())
+      break;
+
+    RunOnHardware(candidates, &results);
+
+    int simpler = -1;
+    for (int i = 0; i < (int)candidates.size() && simpler < 0; ++i)
+    {
+      if (!Matches(results[i], Emulate(candidates[i], pixels)))
+        simpler = i;
+    }
+    if (simpler < 0)
+      break;
+    current = candidates[simpler];
+  }
+
+  return current;
+}
+
+static const char* GetColorArgName(int arg)
+{
+  static const char* names[16] = {"CPREV", "APREV", "C0",   "A0",   "C1",  "A1",
+                                  "C2",    "A2",    "TEXC", "TEXA", "RASC", "RASA",
+                                  "ONE",   "HALF",  "KONST", "ZERO"};
+  return names[arg & 15];
+}
+
+static const char* GetAlphaArgName(int arg)
+{
+  static const char* names[8] = {"APREV", "A0", "A1", "A2", "TEXA", "RASA", "KONST", "ZERO"};
+  return names[arg & 7];
+}
+
+static void PrintProgram(const Program& program)
+{
+  static const char* reg_names[4] = {"PREV", "C0", "C1", "C2"};
+
+  for (int stage = 0; stage < program.num_stages; ++stage)
+  {
+    const auto& cc = program.color[stage];
+    const auto& ac = program.alpha[stage];
+    network_printf("  stage %2d color: a=%s b=%s c=%s d=%s bias=%u op=%u clamp=%u shift=%u "
+                   "dest=%s kcsel=%u\n",
+                   stage, GetColorArgName(cc.a), GetColorArgName(cc.b), GetColorArgName(cc.c),
+                   GetColorArgName(cc.d), (u32)cc.bias, (u32)cc.op, (u32)cc.clamp, (u32)cc.shift,
+                   reg_names[cc.dest], program.kcsel[stage]);
+    network_printf("  stage %2d alpha: a=%s b=%s c=%s d=%s bias=%u op=%u clamp=%u shift=%u "
+                   "dest=%s kasel=%u\n",
+                   stage, GetAlphaArgName(ac.a), GetAlphaArgName(ac.b), GetAlphaArgName(ac.c),
+                   GetAlphaArgName(ac.d), (u32)ac.bias, (u32)ac.op, (u32)ac.clamp, (u32)ac.shift,
+                   reg_names[ac.dest], program.kasel[stage]);
+  }
+  for (int reg = 0; reg < 4; ++reg)
+  {
+    network_printf("  %-4s = %5d %5d %5d %5d, K%d = %3d %3d %3d %3d\n", reg_names[reg],
+                   program.registers[reg][0], program.registers[reg][1],
+                   program.registers[reg][2], program.registers[reg][3], reg,
+                   program.konst[reg][0], program.konst[reg][1], program.konst[reg][2],
+                   program.konst[reg][3]);
+  }
+}
+
+static void FuzzTest()
+{
+  START_TEST();
+
+  // GetTevOutputs needs an EFB with 8 bits per channel
+  PE_CONTROL ctrl;
+  ctrl.hex = BPMEM_ZCOMPARE << 24;
+  ctrl.pixel_format = PIXELFMT_RGB8_Z24;
+  ctrl.zformat = ZC_LINEAR;
+  ctrl.early_ztest = 0;
+  CGX_LOAD_BP_REG(ctrl.hex);
+
+  const u32 seed = FUZZ_SEED ? FUZZ_SEED : (u32)GetTimebase();
+  network_printf("tevfuzz seed: 0x%08x\n", seed);
+  Random random(seed);
+
+  // The tile quads are white, and so is the rasterized color of the software TEV
+  TevEmulator::Pixels pixels(1);
+  for (int component = 0; component < 4; ++component)
+    pixels.Rasterized(0, component)[0] = 255;
+
+  std::vector<Program> programs(PROGRAMS_PER_ROUND);
+  std::vector<GXTest::Vec4<int>> results;
+  std::vector<Program> failures;
+  int num_programs = 0;
+  int num_failures = 0;
+
+  for (int round = 0; round < NUM_ROUNDS; ++round)
+  {
+    for (Program& program : programs)
+      program = GenerateProgram(random);
+
+    const u64 start = GetTimebase();
+    RunOnHardware(programs, &results);
+    const u64 end = GetTimebase();
+
+    for (int i = 0; i < PROGRAMS_PER_ROUND; ++i)
+    {
+      if (Matches(results[i], Emulate(programs[i], &pixels)))
+        continue;
+
+      ++num_failures;
+      if ((int)failures.size() < MAX_MINIMIZED)
+        failures.push_back(programs[i]);
+    }
+    num_programs += PROGRAMS_PER_ROUND;
+
+    network_printf("tevfuzz round %d: %d programs, %d mismatches so far, %u ms on hardware\n",
+                   round, num_programs, num_failures,
+                   (u32)((end - start) / (TB_TIMER_CLOCK / 1000)));
+
+    WPAD_ScanPads();
+    if (WPAD_ButtonsDown(0) & WPAD_BUTTON_HOME)
+      break;
+  }
+
+  for (const Program& failure : failures)
+  {
+    const Program minimized = Minimize(failure, &pixels);
+
+    std::vector<Program> single(1, minimized);
+    RunOnHardware(single, &results);
+    const GXTest::Vec4<int> expected = Emulate(minimized, &pixels);
+    const GXTest::Vec4<int>& result = results[0];
+    DO_TEST(Matches(result, expected),
+            "Minimized program (%d of %d stages) gives %d %d %d %d, expected %d %d %d %d",
+            minimized.num_stages, failure.num_stages, result.r, result.g, result.b, result.a,
+            expected.r, expected.g, expected.b, expected.a);
+    if (!Matches(result, expected))
+      PrintProgram(minimized);
+  }
+
+  DO_TEST(num_failures == 0, "%d of %d programs gave different results (seed 0x%08x)",
+          num_failures, num_programs, seed);
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  GXTest::Init();
+
+  FuzzTest();
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
@@ -2,12 +2,18 @@
 // Licensed under GPLv2
 // Refer to the license.txt file included.
 
+#include <algorithm>
 #include <assert.h>
-#include <gccore.h>
 #include <malloc.h>
-#include <ogc/video.h>
 #include <string.h>
+#ifndef CGX_RECORD_FIFO
+#include <gccore.h>
+#include <ogc/cache.h>
+#include <ogc/video.h>
+#endif
 
+#include "gxtest/DisplayList.h"
+#include "gxtest/XFMemory.h"
 #include "gxtest/cgx.h"
 #include "gxtest/cgx_defaults.h"
 #include "gxtest/util.h"
@@ -16,22 +22,24 @@
 
 namespace GXTest
 {
-#define TEST_BUFFER_SIZE (640 * 528 * 4)
+#define EFB_WIDTH 640
+#define EFB_HEIGHT 528
+#define TEST_BUFFER_SIZE (EFB_WIDTH * EFB_HEIGHT * 4)
 static u32* test_buffer;
 
+// GetTileColors and GetTevOutputs render each test case into its own tile of the EFB
+#define TEV_TILE_SIZE 4
+#define TEV_TILES_PER_ROW (EFB_WIDTH / TEV_TILE_SIZE)
+#define TEV_BATCH_SIZE (TEV_TILES_PER_ROW * (EFB_HEIGHT / TEV_TILE_SIZE))
+
 #ifdef ENABLE_DEBUG_DISPLAY
 static u32 fb = 0;
 static void* frameBuffer[2] = {NULL, NULL};
 static GXRModeObj* rmode;
-
-float yscale;
-u32 xfbHeight;
 #endif
 
 void Init()
 {
-  GXColor background = {0, 0x27, 0, 0xff};
-
 #if defined(ENABLE_DEBUG_DISPLAY)
   VIDEO_Init();
 
@@ -47,85 +55,14 @@ void Init()
   VIDEO_WaitVSync();
   if (rmode->viTVMode & VI_NON_INTERLACE)
     VIDEO_WaitVSync();
-
-  CGX_Init();
-
-  GX_SetCopyClear(background, 0x00ffffff);
-  GX_SetViewport(0, 0, rmode->fbWidth, rmode->efbHeight, 0, 1);
-  yscale = GX_GetYScaleFactor(rmode->efbHeight, rmode->xfbHeight);
-  xfbHeight = GX_SetDispCopyYScale(yscale);
-  GX_SetScissor(0, 0, rmode->fbWidth, rmode->efbHeight);
-  GX_SetDispCopySrc(0, 0, rmode->fbWidth, rmode->efbHeight);
-  GX_SetDispCopyDst(rmode->fbWidth, xfbHeight);
-  GX_SetCopyFilter(rmode->aa, rmode->sample_pattern, 1, rmode->vfilter);
-  GX_SetFieldMode(rmode->field_rendering, ((rmode->viHeight == 2 * rmode->xfbHeight) ? 1 : 0));
-  GX_SetDispCopyGamma(GX_GM_1_0);
-#else
-  CGX_Init();
-
-  GX_SetCopyClear(background, 0x00ffffff);
-  GX_SetViewport(0, 0, 640, 528, 0, 1);
-  GX_SetScissor(0, 0, 640, 528);
 #endif
 
-  test_buffer = (u32*)memalign(32, 640 * 528 * 4);
-
-  GX_SetTexCopySrc(0, 0, 100, 100);
-  GX_SetTexCopyDst(100, 100, GX_TF_RGBA8, false);
-
-  // We draw a dummy quad here to apply cached GX state...
-  // TODO: Implement proper GPU initialization in GX so that we don't need
-  // to do this anymore
-  GX_ClearVtxDesc();
-  GX_SetVtxDesc(GX_VA_POS, GX_DIRECT);
-  GX_SetVtxDesc(GX_VA_CLR0, GX_DIRECT);
-
-  GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_POS, GX_POS_XYZ, GX_F32, 0);
-  GX_SetVtxAttrFmt(GX_VTXFMT0, GX_VA_CLR0, GX_CLR_RGBA, GX_RGBA8, 0);
-
-  Mtx model;
-  guMtxIdentity(model);
-  GX_LoadPosMtxImm(model, GX_PNMTX0);
-
-  float mtx[4][4];
-  memset(mtx, 0, sizeof(mtx));
-  mtx[0][0] = 1;
-  mtx[1][1] = 1;
-  mtx[2][2] = -1;
-  CGX_LoadProjectionMatrixOrthographic(mtx);
+  // Sets up the FIFO and every register the tests rely on, including the viewport, scissor
+  // rectangle, copy clear color, matrices and a single TEV stage passing on vertex colors
+  CGX_Init();
 
-  GX_SetNumChans(1);  // damnit dirty state...
-  GX_SetNumTexGens(0);
-  GX_SetTevOrder(GX_TEVSTAGE0, GX_TEXCOORDNULL, GX_TEXMAP_NULL, GX_COLOR0A0);
-  GX_SetTevOp(GX_TEVSTAGE0, GX_PASSCLR);
-
-  GX_Begin(GX_QUADS, GX_VTXFMT0, 4);
-  // Bottom right
-  wgPipe->F32 = -1.0;
-  wgPipe->F32 = 1.0;
-  wgPipe->F32 = 1.0;
-  wgPipe->U32 = 0xFFFFFFFF;
-
-  // Top right
-  wgPipe->F32 = 1.0;
-  wgPipe->F32 = 1.0;
-  wgPipe->F32 = 1.0;
-  wgPipe->U32 = 0xFFFFFFFF;
-
-  // Top left
-  wgPipe->F32 = 1.0;
-  wgPipe->F32 = -1.0;
-  wgPipe->F32 = 1.0;
-  wgPipe->U32 = 0xFFFFFFFF;
-
-  // Bottom left
-  wgPipe->F32 = -1.0;
-  wgPipe->F32 = -1.0;
-  wgPipe->F32 = 1.0;
-  wgPipe->U32 = 0xFFFFFFFF;
-
-  GX_End();
-  GX_Flush();
+  if (!test_buffer)
+    test_buffer = (u32*)memalign(32, TEST_BUFFER_SIZE);
 
   PE_CONTROL ctrl;
   ctrl.hex = BPMEM_ZCOMPARE << 24;
@@ -138,7 +75,7 @@ void Init()
 void DebugDisplayEfbContents()
 {
 #ifdef ENABLE_DEBUG_DISPLAY
-  CGX_DoEfbCopyXfb(0, 0, rmode->fbWidth, rmode->efbHeight, xfbHeight, frameBuffer[fb]);
+  CGX_DoEfbCopyXfb(0, 0, rmode->fbWidth, rmode->efbHeight, rmode->xfbHeight, frameBuffer[fb]);
   CGX_WaitForGpuToFinish();
 
   VIDEO_SetNextFramebuffer(frameBuffer[fb]);
@@ -169,6 +106,50 @@ Vec4<u8> ReadTestBuffer(int s, int t, int width)
   return ret;
 }
 
+// CPU access to the EFB. Bit 22 selects the depth buffer instead of the color buffer.
+#define EFB_PEEK_BASE 0xC8000000
+#define EFB_PEEK_DEPTH 0x00400000
+
+#ifndef CGX_RECORD_FIFO
+static vu32* GetEfbPeekAddress(int x, int y, bool depth)
+{
+  assert(x >= 0 && x < EFB_WIDTH);
+  assert(y >= 0 && y < EFB_HEIGHT);
+  return (vu32*)(EFB_PEEK_BASE | (depth ? EFB_PEEK_DEPTH : 0) | (x << 2) | (y << 12));
+}
+
+#endif
+
+Vec4<u8> PeekEfbColor(int x, int y)
+{
+  // Colors are returned as ARGB
+#ifdef CGX_RECORD_FIFO
+  (void)x;
+  (void)y;
+  const u32 value = 0;
+#else
+  const u32 value = *GetEfbPeekAddress(x, y, false);
+#endif
+
+  Vec4<u8> ret;
+  ret.a = value >> 24;
+  ret.r = value >> 16;
+  ret.g = value >> 8;
+  ret.b = value;
+  return ret;
+}
+
+u32 PeekEfbDepth(int x, int y)
+{
+#ifdef CGX_RECORD_FIFO
+  (void)x;
+  (void)y;
+  return 0;
+#else
+  return *GetEfbPeekAddress(x, y, true) & 0xFFFFFF;
+#endif
+}
+
 Quad::Quad()
 {
   // top left
@@ -241,7 +222,40 @@ Quad& Quad::ColorRGBA(u8 r, u8 g, u8 b, u8 a)
   return *this;
 }
 
-void Quad::Draw()
+// Quads are either sent through wgPipe, using the shadow state like all other direct register
+// loads, or recorded into display lists, which need to contain every command.
+template <typename Pipe>
+static void LoadQuadCPReg(Pipe* /*pipe*/, u8 reg, u32 value)
+{
+  CGX_LOAD_CP_REG(reg, value);
+}
+
+static void LoadQuadCPReg(DisplayList* list, u8 reg, u32 value)
+{
+  CGX_WRITE_CP_REG_TO(list, reg, value);
+}
+
+template <typename Pipe>
+static void LoadQuadProjection(Pipe* /*pipe*/, float mtx[4][4])
+{
+  CGX_LoadProjectionMatrixOrthographic(mtx);
+}
+
+// Same layout as libogc's GX_LoadProjectionMtx
+static void LoadQuadProjection(DisplayList* list, float mtx[4][4])
+{
+  CGX_BEGIN_WRITE_XF_REGS_TO(list, XFMEM_SETPROJECTION, 7);
+  list->F32 = mtx[0][0];
+  list->F32 = mtx[0][3];
+  list->F32 = mtx[1][1];
+  list->F32 = mtx[1][3];
+  list->F32 = mtx[2][2];
+  list->F32 = mtx[2][3];
+  list->U32 = 1;  // orthographic
+}
+
+template <typename Pipe>
+void Quad::Emit(Pipe* pipe)
 {
   VAT vtxattr;
   vtxattr.g0.Hex = 0;
@@ -268,12 +282,12 @@ void Quad::Draw()
     vtxdesc.Color0 = VTXATTR_DIRECT;
 
   // TODO: Not sure if the order of these two is correct
-  CGX_LOAD_CP_REG(0x50, vtxdesc.Hex0);
-  CGX_LOAD_CP_REG(0x60, vtxdesc.Hex1);
+  LoadQuadCPReg(pipe, 0x50, vtxdesc.Low);
+  LoadQuadCPReg(pipe, 0x60, vtxdesc.High);
 
-  CGX_LOAD_CP_REG(0x70, vtxattr.g0.Hex);
-  CGX_LOAD_CP_REG(0x80, vtxattr.g1.Hex);
-  CGX_LOAD_CP_REG(0x90, vtxattr.g2.Hex);
+  LoadQuadCPReg(pipe, 0x70, vtxattr.g0.Hex);
+  LoadQuadCPReg(pipe, 0x80, vtxattr.g1.Hex);
+  LoadQuadCPReg(pipe, 0x90, vtxattr.g2.Hex);
 
   /* TODO: Should reset this matrix..
   float mtx[3][4];
@@ -288,131 +302,373 @@ void Quad::Draw()
   mtx[0][0] = 1;
   mtx[1][1] = 1;
   mtx[2][2] = -1;
-  CGX_LoadProjectionMatrixOrthographic(mtx);
+  LoadQuadProjection(pipe, mtx);
 
-  wgPipe->U8 = 0x80;  // draw quads
-  wgPipe->U16 = 4;    // 4 vertices
+  pipe->U8 = 0x80;  // draw quads
+  pipe->U16 = 4;    // 4 vertices
 
   for (int i = 0; i < 4; ++i)
   {
-    wgPipe->F32 = x[i];
-    wgPipe->F32 = y[i];
-    wgPipe->F32 = z[i];
+    pipe->F32 = x[i];
+    pipe->F32 = y[i];
+    pipe->F32 = z[i];
 
     if (has_color)
-      wgPipe->U32 = color;
+      pipe->U32 = color;
   }
 }
 
+void Quad::Draw()
+{
+  Emit(wgPipe);
+}
+
+void Quad::Draw(DisplayList* list)
+{
+  Emit(list);
+}
+
 void CopyToTestBuffer(int left_most_pixel, int top_most_pixel, int right_most_pixel,
-                      int bottom_most_pixel)
+                      int bottom_most_pixel, u8 format)
 {
   // TODO: Do we need to impose additional constraints on the parameters?
   memset(test_buffer, 0, TEST_BUFFER_SIZE);
   CGX_DoEfbCopyTex(left_most_pixel, top_most_pixel, right_most_pixel - left_most_pixel + 1,
-                   bottom_most_pixel - top_most_pixel + 1, 0x6 /*RGBA8*/, false, test_buffer);
+                   bottom_most_pixel - top_most_pixel + 1, format, test_buffer);
 }
 
-Vec4<int> GetTevOutput(const GenMode& genmode, const TevStageCombiner::ColorCombiner& last_cc,
-                       const TevStageCombiner::AlphaCombiner& last_ac)
+const u8* GetTestBuffer()
+{
+  return (const u8*)test_buffer;
+}
+
+// The TEV output gets truncated to 8 bits when writing to the EFB.
+// Hence, we cannot retrieve all 11 TEV output bits directly.
+// Instead, we're performing two render passes, one of which retrieves
+// the lower 6 output bits, the other one of which retrieves the upper
+// 5 bits.
+// This sets up the additional TEV stages of the given pass (0 or 1).
+static void LoadTevOutputPass(const GenMode& genmode,
+                              const TevStageCombiner::ColorCombiner& last_cc,
+                              const TevStageCombiner::AlphaCombiner& last_ac, int pass)
 {
   int previous_stage = ((last_cc.hex >> 24) - BPMEM_TEV_COLOR_ENV) >> 1;
   assert(previous_stage < 13);
-  assert(previous_stage == (((last_ac.hex >> 24) - BPMEM_TEV_ALPHA_ENV) >> 1));
-
-  // The TEV output gets truncated to 8 bits when writing to the EFB.
-  // Hence, we cannot retrieve all 11 TEV output bits directly.
-  // Instead, we're performing two render passes, one of which retrieves
-  // the lower 6 output bits, the other one of which retrieves the upper
-  // 5 bits.
-
-  // FIRST RENDER PASS:
-  // As set up by the caller, with one additional tev stage multiplying the result by 4.
-  // This will retrieve the lower 6 bits of the TEV output.
-
-  auto gm = genmode;
-  gm.numtevstages = previous_stage + 1;  // one additional stage
-  CGX_LOAD_BP_REG(gm.hex);
-
-  // Enable new TEV stage. Note that we are using the "a" input here to make
-  // sure the input doesn't get erroneously clamped to 11 bit range.
-  auto cc1 = CGXDefault<TevStageCombiner::ColorCombiner>(previous_stage + 1);
-  cc1.a = last_cc.dest * 2;
-  cc1.shift = TEVSCALE_4;
-  CGX_LOAD_BP_REG(cc1.hex);
-
-  auto ac1 = CGXDefault<TevStageCombiner::AlphaCombiner>(previous_stage + 1);
-  ac1.a = last_ac.dest * 2;
-  ac1.shift = TEVSCALE_4;
-  CGX_LOAD_BP_REG(ac1.hex);
+  assert(previous_stage == (int)(((last_ac.hex >> 24) - BPMEM_TEV_ALPHA_ENV) >> 1));
+
+  if (pass == 0)
+  {
+    // FIRST RENDER PASS:
+    // As set up by the caller, with one additional tev stage multiplying the result by 4.
+    // This will retrieve the lower 6 bits of the TEV output.
+    auto gm = genmode;
+    gm.numtevstages = previous_stage + 1;  // one additional stage
+    CGX_LOAD_BP_REG(gm.hex);
+
+    // Enable new TEV stage. Note that we are using the "a" input here to make
+    // sure the input doesn't get erroneously clamped to 11 bit range.
+    auto cc1 = CGXDefault<TevStageCombiner::ColorCombiner>(previous_stage + 1);
+    cc1.a = last_cc.dest * 2;
+    cc1.shift = TEVSCALE_4;
+    CGX_LOAD_BP_REG(cc1.hex);
+
+    auto ac1 = CGXDefault<TevStageCombiner::AlphaCombiner>(previous_stage + 1);
+    ac1.a = last_ac.dest * 2;
+    ac1.shift = TEVSCALE_4;
+    CGX_LOAD_BP_REG(ac1.hex);
+  }
+  else
+  {
+    // SECOND RENDER PASS
+    // Uses three additional TEV stages which shift the previous result
+    // three bits to the right. This is necessary to read off the 5 upper bits,
+    // 3 of which got masked off when writing to the EFB in the first pass.
+    auto gm = genmode;
+    gm.numtevstages = previous_stage + 3;  // three additional stages
+    CGX_LOAD_BP_REG(gm.hex);
+
+    // The following tev stages are exclusively used to rightshift the
+    // upper bits such that they get written to the render target.
+    for (int stage = previous_stage + 1; stage <= previous_stage + 3; ++stage)
+    {
+      auto cc1 = CGXDefault<TevStageCombiner::ColorCombiner>(stage);
+      cc1.d = last_cc.dest * 2;
+      cc1.shift = TEVDIVIDE_2;
+      CGX_LOAD_BP_REG(cc1.hex);
+
+      auto ac1 = CGXDefault<TevStageCombiner::AlphaCombiner>(stage);
+      ac1.d = last_ac.dest * 2;
+      ac1.shift = TEVDIVIDE_2;
+      CGX_LOAD_BP_REG(ac1.hex);
+    }
+  }
+}
+
+// Reassembles the 11 bit TEV output from the EFB values of both render passes
+static int CombineTevOutput(u8 first_pass, u8 second_pass)
+{
+  u16 low = first_pass >> 2;
+  u16 high = second_pass >> 3;
+
+  // uh.. let's just say this works, but I guess it could be simplified.
+  return low + ((high & 0x10) ? (-0x400 + ((high & 0xF) << 6)) : (high << 6));
+}
+
+Vec4<int> GetTevOutput(const GenMode& genmode, const TevStageCombiner::ColorCombiner& last_cc,
+                       const TevStageCombiner::AlphaCombiner& last_ac)
+{
+  LoadTevOutputPass(genmode, last_cc, last_ac, 0);
 
   memset(test_buffer, 0, TEST_BUFFER_SIZE);  // Just for debugging
   Quad().AtDepth(1.0).ColorRGBA(255, 255, 255, 255).Draw();
-  CGX_DoEfbCopyTex(0, 0, 100, 100, 0x6 /*RGBA8*/, false, test_buffer);
+  CGX_DoEfbCopyTex(0, 0, 100, 100, 0x6 /*RGBA8*/, test_buffer);
   CGX_ForcePipelineFlush();
   CGX_WaitForGpuToFinish();
-  u16 result1r = ReadTestBuffer(5, 5, 100).r >> 2;
-  u16 result1g = ReadTestBuffer(5, 5, 100).g >> 2;
-  u16 result1b = ReadTestBuffer(5, 5, 100).b >> 2;
-  u16 result1a = ReadTestBuffer(5, 5, 100).a >> 2;
-
-  // SECOND RENDER PASS
-  // Uses three additional TEV stages which shift the previous result
-  // three bits to the right. This is necessary to read off the 5 upper bits,
-  // 3 of which got masked off when writing to the EFB in the first pass.
-  gm = genmode;
-  gm.numtevstages = previous_stage + 3;  // three additional stages
-  CGX_LOAD_BP_REG(gm.hex);
-
-  // The following tev stages are exclusively used to rightshift the
-  // upper bits such that they get written to the render target.
-  cc1 = CGXDefault<TevStageCombiner::ColorCombiner>(previous_stage + 1);
-  cc1.d = last_cc.dest * 2;
-  cc1.shift = TEVDIVIDE_2;
-  CGX_LOAD_BP_REG(cc1.hex);
-
-  ac1 = CGXDefault<TevStageCombiner::AlphaCombiner>(previous_stage + 1);
-  ac1.d = last_ac.dest * 2;
-  ac1.shift = TEVDIVIDE_2;
-  CGX_LOAD_BP_REG(ac1.hex);
-
-  cc1 = CGXDefault<TevStageCombiner::ColorCombiner>(previous_stage + 2);
-  cc1.d = last_cc.dest * 2;
-  cc1.shift = TEVDIVIDE_2;
-  CGX_LOAD_BP_REG(cc1.hex);
-
-  ac1 = CGXDefault<TevStageCombiner::AlphaCombiner>(previous_stage + 2);
-  ac1.d = last_ac.dest * 2;
-  ac1.shift = TEVDIVIDE_2;
-  CGX_LOAD_BP_REG(ac1.hex);
-
-  cc1 = CGXDefault<TevStageCombiner::ColorCombiner>(previous_stage + 3);
-  cc1.d = last_cc.dest * 2;
-  cc1.shift = TEVDIVIDE_2;
-  CGX_LOAD_BP_REG(cc1.hex);
-
-  ac1 = CGXDefault<TevStageCombiner::AlphaCombiner>(previous_stage + 3);
-  ac1.d = last_ac.dest * 2;
-  ac1.shift = TEVDIVIDE_2;
-  CGX_LOAD_BP_REG(ac1.hex);
+  Vec4<u8> result1 = ReadTestBuffer(5, 5, 100);
+
+  LoadTevOutputPass(genmode, last_cc, last_ac, 1);
 
   memset(test_buffer, 0, TEST_BUFFER_SIZE);
   Quad().AtDepth(1.0).ColorRGBA(255, 255, 255, 255).Draw();
-  CGX_DoEfbCopyTex(0, 0, 100, 100, 0x6 /*RGBA8*/, false, test_buffer);
+  CGX_DoEfbCopyTex(0, 0, 100, 100, 0x6 /*RGBA8*/, test_buffer);
   CGX_ForcePipelineFlush();
   CGX_WaitForGpuToFinish();
+  Vec4<u8> result2 = ReadTestBuffer(5, 5, 100);
 
-  u16 result2r = ReadTestBuffer(5, 5, 100).r >> 3;
-  u16 result2g = ReadTestBuffer(5, 5, 100).g >> 3;
-  u16 result2b = ReadTestBuffer(5, 5, 100).b >> 3;
-  u16 result2a = ReadTestBuffer(5, 5, 100).a >> 3;
-
-  // uh.. let's just say this works, but I guess it could be simplified.
   Vec4<int> result;
-  result.r = result1r + ((result2r & 0x10) ? (-0x400 + ((result2r & 0xF) << 6)) : (result2r << 6));
-  result.g = result1g + ((result2g & 0x10) ? (-0x400 + ((result2g & 0xF) << 6)) : (result2g << 6));
-  result.b = result1b + ((result2b & 0x10) ? (-0x400 + ((result2b & 0xF) << 6)) : (result2b << 6));
-  result.a = result1a + ((result2a & 0x10) ? (-0x400 + ((result2a & 0xF) << 6)) : (result2a << 6));
+  result.r = CombineTevOutput(result1.r, result2.r);
+  result.g = CombineTevOutput(result1.g, result2.g);
+  result.b = CombineTevOutput(result1.b, result2.b);
+  result.a = CombineTevOutput(result1.a, result2.a);
   return result;
 }
+
+// Reads a pixel of an RGBA8 texture which is `width` pixels wide
+static Vec4<u8> ReadRGBA8Texel(const u8* texture, int s, int t, int width)
+{
+  int width_blocks = (width + 3) >> 2;
+  u32 block = (t >> 2) * width_blocks + (s >> 2);
+  u32 offset = (block << 6) + ((((t & 3) << 2) + (s & 3)) << 1);
+
+  // Each block stores AR pairs for all 16 pixels, followed by GB pairs
+  Vec4<u8> ret;
+  ret.a = texture[offset];
+  ret.r = texture[offset + 1];
+  ret.g = texture[offset + 32];
+  ret.b = texture[offset + 33];
+  return ret;
+}
+
+// The quad drawn into each tile is always the same, so it is only recorded once
+static const DisplayList& GetTileQuadList()
+{
+  static DisplayList* list = nullptr;
+  if (list == nullptr)
+  {
+    list = new DisplayList;
+    Quad().AtDepth(1.0).ColorRGBA(255, 255, 255, 255).Draw(list);
+    list->Finish();
+  }
+  return *list;
+}
+
+// Draws the cases [first, first + batch_size) into their tiles
+static void DrawTiles(int first, int batch_size, const std::function<void(int)>& setup)
+{
+  const DisplayList& quad = GetTileQuadList();
+
+  for (int i = 0; i < batch_size; ++i)
+  {
+    setup(first + i);
+
+    const int tile_x = (i % TEV_TILES_PER_ROW) * TEV_TILE_SIZE;
+    const int tile_y = (i / TEV_TILES_PER_ROW) * TEV_TILE_SIZE;
+    CGX_SetViewport(tile_x, tile_y, TEV_TILE_SIZE, TEV_TILE_SIZE, 0.0f, 1.0f);
+    quad.Call();
+  }
+}
+
+// Height of the EFB area covered by a batch
+static int GetTilesHeight(int batch_size)
+{
+  return (batch_size + TEV_TILES_PER_ROW - 1) / TEV_TILES_PER_ROW * TEV_TILE_SIZE;
+}
+
+ReadbackQueue::ReadbackQueue(int num_buffers) : m_buffers(num_buffers), m_next(0)
+{
+  for (Buffer& buffer : m_buffers)
+  {
+    buffer.data = (u8*)memalign(32, TEST_BUFFER_SIZE);
+    buffer.width = 0;
+    buffer.token = 0;
+    buffer.pending = false;
+  }
+}
+
+ReadbackQueue::~ReadbackQueue()
+{
+  for (int slot = 0; slot < (int)m_buffers.size(); ++slot)
+  {
+    Wait(slot);
+    free(m_buffers[slot].data);
+  }
+}
+
+// Shared by all queues, so that tokens are always issued in increasing order
+static u16 s_next_readback_token = 1;
+
+int ReadbackQueue::Submit(int left, int top, int width, int height)
+{
+  const int slot = m_next;
+  m_next = (m_next + 1) % m_buffers.size();
+
+  // The buffer may still be the destination of an earlier copy
+  Wait(slot);
+
+  Buffer& buffer = m_buffers[slot];
+  // 64 bytes per 4x4 block
+  const u32 size = ((width + 3) >> 2) * ((height + 3) >> 2) * 64;
+  assert(size <= TEST_BUFFER_SIZE);
+
+#ifdef CGX_RECORD_FIFO
+  // Nothing is copied, so at least make the result deterministic
+  memset(buffer.data, 0, size);
+#else
+  // Make sure no dirty cache lines are written back over the copied data
+  DCInvalidateRange(buffer.data, size);
+#endif
+  CGX_DoEfbCopyTex(left, top, width, height, 0x6 /*RGBA8*/, buffer.data);
+
+  buffer.width = width;
+  buffer.size = size;
+  buffer.token = s_next_readback_token++;
+  buffer.pending = true;
+  CGX_SetToken(buffer.token);
+
+  return slot;
+}
+
+void ReadbackQueue::Wait(int slot)
+{
+  Buffer& buffer = m_buffers[slot];
+  if (!buffer.pending)
+    return;
+
+  CGX_WaitForToken(buffer.token);
+
+#ifndef CGX_RECORD_FIFO
+  // Drop anything that was loaded into the cache while the copy was in progress
+  DCInvalidateRange(buffer.data, buffer.size);
+#endif
+  buffer.pending = false;
+}
+
+Vec4<u8> ReadbackQueue::Read(int slot, int x, int y) const
+{
+  const Buffer& buffer = m_buffers[slot];
+  assert(!buffer.pending);
+  return ReadRGBA8Texel(buffer.data, x, y, buffer.width);
+}
+
+// Enough for two batches of GetTevOutputs in flight
+static ReadbackQueue* GetTileReadbackQueue()
+{
+  static ReadbackQueue queue(4);
+  return &queue;
+}
+
+// Reads the center of a tile, away from any edge, from a copy of the tiled EFB area
+static Vec4<u8> ReadTile(const ReadbackQueue& queue, int slot, int index)
+{
+  const int s = (index % TEV_TILES_PER_ROW) * TEV_TILE_SIZE + TEV_TILE_SIZE / 2;
+  const int t = (index / TEV_TILES_PER_ROW) * TEV_TILE_SIZE + TEV_TILE_SIZE / 2;
+  return queue.Read(slot, s, t);
+}
+
+void GetTileColors(int count, const std::function<void(int)>& setup,
+                   const std::function<void(int, const Vec4<u8>&)>& check)
+{
+  ReadbackQueue& queue = *GetTileReadbackQueue();
+
+  // Batches are checked while the GPU is drawing the following batch
+  int previous_first = 0;
+  int previous_size = 0;
+  int previous_slot = -1;
+  auto check_previous = [&]() {
+    if (previous_slot < 0)
+      return;
+    queue.Wait(previous_slot);
+    for (int i = 0; i < previous_size; ++i)
+      check(previous_first + i, ReadTile(queue, previous_slot, i));
+  };
+
+  for (int first = 0; first < count; first += TEV_BATCH_SIZE)
+  {
+    const int batch_size = std::min(count - first, TEV_BATCH_SIZE);
+
+    DrawTiles(first, batch_size, setup);
+    const int slot = queue.Submit(0, 0, EFB_WIDTH, GetTilesHeight(batch_size));
+
+    check_previous();
+    previous_first = first;
+    previous_size = batch_size;
+    previous_slot = slot;
+  }
+  check_previous();
+
+  // Restore the full screen viewport set up by Init
+  CGX_SetViewport(0.0f, 0.0f, EFB_WIDTH, EFB_HEIGHT, 0.0f, 1.0f);
+}
+
+void GetTevOutputs(const GenMode& genmode, const TevStageCombiner::ColorCombiner& last_cc,
+                   const TevStageCombiner::AlphaCombiner& last_ac, int count,
+                   const std::function<void(int)>& setup, Vec4<int>* results)
+{
+  ReadbackQueue& queue = *GetTileReadbackQueue();
+
+  // Batches are decoded while the GPU is drawing the following batch
+  int previous_first = 0;
+  int previous_size = 0;
+  int previous_slots[2] = {-1, -1};
+  auto decode_previous = [&]() {
+    if (previous_slots[0] < 0)
+      return;
+    queue.Wait(previous_slots[0]);
+    queue.Wait(previous_slots[1]);
+    for (int i = 0; i < previous_size; ++i)
+    {
+      Vec4<u8> result1 = ReadTile(queue, previous_slots[0], i);
+      Vec4<u8> result2 = ReadTile(queue, previous_slots[1], i);
+
+      Vec4<int>& result = results[previous_first + i];
+      result.r = CombineTevOutput(result1.r, result2.r);
+      result.g = CombineTevOutput(result1.g, result2.g);
+      result.b = CombineTevOutput(result1.b, result2.b);
+      result.a = CombineTevOutput(result1.a, result2.a);
+    }
+  };
+
+  for (int first = 0; first < count; first += TEV_BATCH_SIZE)
+  {
+    const int batch_size = std::min(count - first, TEV_BATCH_SIZE);
+
+    int slots[2];
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      LoadTevOutputPass(genmode, last_cc, last_ac, pass);
+      DrawTiles(first, batch_size, setup);
+      slots[pass] = queue.Submit(0, 0, EFB_WIDTH, GetTilesHeight(batch_size));
+    }
+
+    decode_previous();
+    previous_first = first;
+    previous_size = batch_size;
+    previous_slots[0] = slots[0];
+    previous_slots[1] = slots[1];
+  }
+  decode_previous();
+
+  // Restore the full screen viewport set up by Init
+  CGX_SetViewport(0.0f, 0.0f, EFB_WIDTH, EFB_HEIGHT, 0.0f, 1.0f);
+}
 }
@@ -4,6 +4,11 @@
 
 #pragma once
 
+#include <functional>
+#include <vector>
+
+class DisplayList;
+
 namespace GXTest
 {
 // Four component vector with arbitrary base type
@@ -37,7 +42,13 @@ public:
 
   void Draw();
 
+  // Record the quad into a display list. Unlike Draw, this doesn't go through the shadow state.
+  void Draw(DisplayList* list);
+
 private:
+  template <typename Pipe>
+  void Emit(Pipe* pipe);
+
   f32 x[4], y[4], z[4];
 
   bool has_color;
@@ -51,15 +62,29 @@ void Init();
 // Modifies the first vertex attribute and descriptor, as well as matrix state
 void DrawFullScreenQuad();
 
-// Perform an RGBA8 EFB copy to the internal testing buffer
+// Perform an EFB copy to the internal testing buffer, in one of the formats supported by
+// CGX_DoEfbCopyTex. ReadTestBuffer only works with the default of RGBA8.
 void CopyToTestBuffer(int left_most_pixel, int top_most_pixel, int right_most_pixel,
-                      int bottom_most_pixel);
+                      int bottom_most_pixel, u8 format = 0x6 /*RGBA8*/);
+
+// Raw contents of the internal testing buffer, e.g. to compare copies in other formats than
+// RGBA8. CopyToTestBuffer needs to be called and the GPU must have finished first.
+const u8* GetTestBuffer();
 
 // Read back result from test buffer
 // CopyToTestBuffer needs to be called before using this.
 // After that, this function is free to use in terms of performance.
 Vec4<u8> ReadTestBuffer(int x, int y, int previous_copy_width);
 
+// Read a single pixel directly from the EFB, without an EFB copy.
+// This is cheaper than CopyToTestBuffer when only a few pixels are needed, but the GPU must
+// have finished drawing (e.g. after CGX_WaitForGpuToFinish). The returned alpha depends on
+// the EFB format and PE alpha read mode.
+Vec4<u8> PeekEfbColor(int x, int y);
+
+// Read the 24 bit depth value of a single pixel directly from the EFB, see PeekEfbColor
+u32 PeekEfbDepth(int x, int y);
+
 // Read back output of the last tev stage (all 11 bits)
 // The BP registers last_cc and last_ac must have already been written before
 // calling this function. The function logic adds 3 additional tev stages,
@@ -68,6 +93,70 @@ Vec4<u8> ReadTestBuffer(int x, int y, int previous_copy_width);
 Vec4<int> GetTevOutput(const GenMode& genmode, const TevStageCombiner::ColorCombiner& last_cc,
                        const TevStageCombiner::AlphaCombiner& last_ac);
 
+// Pipelined readback of RGBA8 EFB copies.
+// Copies go to one of several buffers and are each followed by a PE token, so the CPU can
+// check the result of one copy while the GPU is still drawing the next one:
+//
+//   draw batch 0; slot0 = queue.Submit(...);
+//   draw batch 1; slot1 = queue.Submit(...);
+//   queue.Wait(slot0); check batch 0 using queue.Read(slot0, ...);
+//   draw batch 2; ...
+class ReadbackQueue
+{
+public:
+  explicit ReadbackQueue(int num_buffers = 2);
+  ~ReadbackQueue();
+
+  ReadbackQueue(const ReadbackQueue&) = delete;
+  ReadbackQueue& operator=(const ReadbackQueue&) = delete;
+
+  // Copies the given EFB rectangle into the next buffer and returns its slot.
+  // If the buffer still holds a pending copy, that copy is waited for first; its data must not
+  // be used afterwards.
+  int Submit(int left, int top, int width, int height);
+
+  // Blocks until the copy in the given slot has reached memory
+  void Wait(int slot);
+
+  // Reads a pixel of a completed copy, relative to the top left corner of the copied rectangle
+  Vec4<u8> Read(int slot, int x, int y) const;
+
+private:
+  struct Buffer
+  {
+    u8* data;
+    int width;
+    u32 size;
+    u16 token;
+    bool pending;
+  };
+
+  std::vector<Buffer> m_buffers;
+  int m_next;
+};
+
+// Draws `count` test cases with a single EFB copy per 21120 cases, and passes the resulting
+// EFB color of each case to check(i, color). Results of one batch are checked while the GPU
+// draws the next one.
+// Each case is drawn as a white quad covering its own 4x4 pixel tile of the EFB. Before drawing
+// case i, setup(i) is called, which must load the registers that differ between cases. It must
+// not change the viewport or the EFB format.
+// The viewport is reset to cover the whole EFB afterwards.
+void GetTileColors(int count, const std::function<void(int)>& setup,
+                   const std::function<void(int, const Vec4<u8>&)>& check);
+
+// Batched version of GetTevOutput, which evaluates `count` TEV configurations using two EFB
+// copies per 21120 cases. Decoding is pipelined like in GetTileColors.
+// Each case is drawn into its own 4x4 pixel tile of the EFB. Before drawing case i,
+// setup(i) is called, which must load the registers that differ between cases (e.g. TEV
+// combiners and color registers of the stages up to the one of last_cc). It must not change
+// genmode, the viewport or any other state used by the readback, and it will be called
+// twice per case.
+// The viewport is reset to cover the whole EFB afterwards.
+void GetTevOutputs(const GenMode& genmode, const TevStageCombiner::ColorCombiner& last_cc,
+                   const TevStageCombiner::AlphaCombiner& last_ac, int count,
+                   const std::function<void(int)>& setup, Vec4<int>* results);
+
 void DebugDisplayEfbContents();
 
 }  // namespace
@@ -0,0 +1,199 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <ogc/lwp_watchdog.h>
+#include <ogcsys.h>
+#include <stdlib.h>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+#include "common/timebase.h"
+#include "gxtest/FifoRecorder.h"
+#include "gxtest/cgx.h"
+#include "gxtest/cgx_defaults.h"
+#include "gxtest/util.h"
+
+// Throughput of the write-gather pipe for each store width.
+// Only zero bytes are written, which the command processor interprets as NOP commands, so the
+// measured rate is that of the pipe and FIFO rather than of any particular command.
+// The same loops are run against a FifoRecorder to validate the harness itself.
+
+// The pipe forwards data to the FIFO in 32 byte bursts, so every write loop emits whole bursts
+static const u32 BURST_SIZE = 32;
+static const u32 TRANSFER_SIZES[] = {32, 256, 1024, 4096, 16384, 65536, 262144, 1048576};
+
+template <typename Pipe>
+static void WriteBytes(Pipe* pipe, u32 bursts)
+{
+  for (u32 i = 0; i < bursts; ++i)
+    for (u32 j = 0; j < BURST_SIZE; ++j)
+      pipe->U8 = 0;
+}
+
+template <typename Pipe>
+static void WriteHalfwords(Pipe* pipe, u32 bursts)
+{
+  for (u32 i = 0; i < bursts; ++i)
+    for (u32 j = 0; j < BURST_SIZE / 2; ++j)
+      pipe->U16 = 0;
+}
+
+template <typename Pipe>
+static void WriteWords(Pipe* pipe, u32 bursts)
+{
+  for (u32 i = 0; i < bursts; ++i)
+    for (u32 j = 0; j < BURST_SIZE / 4; ++j)
+      pipe->U32 = 0;
+}
+
+// psq_st with GQR0 (unquantized floats) writes two singles, i.e. 8 bytes, at once.
+// This is the store used by WriteMtxPS4x2 in cgx.cpp.
+static void WritePairedSingles(volatile WGPipe* pipe, u32 bursts)
+{
+  // The compiler only sets ps0 of the register, and copies between registers (fmr) might not
+  // keep ps1 either, so ps1 is set from ps0 in the same asm block as the stores
+  f32 zero = 0.0f;
+  for (u32 i = 0; i < bursts; ++i)
+  {
+    asm volatile("ps_merge00 %0,%0,%0\n"
+                 "psq_st %0,0(%1),0,0\n"
+                 "psq_st %0,0(%1),0,0\n"
+                 "psq_st %0,0(%1),0,0\n"
+                 "psq_st %0,0(%1),0,0"
+                 : "+f"(zero)
+                 : "b"(pipe)
+                 : "memory");
+  }
+}
+
+static void WritePairedSingles(FifoRecorder* pipe, u32 bursts)
+{
+  for (u32 i = 0; i < bursts * (BURST_SIZE / 4); ++i)
+    pipe->F32 = 0.0f;
+}
+
+static const struct
+{
+  const char* name;
+  void (*hardware)(volatile WGPipe*, u32);
+  void (*recorder)(FifoRecorder*, u32);
+} pipe_writes[] = {
+    {"u8", WriteBytes<volatile WGPipe>, WriteBytes<FifoRecorder>},
+    {"u16", WriteHalfwords<volatile WGPipe>, WriteHalfwords<FifoRecorder>},
+    {"u32", WriteWords<volatile WGPipe>, WriteWords<FifoRecorder>},
+    {"psq_st", WritePairedSingles, WritePairedSingles},
+};
+
+static u32 GetBytesPerSecond(u32 size, u64 ticks)
+{
+  if (ticks == 0)
+    return 0;
+  return (u32)((u64)size * TB_TIMER_CLOCK * 1000 / ticks);
+}
+
+static void PipeThroughputTest()
+{
+  START_TEST();
+
+  for (const auto& write : pipe_writes)
+  {
+    for (u32 size : TRANSFER_SIZES)
+    {
+      // Start with an empty FIFO
+      CGX_WaitForGpuToFinish();
+
+      // Writing is throttled by the FIFO high watermark interrupt once the GPU falls behind,
+      // so interrupts must stay enabled here.
+      const u64 start = GetTimebase();
+      write.hardware(wgPipe, size / BURST_SIZE);
+      const u64 issued = GetTimebase();
+      CGX_WaitForGpuToFinish();
+      const u64 drained = GetTimebase();
+
+      network_printf("wgpipe %-6s size=%7u issue_ticks=%8u drain_ticks=%8u issue=%10u B/s "
+                     "drained=%10u B/s\n",
+                     write.name, size, (u32)(issued - start), (u32)(drained - start),
+                     GetBytesPerSecond(size, issued - start),
+                     GetBytesPerSecond(size, drained - start));
+    }
+  }
+
+  END_TEST();
+}
+
+static void RecorderThroughputTest()
+{
+  START_TEST();
+
+  FifoRecorder recorder(TRANSFER_SIZES[sizeof(TRANSFER_SIZES) / sizeof(TRANSFER_SIZES[0]) - 1]);
+
+  for (const auto& write : pipe_writes)
+  {
+    for (u32 size : TRANSFER_SIZES)
+    {
+      recorder.Clear();
+
+      const u64 start = GetTimebase();
+      write.recorder(&recorder, size / BURST_SIZE);
+      const u64 end = GetTimebase();
+
+      size_t nonzero = 0;
+      for (u8 byte : recorder.Data())
+        nonzero += (byte != 0);
+
+      DO_TEST(recorder.Size() == size && nonzero == 0,
+              "%s: recorded %u bytes (%u nonzero), expected %u zero bytes", write.name,
+              (u32)recorder.Size(), (u32)nonzero, size);
+
+      network_printf("recorder %-6s size=%7u ticks=%8u rate=%10u B/s\n", write.name, size,
+                     (u32)(end - start), GetBytesPerSecond(size, end - start));
+    }
+  }
+
+  END_TEST();
+}
+
+// Checks that the recorder stores data in the order the GPU receives it
+static void RecorderEncodingTest()
+{
+  START_TEST();
+
+  FifoRecorder recorder;
+  recorder.U8 = 0x61;
+  recorder.U16 = 0x1234;
+  recorder.U32 = 0x89ABCDEF;
+  recorder.S8 = -2;
+  recorder.S16 = -3;
+  recorder.S32 = -4;
+  recorder.F32 = 1.0f;
+
+  static const u8 expected[] = {0x61, 0x12, 0x34, 0x89, 0xAB, 0xCD, 0xEF, 0xFE, 0xFF,
+                                0xFD, 0xFF, 0xFF, 0xFF, 0xFC, 0x3F, 0x80, 0x00, 0x00};
+
+  DO_TEST(recorder.Size() == sizeof(expected), "Recorded %u bytes, expected %u",
+          (u32)recorder.Size(), (u32)sizeof(expected));
+  for (size_t i = 0; i < sizeof(expected) && i < recorder.Size(); ++i)
+  {
+    DO_TEST(recorder.Data()[i] == expected[i], "Byte %u: got 0x%02x, expected 0x%02x", (u32)i,
+            recorder.Data()[i], expected[i]);
+  }
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  GXTest::Init();
+
+  RecorderEncodingTest();
+  RecorderThroughputTest();
+  PipeThroughputTest();
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
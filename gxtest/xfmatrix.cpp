@@ -0,0 +1,182 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <functional>
+#include <malloc.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogcsys.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wiiuse/wpad.h>
+#include "common/hwtests.h"
+#include "common/timebase.h"
+#include "gxtest/cgx.h"
+#include "gxtest/cgx_defaults.h"
+#include "gxtest/util.h"
+
+// Compares the direct matrix loads of CGX against libogc's, byte for byte. Both are captured with
+// CGX_BeginDisplayList, which redirects everything written to the write-gather pipe into memory,
+// so the exact output of the paired-single stores is checked.
+
+static const u32 CAPTURE_SIZE = 1024;
+static u8* s_capture_libogc;
+static u8* s_capture_cgx;
+
+// Returns the offset of the first command in the capture. Bytes left in the pipe by earlier
+// commands end up in front of it as NOPs.
+static u32 Capture(u8* buffer, const std::function<void()>& load)
+{
+  memset(buffer, 0, CAPTURE_SIZE);
+  DCFlushRange(buffer, CAPTURE_SIZE);
+
+  CGX_BeginDisplayList(buffer, CAPTURE_SIZE);
+  load();
+  CGX_EndDisplayList();
+
+  DCInvalidateRange(buffer, CAPTURE_SIZE);
+  u32 offset = 0;
+  while (offset < CAPTURE_SIZE && buffer[offset] == 0)
+    ++offset;
+  return offset;
+}
+
+static void CompareCaptures(const std::function<void()>& load_libogc,
+                            const std::function<void()>& load_cgx, u32 num_values,
+                            const char* name)
+{
+  // XF load opcode, header and values
+  const u32 size = 5 + 4 * num_values;
+
+  const u32 libogc_offset = Capture(s_capture_libogc, load_libogc);
+  const u32 cgx_offset = Capture(s_capture_cgx, load_cgx);
+  DO_TEST(libogc_offset + size < CAPTURE_SIZE && cgx_offset + size < CAPTURE_SIZE,
+          "%s: commands start at %u and %u", name, libogc_offset, cgx_offset);
+  if (libogc_offset + size >= CAPTURE_SIZE || cgx_offset + size >= CAPTURE_SIZE)
+    return;
+
+  const u8* libogc = s_capture_libogc + libogc_offset;
+  const u8* cgx = s_capture_cgx + cgx_offset;
+  u32 mismatch = 0;
+  while (mismatch < size && libogc[mismatch] == cgx[mismatch])
+    ++mismatch;
+  DO_TEST(mismatch == size, "%s: byte %u is 0x%02x instead of 0x%02x", name, mismatch,
+          cgx[mismatch], libogc[mismatch]);
+}
+
+// Values with all kinds of bit patterns, including signs, zeros and tiny/huge exponents
+static f32 GetValue(int i)
+{
+  static const f32 special[] = {0.0f, -0.0f, 1.0f, -1.0f, 1e-38f, -3e38f, 0.5f, 1234.5678f};
+  if (i % 3 == 0)
+    return special[(i / 3) % 8];
+  return (rand() - RAND_MAX / 2) / 1024.0f;
+}
+
+static void CommandStreamTest()
+{
+  START_TEST();
+
+  for (int round = 0; round < 16; ++round)
+  {
+    Mtx pos;
+    f32 tex[2][4];
+    Mtx44 projection;
+    for (int i = 0; i < 12; ++i)
+      pos[i / 4][i % 4] = GetValue(round * 12 + i);
+    for (int i = 0; i < 8; ++i)
+      tex[i / 4][i % 4] = GetValue(round * 8 + i + 1);
+    for (int i = 0; i < 16; ++i)
+      projection[i / 4][i % 4] = GetValue(round * 16 + i + 2);
+
+    for (u32 index = GX_PNMTX0; index <= GX_PNMTX9; index += 3)
+    {
+      CompareCaptures([&] { GX_LoadPosMtxImm(pos, index); },
+                      [&] { CGX_LoadPosMatrixDirect(pos, index); }, 12, "Position matrix");
+    }
+
+    for (u32 index = GX_TEXMTX0; index <= GX_TEXMTX9; index += 3)
+    {
+      CompareCaptures([&] { GX_LoadTexMtxImm(tex, index, GX_MTX2x4); },
+                      [&] { CGX_LoadTexMatrix2x4Direct(tex, index); }, 8, "Texture matrix");
+    }
+
+    CompareCaptures([&] { GX_LoadProjectionMtx(projection, GX_PERSPECTIVE); },
+                    [&] { CGX_LoadProjectionMatrixPerspective(projection); }, 7,
+                    "Perspective projection");
+    CompareCaptures([&] { GX_LoadProjectionMtx(projection, GX_ORTHOGRAPHIC); },
+                    [&] { CGX_LoadProjectionMatrixOrthographic(projection); }, 7,
+                    "Orthographic projection");
+  }
+
+  END_TEST();
+}
+
+// CPU time for NUM_LOADS matrix loads with libogc and CGX
+static void LoadBenchmark()
+{
+  START_TEST();
+
+  static const int NUM_LOADS = 1024;
+
+  Mtx pos;
+  Mtx44 projection;
+  memset(pos, 0, sizeof(pos));
+  memset(projection, 0, sizeof(projection));
+  pos[0][0] = pos[1][1] = pos[2][2] = 1.0f;
+  projection[0][0] = projection[1][1] = 1.0f;
+  projection[2][2] = -1.0f;
+
+  const struct
+  {
+    const char* name;
+    std::function<void()> load;
+  } loads[] = {
+      {"libogc position", [&] { GX_LoadPosMtxImm(pos, GX_PNMTX0); }},
+      {"cgx position", [&] { CGX_LoadPosMatrixDirect(pos, GX_PNMTX0); }},
+      {"libogc projection", [&] { GX_LoadProjectionMtx(projection, GX_ORTHOGRAPHIC); }},
+      {"cgx projection", [&] { CGX_LoadProjectionMatrixOrthographic(projection); }},
+  };
+
+  for (const auto& load : loads)
+  {
+    CGX_WaitForGpuToFinish();
+    const u64 start = GetTimebase();
+    for (int i = 0; i < NUM_LOADS; ++i)
+      load.load();
+    const u64 end = GetTimebase();
+
+    const u32 ticks = (u32)(end - start);
+    network_printf("xfmatrix %-17s loads=%d ticks=%7u cycles/load=%4u\n", load.name, NUM_LOADS,
+                   ticks, (u32)((u64)ticks * CPU_CYCLES_PER_TIMEBASE_TICK / NUM_LOADS));
+  }
+  CGX_WaitForGpuToFinish();
+
+  // Restore the matrices used by Quad
+  CGX_LoadPosMatrixDirect(pos, GX_PNMTX0);
+  CGX_LoadProjectionMatrixOrthographic(projection);
+
+  END_TEST();
+}
+
+int main()
+{
+  network_init();
+  WPAD_Init();
+
+  GXTest::Init();
+
+  s_capture_libogc = (u8*)memalign(32, CAPTURE_SIZE);
+  s_capture_cgx = (u8*)memalign(32, CAPTURE_SIZE);
+
+  CommandStreamTest();
+  LoadBenchmark();
+
+  free(s_capture_libogc);
+  free(s_capture_cgx);
+
+  network_printf("Shutting down...\n");
+  network_shutdown();
+
+  return 0;
+}
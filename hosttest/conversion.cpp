@@ -0,0 +1,191 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <stdlib.h>
+#include <vector>
+
+#include "gxtest/BPMemory.h"
+#include "gxtest/ConversionTest.h"
+#include "gxtest/EfbFormat.h"
+#include "gxtest/TextureDecoder.h"
+#include "gxtest/TextureEncoder.h"
+#include "hosttest/hosttest.h"
+
+// Compares the SIMD implementations of the conversions in gxtest against their scalar
+// references. On the console, only the texture decoders have optimized versions, which detile
+// compares there; the others are the same code as their references.
+
+int s_num_failures = 0;
+
+static void FillRandom(std::vector<u8>* data)
+{
+  for (u8& value : *data)
+    value = rand();
+}
+
+static void EncoderTest()
+{
+  for (const auto& size : ConversionTest::SIZES)
+  {
+    const int width = size[0];
+    const int height = size[1];
+    std::vector<u8> pixels(width * height * 4);
+    FillRandom(&pixels);
+
+    for (int format : TextureEncoder::ALL_FORMATS)
+    {
+      const u32 texture_size = TextureEncoder::GetTextureSize(format, width, height);
+      std::vector<u8> reference(texture_size);
+      std::vector<u8> result(texture_size);
+      const u32 mismatch = ConversionTest::Compare(
+          reference.data(), result.data(), texture_size,
+          [&](u8* dst) { TextureEncoder::EncodeScalar(format, dst, pixels.data(), width, height); },
+          [&](u8* dst) { TextureEncoder::Encode(format, dst, pixels.data(), width, height); });
+
+      CHECK(mismatch == texture_size, "Encode %s %dx%d: first mismatch at byte %u",
+            TextureEncoder::GetFormatName(format), width, height, mismatch);
+    }
+  }
+}
+
+// Odd sizes drop the last row or column
+static void DownscaleTest()
+{
+  for (const auto& size : ConversionTest::SIZES)
+  {
+    const int width = size[0];
+    const int height = size[1];
+    std::vector<u8> pixels(width * height * 4);
+    FillRandom(&pixels);
+
+    const u32 downscaled_size = (width / 2) * (height / 2) * 4;
+    std::vector<u8> reference(downscaled_size);
+    std::vector<u8> result(downscaled_size);
+    const u32 mismatch = ConversionTest::Compare(
+        reference.data(), result.data(), downscaled_size,
+        [&](u8* dst) { TextureEncoder::DownscaleScalar(dst, pixels.data(), width, height); },
+        [&](u8* dst) { TextureEncoder::Downscale(dst, pixels.data(), width, height); });
+
+    CHECK(mismatch == downscaled_size, "Downscale %dx%d: first mismatch at byte %u", width,
+          height, mismatch);
+  }
+}
+
+// Rows of every EFB format, starting at even and odd columns and rows for the dither pattern
+static void EfbFormatTest()
+{
+  for (int format : {PIXELFMT_RGB8_Z24, PIXELFMT_RGBA6_Z24, PIXELFMT_RGB565_Z16})
+  {
+    for (const auto& size : ConversionTest::SIZES)
+    {
+      const int count = size[0] * size[1];
+      const int x = size[0];
+      const int y = size[1];
+      std::vector<u8> colors(count * 4);
+      FillRandom(&colors);
+
+      for (bool dither : {false, true})
+      {
+        std::vector<u32> reference(count);
+        std::vector<u32> result(count);
+        const u32 mismatch = ConversionTest::Compare(
+            (u8*)reference.data(), (u8*)result.data(), count * 4,
+            [&](u8* dst) {
+              EfbFormat::EncodeRowScalar(format, dither, x, y, count, colors.data(), (u32*)dst);
+            },
+            [&](u8* dst) {
+              EfbFormat::EncodeRow(format, dither, x, y, count, colors.data(), (u32*)dst);
+            });
+        CHECK(mismatch == (u32)count * 4,
+              "EncodeRow format %d dither %d count %d: first mismatch at pixel %u", format,
+              dither, count, mismatch / 4);
+
+        std::vector<u8> reference_colors(count * 4);
+        std::vector<u8> result_colors(count * 4);
+        const u32 color_mismatch = ConversionTest::Compare(
+            reference_colors.data(), result_colors.data(), count * 4,
+            [&](u8* dst) { EfbFormat::DecodeRowScalar(format, count, reference.data(), dst); },
+            [&](u8* dst) { EfbFormat::DecodeRow(format, count, reference.data(), dst); });
+        CHECK(color_mismatch == (u32)count * 4,
+              "DecodeRow format %d count %d: first mismatch at byte %u", format, count,
+              color_mismatch);
+      }
+    }
+  }
+}
+
+// The SSE2 and AVX2 decoders, which detile can't reach on the console
+static void DecoderTest()
+{
+  static const int tlut_formats[] = {
+      TextureDecoder::TLUT_IA8, TextureDecoder::TLUT_RGB565, TextureDecoder::TLUT_RGB5A3,
+  };
+
+  for (const auto& size : ConversionTest::SIZES)
+  {
+    const int width = size[0];
+    const int height = size[1];
+    const u32 linear_size = width * height * 4;
+    std::vector<u8> reference(linear_size);
+    std::vector<u8> result(linear_size);
+
+    for (int format : TextureDecoder::ALL_FORMATS)
+    {
+      std::vector<u8> tiled(TextureDecoder::GetTextureSize(format, width, height));
+      FillRandom(&tiled);
+
+      for (int tlut_format : tlut_formats)
+      {
+        std::vector<u8> tlut(TextureDecoder::GetPaletteSize(format) * 2);
+        FillRandom(&tlut);
+        const u32 mismatch = ConversionTest::Compare(
+            reference.data(), result.data(), linear_size,
+            [&](u8* dst) {
+              TextureDecoder::DecodeScalar(dst, tiled.data(), width, height, format, tlut.data(),
+                                           tlut_format);
+            },
+            [&](u8* dst) {
+              TextureDecoder::Decode(dst, tiled.data(), width, height, format, tlut.data(),
+                                     tlut_format);
+            });
+
+        CHECK(mismatch == linear_size, "Decode %s (TLUT format %d) %dx%d: first mismatch at "
+                                       "byte %u",
+              TextureDecoder::GetFormatName(format), tlut_format, width, height, mismatch);
+
+        // The TLUT format only matters for palette formats
+        if (!TextureDecoder::IsPaletteFormat(format))
+          break;
+      }
+    }
+
+    std::vector<u8> tiled(TextureDecoder::GetRGBA8TextureSize(width, height));
+    FillRandom(&tiled);
+    const u32 mismatch = ConversionTest::Compare(
+        reference.data(), result.data(), linear_size,
+        [&](u8* dst) { TextureDecoder::DetileRGBA8Scalar(dst, tiled.data(), width, height); },
+        [&](u8* dst) { TextureDecoder::DetileRGBA8(dst, tiled.data(), width, height); });
+    CHECK(mismatch == linear_size, "DetileRGBA8 %dx%d: first mismatch at byte %u", width, height,
+          mismatch);
+  }
+}
+
+int main()
+{
+#if defined(__AVX2__)
+  if (!__builtin_cpu_supports("avx2"))
+  {
+    printf("conversion: skipped, the CPU has no AVX2\n");
+    return 77;
+  }
+#endif
+
+  EncoderTest();
+  DownscaleTest();
+  EfbFormatTest();
+  DecoderTest();
+
+  printf("conversion: %d failures\n", s_num_failures);
+  return s_num_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include "gxtest/BPMemory.h"
+#include "gxtest/FifoDecoder.h"
+#include "gxtest/cgx.h"
+#include "gxtest/cgx_defaults.h"
+#include "gxtest/util.h"
+#include "hosttest/hosttest.h"
+
+// Records the command stream of a small test with CGX_RECORD_FIFO and checks that FifoDecoder
+// makes sense of all of it.
+
+int s_num_failures = 0;
+
+class CountingHandler : public FifoDecoder::NullHandler
+{
+public:
+  void OnBP(u8 reg, u32 /*old_value*/, u32 new_value)
+  {
+    if (reg == BPMEM_TRIGGER_EFB_COPY)
+    {
+      ++num_copies;
+      UPE_Copy copy;
+      copy.Hex = new_value;
+      if (copy.clear)
+      {
+        clear_zmode = zmode;
+        clear_blendmode = blendmode;
+      }
+    }
+    if (reg == BPMEM_ZMODE)
+      zmode = new_value;
+    if (reg == BPMEM_BLENDMODE)
+      blendmode = new_value;
+  }
+  void OnDraw(int primitive, int /*vat*/, u16 num_vertices, const u8* /*vertices*/, u32 size)
+  {
+    ++num_draws;
+    last_primitive = primitive;
+    last_num_vertices = num_vertices;
+    vertex_bytes += size;
+  }
+  void OnUnknown(u8 /*opcode*/) { ++num_unknown; }
+
+  int num_copies = 0;
+  int num_draws = 0;
+  int last_primitive = -1;
+  int last_num_vertices = 0;
+  u32 vertex_bytes = 0;
+  int num_unknown = 0;
+
+  // The depth and blend modes when the last clearing copy was triggered
+  u32 zmode = 0;
+  u32 blendmode = 0;
+  u32 clear_zmode = 0;
+  u32 clear_blendmode = 0;
+};
+
+int main()
+{
+  GXTest::Init();
+  const size_t init_size = cgx_fifo_recorder.Size();
+  CHECK(init_size > 0, "GXTest::Init recorded nothing");
+
+  GXTest::Quad().ColorRGBA(0x12, 0x34, 0x56, 0x78).Draw();
+  GXTest::CopyToTestBuffer(0, 0, 99, 99);
+
+  // Without the shadow state, clearing restores the modes of CGX_Init
+  static u8 cleared[16 * 16 * 4];
+  CGX_DoEfbCopyTex(0, 0, 16, 16, 0x6 /*RGBA8*/, cleared, false, true);
+
+  // With it, the modes loaded before
+  CGX_EnableShadowState(true);
+  auto zmode = CGXDefault<ZMode>();
+  zmode.testenable = 1;
+  zmode.func = COMPARE_LEQUAL;
+  CGX_LOAD_BP_REG(zmode.hex);
+  auto blendmode = CGXDefault<BlendMode>();
+  blendmode.blendenable = 1;
+  blendmode.logicopenable = 1;
+  CGX_LOAD_BP_REG(blendmode.hex);
+  CGX_DoEfbCopyTex(0, 0, 16, 16, 0x6 /*RGBA8*/, cleared, false, true);
+  CGX_EnableShadowState(false);
+  CGX_ForcePipelineFlush();
+  CGX_WaitForGpuToFinish();
+
+  CountingHandler handler;
+  FifoDecoder::Decoder<CountingHandler> decoder(&handler);
+  const u32 size = (u32)cgx_fifo_recorder.Size();
+  const u32 used = decoder.Decode(cgx_fifo_recorder.Data().data(), size);
+
+  CHECK(used == size, "Decoded %u of %u bytes", used, size);
+  CHECK(handler.num_unknown == 0, "%d unknown opcodes", handler.num_unknown);
+  CHECK(handler.num_draws == 1, "%d draws instead of 1", handler.num_draws);
+  CHECK(handler.last_primitive == FifoDecoder::PRIMITIVE_QUADS && handler.last_num_vertices == 4,
+        "Drew primitive %d with %d vertices instead of a quad", handler.last_primitive,
+        handler.last_num_vertices);
+  CHECK(handler.num_copies == 3, "%d EFB copies instead of 3", handler.num_copies);
+
+  // Clearing copies only write the depth with an always passing depth test with updates
+  ZMode clear_zmode;
+  clear_zmode.hex = handler.clear_zmode;
+  CHECK(clear_zmode.testenable && clear_zmode.func == COMPARE_ALWAYS && clear_zmode.updateenable,
+        "Cleared with depth test %u, func %u, update %u", (u32)clear_zmode.testenable,
+        (u32)clear_zmode.func, (u32)clear_zmode.updateenable);
+  BlendMode clear_blendmode;
+  clear_blendmode.hex = handler.clear_blendmode;
+  CHECK(!clear_blendmode.blendenable && !clear_blendmode.logicopenable &&
+            clear_blendmode.colorupdate,
+        "Cleared with blend mode 0x%06x", clear_blendmode.hex & 0xFFFFFF);
+
+  // GXTest::Init switches to RGBA6 after CGX_Init set up RGB8
+  const FifoDecoder::State& state = decoder.GetState();
+  CHECK(state.bp.zcontrol.pixel_format == PIXELFMT_RGBA6_Z24, "Pixel format %u",
+        (u32)state.bp.zcontrol.pixel_format);
+  CHECK(state.bp.copyTexSrcWH.x == 15 && state.bp.copyTexSrcWH.y == 15, "Copy size %ux%u",
+        (u32)state.bp.copyTexSrcWH.x + 1, (u32)state.bp.copyTexSrcWH.y + 1);
+  CHECK((state.bp.zmode.hex & 0xFFFFFF) == (zmode.hex & 0xFFFFFF),
+        "Depth mode 0x%06x after clearing instead of 0x%06x", state.bp.zmode.hex & 0xFFFFFF,
+        zmode.hex & 0xFFFFFF);
+  CHECK((state.bp.blendmode.hex & 0xFFFFFF) == (blendmode.hex & 0xFFFFFF),
+        "Blend mode 0x%06x after clearing instead of 0x%06x", state.bp.blendmode.hex & 0xFFFFFF,
+        blendmode.hex & 0xFFFFFF);
+
+  printf("fiforecord: %u bytes recorded, %d failures\n", size, s_num_failures);
+  return s_num_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#pragma once
+
+#include <stdio.h>
+
+// Counterpart of DO_TEST for the host tests, which report failures on stdout and return a
+// non-zero exit code from main if any check failed
+extern int s_num_failures;
+
+#define CHECK(condition, ...)                                                                      \
+  do                                                                                               \
+  {                                                                                                \
+    if (!(condition))                                                                              \
+    {                                                                                              \
+      ++s_num_failures;                                                                            \
+      printf("%s:%d: ", __FILE__, __LINE__);                                                       \
+      printf(__VA_ARGS__);                                                                         \
+      printf("\n");                                                                                \
+    }                                                                                              \
+  } while (0)
@@ -0,0 +1,161 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "gxtest/LightingEmulator.h"
+#include "hosttest/hosttest.h"
+
+// Compares the SSE2 lighting of LightingEmulator against the scalar one, with random lights and
+// vertices. On the console, both are the same code.
+
+int s_num_failures = 0;
+
+static const int NUM_STATES = 2000;
+
+// Not a multiple of the vector width, so that the padding is evaluated as well
+static const int NUM_VERTICES = 37;
+
+static float RandomFloat(float min, float max)
+{
+  return min + (max - min) * rand() / RAND_MAX;
+}
+
+static void RandomUnitVector(float* x, float* y, float* z)
+{
+  float length = 0.0f;
+  while (length < 0.01f)
+  {
+    *x = RandomFloat(-1.0f, 1.0f);
+    *y = RandomFloat(-1.0f, 1.0f);
+    *z = RandomFloat(-1.0f, 1.0f);
+    length = sqrtf(*x * *x + *y * *y + *z * *z);
+  }
+  *x /= length;
+  *y /= length;
+  *z /= length;
+}
+
+static void FillRandom(LightingEmulator::State* state, LightingEmulator::Vertices* vertices)
+{
+  for (int i = 0; i < vertices->Count(); ++i)
+  {
+    for (int component = 0; component < 3; ++component)
+      vertices->Position(component)[i] = RandomFloat(-10.0f, 10.0f);
+    RandomUnitVector(&vertices->Normal(0)[i], &vertices->Normal(1)[i], &vertices->Normal(2)[i]);
+    for (int channel = 0; channel < 2; ++channel)
+    {
+      for (int component = 0; component < 4; ++component)
+        vertices->Color(channel, component)[i] = rand();
+    }
+  }
+
+  state->num_channels = rand() % 3;
+  for (int channel = 0; channel < 2; ++channel)
+  {
+    state->ambient[channel] = rand();
+    state->material[channel] = rand();
+    state->color[channel].hex = rand() & 0x7FFF;
+    state->alpha[channel].hex = rand() & 0x7FFF;
+  }
+
+  for (LightingEmulator::Light& light : state->lights)
+  {
+    light.color = rand();
+    // Some coefficients are zero, so that the attenuation divides by zero
+    for (int i = 0; i < 3; ++i)
+    {
+      light.cosatt[i] = (rand() % 4) ? RandomFloat(-2.0f, 2.0f) : 0.0f;
+      light.distatt[i] = (rand() % 4) ? RandomFloat(-2.0f, 2.0f) : 0.0f;
+    }
+    // Some lights are at the position of a vertex
+    const int vertex = rand() % (2 * vertices->Count());
+    for (int i = 0; i < 3; ++i)
+    {
+      light.pos[i] = (vertex < vertices->Count()) ? vertices->Position(i)[vertex] :
+                                                    RandomFloat(-20.0f, 20.0f);
+    }
+    RandomUnitVector(&light.dir[0], &light.dir[1], &light.dir[2]);
+  }
+}
+
+static void CompareTest()
+{
+  for (int i = 0; i < NUM_STATES; ++i)
+  {
+    LightingEmulator::State state;
+    LightingEmulator::Vertices reference(NUM_VERTICES);
+    FillRandom(&state, &reference);
+    LightingEmulator::Vertices result = reference;
+
+    LightingEmulator::EvaluateScalar(state, &reference);
+    LightingEmulator::Evaluate(state, &result);
+
+    for (int channel = 0; channel < 2; ++channel)
+    {
+      for (int component = 0; component < 4; ++component)
+      {
+        const u8* expected = reference.Output(channel, component);
+        const u8* actual = result.Output(channel, component);
+        const u8* expected_light = reference.Light(channel, component);
+        const u8* actual_light = result.Light(channel, component);
+        int vertex = 0;
+        while (vertex < NUM_VERTICES && expected[vertex] == actual[vertex] &&
+               expected_light[vertex] == actual_light[vertex])
+        {
+          ++vertex;
+        }
+        CHECK(vertex == NUM_VERTICES,
+              "State %d, channel %d component %d, vertex %d: got %d (light %d), expected %d "
+              "(light %d) with color channel %04x and alpha channel %04x",
+              i, channel, component, vertex, vertex < NUM_VERTICES ? actual[vertex] : 0,
+              vertex < NUM_VERTICES ? actual_light[vertex] : 0,
+              vertex < NUM_VERTICES ? expected[vertex] : 0,
+              vertex < NUM_VERTICES ? expected_light[vertex] : 0, state.color[channel].hex,
+              state.alpha[channel].hex);
+      }
+    }
+  }
+}
+
+// A light at the position of the vertex shines along the normal with directional attenuation
+static void ZeroDistanceTest()
+{
+  LightingEmulator::State state;
+  LightingEmulator::Vertices vertices(1);
+  vertices.Position(0)[0] = 1.0f;
+  vertices.Position(1)[0] = 2.0f;
+  vertices.Position(2)[0] = 3.0f;
+  vertices.Normal(2)[0] = 1.0f;
+
+  state.lights[0].color = 0x80808080;
+  for (int i = 0; i < 3; ++i)
+    state.lights[0].pos[i] = vertices.Position(i)[0];
+  state.ambient[0] = 0;
+  state.color[0].enablelighting = 1;
+  state.color[0].lightMask0_3 = 1;
+  state.color[0].diffusefunc = LightingEmulator::DIFFUSE_CLAMP;
+  state.color[0].attnfunc = LightingEmulator::ATTN_DIR;
+
+  for (bool scalar : {false, true})
+  {
+    if (scalar)
+      LightingEmulator::EvaluateScalar(state, &vertices);
+    else
+      LightingEmulator::Evaluate(state, &vertices);
+    CHECK(vertices.Light(0, LightingEmulator::COMP_R)[0] == 0x80,
+          "Light at the vertex position gives %d with the %s code",
+          vertices.Light(0, LightingEmulator::COMP_R)[0], scalar ? "scalar" : "SSE2");
+  }
+}
+
+int main()
+{
+  CompareTest();
+  ZeroDistanceTest();
+
+  printf("lightingemulator: %d failures\n", s_num_failures);
+  return s_num_failures == 0 ? 0 : 1;
+}
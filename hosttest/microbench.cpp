@@ -0,0 +1,183 @@
+// Copyright 2013 Dolphin Emulator Project
+// Licensed under GPLv2
+// Refer to the license.txt file included.
+
+#include <string>
+#include <vector>
+
+#include "common/PPCEncoder.h"
+#include "common/timebase.h"
+#include "cputest/microbench.h"
+#include "hosttest/hosttest.h"
+
+// Checks the code generated by cputest's microbenchmarks and the conversion of tick counts into
+// cycles per instruction, with a fake timebase standing in for running the code.
+
+int s_num_failures = 0;
+
+// Instructions of a generated function which aren't part of the loop body: MTCTR, the two
+// constants, one initialization per chain, BDNZ and BLR
+static const u32 NUM_FIXED_INSTRUCTIONS = 4 + Microbench::NUM_CHAINS + 2;
+
+// Target of a BDNZ at index, as an index into the code
+static s32 GetBranchTarget(u32 instruction, u32 index)
+{
+  return (s32)index + (s16)(instruction & 0xFFFC) / 4;
+}
+
+static void GenerateTest()
+{
+  const Microbench::Config config;
+  for (const auto& benchmark : Microbench::benchmarks)
+  {
+    for (auto mode : {Microbench::Mode::Latency, Microbench::Mode::Throughput})
+    {
+      const char* mode_name = mode == Microbench::Mode::Latency ? "latency" : "throughput";
+      for (u32 unroll : {config.short_unroll, config.long_unroll})
+      {
+        const std::vector<u32> code = Microbench::Generate(benchmark, mode, unroll);
+        CHECK(code.size() == NUM_FIXED_INSTRUCTIONS + unroll, "%s %s x%u: %u instructions",
+              benchmark.name, mode_name, unroll, (u32)code.size());
+        if (code.size() != NUM_FIXED_INSTRUCTIONS + unroll)
+          continue;
+
+        // r3 holds the iteration count and r4 the scratch pointer
+        CHECK(code[0] == PPC::MTCTR(3), "%s %s: starts with %08x", benchmark.name, mode_name,
+              code[0]);
+        CHECK(code.back() == PPC::BLR(), "%s %s: ends with %08x", benchmark.name, mode_name,
+              code.back());
+
+        // The loop branches back to the first instruction of the body
+        const u32 body = NUM_FIXED_INSTRUCTIONS - 2;
+        const u32 branch = (u32)code.size() - 2;
+        CHECK(code[branch] == PPC::BDNZ(-4 * (s32)unroll), "%s %s: loop ends with %08x",
+              benchmark.name, mode_name, code[branch]);
+        CHECK(GetBranchTarget(code[branch], branch) == (s32)body, "%s %s: loop starts at %d",
+              benchmark.name, mode_name, GetBranchTarget(code[branch], branch));
+
+        // A single chain in latency mode, and chains taking turns in throughput mode
+        for (u32 i = 0; i < unroll; ++i)
+        {
+          const u32 period = mode == Microbench::Mode::Latency ? 1 : Microbench::NUM_CHAINS;
+          CHECK(code[body + i] == code[body + i % period], "%s %s: instruction %u is %08x",
+                benchmark.name, mode_name, i, code[body + i]);
+        }
+        if (mode == Microbench::Mode::Throughput)
+        {
+          for (u32 i = 1; i < Microbench::NUM_CHAINS; ++i)
+          {
+            CHECK(code[body + i] != code[body], "%s throughput: chain %u repeats chain 0",
+                  benchmark.name, i);
+          }
+        }
+      }
+    }
+  }
+
+  // The first chain of the integer benchmarks is r3, which is initialized to the scratch pointer
+  // after the iteration count was moved to CTR, and r12 holds one
+  const std::vector<u32> add = Microbench::Generate(Microbench::benchmarks[0],
+                                                    Microbench::Mode::Latency, 4);
+  CHECK(add[1] == PPC::LI(12, 1), "add: loads one with %08x", add[1]);
+  CHECK(add[4] == PPC::ADDI(3, 4, 0), "add: initializes r3 with %08x", add[4]);
+  CHECK(add[NUM_FIXED_INSTRUCTIONS - 2] == PPC::ADD(3, 3, 12), "add: body is %08x",
+        add[NUM_FIXED_INSTRUCTIONS - 2]);
+}
+
+// Stands in for the timebase: each loop iteration costs the loop body at centicycles per
+// instruction plus the loop branch, each call a fixed overhead, and every other call is
+// delayed further as if it had been interrupted
+class FakeTimebase
+{
+public:
+  explicit FakeTimebase(u32 centicycles) : m_centicycles(centicycles) {}
+
+  u64 operator()(const std::vector<u32>& code, u32 iterations)
+  {
+    const u64 unroll = code.size() - NUM_FIXED_INSTRUCTIONS;
+    const u64 centicycles = iterations * (unroll * m_centicycles + 200) + 5000;
+    u64 ticks = centicycles / 100 / CPU_CYCLES_PER_TIMEBASE_TICK;
+    if (m_num_calls++ % 2 == 0)
+      ticks += 1000;
+    return ticks;
+  }
+
+  u32 m_num_calls = 0;
+
+private:
+  u32 m_centicycles;
+};
+
+static void MeasureTest()
+{
+  const Microbench::Config config;
+  for (u32 centicycles : {100u, 150u, 300u, 1725u, 3100u})
+  {
+    FakeTimebase timebase(centicycles);
+    const auto result = Microbench::Measure(Microbench::benchmarks[0], Microbench::Mode::Latency,
+                                            config, std::ref(timebase));
+
+    CHECK(timebase.m_num_calls == 2 * config.repetitions, "%u cycles: %u runs instead of %u",
+          centicycles, timebase.m_num_calls, 2 * config.repetitions);
+    // Truncating both tick counts to whole ticks is off by less than one hundredth of a cycle
+    const s32 error = (s32)result.centicycles - (s32)centicycles;
+    CHECK(error >= -1 && error <= 1, "%u cycles measured as %u", centicycles,
+          result.centicycles);
+  }
+
+  // The fastest of the runs is used, without the interrupted ones
+  Microbench::Config config_single = config;
+  config_single.repetitions = 1;
+  FakeTimebase interrupted(100);
+  const auto slow = Microbench::Measure(Microbench::benchmarks[0], Microbench::Mode::Latency,
+                                        config_single, std::ref(interrupted));
+  FakeTimebase timebase(100);
+  const auto fast = Microbench::Measure(Microbench::benchmarks[0], Microbench::Mode::Latency,
+                                        config, std::ref(timebase));
+  CHECK(slow.short_ticks == fast.short_ticks + 1000, "Short loop took %u and %u ticks",
+        (u32)slow.short_ticks, (u32)fast.short_ticks);
+}
+
+static void AnalyzeTest()
+{
+  Microbench::Config config;
+  config.iterations = 1;
+  config.short_unroll = 0;
+  config.long_unroll = 8;
+
+  // 12 cycles for 8 instructions, with the call overhead cancelling out
+  CHECK(Microbench::AnalyzeCentiCycles(10, 11, config) == 150, "1 tick for 8 instructions: %u",
+        Microbench::AnalyzeCentiCycles(10, 11, config));
+  // Rounded to nearest: 1200 / 7 is 171.4, 2400 / 7 is 342.9
+  config.long_unroll = 7;
+  CHECK(Microbench::AnalyzeCentiCycles(0, 1, config) == 171, "1 tick for 7 instructions: %u",
+        Microbench::AnalyzeCentiCycles(0, 1, config));
+  CHECK(Microbench::AnalyzeCentiCycles(0, 2, config) == 343, "2 ticks for 7 instructions: %u",
+        Microbench::AnalyzeCentiCycles(0, 2, config));
+  // A long loop which isn't slower gives no result
+  CHECK(Microbench::AnalyzeCentiCycles(5, 5, config) == 0, "Equal ticks give %u",
+        Microbench::AnalyzeCentiCycles(5, 5, config));
+  CHECK(Microbench::AnalyzeCentiCycles(6, 5, config) == 0, "Fewer ticks give %u",
+        Microbench::AnalyzeCentiCycles(6, 5, config));
+
+  Microbench::Result result;
+  result.benchmark = &Microbench::benchmarks[0];
+  result.mode = Microbench::Mode::Throughput;
+  result.config = Microbench::Config();
+  result.short_ticks = 123;
+  result.long_ticks = 4567;
+  result.centicycles = 205;
+  const std::string line = Microbench::FormatResult(result);
+  CHECK(line == "bench,add,int,throughput,1000,16,80,123,4567,2.05", "Formatted as %s",
+        line.c_str());
+}
+
+int main()
+{
+  GenerateTest();
+  MeasureTest();
+  AnalyzeTest();
+
+  printf("microbench: %d failures\n", s_num_failures);
+  return s_num_failures == 0 ? 0 : 1;
+}